@@ -1,7 +1,24 @@
 #include <string>
-#include <sstream>
 #include <time.h>
 #include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 extern "C" {
 #include <curl/curl.h>
@@ -13,20 +30,272 @@ extern "C" {
 #include "../datanetworking/math.pb.h"
 #include "../datanetworking/data.pb.h"
 
+#include "datanetworking.h"
+
 using std::string;
-using std::stringstream;
+
+#define SPOOL_MAGIC   0x50534144 // "DASP"
+#define SPOOL_VERSION 1
+
+#define RETRY_MIN_SECONDS 5
+#define RETRY_MAX_SECONDS 300
+
+void DAInitDataNetworking()
+{
+	curl_global_init(CURL_GLOBAL_ALL);
+}
+
+void DAShutdownDataNetworking()
+{
+	curl_global_cleanup();
+}
+
+static void WriteRecordSize(char* p, unsigned int iSize)
+{
+	// Little endian no matter the platform, so a spool can be moved between servers.
+	p[0] = (char)(iSize & 0xFF);
+	p[1] = (char)((iSize >> 8) & 0xFF);
+	p[2] = (char)((iSize >> 16) & 0xFF);
+	p[3] = (char)((iSize >> 24) & 0xFF);
+}
+
+static unsigned int ReadRecordSize(const char* p)
+{
+	const unsigned char* u = (const unsigned char*)p;
+	return u[0] | (u[1] << 8) | (u[2] << 16) | ((unsigned int)u[3] << 24);
+}
+
+CDataSpool::CDataSpool()
+{
+	m_pMap = NULL;
+	m_iCapacity = 0;
+
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#else
+	m_iFile = -1;
+#endif
+}
+
+CDataSpool::~CDataSpool()
+{
+	Close();
+}
+
+bool CDataSpool::Open(const char* pszFile, size_t iCapacity, string& sError)
+{
+	Close();
+
+	if (iCapacity <= sizeof(SpoolHeader))
+	{
+		sError = "Spool capacity is too small.\n";
+		return false;
+	}
+
+#ifdef _WIN32
+	m_hFile = CreateFileA(pszFile, GENERIC_READ|GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		sError = string("Couldn't open spool file ") + pszFile + "\n";
+		return false;
+	}
+
+	// Mapping more than the file holds grows it to fit.
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READWRITE, 0, (DWORD)iCapacity, NULL);
+	if (m_hMapping)
+		m_pMap = (char*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, iCapacity);
+#else
+	m_iFile = open(pszFile, O_RDWR|O_CREAT, 0644);
+	if (m_iFile < 0)
+	{
+		sError = string("Couldn't open spool file ") + pszFile + ": " + strerror(errno) + "\n";
+		return false;
+	}
+
+	struct stat oStat;
+	if (fstat(m_iFile, &oStat) == 0 && (size_t)oStat.st_size < iCapacity)
+	{
+		if (ftruncate(m_iFile, iCapacity) != 0)
+		{
+			sError = string("Couldn't grow spool file ") + pszFile + ": " + strerror(errno) + "\n";
+			Close();
+			return false;
+		}
+	}
+
+	void* pMap = mmap(NULL, iCapacity, PROT_READ|PROT_WRITE, MAP_SHARED, m_iFile, 0);
+	if (pMap != MAP_FAILED)
+		m_pMap = (char*)pMap;
+#endif
+
+	if (!m_pMap)
+	{
+		sError = string("Couldn't map spool file ") + pszFile + "\n";
+		Close();
+		return false;
+	}
+
+	m_iCapacity = iCapacity;
+
+	// A new file, or one from an old version or with a different capacity. Start over.
+	SpoolHeader* pHeader = Header();
+	if (pHeader->m_iMagic != SPOOL_MAGIC || pHeader->m_iVersion != SPOOL_VERSION
+		|| pHeader->m_iReadOffset > pHeader->m_iWriteOffset || pHeader->m_iWriteOffset > DataCapacity())
+	{
+		pHeader->m_iMagic = SPOOL_MAGIC;
+		pHeader->m_iVersion = SPOOL_VERSION;
+		pHeader->m_iReadOffset = 0;
+		pHeader->m_iWriteOffset = 0;
+		pHeader->m_iRecords = 0;
+	}
+
+	return true;
+}
+
+void CDataSpool::Close()
+{
+#ifdef _WIN32
+	if (m_pMap)
+		UnmapViewOfFile(m_pMap);
+
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#else
+	if (m_pMap)
+		munmap(m_pMap, m_iCapacity);
+
+	if (m_iFile >= 0)
+		close(m_iFile);
+
+	m_iFile = -1;
+#endif
+
+	m_pMap = NULL;
+	m_iCapacity = 0;
+}
+
+void CDataSpool::Compact()
+{
+	SpoolHeader* pHeader = Header();
+	if (!pHeader->m_iReadOffset)
+		return;
+
+	memmove(Data(), Data() + pHeader->m_iReadOffset, pHeader->m_iWriteOffset - pHeader->m_iReadOffset);
+	pHeader->m_iWriteOffset -= pHeader->m_iReadOffset;
+	pHeader->m_iReadOffset = 0;
+}
+
+bool CDataSpool::Append(const char* pData, size_t iSize, string& sError)
+{
+	if (!m_pMap)
+	{
+		sError = "Spool isn't open.\n";
+		return false;
+	}
+
+	SpoolHeader* pHeader = Header();
+
+	size_t iNeeded = 4 + iSize;
+	if (pHeader->m_iWriteOffset + iNeeded > DataCapacity())
+		Compact();
+
+	if (pHeader->m_iWriteOffset + iNeeded > DataCapacity())
+	{
+		sError = "Spool is full.\n";
+		return false;
+	}
+
+	char* pRecord = Data() + pHeader->m_iWriteOffset;
+	WriteRecordSize(pRecord, (unsigned int)iSize);
+	memcpy(pRecord + 4, pData, iSize);
+
+	// Only publish the record once it's all there.
+	pHeader->m_iWriteOffset += (unsigned int)iNeeded;
+	pHeader->m_iRecords++;
+
+	return true;
+}
+
+bool CDataSpool::Peek(const char*& pData, size_t& iSize) const
+{
+	if (!m_pMap)
+		return false;
+
+	SpoolHeader* pHeader = Header();
+	if (pHeader->m_iReadOffset >= pHeader->m_iWriteOffset)
+		return false;
+
+	const char* pRecord = Data() + pHeader->m_iReadOffset;
+	size_t iAvailable = pHeader->m_iWriteOffset - pHeader->m_iReadOffset;
+	if (iAvailable < 4 || ReadRecordSize(pRecord) > iAvailable - 4)
+	{
+		// A torn or damaged record. Nothing after it can be trusted either, so drop the lot.
+		pHeader->m_iReadOffset = 0;
+		pHeader->m_iWriteOffset = 0;
+		pHeader->m_iRecords = 0;
+		return false;
+	}
+
+	iSize = ReadRecordSize(pRecord);
+	pData = pRecord + 4;
+
+	return true;
+}
+
+void CDataSpool::Pop()
+{
+	const char* pData;
+	size_t iSize;
+	if (!Peek(pData, iSize))
+		return;
+
+	SpoolHeader* pHeader = Header();
+	pHeader->m_iReadOffset += (unsigned int)(4 + iSize);
+	pHeader->m_iRecords--;
+
+	if (pHeader->m_iReadOffset >= pHeader->m_iWriteOffset)
+	{
+		pHeader->m_iReadOffset = 0;
+		pHeader->m_iWriteOffset = 0;
+		pHeader->m_iRecords = 0;
+	}
+}
+
+size_t CDataSpool::GetRecordCount() const
+{
+	return m_pMap?Header()->m_iRecords:0;
+}
+
+size_t CDataSpool::GetUsedBytes() const
+{
+	return m_pMap?Header()->m_iWriteOffset - Header()->m_iReadOffset:0;
+}
+
+struct CurlReadBuffer
+{
+	const char* m_pData;
+	size_t      m_iRemaining;
+};
 
 size_t CurlReadFunction(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
-	stringstream& ssData = *(stringstream*)userdata;
-	string sData = ssData.str();
+	// Straight from the caller's buffer (the serialized data or the spool mapping) into curl's.
+	CurlReadBuffer& oBuffer = *(CurlReadBuffer*)userdata;
 
-	size_t iBytesToRead = sData.size() - ssData.tellp();
-	if (iBytesToRead > nmemb)
-		iBytesToRead = nmemb;
+	size_t iBytesToRead = size*nmemb;
+	if (iBytesToRead > oBuffer.m_iRemaining)
+		iBytesToRead = oBuffer.m_iRemaining;
 
-	memcpy(ptr, sData.data() + ssData.tellp(), iBytesToRead);
-	ssData.seekp((size_t)ssData.tellp() + iBytesToRead);
+	memcpy(ptr, oBuffer.m_pData, iBytesToRead);
+	oBuffer.m_pData += iBytesToRead;
+	oBuffer.m_iRemaining -= iBytesToRead;
 
 	return iBytesToRead;
 }
@@ -58,53 +327,377 @@ int CurlDebugCallback(CURL *pCurl, curl_infotype eInfo, char* psz, size_t i, voi
 	return 0;
 }
 
-bool DASendData(const da::protobuf::GameData& pbGameData, string& sError)
+static size_t CurlDiscardFunction(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
-	bool bSuccess = false;
+	return size*nmemb;
+}
 
-	curl_global_init(CURL_GLOBAL_ALL);
+CDataSink::CDataSink()
+{
+	m_pCurl = NULL;
+	m_pHeaders = NULL;
+	m_iSpoolSize = 0;
+
+	m_iConsecutiveFailures = 0;
+	m_iNextRetry = 0;
+
+	m_iUploads = 0;
+	m_iTotalFailures = 0;
+	m_iDropped = 0;
+}
+
+CDataSink::~CDataSink()
+{
+	if (m_pCurl)
+		curl_easy_cleanup((CURL*)m_pCurl);
+
+	if (m_pHeaders)
+		curl_slist_free_all((curl_slist*)m_pHeaders);
+}
+
+void CDataSink::Configure(const char* pszURL, const char* pszSpoolFile, size_t iSpoolSize)
+{
+	if (m_sURL != pszURL)
+	{
+		m_sURL = pszURL;
 
-	string sData;
+		// A new server gets a fresh chance.
+		m_iConsecutiveFailures = 0;
+		m_iNextRetry = 0;
 
-	if (pbGameData.SerializeToString(&sData))
+		if (m_pCurl)
+			curl_easy_setopt((CURL*)m_pCurl, CURLOPT_URL, m_sURL.c_str());
+	}
+
+	if (m_sSpoolFile != pszSpoolFile || m_iSpoolSize != iSpoolSize)
 	{
-		stringstream ssData(sData);
+		m_sSpoolFile = pszSpoolFile;
+		m_iSpoolSize = iSpoolSize;
+
+		m_Spool.Close();
+
+		if (m_sSpoolFile.length())
+		{
+			string sError;
+			if (!m_Spool.Open(m_sSpoolFile.c_str(), m_iSpoolSize, sError))
+				DebugString(sError.c_str());
+		}
+	}
+}
+
+int CDataSink::GetSecondsUntilRetry() const
+{
+	long long iNow = (long long)time(NULL);
+	if (m_iNextRetry <= iNow)
+		return 0;
 
-		CURL* pCurl = curl_easy_init();
+	return (int)(m_iNextRetry - iNow);
+}
 
-		if (pCurl)
+bool CDataSink::Upload(const char* pData, size_t iSize, string& sError)
+{
+	if (!m_pCurl)
+	{
+		// One handle for the life of the sink, so the connection to the server is kept alive between uploads.
+		m_pCurl = curl_easy_init();
+		if (!m_pCurl)
 		{
-			curl_easy_setopt(pCurl, CURLOPT_TIMEOUT, 10L);
-			curl_easy_setopt(pCurl, CURLOPT_NOSIGNAL, 1L);
-			curl_easy_setopt(pCurl, CURLOPT_URL, "http://data.doubleactiongame.com/data/receive.php");
-			curl_easy_setopt(pCurl, CURLOPT_UPLOAD, 1);
-			curl_easy_setopt(pCurl, CURLOPT_READDATA, &ssData);
-			curl_easy_setopt(pCurl, CURLOPT_READFUNCTION, CurlReadFunction);
-			curl_easy_setopt(pCurl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)sData.size());
+			sError = "curl_easy_init() failed.\n";
+			return false;
+		}
+
+		// Without this curl waits for a 100 Continue before sending anything over 1k.
+		m_pHeaders = curl_slist_append(NULL, "Expect:");
+
+		CURL* pCurl = (CURL*)m_pCurl;
+		curl_easy_setopt(pCurl, CURLOPT_TIMEOUT, 10L);
+		curl_easy_setopt(pCurl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(pCurl, CURLOPT_URL, m_sURL.c_str());
+		curl_easy_setopt(pCurl, CURLOPT_UPLOAD, 1L);
+		curl_easy_setopt(pCurl, CURLOPT_HTTPHEADER, (curl_slist*)m_pHeaders);
+		curl_easy_setopt(pCurl, CURLOPT_READFUNCTION, CurlReadFunction);
+		curl_easy_setopt(pCurl, CURLOPT_WRITEFUNCTION, CurlDiscardFunction);
 
 #ifdef _DEBUG
-			//curl_easy_setopt(pCurl, CURLOPT_VERBOSE, 1L);
-			//curl_easy_setopt(pCurl, CURLOPT_DEBUGFUNCTION, CurlDebugCallback);
+		//curl_easy_setopt(pCurl, CURLOPT_VERBOSE, 1L);
+		//curl_easy_setopt(pCurl, CURLOPT_DEBUGFUNCTION, CurlDebugCallback);
 #endif
+	}
 
-			CURLcode eRes = curl_easy_perform(pCurl);
+	CURL* pCurl = (CURL*)m_pCurl;
 
-			if(eRes == CURLE_OK)
-				bSuccess = true;
-			else
-				sError = string("curl_easy_perform() failed: ") + curl_easy_strerror(eRes) + "\n";
+	CurlReadBuffer oBuffer;
+	oBuffer.m_pData = pData;
+	oBuffer.m_iRemaining = iSize;
 
-			curl_easy_cleanup(pCurl);
-		}
-		else
-			sError = "curl_easy_init() failed.\n";
+	curl_easy_setopt(pCurl, CURLOPT_READDATA, &oBuffer);
+	curl_easy_setopt(pCurl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)iSize);
+
+	CURLcode eRes = curl_easy_perform(pCurl);
+
+	long iResponse = 0;
+	if (eRes == CURLE_OK)
+		curl_easy_getinfo(pCurl, CURLINFO_RESPONSE_CODE, &iResponse);
+
+	if (eRes == CURLE_OK && iResponse < 400)
+	{
+		m_iUploads++;
+		m_iConsecutiveFailures = 0;
+		m_iNextRetry = 0;
+		return true;
 	}
+
+	if (eRes != CURLE_OK)
+		sError = string("curl_easy_perform() failed: ") + curl_easy_strerror(eRes) + "\n";
 	else
+	{
+		char szResponse[16];
+		sprintf(szResponse, "%ld", iResponse);
+		sError = string("Server responded ") + szResponse + "\n";
+	}
+
+	m_iTotalFailures++;
+	m_iConsecutiveFailures++;
+
+	int iBackoff = RETRY_MIN_SECONDS;
+	for (int i = 1; i < m_iConsecutiveFailures && iBackoff < RETRY_MAX_SECONDS; i++)
+		iBackoff *= 2;
+
+	if (iBackoff > RETRY_MAX_SECONDS)
+		iBackoff = RETRY_MAX_SECONDS;
+
+	m_iNextRetry = (long long)time(NULL) + iBackoff;
+
+	return false;
+}
+
+bool CDataSink::FlushSpool(string& sError)
+{
+	if (!m_Spool.GetRecordCount())
+		return true;
+
+	if (!m_sURL.length())
+		return false;
+
+	if (GetSecondsUntilRetry() > 0)
+		return false;
+
+	const char* pData;
+	size_t iSize;
+	while (m_Spool.Peek(pData, iSize))
+	{
+		if (!Upload(pData, iSize, sError))
+			return false;
+
+		m_Spool.Pop();
+	}
+
+	return true;
+}
+
+bool CDataSink::Send(const da::protobuf::GameData& pbGameData, string& sError)
+{
+	m_sBuffer.clear();
+	if (!pbGameData.SerializeToString(&m_sBuffer))
+	{
 		sError = "Data serialization failed.\n";
+		m_iDropped++;
+		return false;
+	}
 
-	curl_global_cleanup();
+	// Anything spooled is older, so it goes first. If it can't, this waits behind it.
+	if (m_sURL.length() && FlushSpool(sError))
+	{
+		if (Upload(m_sBuffer.data(), m_sBuffer.size(), sError))
+			return true;
+	}
+
+	if (!m_Spool.IsOpen())
+	{
+		if (!m_sURL.length())
+			sError = "No upload URL and no spool file.\n";
+
+		m_iDropped++;
+		return false;
+	}
+
+	string sSpoolError;
+	if (!m_Spool.Append(m_sBuffer.data(), m_sBuffer.size(), sSpoolError))
+	{
+		sError += sSpoolError;
+		m_iDropped++;
+		return false;
+	}
+
+	// Spooled, it'll go up later. Not an error.
+	sError.clear();
+	return true;
+}
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+#define closesocket_portable closesocket
+#else
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closesocket_portable close
+#endif
+
+// Waits up to 100ms for the socket to be readable, so the quit flag gets checked.
+static bool WaitReadable(socket_t iSocket)
+{
+	fd_set oSet;
+	FD_ZERO(&oSet);
+	FD_SET(iSocket, &oSet);
+
+	timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = 100000;
+
+	return select((int)iSocket+1, &oSet, NULL, NULL, &tv) > 0;
+}
+
+static bool HeaderHasValue(const string& sHeaders, const char* pszHeader, string& sValue)
+{
+	size_t iHeaderLength = strlen(pszHeader);
+	size_t iLine = 0;
+	while (iLine < sHeaders.size())
+	{
+		size_t iEnd = sHeaders.find("\r\n", iLine);
+		if (iEnd == string::npos)
+			iEnd = sHeaders.size();
+
+		if (iEnd - iLine > iHeaderLength && sHeaders[iLine + iHeaderLength] == ':'
+#ifdef _WIN32
+			&& _strnicmp(sHeaders.c_str() + iLine, pszHeader, iHeaderLength) == 0)
+#else
+			&& strncasecmp(sHeaders.c_str() + iLine, pszHeader, iHeaderLength) == 0)
+#endif
+		{
+			size_t iValue = sHeaders.find_first_not_of(" \t", iLine + iHeaderLength + 1);
+			sValue = (iValue < iEnd)?sHeaders.substr(iValue, iEnd - iValue):string();
+			return true;
+		}
+
+		iLine = iEnd + 2;
+	}
+
+	return false;
+}
+
+// Handles requests on one connection until it closes. Keeps going as long as the client keeps the connection alive.
+static void ServeConnection(socket_t iClient, volatile bool* pbQuit, DAReceiverStats* pStats)
+{
+	string sRequest;
+	char szBuffer[16*1024];
+
+	da::protobuf::GameData pbGameData;
+
+	while (!*pbQuit)
+	{
+		size_t iHeaderEnd = sRequest.find("\r\n\r\n");
+		if (iHeaderEnd == string::npos)
+		{
+			if (!WaitReadable(iClient))
+				continue;
+
+			int iRead = recv(iClient, szBuffer, sizeof(szBuffer), 0);
+			if (iRead <= 0)
+				return;
+
+			sRequest.append(szBuffer, iRead);
+			continue;
+		}
+
+		string sHeaders = sRequest.substr(0, iHeaderEnd);
+
+		string sValue;
+		size_t iContentLength = 0;
+		if (HeaderHasValue(sHeaders, "Content-Length", sValue))
+			iContentLength = strtoul(sValue.c_str(), NULL, 10);
+
+		bool bClose = HeaderHasValue(sHeaders, "Connection", sValue) && sValue == "close";
+
+		if (HeaderHasValue(sHeaders, "Expect", sValue) && sValue == "100-continue" && sRequest.size() == iHeaderEnd + 4)
+		{
+			static const char szContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+			send(iClient, szContinue, sizeof(szContinue)-1, 0);
+		}
+
+		size_t iRequestEnd = iHeaderEnd + 4 + iContentLength;
+		while (sRequest.size() < iRequestEnd && !*pbQuit)
+		{
+			if (!WaitReadable(iClient))
+				continue;
+
+			int iRead = recv(iClient, szBuffer, sizeof(szBuffer), 0);
+			if (iRead <= 0)
+				return;
+
+			sRequest.append(szBuffer, iRead);
+		}
+
+		if (*pbQuit)
+			return;
+
+		if (!pbGameData.ParseFromArray(sRequest.data() + iHeaderEnd + 4, (int)iContentLength))
+			pStats->m_iInvalid++;
+
+		pStats->m_iRequests++;
+		pStats->m_iBytes += iContentLength;
+
+		static const char szResponse[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+		send(iClient, szResponse, sizeof(szResponse)-1, 0);
+
+		sRequest.erase(0, iRequestEnd);
+
+		if (bClose)
+			return;
+	}
+}
+
+bool DARunLocalReceiver(int iPort, volatile bool* pbQuit, DAReceiverStats* pStats, string& sError)
+{
+	socket_t iListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (iListen == INVALID_SOCKET)
+	{
+		sError = "Couldn't create the receiver socket.\n";
+		return false;
+	}
+
+	int iReuse = 1;
+	setsockopt(iListen, SOL_SOCKET, SO_REUSEADDR, (const char*)&iReuse, sizeof(iReuse));
+
+	sockaddr_in oAddress;
+	memset(&oAddress, 0, sizeof(oAddress));
+	oAddress.sin_family = AF_INET;
+	oAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	oAddress.sin_port = htons((unsigned short)iPort);
+
+	if (bind(iListen, (sockaddr*)&oAddress, sizeof(oAddress)) != 0 || listen(iListen, 4) != 0)
+	{
+		sError = "Couldn't listen on the receiver port.\n";
+		closesocket_portable(iListen);
+		return false;
+	}
+
+	while (!*pbQuit)
+	{
+		if (!WaitReadable(iListen))
+			continue;
+
+		socket_t iClient = accept(iListen, NULL, NULL);
+		if (iClient == INVALID_SOCKET)
+			continue;
+
+		ServeConnection(iClient, pbQuit, pStats);
+
+		closesocket_portable(iClient);
+	}
+
+	closesocket_portable(iListen);
 
-	return bSuccess;
+	return true;
 }
 
 static int still_running = 0;
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+
+namespace da
+{
+	namespace protobuf
+	{
+		class GameData;
+	}
+}
+
+// Call once from the main thread before any sink is used, and once after they're all gone.
+void DAInitDataNetworking();
+void DAShutdownDataNetworking();
+
+// Length-prefixed records in a memory-mapped file. Records that couldn't be uploaded
+// wait here, and survive a crash or restart of the server.
+class CDataSpool
+{
+public:
+	CDataSpool();
+	~CDataSpool();
+
+public:
+	bool   Open(const char* pszFile, size_t iCapacity, std::string& sError);
+	void   Close();
+	bool   IsOpen() const { return !!m_pMap; }
+
+	bool   Append(const char* pData, size_t iSize, std::string& sError);
+
+	// The oldest record. The pointer is into the mapping and is good until the next Append() or Pop().
+	bool   Peek(const char*& pData, size_t& iSize) const;
+	void   Pop();
+
+	size_t GetRecordCount() const;
+	size_t GetUsedBytes() const;
+	size_t GetCapacity() const { return m_iCapacity; }
+
+private:
+	struct SpoolHeader
+	{
+		unsigned int m_iMagic;
+		unsigned int m_iVersion;
+		unsigned int m_iReadOffset;  // Relative to the end of the header
+		unsigned int m_iWriteOffset;
+		unsigned int m_iRecords;
+	};
+
+	SpoolHeader* Header() const { return (SpoolHeader*)m_pMap; }
+	char*        Data() const { return m_pMap + sizeof(SpoolHeader); }
+	size_t       DataCapacity() const { return m_iCapacity - sizeof(SpoolHeader); }
+
+	void         Compact();
+
+private:
+	char*        m_pMap;
+	size_t       m_iCapacity;
+
+#ifdef _WIN32
+	void*        m_hFile;
+	void*        m_hMapping;
+#else
+	int          m_iFile;
+#endif
+};
+
+// Sends game data to the collection server. If an upload fails the data goes to the spool,
+// and the spool is uploaded (oldest first) once the server answers again, backing off
+// exponentially between attempts. Not thread safe: each thread that sends needs its own sink.
+class CDataSink
+{
+public:
+	CDataSink();
+	~CDataSink();
+
+public:
+	// An empty URL only spools. An empty spool file means failed uploads are dropped.
+	// Cheap to call when nothing has changed.
+	void Configure(const char* pszURL, const char* pszSpoolFile, size_t iSpoolSize);
+
+	// Returns true if the data was uploaded or spooled.
+	bool Send(const da::protobuf::GameData& pbGameData, std::string& sError);
+
+	// Uploads spooled records if it's time to try again. Returns true if the spool is empty.
+	bool FlushSpool(std::string& sError);
+
+	const CDataSpool& GetSpool() const { return m_Spool; }
+
+	int GetUploads() const { return m_iUploads; }
+	int GetFailures() const { return m_iTotalFailures; }
+	int GetDropped() const { return m_iDropped; }
+	int GetSecondsUntilRetry() const;
+
+private:
+	bool Upload(const char* pData, size_t iSize, std::string& sError);
+
+private:
+	void*       m_pCurl;
+	void*       m_pHeaders;
+
+	std::string m_sURL;
+	std::string m_sSpoolFile;
+	size_t      m_iSpoolSize;
+
+	CDataSpool  m_Spool;
+
+	std::string m_sBuffer; // Reused between sends so it keeps its allocation.
+
+	int         m_iConsecutiveFailures;
+	long long   m_iNextRetry;
+
+	int         m_iUploads;
+	int         m_iTotalFailures;
+	int         m_iDropped;
+};
+
+struct DAReceiverStats
+{
+	volatile int       m_iRequests;
+	volatile int       m_iInvalid;
+	volatile long long m_iBytes;
+};
+
+// A stand-in for the collection server, for testing and benchmarking without it. Listens on
+// 127.0.0.1:iPort, answers every request with a 200 and checks that the body is a GameData.
+// Blocks until *pbQuit is set, so run it on its own thread.
+bool DARunLocalReceiver(int iPort, volatile bool* pbQuit, DAReceiverStats* pStats, std::string& sError);
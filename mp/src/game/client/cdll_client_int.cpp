@@ -171,6 +171,7 @@ extern vgui::IInputInternal *g_InputInternal;
 
 #ifdef SDK_DLL
 #include "c_sdk_player.h"
+#include "c_da_playerproximity.h"
 #endif
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -2163,6 +2164,11 @@ void OnRenderStart()
 	// Process OnDataChanged events.
 	ProcessOnDataChangedEvents();
 
+#ifdef SDK_DLL
+	// Index where the players were interpolated to, for their think functions and the next CreateMove.
+	PlayerProximity().Rebuild();
+#endif
+
 	// Reset the overlay alpha. Entities can change the state of this in their think functions.
 	g_SmokeFogOverlayAlpha = 0;	
 
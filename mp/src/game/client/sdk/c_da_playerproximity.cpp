@@ -0,0 +1,229 @@
+#include "cbase.h"
+
+#include "c_da_playerproximity.h"
+
+#include "collisionutils.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar cl_showplayerproximity( "cl_showplayerproximity", "0", 0, "Show how long the player proximity index and its users took last frame." );
+
+C_PlayerProximity g_PlayerProximity( "C_PlayerProximity" );
+
+C_PlayerProximity& PlayerProximity()
+{
+	return g_PlayerProximity;
+}
+
+static const char* s_apszProximityTimes[PROXIMITY_TIME_MAX] =
+{
+	"rebuild",
+	"avoidance",
+	"look at",
+	"id target",
+};
+
+C_PlayerProximity::C_PlayerProximity( char const* name )
+	: CAutoGameSystem(name)
+{
+	m_flMaxHullExtent = 0;
+
+	for (int i = 0; i < CLIENT_PROXIMITY_HASH_BUCKETS; i++)
+		m_aiBuckets[i] = -1;
+
+	memset(m_aflFrameTimes, 0, sizeof(m_aflFrameTimes));
+	memset(m_aiFrameCalls, 0, sizeof(m_aiFrameCalls));
+}
+
+void C_PlayerProximity::LevelInitPostEntity()
+{
+	// Don't hand out players from the last map before the first frame renders.
+	m_aPlayers.RemoveAll();
+
+	for (int i = 0; i < CLIENT_PROXIMITY_HASH_BUCKETS; i++)
+		m_aiBuckets[i] = -1;
+}
+
+void C_PlayerProximity::CellForOrigin(const Vector& vecOrigin, int& x, int& y, int& z) const
+{
+	x = (int)floor(vecOrigin.x / CLIENT_PROXIMITY_CELL_SIZE);
+	y = (int)floor(vecOrigin.y / CLIENT_PROXIMITY_CELL_SIZE);
+	z = (int)floor(vecOrigin.z / CLIENT_PROXIMITY_CELL_SIZE);
+}
+
+int C_PlayerProximity::HashCell(int x, int y, int z) const
+{
+	return ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & (CLIENT_PROXIMITY_HASH_BUCKETS-1);
+}
+
+void C_PlayerProximity::Rebuild()
+{
+	// The last frame's users are done, show them before this frame starts adding.
+	ShowFrameTimes();
+
+	CFastTimer oTimer;
+	oTimer.Start();
+
+	m_aPlayers.RemoveAll();
+	m_flMaxHullExtent = 0;
+
+	for (int i = 0; i < CLIENT_PROXIMITY_HASH_BUCKETS; i++)
+		m_aiBuckets[i] = -1;
+
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		C_SDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
+		if (!pPlayer)
+			continue;
+
+		// Dormant players are wherever the server last saw them.
+		if (pPlayer->IsDormant())
+			continue;
+
+		int iProximity = m_aPlayers.AddToTail();
+		ProximityPlayer& oPlayer = m_aPlayers[iProximity];
+
+		oPlayer.m_hPlayer = pPlayer;
+		oPlayer.m_vecOrigin = pPlayer->GetAbsOrigin();
+		oPlayer.m_vecMins = oPlayer.m_vecOrigin + pPlayer->GetPlayerMins();
+		oPlayer.m_vecMaxs = oPlayer.m_vecOrigin + pPlayer->GetPlayerMaxs();
+		pPlayer->CollisionProp()->WorldSpaceSurroundingBounds(&oPlayer.m_vecSurroundMins, &oPlayer.m_vecSurroundMaxs);
+
+		for (int j = 0; j < 3; j++)
+		{
+			m_flMaxHullExtent = max(m_flMaxHullExtent, oPlayer.m_vecOrigin[j] - oPlayer.m_vecMins[j]);
+			m_flMaxHullExtent = max(m_flMaxHullExtent, oPlayer.m_vecMaxs[j] - oPlayer.m_vecOrigin[j]);
+		}
+
+		CellForOrigin(oPlayer.m_vecOrigin, oPlayer.m_iCellX, oPlayer.m_iCellY, oPlayer.m_iCellZ);
+
+		int iBucket = HashCell(oPlayer.m_iCellX, oPlayer.m_iCellY, oPlayer.m_iCellZ);
+		oPlayer.m_iNextInBucket = m_aiBuckets[iBucket];
+		m_aiBuckets[iBucket] = iProximity;
+	}
+
+	oTimer.End();
+	AddFrameTime(PROXIMITY_TIME_REBUILD, oTimer);
+}
+
+void C_PlayerProximity::GetPlayersInBox(const Vector& vecMins, const Vector& vecMaxs, CUtlVector<C_SDKPlayer*>& apPlayers)
+{
+	apPlayers.RemoveAll();
+
+	// Players are hashed by origin, so look as far out as any hull reaches.
+	Vector vecExtent(m_flMaxHullExtent, m_flMaxHullExtent, m_flMaxHullExtent);
+
+	int iMinX, iMinY, iMinZ;
+	int iMaxX, iMaxY, iMaxZ;
+	CellForOrigin(vecMins - vecExtent, iMinX, iMinY, iMinZ);
+	CellForOrigin(vecMaxs + vecExtent, iMaxX, iMaxY, iMaxZ);
+
+	for (int x = iMinX; x <= iMaxX; x++)
+	{
+		for (int y = iMinY; y <= iMaxY; y++)
+		{
+			for (int z = iMinZ; z <= iMaxZ; z++)
+			{
+				for (int i = m_aiBuckets[HashCell(x, y, z)]; i >= 0; i = m_aPlayers[i].m_iNextInBucket)
+				{
+					const ProximityPlayer& oPlayer = m_aPlayers[i];
+
+					// Other cells can share the bucket. Only take players from this cell so nobody is added twice.
+					if (oPlayer.m_iCellX != x || oPlayer.m_iCellY != y || oPlayer.m_iCellZ != z)
+						continue;
+
+					if (!IsBoxIntersectingBox(vecMins, vecMaxs, oPlayer.m_vecMins, oPlayer.m_vecMaxs))
+						continue;
+
+					// Deleted by a packet since the last rebuild.
+					if (!oPlayer.m_hPlayer)
+						continue;
+
+					apPlayers.AddToTail(oPlayer.m_hPlayer);
+				}
+			}
+		}
+	}
+}
+
+void C_PlayerProximity::GetPlayersInRadius(const Vector& vecOrigin, float flRadius, CUtlVector<C_SDKPlayer*>& apPlayers)
+{
+	apPlayers.RemoveAll();
+
+	int iMinX, iMinY, iMinZ;
+	int iMaxX, iMaxY, iMaxZ;
+	CellForOrigin(vecOrigin - Vector(flRadius, flRadius, flRadius), iMinX, iMinY, iMinZ);
+	CellForOrigin(vecOrigin + Vector(flRadius, flRadius, flRadius), iMaxX, iMaxY, iMaxZ);
+
+	float flRadiusSqr = flRadius*flRadius;
+
+	for (int x = iMinX; x <= iMaxX; x++)
+	{
+		for (int y = iMinY; y <= iMaxY; y++)
+		{
+			for (int z = iMinZ; z <= iMaxZ; z++)
+			{
+				for (int i = m_aiBuckets[HashCell(x, y, z)]; i >= 0; i = m_aPlayers[i].m_iNextInBucket)
+				{
+					const ProximityPlayer& oPlayer = m_aPlayers[i];
+
+					if (oPlayer.m_iCellX != x || oPlayer.m_iCellY != y || oPlayer.m_iCellZ != z)
+						continue;
+
+					if ((oPlayer.m_vecOrigin - vecOrigin).LengthSqr() > flRadiusSqr)
+						continue;
+
+					if (!oPlayer.m_hPlayer)
+						continue;
+
+					apPlayers.AddToTail(oPlayer.m_hPlayer);
+				}
+			}
+		}
+	}
+}
+
+bool C_PlayerProximity::IsAnyPlayerAlongRay(const Vector& vecStart, const Vector& vecEnd, C_BasePlayer* pIgnore)
+{
+	// A long ray crosses more cells than there are players, so just check them all.
+	Vector vecDelta = vecEnd - vecStart;
+
+	for (int i = 0; i < m_aPlayers.Count(); i++)
+	{
+		const ProximityPlayer& oPlayer = m_aPlayers[i];
+		if (!oPlayer.m_hPlayer || oPlayer.m_hPlayer == pIgnore)
+			continue;
+
+		if (IsBoxIntersectingRay(oPlayer.m_vecSurroundMins, oPlayer.m_vecSurroundMaxs, vecStart, vecDelta))
+			return true;
+	}
+
+	return false;
+}
+
+void C_PlayerProximity::AddFrameTime(int iCategory, CFastTimer& oTimer)
+{
+	Assert(iCategory >= 0 && iCategory < PROXIMITY_TIME_MAX);
+
+	m_aflFrameTimes[iCategory] += oTimer.GetDuration().GetMicrosecondsF();
+	m_aiFrameCalls[iCategory]++;
+}
+
+void C_PlayerProximity::ShowFrameTimes()
+{
+	if (cl_showplayerproximity.GetBool())
+	{
+		float flTotal = 0;
+		for (int i = 0; i < PROXIMITY_TIME_MAX; i++)
+			flTotal += m_aflFrameTimes[i];
+
+		engine->Con_NPrintf(20, "Player proximity: %d players, %.1fus total", m_aPlayers.Count(), flTotal);
+
+		for (int i = 0; i < PROXIMITY_TIME_MAX; i++)
+			engine->Con_NPrintf(21 + i, "  %-10s %7.1fus (%d calls)", s_apszProximityTimes[i], m_aflFrameTimes[i], m_aiFrameCalls[i]);
+	}
+
+	memset(m_aflFrameTimes, 0, sizeof(m_aflFrameTimes));
+	memset(m_aiFrameCalls, 0, sizeof(m_aiFrameCalls));
+}
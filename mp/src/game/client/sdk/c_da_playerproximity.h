@@ -0,0 +1,79 @@
+#pragma once
+
+#include "c_sdk_player.h"
+
+#include "utlvector.h"
+#include "tier0/fasttimer.h"
+
+// --------------------------------------------------------------------------------------------------- //
+// Per-frame index of the players the client knows about: a spatial hash of their interpolated
+// positions and bounds. Rebuilt once a frame in OnRenderStart, after interpolation and before
+// entities think, so avoidance, look-at and ID targeting don't each scan every player.
+// --------------------------------------------------------------------------------------------------- //
+
+#define CLIENT_PROXIMITY_CELL_SIZE 256 // Should be around the largest radius that gets queried.
+#define CLIENT_PROXIMITY_HASH_BUCKETS 128 // Power of two
+
+enum
+{
+	PROXIMITY_TIME_REBUILD = 0,
+	PROXIMITY_TIME_AVOID,
+	PROXIMITY_TIME_LOOKAT,
+	PROXIMITY_TIME_IDTARGET,
+
+	PROXIMITY_TIME_MAX,
+};
+
+class C_PlayerProximity : public CAutoGameSystem
+{
+public:
+	C_PlayerProximity( char const *name );
+
+public:
+	virtual void LevelInitPostEntity();
+
+	// Index the players where they were interpolated to this frame.
+	void Rebuild();
+
+	// Non-dormant players whose collision hulls overlap the box.
+	void GetPlayersInBox(const Vector& vecMins, const Vector& vecMaxs, CUtlVector<C_SDKPlayer*>& apPlayers);
+
+	// Non-dormant players whose origin is within flRadius of vecOrigin.
+	void GetPlayersInRadius(const Vector& vecOrigin, float flRadius, CUtlVector<C_SDKPlayer*>& apPlayers);
+
+	// Does the segment pass through any non-dormant player's surrounding bounds, besides pIgnore's?
+	bool IsAnyPlayerAlongRay(const Vector& vecStart, const Vector& vecEnd, C_BasePlayer* pIgnore);
+
+	// Frame time breakdown for cl_showplayerproximity.
+	void AddFrameTime(int iCategory, CFastTimer& oTimer);
+
+private:
+	void CellForOrigin(const Vector& vecOrigin, int& x, int& y, int& z) const;
+	int  HashCell(int x, int y, int z) const;
+
+	void ShowFrameTimes();
+
+private:
+	struct ProximityPlayer
+	{
+		CHandle<C_SDKPlayer> m_hPlayer;
+		Vector      m_vecOrigin;
+		Vector      m_vecMins;           // World space collision hull.
+		Vector      m_vecMaxs;
+		Vector      m_vecSurroundMins;   // World space surrounding bounds, covers the hitboxes.
+		Vector      m_vecSurroundMaxs;
+		int         m_iCellX, m_iCellY, m_iCellZ;
+		int         m_iNextInBucket;
+	};
+
+	CUtlVector<ProximityPlayer> m_aPlayers;
+	int   m_aiBuckets[CLIENT_PROXIMITY_HASH_BUCKETS];
+
+	// How far any player's hull reaches from its origin, box queries look this much further out.
+	float m_flMaxHullExtent;
+
+	float m_aflFrameTimes[PROXIMITY_TIME_MAX];     // Microseconds
+	int   m_aiFrameCalls[PROXIMITY_TIME_MAX];
+};
+
+C_PlayerProximity& PlayerProximity();
@@ -46,6 +46,7 @@
 #include "da_skillmenu.h"
 #include "da_viewmodel.h"
 #include "da_viewback.h"
+#include "c_da_playerproximity.h"
 
 #include "tier0/valve_minmax_on.h"
 
@@ -130,41 +131,61 @@ END_RECV_TABLE()
 
 void RecvProxy_Skill( const CRecvProxyData *pData, void *pStruct, void *pOut );
 
+static void RecvProxy_MovementBits( const CRecvProxyData *pData, void *pStruct, void *pOut )
+{
+	((CSDKPlayerShared*)pStruct)->SetMovementBits( pData->m_Value.m_Int );
+}
+
+static void RecvProxy_PlayerTimer( const CRecvProxyData *pData, void *pStruct, void *pOut )
+{
+	// m_flCurrentTime isn't rebuilt until PostDataUpdate, so go straight to the lag. It's
+	// SPROP_CHANGES_OFTEN, which puts it ahead of the timers if it's in this packet at all.
+	*(float*)pOut = PlayerTimerFromNetwork( pData->m_Value.m_Int, ((CSDKPlayerShared*)pStruct)->GetOuter()->GetNetworkedCurrentTime() );
+}
+
+static void RecvProxy_ServerTimer( const CRecvProxyData *pData, void *pStruct, void *pOut )
+{
+	*(float*)pOut = PlayerTimerFromNetwork( pData->m_Value.m_Int, engine->GetLastTimeStamp() );
+}
+
+static RecvProp RecvPropPlayerTimer( const char *pVarName, int offset, int sizeofVar )
+{
+	return RecvPropInt( pVarName, offset, sizeofVar, 0, RecvProxy_PlayerTimer );
+}
+
+static RecvProp RecvPropServerTimer( const char *pVarName, int offset, int sizeofVar )
+{
+	return RecvPropInt( pVarName, offset, sizeofVar, 0, RecvProxy_ServerTimer );
+}
+
 BEGIN_RECV_TABLE_NOBASE( CSDKPlayerShared, DT_SDKPlayerShared )
 #if defined ( SDK_USE_STAMINA ) || defined ( SDK_USE_SPRINTING )
 	RecvPropFloat( RECVINFO( m_flStamina ) ),
 #endif
 
+	RecvPropInt( "m_iMovementBits", 0, SIZEOF_IGNORE, 0, RecvProxy_MovementBits ),
+
 #if defined ( SDK_USE_PRONE )
-	RecvPropBool( RECVINFO( m_bProne ) ),
-	RecvPropTime( RECVINFO( m_flGoProneTime ) ),
-	RecvPropTime( RECVINFO( m_flUnProneTime ) ),
-	RecvPropTime( RECVINFO( m_flDisallowUnProneTime ) ),
-	RecvPropBool( RECVINFO( m_bProneSliding ) ),
+	RecvPropPlayerTimer( RECVINFO( m_flGoProneTime ) ),
+	RecvPropPlayerTimer( RECVINFO( m_flUnProneTime ) ),
+	RecvPropPlayerTimer( RECVINFO( m_flDisallowUnProneTime ) ),
 #endif
 #if defined( SDK_USE_SPRINTING )
 	RecvPropBool( RECVINFO( m_bIsSprinting ) ),
 #endif
-	RecvPropBool( RECVINFO( m_bSliding ) ),
-	RecvPropBool( RECVINFO( m_bInAirSlide ) ),
 	RecvPropVector( RECVINFO(m_vecSlideDirection) ),
-	RecvPropTime( RECVINFO(m_flSlideStartTime) ),
-	RecvPropTime( RECVINFO(m_flSlideAutoEndTime) ),
-	RecvPropTime( RECVINFO( m_flLastUnSlideTime ) ),
-	RecvPropBool( RECVINFO( m_bDiveSliding ) ),
+	RecvPropPlayerTimer( RECVINFO(m_flSlideStartTime) ),
+	RecvPropPlayerTimer( RECVINFO(m_flSlideAutoEndTime) ),
+	RecvPropPlayerTimer( RECVINFO( m_flLastUnSlideTime ) ),
 	RecvPropVector( RECVINFO(m_vecUnSlideEyeStartOffset) ),
-	RecvPropTime( RECVINFO( m_flLastDuckPress ) ),
-	RecvPropBool( RECVINFO( m_bRolling ) ),
-	RecvPropBool( RECVINFO( m_bRollingFromDive ) ),
+	RecvPropServerTimer( RECVINFO( m_flLastDuckPress ) ),
 	RecvPropVector( RECVINFO(m_vecRollDirection) ),
-	RecvPropTime( RECVINFO(m_flRollTime) ),
-	RecvPropBool( RECVINFO( m_bDiving ) ),
+	RecvPropPlayerTimer( RECVINFO(m_flRollTime) ),
 	RecvPropVector( RECVINFO(m_vecDiveDirection) ),
-	RecvPropBool( RECVINFO( m_bRollAfterDive ) ),
-	RecvPropTime( RECVINFO(m_flDiveTime) ),
-	RecvPropTime( RECVINFO(m_flTimeLeftGround) ),
+	RecvPropPlayerTimer( RECVINFO(m_flDiveTime) ),
+	RecvPropPlayerTimer( RECVINFO(m_flTimeLeftGround) ),
 	RecvPropFloat( RECVINFO(m_flDiveLerped) ),
-	RecvPropFloat( RECVINFO(m_flDiveToProneLandTime) ),
+	RecvPropPlayerTimer( RECVINFO(m_flDiveToProneLandTime) ),
 	RecvPropBool( RECVINFO( m_bAimedIn ) ),
 	RecvPropFloat( RECVINFO( m_flAimIn ) ),
 	RecvPropFloat( RECVINFO( m_flSlowAimIn ) ),
@@ -174,13 +195,10 @@ BEGIN_RECV_TABLE_NOBASE( CSDKPlayerShared, DT_SDKPlayerShared )
 	RecvPropDataTable( "sdksharedlocaldata", 0, 0, &REFERENCE_RECV_TABLE(DT_SDKSharedLocalPlayerExclusive) ),
 
 	RecvPropInt (RECVINFO (m_iWallFlipCount)),
-	RecvPropBool (RECVINFO (m_bIsWallFlipping)),
-	RecvPropFloat (RECVINFO (m_flWallFlipEndTime)),
-	RecvPropBool (RECVINFO (m_bIsManteling)),
+	RecvPropPlayerTimer (RECVINFO (m_flWallFlipEndTime)),
 	RecvPropVector (RECVINFO (m_vecMantelWallNormal)),
 	RecvPropBool( RECVINFO( m_bSuperFalling ), RECVCALLBACKPROXY(RecvProxy_Int32ToInt8, RecvCallback_UpdateRichPresence) ),
-	RecvPropBool( RECVINFO( m_bSuperFallOthersVisible ) ),
-	RecvPropTime( RECVINFO( m_flSuperFallOthersNextCheck ) ),
+	RecvPropServerTimer( RECVINFO( m_flSuperFallOthersNextCheck ) ),
 END_RECV_TABLE()
 
 void RecvProxy_Loadout( const CRecvProxyData *pData, void *pStruct, void *pOut );
@@ -243,7 +261,7 @@ IMPLEMENT_CLIENTCLASS_DT( C_SDKPlayer, DT_SDKPlayer, CSDKPlayer )
 	RecvPropFloat		( RECVINFO( m_flSlowMoSeconds ) ),
 	RecvPropFloat		( RECVINFO( m_flSlowMoTime ) ),
 	RecvPropFloat		( RECVINFO( m_flSlowMoMultiplier ) ),
-	RecvPropFloat		( RECVINFO( m_flCurrentTime ) ),
+	RecvPropInt			( RECVINFO_NAME( m_iCurrentTimeLag, m_flCurrentTime ) ),
 	RecvPropFloat		( RECVINFO( m_flLastSpawnTime ) ),
 	RecvPropTime		( RECVINFO( m_flReadyWeaponUntil ) ),
 
@@ -276,15 +294,20 @@ END_RECV_TABLE()
 // ------------------------------------------------------------------------------------------ //
 // Prediction tables.
 // ------------------------------------------------------------------------------------------ //
+// The networked values are quantized, see DT_SDKPlayerShared.
+#define PLAYER_TIMER_TOLERANCE 0.001f
+#define PLAYER_RAMP_TOLERANCE (1.0f/((1<<PLAYER_RAMP_BITS)-1))
+#define PLAYER_NORMAL_TOLERANCE 0.05f // Most of the error ends up in the rebuilt z
+
 BEGIN_PREDICTION_DATA_NO_BASE( CSDKPlayerShared )
 #if defined ( SDK_USE_STAMINA ) || defined ( SDK_USE_SPRINTING )
 	DEFINE_PRED_FIELD( m_flStamina, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
 #endif
 #if defined( SDK_USE_PRONE )
 	DEFINE_PRED_FIELD( m_bProne, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flGoProneTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flUnProneTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flDisallowUnProneTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_flGoProneTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flUnProneTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flDisallowUnProneTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_bProneSliding, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
 #endif
 #if defined( SDK_USE_SPRINTING )
@@ -292,29 +315,29 @@ BEGIN_PREDICTION_DATA_NO_BASE( CSDKPlayerShared )
 #endif
 	DEFINE_PRED_FIELD( m_bSliding, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
 	DEFINE_PRED_FIELD( m_bInAirSlide, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_vecSlideDirection, FIELD_VECTOR, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flSlideStartTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flSlideAutoEndTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flLastUnSlideTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_vecSlideDirection, FIELD_VECTOR, FTYPEDESC_INSENDTABLE, PLAYER_NORMAL_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flSlideStartTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flSlideAutoEndTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flLastUnSlideTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_vecUnSlideEyeStartOffset, FIELD_VECTOR, FTYPEDESC_INSENDTABLE ),
 	DEFINE_PRED_FIELD( m_bDiveSliding, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flLastDuckPress, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_flLastDuckPress, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_bRolling, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
 	DEFINE_PRED_FIELD( m_bRollingFromDive, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_vecRollDirection, FIELD_VECTOR, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flRollTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_vecRollDirection, FIELD_VECTOR, FTYPEDESC_INSENDTABLE, PLAYER_NORMAL_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flRollTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_bDiving, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_vecDiveDirection, FIELD_VECTOR, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_vecDiveDirection, FIELD_VECTOR, FTYPEDESC_INSENDTABLE, PLAYER_NORMAL_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_bRollAfterDive, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flDiveTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flTimeLeftGround, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_flDiveTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flTimeLeftGround, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_flDiveLerped, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flDiveToProneLandTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_flDiveToProneLandTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_flViewTilt, FIELD_FLOAT, FTYPEDESC_PRIVATE ),
 	DEFINE_PRED_FIELD( m_flViewBobRamp, FIELD_FLOAT, FTYPEDESC_PRIVATE ),
 	DEFINE_PRED_FIELD( m_bAimedIn, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flAimIn, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flSlowAimIn, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_flAimIn, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_RAMP_TOLERANCE ),
+	DEFINE_PRED_FIELD_TOL( m_flSlowAimIn, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_RAMP_TOLERANCE ),
 	DEFINE_PRED_FIELD( m_vecRecoilDirection, FIELD_VECTOR, FTYPEDESC_PRIVATE ),
 	DEFINE_PRED_FIELD( m_flRecoilAccumulator, FIELD_FLOAT, FTYPEDESC_PRIVATE ),
 	DEFINE_PRED_FIELD( m_iStyleSkill, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
@@ -322,13 +345,13 @@ BEGIN_PREDICTION_DATA_NO_BASE( CSDKPlayerShared )
 
 	DEFINE_PRED_FIELD (m_iWallFlipCount, FIELD_INTEGER, FTYPEDESC_INSENDTABLE),
 	DEFINE_PRED_FIELD (m_bIsWallFlipping, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE),
-	DEFINE_PRED_FIELD (m_flWallFlipEndTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE),
+	DEFINE_PRED_FIELD_TOL (m_flWallFlipEndTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE),
 	DEFINE_PRED_FIELD (m_bIsManteling, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE),
-	DEFINE_PRED_FIELD (m_vecMantelWallNormal, FIELD_VECTOR, FTYPEDESC_INSENDTABLE),
+	DEFINE_PRED_FIELD_TOL (m_vecMantelWallNormal, FIELD_VECTOR, FTYPEDESC_INSENDTABLE, PLAYER_NORMAL_TOLERANCE),
 
 	DEFINE_PRED_FIELD( m_bSuperFalling, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
 	DEFINE_PRED_FIELD( m_bSuperFallOthersVisible, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),
-	DEFINE_PRED_FIELD( m_flSuperFallOthersNextCheck, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),
+	DEFINE_PRED_FIELD_TOL( m_flSuperFallOthersNextCheck, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),
 END_PREDICTION_DATA()
 
 BEGIN_PREDICTION_DATA( C_SDKPlayer )
@@ -346,7 +369,7 @@ BEGIN_PREDICTION_DATA( C_SDKPlayer )
 	DEFINE_PRED_FIELD( m_flSlowMoSeconds, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),   
 	DEFINE_PRED_FIELD( m_flSlowMoTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),   
 	DEFINE_PRED_FIELD( m_flSlowMoMultiplier, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),   
-	DEFINE_PRED_FIELD( m_flCurrentTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),   
+	DEFINE_PRED_FIELD_TOL( m_flCurrentTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE, PLAYER_TIMER_TOLERANCE ),   
 	DEFINE_PRED_FIELD( m_flLastSpawnTime, FIELD_FLOAT, FTYPEDESC_INSENDTABLE ),   
 	DEFINE_PRED_FIELD( m_bThirdPerson, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),   
 	DEFINE_PRED_FIELD( m_bThirdPersonCamSide, FIELD_BOOLEAN, FTYPEDESC_INSENDTABLE ),   
@@ -732,6 +755,7 @@ C_SDKPlayer::C_SDKPlayer() :
 	m_fNextThinkPushAway = 0.0f;
 
 	m_flLastSlowMoMultiplier = 1;
+	m_iCurrentTimeLag = 0;
 	m_currentAlphaVal = 255.0f;
 
 	m_hLeftArmGlow = NULL;
@@ -907,8 +931,17 @@ void C_SDKPlayer::InitializePoseParams( void )
 	m_PlayerAnimState->SetWalkSpeed( GetPlayerClass()->GetMaxSpeed() * 0.5 );
 }
 */
+float C_SDKPlayer::GetNetworkedCurrentTime() const
+{
+	return (float)((double)engine->GetLastTimeStamp() - m_iCurrentTimeLag/1000.0);
+}
+
 void C_SDKPlayer::PostDataUpdate( DataUpdateType_t updateType )
 {
+	// The lag only gets sent when it changes, which is only during slow motion, so the
+	// time has to be brought up to this packet's tick on every update.
+	m_flCurrentTime = GetNetworkedCurrentTime();
+
 	// C_BaseEntity assumes we're networking the entity's angles, so pretend that it
 	// networked the same value we already have.
 	SetNetworkAngles( GetLocalAngles() );
@@ -1651,44 +1684,56 @@ void C_SDKPlayer::ClientThink()
 	// Pass on through to the base class.
 	BaseClass::ClientThink();
 
-	bool bFoundViewTarget = false;
+	CFastTimer oTimer;
+	oTimer.Start();
+
+	C_SDKPlayer *pViewTarget = NULL;
 	
 	Vector vForward;
 	AngleVectors( GetLocalAngles(), &vForward );
 
-	for( int iClient = 1; iClient <= gpGlobals->maxClients; ++iClient )
+	CUtlVector<C_SDKPlayer*> apNearby;
+	PlayerProximity().GetPlayersInRadius( GetAbsOrigin(), 128, apNearby );
+
+	for( int i = 0; i < apNearby.Count(); ++i )
 	{
-		CBaseEntity *pEnt = UTIL_PlayerByIndex( iClient );
-		if(!pEnt || !pEnt->IsPlayer())
+		C_SDKPlayer *pEnt = apNearby[i];
+		if ( pEnt == this )
 			continue;
 
-		if ( pEnt->entindex() == entindex() )
+		// Look at the lowest numbered player in front, like the old scan over every client did.
+		if ( pViewTarget && pViewTarget->entindex() < pEnt->entindex() )
 			continue;
 
 		Vector vTargetOrigin = pEnt->GetAbsOrigin();
 		Vector vMyOrigin =  GetAbsOrigin();
 
 		Vector vDir = vTargetOrigin - vMyOrigin;
-		
-		if ( vDir.Length() > 128 ) 
-			continue;
 
 		VectorNormalize( vDir );
 
 		if ( DotProduct( vForward, vDir ) < 0.0f )
 			 continue;
 
-		m_vLookAtTarget = pEnt->EyePosition();
-		bFoundViewTarget = true;
-		break;
+		pViewTarget = pEnt;
 	}
 
-	if ( bFoundViewTarget == false )
+	if ( pViewTarget )
+	{
+		m_vLookAtTarget = pViewTarget->EyePosition();
+	}
+	else
 	{
 		m_vLookAtTarget = GetAbsOrigin() + vForward * 512;
 	}
 
+	oTimer.End();
+	PlayerProximity().AddFrameTime( PROXIMITY_TIME_LOOKAT, oTimer );
+
+	oTimer.Start();
 	UpdateIDTarget();
+	oTimer.End();
+	PlayerProximity().AddFrameTime( PROXIMITY_TIME_IDTARGET, oTimer );
 
 	// Avoidance
 	if ( gpGlobals->curtime >= m_fNextThinkPushAway )
@@ -1771,6 +1816,11 @@ void C_SDKPlayer::UpdateIDTarget()
 	Vector vecStart, vecEnd;
 	VectorMA( MainViewOrigin(), 1500, MainViewForward(), vecEnd );
 	VectorMA( MainViewOrigin(), 10,   MainViewForward(), vecStart );
+
+	// Only players get an ID. Don't trace if the view doesn't pass near any of them.
+	if ( !PlayerProximity().IsAnyPlayerAlongRay( vecStart, vecEnd, this ) )
+		return;
+
 	UTIL_TraceLine( vecStart, vecEnd, MASK_SOLID, this, COLLISION_GROUP_NONE, &tr );
 
 	if ( !tr.startsolid && tr.DidHitNonWorldEntity() )
@@ -1820,28 +1870,26 @@ void C_SDKPlayer::AvoidPlayers( CUserCmd *pCmd )
 	VectorAdd( vecSDKPlayerMax, vecSDKPlayerCenter, vecSDKPlayerMax );
 
 	// Find an intersecting player or object.
-	int nAvoidPlayerCount = 0;
-	C_SDKPlayer *pAvoidPlayerList[MAX_PLAYERS];
-
 	C_SDKPlayer *pIntersectPlayer = NULL;
 	float flAvoidRadius = 0.0f;
 
+	// The index has each player's hull at their origin, but the boxes below are raised by half the
+	// player's height. Look down by half a standing hull so nobody is missed.
+	Vector vecQueryMin = vecSDKPlayerMin;
+	vecQueryMin.z -= 0.5f * ( VEC_HULL_MAX.z - VEC_HULL_MIN.z );
+
+	CUtlVector<C_SDKPlayer*> apNearby;
+	PlayerProximity().GetPlayersInBox( vecQueryMin, vecSDKPlayerMax, apNearby );
+
 	Vector vecAvoidCenter, vecAvoidMin, vecAvoidMax;
-	for ( int i = 0; i < pTeam->GetNumPlayers(); ++i )
+	for ( int i = 0; i < apNearby.Count(); ++i )
 	{
-		C_SDKPlayer *pAvoidPlayer = static_cast< C_SDKPlayer * >( pTeam->GetPlayer( i ) );
-		if ( pAvoidPlayer == NULL )
-			continue;
+		C_SDKPlayer *pAvoidPlayer = apNearby[i];
 		// Is the avoid player me?
 		if ( pAvoidPlayer == this )
 			continue;
 
-		// Save as list to check against for objects.
-		pAvoidPlayerList[nAvoidPlayerCount] = pAvoidPlayer;
-		++nAvoidPlayerCount;
-
-		// Check to see if the avoid player is dormant.
-		if ( pAvoidPlayer->IsDormant() )
+		if ( pAvoidPlayer->GetTeam() != pTeam )
 			continue;
 
 		// Is the avoid player solid?
@@ -2001,7 +2049,11 @@ bool C_SDKPlayer::CreateMove( float flInputSampleTime, CUserCmd *pCmd )
 
 	BaseClass::CreateMove( flInputSampleTime, pCmd );
 
+	CFastTimer oTimer;
+	oTimer.Start();
 	AvoidPlayers( pCmd );
+	oTimer.End();
+	PlayerProximity().AddFrameTime( PROXIMITY_TIME_AVOID, oTimer );
 
 	return true;
 }
@@ -284,6 +284,7 @@ public:
 	virtual void	UpdateTeamMenu( void );
 
 	float			GetCurrentTime() const { return m_flCurrentTime; }
+	float			GetNetworkedCurrentTime() const;	// The server's m_flCurrentTime as of the last packet
 
 	float           GetLastSpawnTime() const { return m_flLastSpawnTime; }
 
@@ -378,6 +379,7 @@ private:
 	float m_flLastSlowMoMultiplier;
 
 	CNetworkVar( float, m_flCurrentTime );		// Accounts for slow motion
+	int m_iCurrentTimeLag;		// Milliseconds m_flCurrentTime is behind the server's tick, see SendProxy_PlayerCurrentTime
 
 	CNetworkVar( float, m_flLastSpawnTime );
 
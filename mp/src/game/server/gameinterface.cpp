@@ -129,6 +129,10 @@ extern ConVar tf_mm_servermode;
 #include "replay/ireplaysystem.h"
 #endif
 
+#ifdef SDK_DLL
+#include "sdk_playeranimstate.h"
+#endif
+
 extern IToolFrameworkServer *g_pToolFrameworkServer;
 extern IParticleSystemQuery *g_pParticleSystemQuery;
 
@@ -1242,6 +1246,11 @@ void CServerGameDLL::GameFrame( bool simulating )
 	g_pServerBenchmark->UpdateBenchmark();
 
 	Physics_RunThinkFunctions( simulating );
+
+#ifdef SDK_DLL
+	// Player pose parameters left for the job pool, before lag compensation records them.
+	CSDKPlayerAnimState::FinishAllPoseUpdates();
+#endif
 	
 	IGameSystem::FrameUpdatePostEntityThinkAllSystems();
 
@@ -22,6 +22,9 @@ enum { MAX_NAV_TEAMS = 2 };
 class CFuncElevator;
 class CFuncNavPrerequisite;
 class CFuncNavCost;
+class CNavPackedWriter;
+class CNavPackedReader;
+struct NavPackedArea;
 
 class CNavVectorNoEditAllocator
 {
@@ -275,6 +278,9 @@ public:
 	virtual NavErrorType Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion );		// (EXTEND)
 	virtual NavErrorType PostLoad( void );								// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
 
+	void SavePacked( CNavPackedWriter &writer ) const;					// store the loaded area in a packed nav file
+	NavErrorType LoadPacked( const CNavPackedReader &reader, const NavPackedArea &packed );	// load from a packed nav file, in place of Load() and PostLoad()
+
 	virtual void SaveToSelectedSet( KeyValues *areaKey ) const;		// (EXTEND) saves attributes for the area to a KeyValues
 	virtual void RestoreFromSelectedSet( KeyValues *areaKey );		// (EXTEND) restores attributes from a KeyValues
 
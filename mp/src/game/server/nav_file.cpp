@@ -29,6 +29,8 @@
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
 
+extern ConVar nav_load_packed;
+
 
 //--------------------------------------------------------------------------------------------------------------
 /// The current version of the nav file format
@@ -1385,6 +1387,22 @@ const CUtlVector< Place > *CNavMesh::GetPlacesFromNavFile( bool *hasUnnamedPlace
  * Load AI navigation data from a file
  */
 NavErrorType CNavMesh::Load( void )
+{
+	// the packed copy is only used while it's up to date with the .nav file, so that is always the one to edit
+	if ( nav_load_packed.GetBool() && LoadPacked() == NAV_OK )
+	{
+		return NAV_OK;
+	}
+
+	return LoadNavFile();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load AI navigation data from the .nav file
+ */
+NavErrorType CNavMesh::LoadNavFile( void )
 {
 	MDLCACHE_CRITICAL_SECTION();
 
@@ -17,6 +17,9 @@
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "tier1/utlhash.h"
+#include "tier1/generichash.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -3370,6 +3373,188 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * With nav_generate_threaded, the traces for every step the sampler can take are run on worker
+ * threads first, in waves outward from the position SampleStep is at. SampleStep then builds the
+ * node graph from the results in its usual order, so the nodes match sampling on the main thread.
+ */
+ConVar nav_generate_threaded( "nav_generate_threaded", "0", FCVAR_CHEAT, "Trace walkable space on worker threads when generating. Blocks the server until sampling is done." );
+
+struct NavSamplePoint
+{
+	Vector pos;
+	NavSampleStep steps[ NUM_DIRECTIONS ];
+	NavCrouchSample crouch;
+	NavSamplePoint *nextAtXY;
+};
+
+class CNavSamplePointHashFuncs
+{
+public:
+	CNavSamplePointHashFuncs( int ) {}
+
+	bool operator()( const NavSamplePoint *pLhs, const NavSamplePoint *pRhs ) const
+	{
+		return pRhs->pos.AsVector2D() == pLhs->pos.AsVector2D();
+	}
+
+	unsigned int operator()( const NavSamplePoint *pItem ) const
+	{
+		return Hash8( &pItem->pos.AsVector2D() );
+	}
+};
+
+static CUtlHash< NavSamplePoint *, CNavSamplePointHashFuncs, CNavSamplePointHashFuncs > *s_pNavSampleHash = NULL;
+static CUtlVector< NavSamplePoint * > s_navSamplePoints;
+static int s_navSampleWaves = 0;
+static double s_navSampleTime = 0.0;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the sampled position at pos with a Z within tolerance, or NULL
+ */
+static NavSamplePoint *FindSamplePoint( const Vector &pos, float tolerance )
+{
+	if ( !s_pNavSampleHash )
+		return NULL;
+
+	static NavSamplePoint lookup;
+	lookup.pos = pos;
+	UtlHashHandle_t hPoint = s_pNavSampleHash->Find( &lookup );
+	if ( hPoint == s_pNavSampleHash->InvalidHandle() )
+		return NULL;
+
+	for ( NavSamplePoint *point = s_pNavSampleHash->Element( hPoint ); point; point = point->nextAtXY )
+	{
+		if ( fabs( point->pos.z - pos.z ) <= tolerance )
+			return point;
+	}
+
+	return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static NavSamplePoint *AddSamplePoint( const Vector &pos )
+{
+	if ( !s_pNavSampleHash )
+	{
+		s_pNavSampleHash = new CUtlHash< NavSamplePoint *, CNavSamplePointHashFuncs, CNavSamplePointHashFuncs >( 16*1024 );
+	}
+
+	NavSamplePoint *point = new NavSamplePoint;
+	point->pos = pos;
+
+	bool bDidInsert;
+	UtlHashHandle_t hPoint = s_pNavSampleHash->Insert( point, &bDidInsert );
+	if ( !bDidInsert )
+	{
+		point->nextAtXY = s_pNavSampleHash->Element( hPoint );
+		s_pNavSampleHash->Element( hPoint ) = point;
+	}
+	else
+	{
+		point->nextAtXY = NULL;
+	}
+
+	s_navSamplePoints.AddToTail( point );
+	return point;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void ReleaseSamplePoints( void )
+{
+	if ( s_navSamplePoints.Count() )
+	{
+		Msg( "Traced %d sample positions in %d waves on %d threads, %.2f seconds.\n", s_navSamplePoints.Count(), s_navSampleWaves, g_pThreadPool->NumThreads() + 1, s_navSampleTime );
+	}
+
+	s_navSamplePoints.PurgeAndDeleteElements();
+
+	delete s_pNavSampleHash;
+	s_pNavSampleHash = NULL;
+
+	s_navSampleWaves = 0;
+	s_navSampleTime = 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::TraceSamplePoint( NavSamplePoint *&point )
+{
+	for ( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+	{
+		TraceSampleStep( point->pos, (NavDirType)dir, &point->steps[ dir ] );
+	}
+
+	CNavNode::SampleCrouch( point->pos, 0, &point->crouch );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace every step that can be reached from pos and hasn't been traced yet, a wave of positions
+ * at a time on the thread pool. Nodes aren't touched, SampleStep adds them from the results.
+ */
+void CNavMesh::SampleWalkableSpaceFrom( const Vector &pos )
+{
+	double startTime = Plat_FloatTime();
+
+	// SampleStep needs this exact position, even if a position close to it was traced
+	CUtlVector< NavSamplePoint * > wave, nextWave;
+	wave.AddToTail( AddSamplePoint( pos ) );
+
+	// positions this close to one already traced would become the same node, see CNavNode::GetNode()
+	const float tolerance = 0.45f * GenerationStepSize;
+
+	while ( wave.Count() )
+	{
+		ParallelProcess( "CNavMesh::SampleWalkableSpaceFrom", wave.Base(), wave.Count(), this, &CNavMesh::TraceSamplePoint );
+		++s_navSampleWaves;
+
+		nextWave.RemoveAll();
+
+		FOR_EACH_VEC( wave, it )
+		{
+			for ( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+			{
+				const NavSampleStep &step = wave[ it ]->steps[ dir ];
+				if ( !step.isValid )
+					continue;
+
+				if ( FindSamplePoint( step.to, tolerance ) )
+					continue;
+
+				nextWave.AddToTail( AddSamplePoint( step.to ) );
+			}
+		}
+
+		wave.Swap( nextWave );
+	}
+
+	s_navSampleTime += Plat_FloatTime() - startTime;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+const NavSamplePoint *CNavMesh::GetSamplePoint( const Vector &pos )
+{
+	NavSamplePoint *point = FindSamplePoint( pos, 0.0f );
+	if ( !point )
+	{
+		SampleWalkableSpaceFrom( pos );
+
+		point = FindSamplePoint( pos, 0.0f );
+		Assert( point );
+	}
+
+	return point;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 // adds walkable positions for any/all positions a mod specifies
 void CNavMesh::AddWalkableSeeds( void )
@@ -3431,6 +3616,7 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	// clear any previous mesh
 	DestroyNavigationMesh( incremental );
+	ReleaseSamplePoints();
 
 	SetNavPlace( UNDEFINED_PLACE );
 
@@ -3630,9 +3816,12 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
 			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
 
+			// threaded sampling is done offline, in one go
+			bool isThreaded = nav_generate_threaded.GetBool();
+
 			while ( SampleStep() )
 			{
-				if ( Plat_FloatTime() - startTime > maxTime )
+				if ( !isThreaded && Plat_FloatTime() - startTime > maxTime )
 				{
 					return true;
 				}
@@ -3640,6 +3829,9 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 
 			Assert(m_seedIdx == m_walkableSeeds.Count());
 
+			float sampleTime = Plat_FloatTime() - m_generationStartTime;
+			Msg( "Sampled %d nodes in %0.1f seconds (%0.0f nodes/sec).\n", CNavNode::GetListLength(), sampleTime, CNavNode::GetListLength() / MAX( sampleTime, 0.001f ) );
+
 			// sampling is complete, now build nav areas
 			m_generationState = CREATE_AREAS_FROM_SAMPLES;
 
@@ -4109,7 +4301,14 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		m_currentNode = node;
 	}
 
-	node->CheckCrouch();
+	if ( nav_generate_threaded.GetBool() )
+	{
+		node->ApplyCrouch( GetSamplePoint( *node->GetPosition() )->crouch );
+	}
+	else
+	{
+		node->CheckCrouch();
+	}
 
 	// determine if there's a cliff nearby and set an attribute on this node
 	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
@@ -4332,6 +4531,235 @@ static bool IsNodeOverlapped( const Vector& pos, const Vector& offset )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run the traces for one sampling step from the given position in the given direction.
+ * This only reads the world and the existing nav areas, so it is safe to run on worker threads
+ * while sampling, see SampleWalkableSpaceFrom().
+ */
+void CNavMesh::TraceSampleStep( const Vector &from, NavDirType dir, NavSampleStep *step ) const
+{
+	step->isValid = false;
+
+	// start at the given position
+	Vector pos = from;
+
+	// snap to grid
+	int cx = SnapToGrid( pos.x );
+	int cy = SnapToGrid( pos.y );
+
+	// attempt to move to adjacent node
+	switch( dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
+
+	pos.x = cx;
+	pos.y = cy;
+
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to, toNormal;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
+				}
+
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
+
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
+
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
+				{
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
+					{
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
+						{
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
+							{
+								obstacleEndDist = GenerationStepSize;
+							}
+						}								
+					}
+				}
+			}
+		}
+
+		if ( !success )
+		{
+			return;
+		}
+	}
+
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return;
+	}
+
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
+			}
+		}
+
+		if ( !bValid )
+			return;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
+				{
+					return;
+				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - from.z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
+
+	step->isValid = true;
+	step->to = to;
+	step->toNormal = toNormal;
+	step->isOnDisplacement = isOnDisplacement;
+	step->obstacleHeight = obstacleHeight;
+	step->obstacleStartDist = obstacleStartDist;
+	step->obstacleEndDist = obstacleEndDist;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Search the world and build a map of possible movements.
@@ -4356,6 +4784,7 @@ bool CNavMesh::SampleStep( void )
 			{
 				if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
 				{
+					ReleaseSamplePoints();
 					return false;
 				}
 
@@ -4376,6 +4805,7 @@ bool CNavMesh::SampleStep( void )
 				if (m_currentNode == NULL)
 				{
 					// all seeds exhausted, sampling complete
+					ReleaseSamplePoints();
 					return false;
 				}
 			}
@@ -4390,224 +4820,30 @@ bool CNavMesh::SampleStep( void )
 			{
 				// have not searched in this direction yet
 
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
-
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
-
-				// attempt to move to adjacent node
-				switch( dir )
-				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
-				}
-
-				pos.x = cx;
-				pos.y = cy;
-
 				m_generationDir = (NavDirType)dir;
 
 				// mark direction as visited
 				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
-				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
-
-					if ( !inRange )
-					{
-						return true;
-					}
-				}
-
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
-
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to, toNormal;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
+				NavSampleStep tracedStep;
+				const NavSampleStep *step = &tracedStep;
+				if ( nav_generate_threaded.GetBool() )
 				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
+					step = &GetSamplePoint( *m_currentNode->GetPosition() )->steps[ m_generationDir ];
 				}
 				else
 				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
-
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
-
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
-
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
-
-					if ( !success )
-					{
-						return true;
-					}
-				}
-
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
+					TraceSampleStep( *m_currentNode->GetPosition(), m_generationDir, &tracedStep );
 				}
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+				if ( !step->isValid )
 				{
 					return true;
 				}
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
-
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
-
-					if ( !bValid )
-						return true;
-				}
-
-
-				bool isOnDisplacement = result.IsDispSurface();
-
-				if ( nav_displacement_test.GetInt() > 0 )
-				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
-					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
-						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
-							{
-								return true;
-							}
-						}
-					}
-				}
-
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
-				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
-				}
-
 				// we can move here
 				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+				AddNode( step->to, step->toNormal, m_generationDir, m_currentNode, step->isOnDisplacement, step->obstacleHeight, step->obstacleStartDist, step->obstacleEndDist );
 
 				return true;
 			}
@@ -14,6 +14,9 @@
 #include "nav.h"
 
 class CNavArea;
+class CNavPackedWriter;
+class CNavPackedReader;
+struct NavPackedLadder;
 
 //--------------------------------------------------------------------------------------------------------------
 /**
@@ -41,6 +44,8 @@ public:
 
 	void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;
 	void Load( CUtlBuffer &fileBuffer, unsigned int version );
+	void SavePacked( CNavPackedWriter &writer ) const;
+	void LoadPacked( const CNavPackedReader &reader, const NavPackedLadder &packed );
 
 	unsigned int GetID( void ) const	{ return m_id; }		///< return this ladder's unique ID
 	static void CompressIDs( void );							///<re-orders ladder ID's so they are continuous
@@ -484,6 +484,15 @@ void CNavMesh::AddNavArea( CNavArea *area )
 		}
 	}
 
+	IndexNavArea( area );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add an area to the ID hash table, for areas that are already in the grid
+ */
+void CNavMesh::IndexNavArea( CNavArea *area )
+{
 	// add to hash table
 	int key = ComputeHashKey( area->GetID() );
 
@@ -31,6 +31,8 @@
 class CNavArea;
 class CBaseEntity; 
 class CBreakable;
+struct NavSampleStep;
+struct NavSamplePoint;
 
 extern ConVar nav_edit;
 extern ConVar nav_quicksave;
@@ -272,6 +274,8 @@ public:
 	virtual void FireGameEvent( IGameEvent *event );					// incoming event processing
 
 	virtual NavErrorType Load( void );									// load navigation data from a file
+	NavErrorType LoadNavFile( void );									// load navigation data from the .nav file, ignoring any packed copy
+	NavErrorType LoadPacked( void );									// load navigation data from the packed copy of the .nav file, if it's up to date
 	virtual NavErrorType PostLoad( unsigned int version );				// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
 	bool IsLoaded( void ) const		{ return m_isLoaded; }				// return true if a Navigation Mesh has been loaded
 	bool IsAnalyzed( void ) const	{ return m_isAnalyzed; }			// return true if a Navigation Mesh has been analyzed
@@ -285,6 +289,8 @@ public:
 	const CUtlVector< Place > *GetPlacesFromNavFile( bool *hasUnnamedPlaces );	// Reads the used place names from the nav file (can be used to selectively precache before the nav is loaded)
 
 	virtual bool Save( void ) const;									// store Navigation Mesh to a file
+	bool SavePacked( void ) const;										// store the loaded Navigation Mesh to a packed nav file
+	unsigned int ComputeChecksum( void ) const;							// return a CRC of the loaded mesh, to compare the results of different loads
 	bool IsOutOfDate( void ) const	{ return m_isOutOfDate; }			// return true if the Navigation Mesh is older than the current map version
 
 	virtual unsigned int GetSubVersionNumber( void ) const;										// returns sub-version number of data format used by derived classes
@@ -1086,6 +1092,7 @@ private:
 	void GridToWorld( int gridX, int gridY, Vector *pos ) const;
 
 	void AddNavArea( CNavArea *area );							// add an area to the grid
+	void IndexNavArea( CNavArea *area );						// add an area to the ID hash table, but not the grid
 
 	void DestroyNavigationMesh( bool incremental = false );		// free all resources of the mesh and reset it to empty state
 	void DestroyHidingSpots( void );
@@ -1163,6 +1170,10 @@ private:
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	void TraceSampleStep( const Vector &from, NavDirType dir, NavSampleStep *step ) const;	// run the traces for a step from the given position, without touching the nodes
+	void SampleWalkableSpaceFrom( const Vector &pos );			// trace every step reachable from pos on worker threads, ahead of SampleStep
+	const NavSamplePoint *GetSamplePoint( const Vector &pos );	// return the traced steps from pos, sampling from it first if they aren't known yet
+	void TraceSamplePoint( NavSamplePoint *&point );
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
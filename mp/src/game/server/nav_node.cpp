@@ -275,12 +275,12 @@ float CNavNode::GetGroundHeightAboveNode( NavCornerType cornerType ) const
 /**
  * Look up to JumpCrouchHeight in the air to see if we can fit a whole HumanHeight box
  */
-bool CNavNode::TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, const Vector& maxs, float *groundHeightAboveNode )
+bool CNavNode::TestForCrouchArea( const Vector &pos, unsigned int id, NavCornerType cornerNum, const Vector& mins, const Vector& maxs, float *groundHeightAboveNode, bool *isBlocked )
 {
 	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_PLAYER_MOVEMENT, WALK_THRU_EVERYTHING );
 	trace_t tr;
 
-	Vector start( m_pos );
+	Vector start( pos );
 	Vector end( start );
 	end.z += JumpCrouchHeight;
 	UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, MASK_NPCSOLID_BRUSHONLY, &filter, &tr );
@@ -291,14 +291,14 @@ bool CNavNode::TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, c
 
 	for ( float height = 0; height <= maxHeight; height += 1.0f )
 	{
-		start = m_pos;
+		start = pos;
 		start.z += height;
 
 		realMaxs.z = HumanCrouchHeight;
 		UTIL_TraceHull( start, start, mins, realMaxs, MASK_NPCSOLID_BRUSHONLY, &filter, &tr );
 		if ( !tr.startsolid )
 		{
-			*groundHeightAboveNode = start.z - m_pos.z;
+			*groundHeightAboveNode = start.z - pos.z;
 
 			// We found a crouch-sized space.  See if we can stand up.
 			realMaxs.z = HumanHeight;
@@ -307,7 +307,7 @@ bool CNavNode::TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, c
 			{
 				// We found a crouch-sized space.  See if we can stand up.
 #if DEBUG_NAV_NODES
-				if ( (unsigned int)(nav_test_node_crouch.GetInt()) == GetID() )
+				if ( id && (unsigned int)(nav_test_node_crouch.GetInt()) == id )
 				{
 					NDebugOverlay::Box( start, mins, maxs, 0, 255, 255, 100, 100 );
 				}
@@ -315,7 +315,7 @@ bool CNavNode::TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, c
 				return true;
 			}
 #if DEBUG_NAV_NODES
-			if ( (unsigned int)(nav_test_node_crouch.GetInt()) == GetID() )
+			if ( id && (unsigned int)(nav_test_node_crouch.GetInt()) == id )
 			{
 				NDebugOverlay::Box( start, mins, maxs, 255, 0, 0, 100, 100 );
 			}
@@ -326,17 +326,31 @@ bool CNavNode::TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, c
 	}
 
 	*groundHeightAboveNode = JumpCrouchHeight;
-	m_isBlocked[ cornerNum ] = true;
+	*isBlocked = true;
 	return false;
 }
 
 
 //--------------------------------------------------------------------------------------------------------------
 void CNavNode::CheckCrouch( void )
+{
+	NavCrouchSample sample;
+	SampleCrouch( m_pos, m_id, &sample );
+	ApplyCrouch( sample );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavNode::SampleCrouch( const Vector &pos, unsigned int id, NavCrouchSample *sample )
 {
 	// For each direction, trace upwards from our best ground height to VEC_HULL_MAX.z to see if we have standing room.
 	for ( int i=0; i<NUM_CORNERS; ++i )
 	{
+		sample->isTested[i] = false;
+		sample->isBlocked[i] = false;
+		sample->isCrouch[i] = false;
+		sample->groundHeightAboveNode[i] = 0.0f;
+
 #if DEBUG_NAV_NODES
 		if ( nav_test_node_crouch_dir.GetInt() != NUM_CORNERS && i != nav_test_node_crouch_dir.GetInt() )
 			continue;
@@ -378,10 +392,31 @@ void CNavNode::CheckCrouch( void )
 			}
 		}
 
-		if ( !TestForCrouchArea( corner, mins, maxs, &m_groundHeightAboveNode[i] ) )
+		sample->isTested[i] = true;
+		sample->isCrouch[i] = !TestForCrouchArea( pos, id, corner, mins, maxs, &sample->groundHeightAboveNode[i], &sample->isBlocked[i] );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavNode::ApplyCrouch( const NavCrouchSample &sample )
+{
+	for ( int i=0; i<NUM_CORNERS; ++i )
+	{
+		if ( !sample.isTested[i] )
+			continue;
+
+		m_groundHeightAboveNode[i] = sample.groundHeightAboveNode[i];
+
+		if ( sample.isBlocked[i] )
+		{
+			m_isBlocked[i] = true;
+		}
+
+		if ( sample.isCrouch[i] )
 		{
 			SetAttributes( NAV_MESH_CROUCH );
-			m_crouch[corner] = true;
+			m_crouch[i] = true;
 		}
 	}
 }
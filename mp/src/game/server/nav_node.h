@@ -18,6 +18,34 @@
 // nav_show_node_id allows you to show the IDs of nodes that didn't get used to create areas.
 #define DEBUG_NAV_NODES 1
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The result of the crouch traces for a node position, see CNavNode::CheckCrouch().
+ * These only depend on the position, so they can be traced before the node exists.
+ */
+struct NavCrouchSample
+{
+	bool isTested[ NUM_CORNERS ];
+	bool isBlocked[ NUM_CORNERS ];
+	bool isCrouch[ NUM_CORNERS ];
+	float groundHeightAboveNode[ NUM_CORNERS ];
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The result of the traces for one sampling step from a node position, see CNavMesh::SampleStep().
+ */
+struct NavSampleStep
+{
+	bool isValid;													///< false if no node is added in this direction
+	Vector to;														///< ground position of the node to add
+	Vector toNormal;
+	bool isOnDisplacement;
+	float obstacleHeight;
+	float obstacleStartDist;
+	float obstacleEndDist;
+};
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Navigation Nodes.
@@ -69,7 +97,9 @@ private:
 	CNavNode() {}													// constructor used only for hash lookup
 	friend class CNavMesh;
 
-	bool TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, const Vector& maxs, float *groundHeightAboveNode );
+	static bool TestForCrouchArea( const Vector &pos, unsigned int id, NavCornerType cornerNum, const Vector& mins, const Vector& maxs, float *groundHeightAboveNode, bool *isBlocked );
+	static void SampleCrouch( const Vector &pos, unsigned int id, NavCrouchSample *sample );	///< run the crouch traces for a node at pos, id is only used for debug drawing
+	void ApplyCrouch( const NavCrouchSample &sample );
 	void CheckCrouch( void );
 
 	Vector m_pos;													///< position of this node in the world
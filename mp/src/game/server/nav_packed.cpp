@@ -0,0 +1,1215 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_packed.cpp
+// Reading and writing packed nav files
+
+#include "cbase.h"
+#include "filesystem.h"
+#include "nav_mesh.h"
+#include "nav_packed.h"
+#include "gamerules.h"
+#include "datacache/imdlcache.h"
+#include "checksum_crc.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+ConVar nav_load_packed( "nav_load_packed", "1", FCVAR_GAMEDLL, "Load the Navigation Mesh from the map's packed nav file (see nav_convert_packed) when it is up to date with the .nav file." );
+
+extern char *GetBspFilename( const char *navFilename );
+
+#if defined( _X360 )
+	#define FORMAT_PACKEDNAVFILE "maps\\%s.360.pnav"
+#else
+	#define FORMAT_PACKEDNAVFILE "maps\\%s.pnav"
+#endif
+
+/// Size of one element of each lump, in NavPackedLumpType order
+static const unsigned int s_lumpElementSize[ NAV_PACKED_LUMP_COUNT ] =
+{
+	sizeof( NavPackedPlace ),
+	sizeof( NavPackedArea ),
+	sizeof( NavPackedConnect ),
+	sizeof( unsigned int ),
+	sizeof( NavPackedHidingSpot ),
+	sizeof( unsigned int ),
+	sizeof( NavPackedEncounter ),
+	sizeof( NavPackedSpotOrder ),
+	sizeof( NavPackedAreaBind ),
+	sizeof( NavPackedLadder ),
+	sizeof( NavPackedRange ),
+	sizeof( unsigned int ),
+};
+
+// the lumps are used in place, so every element has to keep the next one 4 byte aligned
+COMPILE_TIME_ASSERT( sizeof( NavPackedHeader ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedPlace ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedArea ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedConnect ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedHidingSpot ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedEncounter ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedSpotOrder ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedAreaBind ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedLadder ) % 4 == 0 );
+COMPILE_TIME_ASSERT( sizeof( NavPackedRange ) % 4 == 0 );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the game relative filenames of this map's packed nav file, and of the .nav file it is converted from
+ */
+static void GetPackedFilenames( char *filename, char *navFilename, int size )
+{
+	Q_snprintf( filename, size, FORMAT_PACKEDNAVFILE, STRING( gpGlobals->mapname ) );
+
+	Q_StripExtension( filename, navFilename, size );
+	Q_strncat( navFilename, ".nav", size, COPY_ALL_CHARACTERS );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPackedWriter::CNavPackedWriter( void ) : m_index( DefLessFunc( const void * ) )
+{
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		m_index.Insert( TheNavAreas[ it ], it );
+	}
+
+	FOR_EACH_VEC( TheHidingSpots, it )
+	{
+		m_index.Insert( TheHidingSpots[ it ], it );
+	}
+
+	for ( int i=0; i<TheNavMesh->GetLadders().Count(); ++i )
+	{
+		m_index.Insert( TheNavMesh->GetLadders()[i], i );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+unsigned int CNavPackedWriter::GetAreaIndex( const CNavArea *area ) const
+{
+	int it = m_index.Find( area );
+	return ( it == m_index.InvalidIndex() ) ? NAV_PACKED_NONE : m_index[ it ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+unsigned int CNavPackedWriter::GetHidingSpotIndex( const HidingSpot *spot ) const
+{
+	int it = m_index.Find( spot );
+	return ( it == m_index.InvalidIndex() ) ? NAV_PACKED_NONE : m_index[ it ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+unsigned int CNavPackedWriter::GetLadderIndex( const CNavLadder *ladder ) const
+{
+	int it = m_index.Find( ladder );
+	return ( it == m_index.InvalidIndex() ) ? NAV_PACKED_NONE : m_index[ it ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Places are stored by name, since place IDs depend on the order of the place database
+ */
+unsigned int CNavPackedWriter::GetPlaceIndex( Place place )
+{
+	if ( place == UNDEFINED_PLACE )
+		return 0;
+
+	int index = m_placeIDs.Find( place );
+	if ( index == m_placeIDs.InvalidIndex() )
+	{
+		index = m_placeIDs.AddToTail( place );
+
+		NavPackedPlace &name = m_places[ m_places.AddToTail() ];
+		const char *placeName = TheNavMesh->PlaceToName( place );
+		Q_strncpy( name.name, placeName ? placeName : "", sizeof( name.name ) );
+	}
+
+	return 1 + index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+NavPackedRange CNavPackedWriter::AddConnections( const NavConnectVector &connections )
+{
+	NavPackedRange range;
+	range.first = m_connections.Count();
+	range.count = connections.Count();
+
+	FOR_EACH_VEC( connections, it )
+	{
+		NavPackedConnect &connect = m_connections[ m_connections.AddToTail() ];
+		connect.area = GetAreaIndex( connections[ it ].area );
+		connect.length = connections[ it ].length;
+	}
+
+	return range;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPackedWriter::Write( CUtlBuffer &fileBuffer, NavPackedHeader &header ) const
+{
+	const void *lumpData[ NAV_PACKED_LUMP_COUNT ] =
+	{
+		m_places.Base(),
+		m_areas.Base(),
+		m_connections.Base(),
+		m_ladderConnections.Base(),
+		m_hidingSpots.Base(),
+		m_areaHidingSpots.Base(),
+		m_encounters.Base(),
+		m_encounterSpots.Base(),
+		m_visibleAreas.Base(),
+		m_ladders.Base(),
+		m_gridCells.Base(),
+		m_gridAreas.Base(),
+	};
+
+	const int lumpCount[ NAV_PACKED_LUMP_COUNT ] =
+	{
+		m_places.Count(),
+		m_areas.Count(),
+		m_connections.Count(),
+		m_ladderConnections.Count(),
+		m_hidingSpots.Count(),
+		m_areaHidingSpots.Count(),
+		m_encounters.Count(),
+		m_encounterSpots.Count(),
+		m_visibleAreas.Count(),
+		m_ladders.Count(),
+		m_gridCells.Count(),
+		m_gridAreas.Count(),
+	};
+
+	// lumps follow the header back to back
+	unsigned int offset = sizeof( NavPackedHeader );
+	for ( int i=0; i<NAV_PACKED_LUMP_COUNT; ++i )
+	{
+		header.lumps[i].offset = offset;
+		header.lumps[i].count = lumpCount[i];
+		offset += lumpCount[i] * s_lumpElementSize[i];
+	}
+
+	fileBuffer.EnsureCapacity( offset );
+	fileBuffer.Put( &header, sizeof( header ) );
+
+	for ( int i=0; i<NAV_PACKED_LUMP_COUNT; ++i )
+	{
+		if ( lumpCount[i] )
+		{
+			fileBuffer.Put( lumpData[i], lumpCount[i] * s_lumpElementSize[i] );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Check the header and that every lump lies within the file, the lump contents are checked as they are used
+ */
+CNavPackedReader::CNavPackedReader( const CUtlBuffer &fileBuffer )
+{
+	m_base = (const unsigned char *)fileBuffer.Base();
+	m_header = NULL;
+	m_isCorrupt = false;
+
+	unsigned int size = fileBuffer.TellPut();
+	if ( m_base == NULL || size < sizeof( NavPackedHeader ) )
+		return;
+
+	const NavPackedHeader *header = (const NavPackedHeader *)m_base;
+	if ( header->magic != NAV_PACKED_MAGIC_NUMBER || header->version != NavPackedVersion )
+		return;
+
+	for ( int i=0; i<NAV_PACKED_LUMP_COUNT; ++i )
+	{
+		const NavPackedLump &lump = header->lumps[i];
+		if ( lump.offset % 4 || lump.offset > size || lump.count > ( size - lump.offset ) / s_lumpElementSize[i] )
+			return;
+	}
+
+	m_header = header;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavPackedReader::IsValidRange( NavPackedLumpType type, const NavPackedRange &range ) const
+{
+	unsigned int count = GetCount( type );
+	return range.first <= count && range.count <= count - range.first;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavArea *CNavPackedReader::GetArea( unsigned int index ) const
+{
+	if ( index == NAV_PACKED_NONE )
+		return NULL;
+
+	if ( index >= (unsigned int)m_areas.Count() )
+	{
+		m_isCorrupt = true;
+		return NULL;
+	}
+
+	return m_areas[ index ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+HidingSpot *CNavPackedReader::GetHidingSpot( unsigned int index ) const
+{
+	if ( index == NAV_PACKED_NONE )
+		return NULL;
+
+	if ( index >= (unsigned int)m_hidingSpots.Count() )
+	{
+		m_isCorrupt = true;
+		return NULL;
+	}
+
+	return m_hidingSpots[ index ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavLadder *CNavPackedReader::GetLadder( unsigned int index ) const
+{
+	if ( index == NAV_PACKED_NONE )
+		return NULL;
+
+	if ( index >= (unsigned int)m_ladders.Count() )
+	{
+		m_isCorrupt = true;
+		return NULL;
+	}
+
+	return m_ladders[ index ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+Place CNavPackedReader::GetPlace( unsigned int index ) const
+{
+	if ( index == 0 )
+		return UNDEFINED_PLACE;
+
+	if ( index > (unsigned int)m_places.Count() )
+	{
+		m_isCorrupt = true;
+		return UNDEFINED_PLACE;
+	}
+
+	return m_places[ index-1 ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the area as it is after PostLoad(), with pointers as array indices
+ */
+void CNavArea::SavePacked( CNavPackedWriter &writer ) const
+{
+	NavPackedArea packed;
+
+	packed.id = m_id;
+	packed.attributeFlags = m_attributeFlags;
+	packed.nwCorner = m_nwCorner;
+	packed.seCorner = m_seCorner;
+	packed.neZ = m_neZ;
+	packed.swZ = m_swZ;
+	packed.place = writer.GetPlaceIndex( m_place );
+	packed.isUnderwater = m_isUnderwater;
+
+	for( int i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		packed.earliestOccupyTime[i] = m_earliestOccupyTime[i];
+	}
+
+	for ( int i=0; i<NUM_CORNERS; ++i )
+	{
+		packed.lightIntensity[i] = m_lightIntensity[i];
+	}
+
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		packed.connect[d] = writer.AddConnections( m_connect[d] );
+		packed.incomingConnect[d] = writer.AddConnections( m_incomingConnect[d] );
+	}
+
+	for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+	{
+		packed.ladder[dir].first = writer.m_ladderConnections.Count();
+		packed.ladder[dir].count = m_ladder[dir].Count();
+
+		FOR_EACH_VEC( m_ladder[dir], it )
+		{
+			writer.m_ladderConnections.AddToTail( writer.GetLadderIndex( m_ladder[dir][it].ladder ) );
+		}
+	}
+
+	packed.hidingSpots.first = writer.m_areaHidingSpots.Count();
+	packed.hidingSpots.count = m_hidingSpots.Count();
+
+	FOR_EACH_VEC( m_hidingSpots, it )
+	{
+		writer.m_areaHidingSpots.AddToTail( writer.GetHidingSpotIndex( m_hidingSpots[ it ] ) );
+	}
+
+	packed.spotEncounters.first = writer.m_encounters.Count();
+	packed.spotEncounters.count = m_spotEncounters.Count();
+
+	FOR_EACH_VEC( m_spotEncounters, it )
+	{
+		const SpotEncounter *e = m_spotEncounters[ it ];
+
+		NavPackedEncounter encounter;
+		encounter.from = writer.GetAreaIndex( e->from.area );
+		encounter.fromDir = e->fromDir;
+		encounter.to = writer.GetAreaIndex( e->to.area );
+		encounter.toDir = e->toDir;
+		encounter.pathFrom = e->path.from;
+		encounter.pathTo = e->path.to;
+		encounter.spots.first = writer.m_encounterSpots.Count();
+		encounter.spots.count = e->spots.Count();
+
+		FOR_EACH_VEC( e->spots, sit )
+		{
+			NavPackedSpotOrder &order = writer.m_encounterSpots[ writer.m_encounterSpots.AddToTail() ];
+			order.spot = writer.GetHidingSpotIndex( e->spots[ sit ].spot );
+			order.t = e->spots[ sit ].t;
+		}
+
+		writer.m_encounters.AddToTail( encounter );
+	}
+
+	packed.potentiallyVisibleAreas.first = writer.m_visibleAreas.Count();
+	packed.potentiallyVisibleAreas.count = m_potentiallyVisibleAreas.Count();
+
+	for ( int it=0; it<m_potentiallyVisibleAreas.Count(); ++it )
+	{
+		NavPackedAreaBind &info = writer.m_visibleAreas[ writer.m_visibleAreas.AddToTail() ];
+		info.area = writer.GetAreaIndex( m_potentiallyVisibleAreas[ it ].area );
+		info.attributes = m_potentiallyVisibleAreas[ it ].attributes;
+	}
+
+	packed.inheritVisibilityFrom = writer.GetAreaIndex( m_inheritVisibilityFrom.area );
+
+	writer.m_areas.AddToTail( packed );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Fill in a list of connections from a range of the connection lump
+ */
+static void LoadPackedConnections( const CNavPackedReader &reader, const NavPackedRange &range, NavConnectVector *connections )
+{
+	if ( !reader.IsValidRange( NAV_PACKED_LUMP_CONNECTIONS, range ) )
+	{
+		reader.SetCorrupt();
+		return;
+	}
+
+	const NavPackedConnect *packed = reader.GetLump< NavPackedConnect >( NAV_PACKED_LUMP_CONNECTIONS ) + range.first;
+
+	connections->EnsureCapacity( range.count );
+	for( unsigned int i=0; i<range.count; ++i )
+	{
+		NavConnect connect;
+		connect.area = reader.GetArea( packed[i].area );
+		connect.length = packed[i].length;
+
+		if ( connect.area == NULL )
+		{
+			reader.SetCorrupt();
+			continue;
+		}
+
+		connections->AddToTail( connect );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the area from a packed nav file. All the areas, hiding spots and ladders of the mesh already
+ * exist, so everything is bound as it's read and there's nothing left for PostLoad() to do.
+ * Bad indices are noted in the reader.
+ */
+NavErrorType CNavArea::LoadPacked( const CNavPackedReader &reader, const NavPackedArea &packed )
+{
+	m_id = packed.id;
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_attributeFlags = packed.attributeFlags;
+
+	m_nwCorner = packed.nwCorner;
+	m_seCorner = packed.seCorner;
+
+	m_center.x = (m_nwCorner.x + m_seCorner.x)/2.0f;
+	m_center.y = (m_nwCorner.y + m_seCorner.y)/2.0f;
+	m_center.z = (m_nwCorner.z + m_seCorner.z)/2.0f;
+
+	if ( ( m_seCorner.x - m_nwCorner.x ) > 0.0f && ( m_seCorner.y - m_nwCorner.y ) > 0.0f )
+	{
+		m_invDxCorners = 1.0f / ( m_seCorner.x - m_nwCorner.x );
+		m_invDyCorners = 1.0f / ( m_seCorner.y - m_nwCorner.y );
+	}
+	else
+	{
+		m_invDxCorners = m_invDyCorners = 0;
+	}
+
+	m_neZ = packed.neZ;
+	m_swZ = packed.swZ;
+
+	m_isUnderwater = packed.isUnderwater != 0;
+
+	SetPlace( reader.GetPlace( packed.place ) );
+
+	for( int i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		m_earliestOccupyTime[i] = packed.earliestOccupyTime[i];
+	}
+
+	for ( int i=0; i<NUM_CORNERS; ++i )
+	{
+		m_lightIntensity[i] = packed.lightIntensity[i];
+	}
+
+	// connections come with their lengths, and the one-way links into this area are already found
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		LoadPackedConnections( reader, packed.connect[d], &m_connect[d] );
+		LoadPackedConnections( reader, packed.incomingConnect[d], &m_incomingConnect[d] );
+	}
+
+	for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+	{
+		const NavPackedRange &range = packed.ladder[dir];
+		if ( !reader.IsValidRange( NAV_PACKED_LUMP_LADDER_CONNECTIONS, range ) )
+		{
+			reader.SetCorrupt();
+			continue;
+		}
+
+		const unsigned int *ladder = reader.GetLump< unsigned int >( NAV_PACKED_LUMP_LADDER_CONNECTIONS ) + range.first;
+
+		m_ladder[dir].EnsureCapacity( range.count );
+		for( unsigned int i=0; i<range.count; ++i )
+		{
+			NavLadderConnect connect;
+			connect.ladder = reader.GetLadder( ladder[i] );
+
+			if ( connect.ladder == NULL )
+			{
+				reader.SetCorrupt();
+				continue;
+			}
+
+			m_ladder[dir].AddToTail( connect );
+		}
+	}
+
+	if ( reader.IsValidRange( NAV_PACKED_LUMP_AREA_HIDING_SPOTS, packed.hidingSpots ) )
+	{
+		const unsigned int *spot = reader.GetLump< unsigned int >( NAV_PACKED_LUMP_AREA_HIDING_SPOTS ) + packed.hidingSpots.first;
+
+		m_hidingSpots.EnsureCapacity( packed.hidingSpots.count );
+		for( unsigned int i=0; i<packed.hidingSpots.count; ++i )
+		{
+			HidingSpot *hidingSpot = reader.GetHidingSpot( spot[i] );
+			if ( hidingSpot )
+			{
+				m_hidingSpots.AddToTail( hidingSpot );
+			}
+		}
+	}
+	else
+	{
+		reader.SetCorrupt();
+	}
+
+	// encounter paths were computed from the portals when the .nav file was loaded
+	if ( reader.IsValidRange( NAV_PACKED_LUMP_ENCOUNTERS, packed.spotEncounters ) )
+	{
+		const NavPackedEncounter *encounter = reader.GetLump< NavPackedEncounter >( NAV_PACKED_LUMP_ENCOUNTERS ) + packed.spotEncounters.first;
+		const NavPackedSpotOrder *spots = reader.GetLump< NavPackedSpotOrder >( NAV_PACKED_LUMP_ENCOUNTER_SPOTS );
+
+		m_spotEncounters.EnsureCapacity( packed.spotEncounters.count );
+		for( unsigned int i=0; i<packed.spotEncounters.count; ++i )
+		{
+			SpotEncounter *e = new SpotEncounter;
+
+			e->from.area = reader.GetArea( encounter[i].from );
+			e->fromDir = static_cast<NavDirType>( encounter[i].fromDir );
+			e->to.area = reader.GetArea( encounter[i].to );
+			e->toDir = static_cast<NavDirType>( encounter[i].toDir );
+			e->path.from = encounter[i].pathFrom;
+			e->path.to = encounter[i].pathTo;
+
+			if ( reader.IsValidRange( NAV_PACKED_LUMP_ENCOUNTER_SPOTS, encounter[i].spots ) )
+			{
+				e->spots.EnsureCapacity( encounter[i].spots.count );
+				for( unsigned int s=0; s<encounter[i].spots.count; ++s )
+				{
+					const NavPackedSpotOrder &packedOrder = spots[ encounter[i].spots.first + s ];
+
+					SpotOrder order;
+					order.spot = reader.GetHidingSpot( packedOrder.spot );
+					order.t = packedOrder.t;
+
+					e->spots.AddToTail( order );
+				}
+			}
+			else
+			{
+				reader.SetCorrupt();
+			}
+
+			m_spotEncounters.AddToTail( e );
+		}
+	}
+	else
+	{
+		reader.SetCorrupt();
+	}
+
+	if ( reader.IsValidRange( NAV_PACKED_LUMP_VISIBLE_AREAS, packed.potentiallyVisibleAreas ) )
+	{
+		const NavPackedAreaBind *visible = reader.GetLump< NavPackedAreaBind >( NAV_PACKED_LUMP_VISIBLE_AREAS ) + packed.potentiallyVisibleAreas.first;
+
+		m_potentiallyVisibleAreas.EnsureCapacity( packed.potentiallyVisibleAreas.count );
+		for( unsigned int i=0; i<packed.potentiallyVisibleAreas.count; ++i )
+		{
+			AreaBindInfo info;
+			info.area = reader.GetArea( visible[i].area );
+			info.attributes = visible[i].attributes;
+
+			if ( info.area )
+			{
+				m_potentiallyVisibleAreas.AddToTail( info );
+			}
+		}
+	}
+	else
+	{
+		reader.SetCorrupt();
+	}
+
+	m_inheritVisibilityFrom.area = reader.GetArea( packed.inheritVisibilityFrom );
+
+	// func avoid/prefer attributes are controlled by func_nav_cost entities
+	ClearAllNavCostEntities();
+
+	return reader.IsCorrupt() ? NAV_CORRUPT_DATA : NAV_OK;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavLadder::SavePacked( CNavPackedWriter &writer ) const
+{
+	NavPackedLadder packed;
+
+	packed.id = m_id;
+	packed.top = m_top;
+	packed.bottom = m_bottom;
+	packed.length = m_length;
+	packed.width = m_width;
+	packed.dir = m_dir;
+	packed.normal = m_normal;
+
+	packed.topForwardArea = writer.GetAreaIndex( m_topForwardArea );
+	packed.topLeftArea = writer.GetAreaIndex( m_topLeftArea );
+	packed.topRightArea = writer.GetAreaIndex( m_topRightArea );
+	packed.topBehindArea = writer.GetAreaIndex( m_topBehindArea );
+	packed.bottomArea = writer.GetAreaIndex( m_bottomArea );
+
+	writer.m_ladders.AddToTail( packed );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the ladder from a packed nav file. The surface normal is stored, so unlike Load() this doesn't trace.
+ */
+void CNavLadder::LoadPacked( const CNavPackedReader &reader, const NavPackedLadder &packed )
+{
+	m_id = packed.id;
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_top = packed.top;
+	m_bottom = packed.bottom;
+	m_length = packed.length;
+	m_width = packed.width;
+	m_dir = (NavDirType)packed.dir;
+	m_normal = packed.normal;
+
+	m_topForwardArea = reader.GetArea( packed.topForwardArea );
+	m_topLeftArea = reader.GetArea( packed.topLeftArea );
+	m_topRightArea = reader.GetArea( packed.topRightArea );
+	m_topBehindArea = reader.GetArea( packed.topBehindArea );
+	m_bottomArea = reader.GetArea( packed.bottomArea );
+
+	FindLadderEntity();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the loaded Navigation Mesh to this map's packed nav file. Convert right after loading the .nav file,
+ * the packed file is stamped with the .nav file on disk and is only loaded while that hasn't changed.
+ */
+bool CNavMesh::SavePacked( void ) const
+{
+	// custom data is free form, it can't be packed
+	if ( GetSubVersionNumber() != 0 )
+	{
+		Msg( "This game's Navigation Mesh has custom data, which can't be stored in a packed nav file.\n" );
+		return false;
+	}
+
+	char filename[256];
+	char navFilename[256];
+	GetPackedFilenames( filename, navFilename, sizeof( filename ) );
+
+	NavPackedHeader header;
+	Q_memset( &header, 0, sizeof( header ) );
+
+	header.magic = NAV_PACKED_MAGIC_NUMBER;
+	header.version = NavPackedVersion;
+	header.subVersion = GetSubVersionNumber();
+
+	header.navSize = filesystem->Size( navFilename, "MOD" );
+	header.navTime = (unsigned int)filesystem->GetFileTime( navFilename, "MOD" );
+	if ( header.navSize == 0 )
+	{
+		Msg( "Can't find '%s' to convert.\n", navFilename );
+		return false;
+	}
+
+	// keep an out of date mesh out of date
+	char *bspFilename = GetBspFilename( navFilename );
+	if ( bspFilename == NULL )
+	{
+		return false;
+	}
+
+	header.bspSize = m_isOutOfDate ? 0 : filesystem->Size( bspFilename );
+	header.isAnalyzed = m_isAnalyzed;
+
+	header.gridCellSize = m_gridCellSize;
+	header.gridMinX = m_minX;
+	header.gridMinY = m_minY;
+	header.gridSizeX = m_gridSizeX;
+	header.gridSizeY = m_gridSizeY;
+
+	CNavPackedWriter writer;
+
+	FOR_EACH_VEC( TheHidingSpots, it )
+	{
+		const HidingSpot *spot = TheHidingSpots[ it ];
+
+		NavPackedHidingSpot &packed = writer.m_hidingSpots[ writer.m_hidingSpots.AddToTail() ];
+		packed.id = spot->m_id;
+		packed.pos = spot->m_pos;
+		packed.flags = spot->m_flags;
+		packed.area = writer.GetAreaIndex( spot->m_area );
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[ it ]->SavePacked( writer );
+	}
+
+	for ( int i=0; i<m_ladders.Count(); ++i )
+	{
+		m_ladders[i]->SavePacked( writer );
+	}
+
+	FOR_EACH_VEC( m_grid, it )
+	{
+		const NavAreaVector &cell = m_grid[ it ];
+
+		NavPackedRange &range = writer.m_gridCells[ writer.m_gridCells.AddToTail() ];
+		range.first = writer.m_gridAreas.Count();
+		range.count = cell.Count();
+
+		FOR_EACH_VEC( cell, cit )
+		{
+			writer.m_gridAreas.AddToTail( writer.GetAreaIndex( cell[ cit ] ) );
+		}
+	}
+
+	CUtlBuffer fileBuffer;
+	writer.Write( fileBuffer, header );
+
+	// filename is local to game dir for Steam, so we need to prepend game dir for regular file save
+	char gamePath[256];
+	engine->GetGameDir( gamePath, 256 );
+
+	char path[256];
+	Q_snprintf( path, sizeof( path ), "%s\\%s", gamePath, filename );
+	Q_FixSlashes( path );
+
+	if ( !filesystem->WriteFile( path, "MOD", fileBuffer ) )
+	{
+		Warning( "Unable to save %d bytes to %s\n", fileBuffer.TellPut(), path );
+		return false;
+	}
+
+	Msg( "Converted '%s' (%u bytes) to '%s' (%d bytes).\n", navFilename, header.navSize, filename, fileBuffer.TellPut() );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load this map's packed nav file, if it is up to date with the .nav file. The file is read in one go and its
+ * arrays are used in place: every area, hiding spot and ladder is created up front, then bound by index as
+ * it's filled in. Water levels, stairs, connection lengths, encounter paths, one-way links and the area grid
+ * are all as they were when the file was converted, so none of PostLoad() has to run again.
+ */
+NavErrorType CNavMesh::LoadPacked( void )
+{
+	MDLCACHE_CRITICAL_SECTION();
+
+	char filename[256];
+	char navFilename[256];
+	GetPackedFilenames( filename, navFilename, sizeof( filename ) );
+
+	CUtlBuffer fileBuffer( 0, 0, CUtlBuffer::READ_ONLY );
+	if ( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )
+	{
+		return NAV_CANT_ACCESS_FILE;
+	}
+
+	CNavPackedReader reader( fileBuffer );
+	if ( !reader.IsValid() )
+	{
+		Msg( "Invalid packed navigation file '%s'.\n", filename );
+		return NAV_INVALID_FILE;
+	}
+
+	const NavPackedHeader &header = reader.GetHeader();
+
+	// only trust it while it matches the .nav file, and the mesh the .nav file is loaded into
+	if ( header.subVersion != GetSubVersionNumber() ||
+		 header.navSize != filesystem->Size( navFilename, "MOD" ) ||
+		 header.navTime != (unsigned int)filesystem->GetFileTime( navFilename, "MOD" ) ||
+		 header.gridCellSize != m_gridCellSize )
+	{
+		DevMsg( "Packed navigation file '%s' is out of date, use nav_convert_packed to update it.\n", filename );
+		return NAV_FILE_OUT_OF_DATE;
+	}
+
+	unsigned int areaCount = reader.GetCount( NAV_PACKED_LUMP_AREAS );
+	if ( areaCount == 0 || header.gridSizeX <= 0 || header.gridSizeY <= 0 ||
+		 reader.GetCount( NAV_PACKED_LUMP_GRID_CELLS ) != (unsigned int)( header.gridSizeX * header.gridSizeY ) )
+	{
+		Msg( "Invalid packed navigation file '%s'.\n", filename );
+		return NAV_INVALID_FILE;
+	}
+
+	// free previous navigation mesh data
+	Reset();
+	placeDirectory.Reset();
+	CNavVectorNoEditAllocator::Reset();
+
+	GameRules()->OnNavMeshLoad();
+
+	CNavArea::m_nextID = 1;
+
+	char *bspFilename = GetBspFilename( navFilename );
+	if ( bspFilename == NULL )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	if ( header.bspSize != filesystem->Size( bspFilename ) )
+	{
+		if ( engine->IsDedicatedServer() )
+		{
+			// Warning doesn't print to the dedicated server console, so we'll use Msg instead
+			DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
+		}
+		else
+		{
+			DevWarning( "The Navigation Mesh was built using a different version of this map.\n" );
+		}
+		m_isOutOfDate = true;
+	}
+
+	m_isAnalyzed = header.isAnalyzed != 0;
+
+	// place IDs depend on the place database, so look the names up once for the whole mesh
+	const NavPackedPlace *places = reader.GetLump< NavPackedPlace >( NAV_PACKED_LUMP_PLACES );
+	reader.m_places.EnsureCapacity( reader.GetCount( NAV_PACKED_LUMP_PLACES ) );
+	for( unsigned int i=0; i<reader.GetCount( NAV_PACKED_LUMP_PLACES ); ++i )
+	{
+		char name[ sizeof( places[i].name ) ];
+		Q_strncpy( name, places[i].name, sizeof( name ) );
+
+		reader.m_places.AddToTail( NameToPlace( name ) );
+	}
+
+	//
+	// Create everything first, so the areas can bind to each other as they load
+	//
+	PreLoadAreas( areaCount );
+	reader.m_areas.EnsureCapacity( areaCount );
+	TheNavAreas.EnsureCapacity( areaCount );
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		CNavArea *area = CreateArea();
+		reader.m_areas.AddToTail( area );
+		TheNavAreas.AddToTail( area );
+	}
+
+	const NavPackedHidingSpot *spots = reader.GetLump< NavPackedHidingSpot >( NAV_PACKED_LUMP_HIDING_SPOTS );
+	reader.m_hidingSpots.EnsureCapacity( reader.GetCount( NAV_PACKED_LUMP_HIDING_SPOTS ) );
+	for( unsigned int i=0; i<reader.GetCount( NAV_PACKED_LUMP_HIDING_SPOTS ); ++i )
+	{
+		HidingSpot *spot = CreateHidingSpot();
+
+		spot->m_id = spots[i].id;
+		spot->m_pos = spots[i].pos;
+		spot->m_flags = spots[i].flags;
+		spot->m_area = reader.GetArea( spots[i].area );
+
+		// update next ID to avoid ID collisions by later spots
+		if ( spot->m_id >= HidingSpot::m_nextID )
+			HidingSpot::m_nextID = spot->m_id+1;
+
+		reader.m_hidingSpots.AddToTail( spot );
+	}
+
+	const NavPackedLadder *ladders = reader.GetLump< NavPackedLadder >( NAV_PACKED_LUMP_LADDERS );
+	unsigned int ladderCount = reader.GetCount( NAV_PACKED_LUMP_LADDERS );
+	m_ladders.EnsureCapacity( ladderCount );
+	reader.m_ladders.EnsureCapacity( ladderCount );
+	for( unsigned int i=0; i<ladderCount; ++i )
+	{
+		CNavLadder *ladder = new CNavLadder;
+		m_ladders.AddToTail( ladder );
+		reader.m_ladders.AddToTail( ladder );
+	}
+
+	//
+	// Fill them in
+	//
+	const NavPackedArea *areas = reader.GetLump< NavPackedArea >( NAV_PACKED_LUMP_AREAS );
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		reader.m_areas[i]->LoadPacked( reader, areas[i] );
+	}
+
+	for( unsigned int i=0; i<ladderCount; ++i )
+	{
+		reader.m_ladders[i]->LoadPacked( reader, ladders[i] );
+	}
+
+	//
+	// Rebuild the grid cell by cell, rather than finding the cells each area overlaps
+	//
+	m_grid.RemoveAll();
+	m_minX = header.gridMinX;
+	m_minY = header.gridMinY;
+	m_gridSizeX = header.gridSizeX;
+	m_gridSizeY = header.gridSizeY;
+	m_grid.SetCount( m_gridSizeX * m_gridSizeY );
+
+	const NavPackedRange *cells = reader.GetLump< NavPackedRange >( NAV_PACKED_LUMP_GRID_CELLS );
+	const unsigned int *cellAreas = reader.GetLump< unsigned int >( NAV_PACKED_LUMP_GRID_AREAS );
+	FOR_EACH_VEC( m_grid, it )
+	{
+		if ( !reader.IsValidRange( NAV_PACKED_LUMP_GRID_AREAS, cells[ it ] ) )
+		{
+			reader.SetCorrupt();
+			continue;
+		}
+
+		NavAreaVector &cell = m_grid[ it ];
+		cell.EnsureCapacity( cells[ it ].count );
+		for( unsigned int i=0; i<cells[ it ].count; ++i )
+		{
+			CNavArea *area = reader.GetArea( cellAreas[ cells[ it ].first + i ] );
+			if ( area )
+			{
+				cell.AddToTail( area );
+			}
+		}
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		IndexNavArea( TheNavAreas[ it ] );
+	}
+
+	if ( reader.IsCorrupt() )
+	{
+		Msg( "Corrupt packed navigation file '%s'.\n", filename );
+		return NAV_CORRUPT_DATA;
+	}
+
+	// TERROR: loading into a map directly creates entities before the mesh is loaded.  Tell the preexisting
+	// entities now that the mesh is loaded so they can update areas.
+	for ( int i=0; i<m_avoidanceObstacles.Count(); ++i )
+	{
+		m_avoidanceObstacles[i]->OnNavMeshLoaded();
+	}
+
+	// the Navigation Mesh has been successfully loaded
+	m_isLoaded = true;
+
+	if ( !m_isAnalyzed )
+	{
+		Warning( "The nav mesh needs a full nav_analyze\n" );
+	}
+
+	return NAV_OK;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+template < typename T >
+static void ChecksumValue( CRC32_t *crc, const T &value )
+{
+	CRC32_ProcessBuffer( crc, &value, sizeof( value ) );
+}
+
+static void ChecksumArea( CRC32_t *crc, const CNavArea *area )
+{
+	ChecksumValue( crc, area ? area->GetID() : 0 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a CRC of everything a load produces, by ID rather than by pointer
+ */
+unsigned int CNavMesh::ComputeChecksum( void ) const
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+
+	ChecksumValue( &crc, m_isAnalyzed );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+
+		ChecksumValue( &crc, area->m_id );
+		ChecksumValue( &crc, area->m_attributeFlags );
+		ChecksumValue( &crc, area->m_nwCorner );
+		ChecksumValue( &crc, area->m_seCorner );
+		ChecksumValue( &crc, area->m_center );
+		ChecksumValue( &crc, area->m_invDxCorners );
+		ChecksumValue( &crc, area->m_invDyCorners );
+		ChecksumValue( &crc, area->m_neZ );
+		ChecksumValue( &crc, area->m_swZ );
+		ChecksumValue( &crc, area->m_place );
+		ChecksumValue( &crc, area->m_isUnderwater );
+		ChecksumValue( &crc, area->m_earliestOccupyTime );
+		ChecksumValue( &crc, area->m_lightIntensity );
+
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			FOR_EACH_VEC( area->m_connect[d], cit )
+			{
+				ChecksumArea( &crc, area->m_connect[d][ cit ].area );
+				ChecksumValue( &crc, area->m_connect[d][ cit ].length );
+			}
+
+			// the .nav load sorts one-way links by pointer, so only their contents can be compared
+			unsigned int incomingIDs = 0;
+			unsigned int incomingLengths = 0;
+			FOR_EACH_VEC( area->m_incomingConnect[d], cit )
+			{
+				const NavConnect &connect = area->m_incomingConnect[d][ cit ];
+				incomingIDs ^= connect.area->GetID();
+				incomingLengths ^= *(const unsigned int *)&connect.length;
+			}
+
+			ChecksumValue( &crc, area->m_incomingConnect[d].Count() );
+			ChecksumValue( &crc, incomingIDs );
+			ChecksumValue( &crc, incomingLengths );
+		}
+
+		for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			FOR_EACH_VEC( area->m_ladder[dir], lit )
+			{
+				const CNavLadder *ladder = area->m_ladder[dir][ lit ].ladder;
+				ChecksumValue( &crc, ladder ? ladder->GetID() : 0 );
+			}
+		}
+
+		FOR_EACH_VEC( area->m_hidingSpots, hit )
+		{
+			const HidingSpot *spot = area->m_hidingSpots[ hit ];
+			ChecksumValue( &crc, spot->m_id );
+			ChecksumValue( &crc, spot->m_pos );
+			ChecksumValue( &crc, spot->m_flags );
+			ChecksumArea( &crc, spot->m_area );
+		}
+
+		FOR_EACH_VEC( area->m_spotEncounters, eit )
+		{
+			const SpotEncounter *e = area->m_spotEncounters[ eit ];
+			ChecksumArea( &crc, e->from.area );
+			ChecksumValue( &crc, e->fromDir );
+			ChecksumArea( &crc, e->to.area );
+			ChecksumValue( &crc, e->toDir );
+			ChecksumValue( &crc, e->path.from );
+			ChecksumValue( &crc, e->path.to );
+
+			FOR_EACH_VEC( e->spots, sit )
+			{
+				ChecksumValue( &crc, e->spots[ sit ].spot ? e->spots[ sit ].spot->GetID() : 0 );
+				ChecksumValue( &crc, e->spots[ sit ].t );
+			}
+		}
+
+		for ( int vit=0; vit<area->m_potentiallyVisibleAreas.Count(); ++vit )
+		{
+			ChecksumArea( &crc, area->m_potentiallyVisibleAreas[ vit ].area );
+			ChecksumValue( &crc, area->m_potentiallyVisibleAreas[ vit ].attributes );
+		}
+
+		ChecksumArea( &crc, area->m_inheritVisibilityFrom.area );
+	}
+
+	for ( int i=0; i<m_ladders.Count(); ++i )
+	{
+		const CNavLadder *ladder = m_ladders[i];
+		ChecksumValue( &crc, ladder->GetID() );
+		ChecksumValue( &crc, ladder->m_top );
+		ChecksumValue( &crc, ladder->m_bottom );
+		ChecksumValue( &crc, ladder->m_length );
+		ChecksumValue( &crc, ladder->m_width );
+		ChecksumValue( &crc, ladder->GetDir() );
+		ChecksumValue( &crc, ladder->GetNormal() );
+		ChecksumArea( &crc, ladder->m_topForwardArea );
+		ChecksumArea( &crc, ladder->m_topLeftArea );
+		ChecksumArea( &crc, ladder->m_topRightArea );
+		ChecksumArea( &crc, ladder->m_topBehindArea );
+		ChecksumArea( &crc, ladder->m_bottomArea );
+	}
+
+	ChecksumValue( &crc, m_minX );
+	ChecksumValue( &crc, m_minY );
+	ChecksumValue( &crc, m_gridSizeX );
+	ChecksumValue( &crc, m_gridSizeY );
+
+	FOR_EACH_VEC( m_grid, it )
+	{
+		ChecksumValue( &crc, m_grid[ it ].Count() );
+
+		FOR_EACH_VEC( m_grid[ it ], cit )
+		{
+			ChecksumArea( &crc, m_grid[ it ][ cit ] );
+		}
+	}
+
+	CRC32_Final( &crc );
+	return crc;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavConvertPacked( void )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	// convert a fresh load of the .nav file, not whatever edits have been made since
+	if ( TheNavMesh->LoadNavFile() != NAV_OK )
+	{
+		Msg( "ERROR: Navigation Mesh load failed.\n" );
+		return;
+	}
+
+	if ( !TheNavMesh->SavePacked() )
+	{
+		Msg( "ERROR: Unable to save the packed Navigation Mesh.\n" );
+	}
+}
+static ConCommand nav_convert_packed( "nav_convert_packed", CommandNavConvertPacked, "Loads the current map's .nav file and writes the packed copy of it that nav_load_packed loads instead.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavLoadCompare( const CCommand &args )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int count = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 1;
+
+	double navTime = 0.0;
+	double packedTime = 0.0;
+	unsigned int navChecksum = 0;
+	unsigned int packedChecksum = 0;
+
+	for( int i=0; i<count; ++i )
+	{
+		double start = Plat_FloatTime();
+		NavErrorType result = TheNavMesh->LoadNavFile();
+		navTime += Plat_FloatTime() - start;
+
+		if ( result != NAV_OK )
+		{
+			Msg( "ERROR: Navigation Mesh load failed.\n" );
+			return;
+		}
+
+		navChecksum = TheNavMesh->ComputeChecksum();
+
+		start = Plat_FloatTime();
+		result = TheNavMesh->LoadPacked();
+		packedTime += Plat_FloatTime() - start;
+
+		if ( result != NAV_OK )
+		{
+			Msg( "ERROR: Packed Navigation Mesh load failed, use nav_convert_packed to write it.\n" );
+			TheNavMesh->Load();
+			return;
+		}
+
+		packedChecksum = TheNavMesh->ComputeChecksum();
+	}
+
+	Msg( "Loaded %d areas, %d hiding spots and %d ladders, %d times each:\n", TheNavAreas.Count(), TheHidingSpots.Count(), TheNavMesh->GetLadders().Count(), count );
+	Msg( "  .nav file:   %.2f ms\n", 1000.0 * navTime / count );
+	Msg( "  packed file: %.2f ms (%.1fx)\n", 1000.0 * packedTime / count, ( packedTime > 0.0 ) ? navTime / packedTime : 0.0 );
+
+	if ( navChecksum == packedChecksum )
+	{
+		Msg( "  Meshes match (checksum %08X)\n", navChecksum );
+	}
+	else
+	{
+		Msg( "  Meshes DIFFER (checksum %08X from the .nav file, %08X from the packed file), use nav_convert_packed to rewrite it.\n", navChecksum, packedChecksum );
+	}
+}
+static ConCommand nav_load_compare( "nav_load_compare", CommandNavLoadCompare, "Loads the current map's Navigation Mesh from the .nav file and from the packed file, and compares the load times and the results. Optionally give the number of times to load each.", FCVAR_GAMEDLL | FCVAR_CHEAT );
@@ -0,0 +1,250 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_packed.h
+// Packed nav files - a load-in-place copy of the .nav file
+//
+// The .nav file stays the authoring format. nav_convert_packed writes the mesh as it is after a load
+// to maps/<map>.pnav, with every ID already resolved to an array index and everything PostLoad() would
+// compute (connection lengths, encounter paths, one-way links, the area grid) already computed. Loading
+// it is one read, then the arrays are used in place to build the mesh with nothing left to search for.
+
+#ifndef _NAV_PACKED_H_
+#define _NAV_PACKED_H_
+
+#include "nav_area.h"
+#include "utlmap.h"
+
+#define NAV_PACKED_MAGIC_NUMBER 0xFEEDFACF		// to help identify packed nav files
+
+/// The current version of the packed nav file format
+const unsigned int NavPackedVersion = 1;
+
+/// Index used in place of an area, spot or ladder that doesn't exist
+const unsigned int NAV_PACKED_NONE = 0xFFFFFFFF;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Each lump is an array of one of the structs below, placed at a 4 byte aligned offset from the start of the file
+ */
+enum NavPackedLumpType
+{
+	NAV_PACKED_LUMP_PLACES = 0,				// NavPackedPlace
+	NAV_PACKED_LUMP_AREAS,					// NavPackedArea
+	NAV_PACKED_LUMP_CONNECTIONS,			// NavPackedConnect, outgoing and incoming connections of every area
+	NAV_PACKED_LUMP_LADDER_CONNECTIONS,		// unsigned int, ladder index
+	NAV_PACKED_LUMP_HIDING_SPOTS,			// NavPackedHidingSpot
+	NAV_PACKED_LUMP_AREA_HIDING_SPOTS,		// unsigned int, hiding spot index
+	NAV_PACKED_LUMP_ENCOUNTERS,				// NavPackedEncounter
+	NAV_PACKED_LUMP_ENCOUNTER_SPOTS,		// NavPackedSpotOrder
+	NAV_PACKED_LUMP_VISIBLE_AREAS,			// NavPackedAreaBind
+	NAV_PACKED_LUMP_LADDERS,				// NavPackedLadder
+	NAV_PACKED_LUMP_GRID_CELLS,				// NavPackedRange into NAV_PACKED_LUMP_GRID_AREAS
+	NAV_PACKED_LUMP_GRID_AREAS,				// unsigned int, area index
+
+	NAV_PACKED_LUMP_COUNT
+};
+
+struct NavPackedLump
+{
+	unsigned int offset;					// from the start of the file
+	unsigned int count;						// number of elements
+};
+
+struct NavPackedRange
+{
+	unsigned int first;						// index of the first element in the lump
+	unsigned int count;
+};
+
+struct NavPackedHeader
+{
+	unsigned int magic;						// NAV_PACKED_MAGIC_NUMBER
+	unsigned int version;					// NavPackedVersion
+	unsigned int subVersion;				// GetSubVersionNumber() of the mesh that wrote it - custom mesh data isn't packed
+	unsigned int bspSize;					// size of the bsp the mesh was built for, as in the .nav file
+
+	unsigned int navSize;					// size and time of the .nav file this was converted from - if either
+	unsigned int navTime;					// changes the packed file is stale and the .nav file is loaded instead
+
+	unsigned int isAnalyzed;
+
+	float gridCellSize;						// the area grid, exactly as it was allocated by the .nav load
+	float gridMinX;
+	float gridMinY;
+	int gridSizeX;
+	int gridSizeY;
+
+	NavPackedLump lumps[ NAV_PACKED_LUMP_COUNT ];
+};
+
+struct NavPackedPlace
+{
+	char name[ 64 ];
+};
+
+struct NavPackedArea
+{
+	unsigned int id;
+	int attributeFlags;
+
+	Vector nwCorner;
+	Vector seCorner;
+	float neZ;
+	float swZ;
+
+	unsigned int place;						// 1 + index into NAV_PACKED_LUMP_PLACES, or 0 for no place
+	unsigned int isUnderwater;
+
+	float earliestOccupyTime[ MAX_NAV_TEAMS ];
+	float lightIntensity[ NUM_CORNERS ];
+
+	NavPackedRange connect[ NUM_DIRECTIONS ];							// NAV_PACKED_LUMP_CONNECTIONS
+	NavPackedRange incomingConnect[ NUM_DIRECTIONS ];					// NAV_PACKED_LUMP_CONNECTIONS
+	NavPackedRange ladder[ CNavLadder::NUM_LADDER_DIRECTIONS ];		// NAV_PACKED_LUMP_LADDER_CONNECTIONS
+	NavPackedRange hidingSpots;										// NAV_PACKED_LUMP_AREA_HIDING_SPOTS
+	NavPackedRange spotEncounters;									// NAV_PACKED_LUMP_ENCOUNTERS
+	NavPackedRange potentiallyVisibleAreas;							// NAV_PACKED_LUMP_VISIBLE_AREAS
+	unsigned int inheritVisibilityFrom;								// area index
+};
+
+struct NavPackedConnect
+{
+	unsigned int area;						// area index
+	float length;
+};
+
+struct NavPackedHidingSpot
+{
+	unsigned int id;
+	Vector pos;
+	unsigned int flags;
+	unsigned int area;						// area index of the area the spot is in, which isn't necessarily the one that owns it
+};
+
+struct NavPackedEncounter
+{
+	unsigned int from;						// area index
+	unsigned int fromDir;
+	unsigned int to;						// area index
+	unsigned int toDir;
+	Vector pathFrom;						// the path segment, as computed by CNavArea::PostLoad()
+	Vector pathTo;
+	NavPackedRange spots;					// NAV_PACKED_LUMP_ENCOUNTER_SPOTS
+};
+
+struct NavPackedSpotOrder
+{
+	unsigned int spot;						// hiding spot index
+	float t;
+};
+
+struct NavPackedAreaBind
+{
+	unsigned int area;						// area index
+	unsigned int attributes;
+};
+
+struct NavPackedLadder
+{
+	unsigned int id;
+	Vector top;
+	Vector bottom;
+	float length;
+	float width;
+	unsigned int dir;
+	Vector normal;							// as found by CNavLadder::SetDir(), which has to trace for it
+
+	unsigned int topForwardArea;			// area indices
+	unsigned int topLeftArea;
+	unsigned int topRightArea;
+	unsigned int topBehindArea;
+	unsigned int bottomArea;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collects the lumps of a packed nav file while the mesh is being written
+ */
+class CNavPackedWriter
+{
+public:
+	CNavPackedWriter( void );
+
+	unsigned int GetAreaIndex( const CNavArea *area ) const;			// return NAV_PACKED_NONE for NULL
+	unsigned int GetHidingSpotIndex( const HidingSpot *spot ) const;
+	unsigned int GetLadderIndex( const CNavLadder *ladder ) const;
+	unsigned int GetPlaceIndex( Place place );						// 1 + index into the place lump, added if new, or 0 for no place
+
+	NavPackedRange AddConnections( const NavConnectVector &connections );
+
+	void Write( CUtlBuffer &fileBuffer, NavPackedHeader &header ) const;	// fill in the lump table and write the header and lumps
+
+	CUtlVector< NavPackedPlace > m_places;
+	CUtlVector< NavPackedArea > m_areas;
+	CUtlVector< NavPackedConnect > m_connections;
+	CUtlVector< unsigned int > m_ladderConnections;
+	CUtlVector< NavPackedHidingSpot > m_hidingSpots;
+	CUtlVector< unsigned int > m_areaHidingSpots;
+	CUtlVector< NavPackedEncounter > m_encounters;
+	CUtlVector< NavPackedSpotOrder > m_encounterSpots;
+	CUtlVector< NavPackedAreaBind > m_visibleAreas;
+	CUtlVector< NavPackedLadder > m_ladders;
+	CUtlVector< NavPackedRange > m_gridCells;
+	CUtlVector< unsigned int > m_gridAreas;
+
+private:
+	CUtlMap< const void *, unsigned int, int > m_index;						// area, hiding spot and ladder pointers to their array index
+	CUtlVector< Place > m_placeIDs;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Gives access to the lumps of a packed nav file in place, and the objects created from them so far
+ */
+class CNavPackedReader
+{
+public:
+	CNavPackedReader( const CUtlBuffer &fileBuffer );
+
+	bool IsValid( void ) const		{ return m_header != NULL; }	// false if the header or lump table is damaged
+	const NavPackedHeader &GetHeader( void ) const	{ return *m_header; }
+
+	template < typename T >
+	const T *GetLump( NavPackedLumpType type ) const
+	{
+		return (const T *)( m_base + m_header->lumps[ type ].offset );
+	}
+
+	unsigned int GetCount( NavPackedLumpType type ) const	{ return m_header->lumps[ type ].count; }
+	bool IsValidRange( NavPackedLumpType type, const NavPackedRange &range ) const;
+
+	// return NULL for NAV_PACKED_NONE, and note any other index that's out of range as corrupt
+	CNavArea *GetArea( unsigned int index ) const;
+	HidingSpot *GetHidingSpot( unsigned int index ) const;
+	CNavLadder *GetLadder( unsigned int index ) const;
+	Place GetPlace( unsigned int index ) const;
+
+	bool IsCorrupt( void ) const	{ return m_isCorrupt; }
+	void SetCorrupt( void ) const	{ m_isCorrupt = true; }
+
+	CUtlVector< CNavArea * > m_areas;
+	CUtlVector< HidingSpot * > m_hidingSpots;
+	CUtlVector< CNavLadder * > m_ladders;
+	CUtlVector< Place > m_places;
+
+private:
+	const unsigned char *m_base;
+	const NavPackedHeader *m_header;
+	mutable bool m_isCorrupt;
+};
+
+
+#endif // _NAV_PACKED_H_
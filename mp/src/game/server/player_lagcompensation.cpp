@@ -10,9 +10,9 @@
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
 #include "inetchannelinfo.h"
-#include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -114,6 +114,107 @@ public:
 	float					m_masterCycle;
 };
 
+// Animation state of a record. Only needed once a record has been picked, so it's kept
+// apart from the data that gets searched and interpolated.
+struct LagAnimRecord
+{
+	LayerRecord				m_layerRecords[MAX_LAYER_RECORDS];
+	int						m_masterSequence;
+	float					m_masterCycle;
+};
+
+#define LAG_RECORD_CAPACITY	256	// Power of two. A second of history at up to 255 ticks per second.
+
+//-----------------------------------------------------------------------------
+// Purpose: Fixed size ring of a player's recent history. Records are numbered in
+//			the order they were added and the numbers keep counting up as the ring
+//			wraps, so they stay sorted by simulation time. Each field has its own
+//			array so searching and interpolating only touch the memory they use.
+//-----------------------------------------------------------------------------
+class CLagTrack
+{
+public:
+	CLagTrack()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		m_nFirst = 0;
+		m_nCount = 0;
+		m_nBreak = -1;
+	}
+
+	int Count() const { return m_nCount; }
+	int Oldest() const { return m_nFirst; }
+	int Newest() const { return m_nFirst + m_nCount - 1; }
+	int Slot( int nRecord ) const { return nRecord & (LAG_RECORD_CAPACITY-1); }
+
+	// Drops the oldest record if the ring is full.
+	int AddRecord()
+	{
+		if ( m_nCount == LAG_RECORD_CAPACITY )
+			m_nFirst++;
+		else
+			m_nCount++;
+
+		return Newest();
+	}
+
+	void RemoveOldest()
+	{
+		Assert( m_nCount > 0 );
+		m_nFirst++;
+		m_nCount--;
+	}
+
+	// Newest record at or before flTime, or the oldest record if they're all later.
+	int Find( float flTime ) const
+	{
+		int lo = Oldest();
+		int hi = Newest();
+
+		if ( m_flSimulationTime[ Slot( lo ) ] > flTime )
+			return lo;
+
+		while ( lo < hi )
+		{
+			int mid = lo + (hi - lo + 1) / 2;
+			if ( m_flSimulationTime[ Slot( mid ) ] <= flTime )
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		return lo;
+	}
+
+	float					m_flSimulationTime[ LAG_RECORD_CAPACITY ];
+	Vector					m_vecOrigin[ LAG_RECORD_CAPACITY ];
+	QAngle					m_vecAngles[ LAG_RECORD_CAPACITY ];
+	Vector					m_vecMinsPreScaled[ LAG_RECORD_CAPACITY ];
+	Vector					m_vecMaxsPreScaled[ LAG_RECORD_CAPACITY ];
+	LagAnimRecord			m_anim[ LAG_RECORD_CAPACITY ];
+
+	// Backtracking can't reach this record or anything older: the player was dead
+	// in it, or got teleported right after it.
+	int						m_nBreak;
+
+private:
+	int						m_nFirst;
+	int						m_nCount;
+};
+
+// A player picked to be moved back, and the records to move him between.
+struct LagRewind
+{
+	CBasePlayer				*m_pPlayer;
+	int						m_nRecord;
+	int						m_nPrevRecord;	// The newer record to interpolate towards. Same as m_nRecord if there's none.
+	float					m_flFrac;
+};
+
 
 //
 // Try to take the player from his current origin to vWantedPos.
@@ -194,17 +295,23 @@ public:
 	void			StartLagCompensation( CBasePlayer *player, CUserCmd *cmd );
 	void			FinishLagCompensation( CBasePlayer *player );
 
+	// Times moving everyone else back and forth for player, see da_lagcompensation_bench.
+	void			Benchmark( CBasePlayer *player, int iterations );
+
 private:
+	void			BeginLagCompensation( CBasePlayer *player );
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
+	void			BacktrackPlayers( CBasePlayer **ppPlayers, int nPlayers, float flTargetTime );
+	void			ApplyBacktrack( const LagRewind &rewind, Vector org, const Vector &minsPreScaled, const Vector &maxsPreScaled, float flTargetTime );
 
 	void ClearHistory()
 	{
 		for ( int i=0; i<MAX_PLAYERS; i++ )
-			m_PlayerTrack[i].Purge();
+			m_PlayerTrack[i].Clear();
 	}
 
-	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	// keep a ring of lag records for each player
+	CLagTrack				m_PlayerTrack[ MAX_PLAYERS ];
 
 	// Scratchpad for determining what needs to be restored
 	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
@@ -238,66 +345,68 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
 	// remove all records before that time:
-	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+	float flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
 
 	// Iterate all active players
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 
-		CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[i-1];
+		CLagTrack *track = &m_PlayerTrack[i-1];
 
 		if ( !pPlayer )
 		{
 			if ( track->Count() > 0 )
 			{
-				track->RemoveAll();
+				track->Clear();
 			}
 
 			continue;
 		}
 
-		Assert( track->Count() < 1000 ); // insanity check
-
 		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while ( track->IsValidIndex( tailIndex ) )
+		while ( track->Count() > 0 && track->m_flSimulationTime[ track->Slot( track->Oldest() ) ] < flDeadtime )
 		{
-			LagRecord &tail = track->Element( tailIndex );
-
-			// if tail is within limits, stop
-			if ( tail.m_flSimulationTime >= flDeadtime )
-				break;
-			
-			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
+			track->RemoveOldest();
 		}
 
 		// check if head has same simulation time
 		if ( track->Count() > 0 )
 		{
-			LagRecord &head = track->Element( track->Head() );
-
 			// check if player changed simulation time since last time updated
-			if ( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
+			if ( track->m_flSimulationTime[ track->Slot( track->Newest() ) ] >= pPlayer->GetSimulationTime() )
 				continue; // don't add new entry for same or older time
 		}
 
 		// add new record to player track
-		LagRecord &record = track->Element( track->AddToHead() );
+		int record = track->AddRecord();
+		int slot = track->Slot( record );
 
-		record.m_fFlags = 0;
+		int flags = 0;
 		if ( pPlayer->IsAlive() )
 		{
-			record.m_fFlags |= LC_ALIVE;
+			flags |= LC_ALIVE;
 		}
 
-		record.m_flSimulationTime	= pPlayer->GetSimulationTime();
-		record.m_vecAngles			= pPlayer->GetLocalAngles();
-		record.m_vecOrigin			= pPlayer->GetLocalOrigin();
-		record.m_vecMinsPreScaled	= pPlayer->CollisionProp()->OBBMinsPreScaled();
-		record.m_vecMaxsPreScaled	= pPlayer->CollisionProp()->OBBMaxsPreScaled();
+		track->m_flSimulationTime[slot]		= pPlayer->GetSimulationTime();
+		track->m_vecAngles[slot]			= pPlayer->GetLocalAngles();
+		track->m_vecOrigin[slot]			= pPlayer->GetLocalOrigin();
+		track->m_vecMinsPreScaled[slot]		= pPlayer->CollisionProp()->OBBMinsPreScaled();
+		track->m_vecMaxsPreScaled[slot]		= pPlayer->CollisionProp()->OBBMaxsPreScaled();
+
+		// Work out now where backtracking has to stop, so BacktrackPlayer doesn't have to walk the track
+		if ( !(flags & LC_ALIVE) )
+		{
+			track->m_nBreak = record;
+		}
+		else if ( record > track->Oldest() )
+		{
+			Vector delta = track->m_vecOrigin[slot] - track->m_vecOrigin[ track->Slot( record - 1 ) ];
+			if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+				track->m_nBreak = record - 1;
+		}
+
+		LagAnimRecord &anim = track->m_anim[slot];
 
 		int layerCount = pPlayer->GetNumAnimOverlays();
 		for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
@@ -305,14 +414,14 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 			CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
 			if( currentLayer )
 			{
-				record.m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
-				record.m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
-				record.m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
-				record.m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
+				anim.m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
+				anim.m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
+				anim.m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
+				anim.m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
 			}
 		}
-		record.m_masterSequence = pPlayer->GetSequence();
-		record.m_masterCycle = pPlayer->GetCycle();
+		anim.m_masterSequence = pPlayer->GetSequence();
+		anim.m_masterCycle = pPlayer->GetCycle();
 	}
 
 	//Clear the current player.
@@ -331,11 +440,7 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		return;
 	}
 
-	// Assume no players need to be restored
-	m_RestorePlayer.ClearAll();
-	m_bNeedToRestore = false;
-
-	m_pCurrentPlayer = player;
+	BeginLagCompensation( player );
 	
 	if ( !player->m_bLagCompensation		// Player not wanting lag compensation
 		 || (gpGlobals->maxClients <= 1)	// no lag compensation in single player
@@ -385,6 +490,9 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		targettick = gpGlobals->tickcount - TIME_TO_TICKS( correct );
 	}
 	
+	CBasePlayer *pPlayers[ MAX_PLAYERS ];
+	int nPlayers = 0;
+
 	// Iterate all active players
 	const CBitVec<MAX_EDICTS> *pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
@@ -406,109 +514,163 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		if ( !player->WantsLagCompensationOnEntity( pPlayer, cmd, pEntityTransmitBits ) )
 			continue;
 
-		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		pPlayers[ nPlayers++ ] = pPlayer;
 	}
+
+	// Move other players back in time
+	BacktrackPlayers( pPlayers, nPlayers, TICKS_TO_TIME( targettick ) );
 }
 
-void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
+void CLagCompensationManager::BeginLagCompensation( CBasePlayer *player )
+{
+	// Assume no players need to be restored
+	m_RestorePlayer.ClearAll();
+	m_bNeedToRestore = false;
+
+	m_pCurrentPlayer = player;
+}
+
+// Interpolates up to four vectors at once: pOut[i] = Lerp( frac[i], *ppFrom[i], *ppTo[i] ).
+static void LerpFourVectors( const Vector **ppFrom, const Vector **ppTo, const fltx4 &frac, Vector *pOut, int nCount )
 {
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
+	FourVectors from, to;
+	from.LoadAndSwizzle( *ppFrom[0], *ppFrom[1], *ppFrom[2], *ppFrom[3] );
+	to.LoadAndSwizzle( *ppTo[0], *ppTo[1], *ppTo[2], *ppTo[3] );
 
-	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
-	int pl_index = pPlayer->entindex() - 1;
+	to -= from;
+	to *= frac;
+	to += from;
 
-	// get track history of this player
-	CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[ pl_index ];
+	for ( int i = 0; i < nCount; i++ )
+		pOut[i] = to.Vec( i );
+}
 
-	// check if we have at leat one entry
-	if ( track->Count() <= 0 )
-		return;
+void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
+{
+	BacktrackPlayers( &pPlayer, 1, flTargetTime );
+}
 
-	int curr = track->Head();
+void CLagCompensationManager::BacktrackPlayers( CBasePlayer **ppPlayers, int nPlayers, float flTargetTime )
+{
+	VPROF_BUDGET( "BacktrackPlayers", "CLagCompensationManager" );
 
-	LagRecord *prevRecord = NULL;
-	LagRecord *record = NULL;
+	// Not members, BacktrackPlayer() can come back in here while the results are being applied.
+	LagRewind rewinds[ MAX_PLAYERS ];
+	Vector org[ MAX_PLAYERS ];
+	Vector minsPreScaled[ MAX_PLAYERS ];
+	Vector maxsPreScaled[ MAX_PLAYERS ];
+	int nRewinds = 0;
 
-	Vector prevOrg = pPlayer->GetLocalOrigin();
-	
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex(curr) )
+	Assert( nPlayers <= MAX_PLAYERS );
+
+	// Find the records to move each player between
+	for ( int i = 0; i < nPlayers; i++ )
 	{
-		// remember last record
-		prevRecord = record;
+		CBasePlayer *pPlayer = ppPlayers[i];
+		CLagTrack *track = &m_PlayerTrack[ pPlayer->entindex() - 1 ];
 
-		// get next record
-		record = &track->Element( curr );
+		// check if we have at leat one entry
+		if ( track->Count() <= 0 )
+			continue;
 
-		if ( !(record->m_fFlags & LC_ALIVE) )
-		{
-			// player most be alive, lost track
-			return;
-		}
+		int newest = track->Newest();
+		int record = track->Find( flTargetTime );
 
-		Vector delta = record->m_vecOrigin - prevOrg;
+		// player must be alive in every record back to the one we want, and not have teleported
+		if ( record <= track->m_nBreak )
+			continue;
+
+		Vector delta = track->m_vecOrigin[ track->Slot( newest ) ] - pPlayer->GetLocalOrigin();
 		if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
 		{
 			// lost track, too much difference
-			return; 
+			continue;
 		}
 
-		// did we find a context smaller than target time ?
-		if ( record->m_flSimulationTime <= flTargetTime )
-			break; // hurra, stop
+		LagRewind &rewind = rewinds[ nRewinds++ ];
+		rewind.m_pPlayer = pPlayer;
+		rewind.m_nRecord = record;
+		rewind.m_nPrevRecord = record;
+		rewind.m_flFrac = 0.0f;
 
-		prevOrg = record->m_vecOrigin;
+		float flRecordTime = track->m_flSimulationTime[ track->Slot( record ) ];
+		if ( record < newest && flRecordTime < flTargetTime )
+		{
+			// we didn't find the exact time but have a valid previous record
+			// so interpolate between these two records;
+			float flPrevTime = track->m_flSimulationTime[ track->Slot( record + 1 ) ];
 
-		// go one step back
-		curr = track->Next( curr );
-	}
+			Assert( flTargetTime < flPrevTime );
 
-	Assert( record );
+			rewind.m_nPrevRecord = record + 1;
+			rewind.m_flFrac = ( flTargetTime - flRecordTime ) / ( flPrevTime - flRecordTime );
 
-	if ( !record )
+			Assert( rewind.m_flFrac > 0 && rewind.m_flFrac < 1 ); // should never extrapolate
+		}
+	}
+
+	// Interpolate everyone's origin and bounds, four players at a time. A fraction
+	// of zero gives back the record exactly.
+	for ( int i = 0; i < nRewinds; i += 4 )
 	{
-		if ( sv_unlag_debug.GetBool() )
+		int nCount = MIN( 4, nRewinds - i );
+
+		const Vector *from[3][4];
+		const Vector *to[3][4];
+		float frac[4];
+
+		for ( int j = 0; j < 4; j++ )
 		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
+			// Pad the last group out with the first player in it
+			const LagRewind &rewind = rewinds[ i + ( j < nCount ? j : 0 ) ];
+			const CLagTrack *track = &m_PlayerTrack[ rewind.m_pPlayer->entindex() - 1 ];
+			int slot = track->Slot( rewind.m_nRecord );
+			int prevSlot = track->Slot( rewind.m_nPrevRecord );
+
+			from[0][j] = &track->m_vecOrigin[ slot ];
+			from[1][j] = &track->m_vecMinsPreScaled[ slot ];
+			from[2][j] = &track->m_vecMaxsPreScaled[ slot ];
+			to[0][j] = &track->m_vecOrigin[ prevSlot ];
+			to[1][j] = &track->m_vecMinsPreScaled[ prevSlot ];
+			to[2][j] = &track->m_vecMaxsPreScaled[ prevSlot ];
+			frac[j] = rewind.m_flFrac;
 		}
 
-		return; // that should never happen
+		fltx4 frac4 = LoadUnalignedSIMD( frac );
+
+		LerpFourVectors( from[0], to[0], frac4, &org[i], nCount );
+		LerpFourVectors( from[1], to[1], frac4, &minsPreScaled[i], nCount );
+		LerpFourVectors( from[2], to[2], frac4, &maxsPreScaled[i], nCount );
 	}
 
-	float frac = 0.0f;
-	if ( prevRecord && 
-		 (record->m_flSimulationTime < flTargetTime) &&
-		 (record->m_flSimulationTime < prevRecord->m_flSimulationTime) )
+	for ( int i = 0; i < nRewinds; i++ )
 	{
-		// we didn't find the exact time but have a valid previous record
-		// so interpolate between these two records;
+		// Already moved back while making room for someone else
+		if ( m_RestorePlayer.Get( rewinds[i].m_pPlayer->entindex() - 1 ) )
+			continue;
 
-		Assert( prevRecord->m_flSimulationTime > record->m_flSimulationTime );
-		Assert( flTargetTime < prevRecord->m_flSimulationTime );
+		ApplyBacktrack( rewinds[i], org[i], minsPreScaled[i], maxsPreScaled[i], flTargetTime );
+	}
+}
 
-		// calc fraction between both records
-		frac = ( flTargetTime - record->m_flSimulationTime ) / 
-			( prevRecord->m_flSimulationTime - record->m_flSimulationTime );
+void CLagCompensationManager::ApplyBacktrack( const LagRewind &rewind, Vector org, const Vector &minsPreScaled, const Vector &maxsPreScaled, float flTargetTime )
+{
+	CBasePlayer *pPlayer = rewind.m_pPlayer;
+	int pl_index = pPlayer->entindex() - 1;
+	CLagTrack *track = &m_PlayerTrack[ pl_index ];
 
-		Assert( frac > 0 && frac < 1 ); // should never extrapolate
+	float frac = rewind.m_flFrac;
 
-		ang				= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
-		org				= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
-		minsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
-		maxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
-	}
-	else
+	LagAnimRecord *record = &track->m_anim[ track->Slot( rewind.m_nRecord ) ];
+	LagAnimRecord *prevRecord = NULL;
+
+	QAngle ang = track->m_vecAngles[ track->Slot( rewind.m_nRecord ) ];
+	if ( frac > 0.0f )
 	{
-		// we found the exact record or no other record to interpolate with
-		// just copy these values since they are the best we have
-		org				= record->m_vecOrigin;
-		ang				= record->m_vecAngles;
-		minsPreScaled	= record->m_vecMinsPreScaled;
-		maxsPreScaled	= record->m_vecMaxsPreScaled;
+		prevRecord = &track->m_anim[ track->Slot( rewind.m_nPrevRecord ) ];
+
+		// Angles have to go through quaternions, they don't batch with the rest
+		ang = Lerp( frac, ang, track->m_vecAngles[ track->Slot( rewind.m_nPrevRecord ) ] );
 	}
 
 	// See if this is still a valid position for us to teleport to
@@ -831,3 +993,89 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 }
 
 
+
+void CLagCompensationManager::Benchmark( CBasePlayer *player, int iterations )
+{
+	if ( m_pCurrentPlayer )
+	{
+		Warning( "Can't benchmark while a lag compensation session is active.\n" );
+		return;
+	}
+
+	CBasePlayer *pPlayers[ MAX_PLAYERS ];
+	int nPlayers = 0;
+	int nRecords = 0;
+
+	// Everyone gets moved, as if they were all in front of the player when he fired
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( !pPlayer || pPlayer == player || !pPlayer->IsAlive() )
+			continue;
+
+		pPlayers[ nPlayers++ ] = pPlayer;
+		nRecords += m_PlayerTrack[ i-1 ].Count();
+	}
+
+	if ( !nPlayers )
+	{
+		Msg( "Nobody to move back, add some bots.\n" );
+		return;
+	}
+
+	float flMaxUnlag = sv_maxunlag.GetFloat();
+
+	Msg( "%d players, %d records of history, sv_maxunlag %.2f\n", nPlayers, nRecords, flMaxUnlag );
+	if ( nPlayers < 32 || flMaxUnlag < 1 )
+		Msg( "The case to measure is 32 players and sv_maxunlag 1, after they've been in the game for a second.\n" );
+
+	double flStartTime = 0;
+	double flFinishTime = 0;
+
+	for ( int i = 0; i < iterations; i++ )
+	{
+		// Sweep the target time across all of the history
+		float flTargetTime = gpGlobals->curtime - flMaxUnlag * ( i % 64 ) / 63.0f;
+
+		double flStart = Plat_FloatTime();
+
+		BeginLagCompensation( player );
+		Q_memset( m_RestoreData, 0, sizeof( m_RestoreData ) );
+		Q_memset( m_ChangeData, 0, sizeof( m_ChangeData ) );
+		BacktrackPlayers( pPlayers, nPlayers, flTargetTime );
+
+		double flMiddle = Plat_FloatTime();
+
+		FinishLagCompensation( player );
+
+		double flEnd = Plat_FloatTime();
+
+		flStartTime += flMiddle - flStart;
+		flFinishTime += flEnd - flMiddle;
+	}
+
+	Msg( "StartLagCompensation: %.4fms per call\n", flStartTime*1000/iterations );
+	Msg( "FinishLagCompensation: %.4fms per call\n", flFinishTime*1000/iterations );
+}
+
+CON_COMMAND( da_lagcompensation_bench, "Time lag compensating every living player at once: da_lagcompensation_bench [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CBasePlayer *pPlayer = UTIL_GetCommandClient();
+	for ( int i = 1; !pPlayer && i <= gpGlobals->maxClients; i++ )
+		pPlayer = UTIL_PlayerByIndex( i );
+
+	if ( !pPlayer )
+	{
+		Msg( "Need at least one player in the game.\n" );
+		return;
+	}
+
+	int iterations = (args.ArgC() > 1) ? atoi( args[1] ) : 1000;
+	if ( iterations < 1 )
+		iterations = 1;
+
+	g_LagCompensationManager.Benchmark( pPlayer, iterations );
+}
@@ -0,0 +1,287 @@
+#include "cbase.h"
+
+#include "bot_navcache.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar bot_nav_cache( "bot_nav_cache", "1", FCVAR_GAMEDLL, "Share nav mesh paths between bots" );
+ConVar bot_nav_cache_size( "bot_nav_cache_size", "256", FCVAR_GAMEDLL, "How many paths to keep", true, 1, true, 4096 );
+ConVar bot_nav_cache_lifetime( "bot_nav_cache_lifetime", "5", FCVAR_GAMEDLL, "How many seconds a path is reused before it's searched for again", true, 0, false, 0 );
+
+CBotPathCache g_BotPathCache( "CBotPathCache" );
+
+CBotPathCache &BotPathCache()
+{
+	return g_BotPathCache;
+}
+
+CBotPathCache::CBotPathCache( char const *name )
+	: CAutoGameSystem( name ), m_PathsByKey( DefLessFunc(uint64) ), m_LaddersByArea( DefLessFunc(unsigned int) )
+{
+	m_bLaddersBuilt = false;
+	ResetStats();
+}
+
+void CBotPathCache::LevelInitPostEntity()
+{
+	Clear();
+}
+
+void CBotPathCache::LevelShutdownPostEntity()
+{
+	Clear();
+}
+
+void CBotPathCache::Clear()
+{
+	FOR_EACH_LL( m_apPaths, i )
+		delete m_apPaths[i];
+
+	m_apPaths.Purge();
+	m_PathsByKey.Purge();
+
+	m_LaddersByArea.Purge();
+	m_bLaddersBuilt = false;
+}
+
+CNavArea *CBotPathCache::GetNavArea( const Vector &vecPos, unsigned int &iLastArea )
+{
+	m_iAreaLookups++;
+
+	if ( iLastArea )
+	{
+		CNavArea *pArea = TheNavMesh->GetNavAreaByID( iLastArea );
+
+		// Same test GetNearestNavArea starts with, minus looking for a better area above or below.
+		if ( pArea && pArea->IsOverlapping( vecPos ) && fabs( vecPos.z - pArea->GetZ( vecPos ) ) <= StepHeight )
+		{
+			m_iAreaHits++;
+			return pArea;
+		}
+	}
+
+	CNavArea *pArea = TheNavMesh->GetNearestNavArea( vecPos );
+	iLastArea = pArea ? pArea->GetID() : 0;
+
+	return pArea;
+}
+
+bool CBotPathCache::GetPath( CNavArea *pStart, CNavArea *pGoal, const Vector &vecGoal, CUtlVector<NavAreaData_t> &aWaypoints )
+{
+	m_iRequests++;
+
+	aWaypoints.RemoveAll();
+
+	bool bFound;
+
+	if ( !bot_nav_cache.GetBool() )
+	{
+		BuildPath( pStart, pGoal, vecGoal, aWaypoints, bFound );
+		return bFound;
+	}
+
+	uint64 iKey = ((uint64)pStart->GetID() << 32) | pGoal->GetID();
+
+	unsigned short iMap = m_PathsByKey.Find( iKey );
+	if ( m_PathsByKey.IsValidIndex( iMap ) )
+	{
+		unsigned short iPath = m_PathsByKey[iMap];
+		CachedPath *pPath = m_apPaths[iPath];
+
+		if ( pPath->m_flExpire > gpGlobals->curtime )
+		{
+			m_iHits++;
+
+			m_apPaths.Unlink( iPath );
+			m_apPaths.LinkToHead( iPath );
+
+			aWaypoints.CopyArray( pPath->m_aWaypoints.Base(), pPath->m_aWaypoints.Count() );
+			return pPath->m_bFound;
+		}
+
+		m_iExpired++;
+
+		m_apPaths.Remove( iPath );
+		m_PathsByKey.RemoveAt( iMap );
+		delete pPath;
+	}
+
+	while ( m_apPaths.Count() >= bot_nav_cache_size.GetInt() )
+	{
+		unsigned short iOldest = m_apPaths.Tail();
+		CachedPath *pOldest = m_apPaths[iOldest];
+
+		m_iEvictions++;
+
+		m_PathsByKey.Remove( pOldest->m_iKey );
+		m_apPaths.Remove( iOldest );
+		delete pOldest;
+	}
+
+	CachedPath *pPath = new CachedPath;
+	pPath->m_iKey = iKey;
+	pPath->m_flExpire = gpGlobals->curtime + bot_nav_cache_lifetime.GetFloat();
+
+	BuildPath( pStart, pGoal, vecGoal, pPath->m_aWaypoints, pPath->m_bFound );
+
+	m_PathsByKey.Insert( iKey, m_apPaths.AddToHead( pPath ) );
+
+	aWaypoints.CopyArray( pPath->m_aWaypoints.Base(), pPath->m_aWaypoints.Count() );
+	return pPath->m_bFound;
+}
+
+void CBotPathCache::BuildPath( CNavArea *pStart, CNavArea *pGoal, const Vector &vecGoal, CUtlVector<NavAreaData_t> &aWaypoints, bool &bFound )
+{
+	m_iBuilds++;
+
+	double flStart = Plat_FloatTime();
+
+	CNavArea *closestArea = NULL;
+	Vector vEnd = vecGoal;
+
+	ShortestPathCost costfunc;
+
+	// if you want to understand how waypoint gathering process work, read NavAreaBuildPath notes, very informative
+	// nav areas are parented creating a path to goalArea. So we determine which ones are parented, and then they added to our waypoint list
+	bFound = NavAreaBuildPath( pStart, pGoal, &vEnd, costfunc, &closestArea );
+
+	if ( bFound )
+	{
+		Vector center, center_portal;
+		float hwidth;
+		NavDirType dir;
+
+		CNavArea *goalArea = closestArea;
+
+		Vector closestpoint;
+
+		// waypopints are returned from last one (goal area) to closest one (start area)
+
+		while( goalArea->GetParent() )
+		{
+			center = goalArea->GetParent()->GetCenter();
+			dir = goalArea->ComputeDirection(&center);
+			goalArea->ComputePortal( goalArea->GetParent(), dir, &center_portal, &hwidth );
+			goalArea->ComputeClosestPointInPortal( goalArea->GetParent(), dir, goalArea->GetParent()->GetCenter(), &closestpoint );
+
+			closestpoint.z = goalArea->GetZ( closestpoint );
+
+			NavTraverseType trav = goalArea->GetParentHow();
+
+			// if previous waypoint is a ladder top dismount point, increase height a bit
+			if( aWaypoints.Count() > 0 && (aWaypoints[0].Center.z - closestpoint.z ) > 64.0f && aWaypoints[0].TransientType == GO_LADDER_UP )
+			{
+				Vector vecTop;
+				unsigned int iLadder;
+
+				// if bot is meant to go up the ladder, some extra height is added to the ladder top end waypoint so the unmount operation can be completed successfully
+				// gets an extra impulse when leaving ladder, let's say
+				if( GetLadderUp( goalArea, vecTop, iLadder ) )
+				{
+					NavAreaData_t data;
+					data.Center = vecTop+LADDER_EXTRA_HEIGHT_VEC; // extra height to ladder top waypoint
+					data.TransientType = GO_LADDER_UP;
+					data.AttributeType = goalArea->GetAttributes();
+					data.Id = iLadder;
+					aWaypoints.AddToHead( data );
+				}
+				trav = GO_NORTH; // since the new waypoint we just created is the reference for this ladder, set the original ladder waypoint to a non ladder traverse property
+			}
+
+			NavAreaData_t data;
+			data.Center = closestpoint;
+			data.TransientType = trav;
+			data.AttributeType = goalArea->GetAttributes();
+			data.Id = goalArea->GetID();
+			aWaypoints.AddToHead( data );
+
+			goalArea = goalArea->GetParent();
+		}
+	}
+	else
+	{
+		m_iFailures++;
+	}
+
+	m_flBuildTime += Plat_FloatTime() - flStart;
+}
+
+bool CBotPathCache::GetLadderUp( CNavArea *pArea, Vector &vecTop, unsigned int &iLadder )
+{
+	if ( !m_bLaddersBuilt )
+		BuildLadders();
+
+	unsigned short i = m_LaddersByArea.Find( pArea->GetID() );
+	if ( !m_LaddersByArea.IsValidIndex( i ) )
+		return false;
+
+	vecTop = m_LaddersByArea[i].m_vecTop;
+	iLadder = m_LaddersByArea[i].m_iLadder;
+	return true;
+}
+
+void CBotPathCache::BuildLadders()
+{
+	m_LaddersByArea.RemoveAll();
+	m_bLaddersBuilt = true;
+
+	FOR_EACH_VEC( TheNavAreas, i )
+	{
+		CNavArea *pArea = TheNavAreas[i];
+
+		if ( !pArea->GetLadders( CNavLadder::LADDER_UP )->Count() )
+			continue;
+
+		// If an area goes up more than one ladder, take the first in the mesh's list like CreatePath always has.
+		FOR_EACH_VEC( TheNavMesh->GetLadders(), it )
+		{
+			CNavLadder *pLadder = TheNavMesh->GetLadders()[it];
+
+			if ( pArea->IsConnected( pLadder, CNavLadder::LADDER_UP ) )
+			{
+				LadderUp oLadder;
+				oLadder.m_vecTop = pLadder->m_top;
+				oLadder.m_iLadder = pLadder->GetID();
+				m_LaddersByArea.Insert( pArea->GetID(), oLadder );
+				break;
+			}
+		}
+	}
+}
+
+void CBotPathCache::PrintStats()
+{
+	Msg( "Path requests: %d\n", m_iRequests );
+	Msg( "  Cached: %d (%.1f%%)\n", m_iHits, m_iRequests?100.0f*m_iHits/m_iRequests:0.0f );
+	Msg( "  Searched: %d, %d with no path, %.3fms total, %.3fms each\n", m_iBuilds, m_iFailures, m_flBuildTime*1000, m_iBuilds?m_flBuildTime*1000/m_iBuilds:0.0 );
+	Msg( "  Expired: %d, evicted: %d, cached now: %d of %d\n", m_iExpired, m_iEvictions, m_apPaths.Count(), bot_nav_cache_size.GetInt() );
+	Msg( "Paths kept because the goal stayed in the same area: %d\n", m_iReuses );
+	Msg( "Area lookups: %d, %d (%.1f%%) still on the last area\n", m_iAreaLookups, m_iAreaHits, m_iAreaLookups?100.0f*m_iAreaHits/m_iAreaLookups:0.0f );
+	Msg( "Areas with a ladder up: %d\n", m_LaddersByArea.Count() );
+}
+
+void CBotPathCache::ResetStats()
+{
+	m_iRequests = 0;
+	m_iHits = 0;
+	m_iBuilds = 0;
+	m_iFailures = 0;
+	m_iExpired = 0;
+	m_iEvictions = 0;
+	m_iReuses = 0;
+	m_iAreaLookups = 0;
+	m_iAreaHits = 0;
+	m_flBuildTime = 0;
+}
+
+CON_COMMAND( bot_nav_stats, "Print bot path cache counters. bot_nav_stats reset to zero them." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	BotPathCache().PrintStats();
+
+	if ( args.ArgC() > 1 && FStrEq( args[1], "reset" ) )
+		BotPathCache().ResetStats();
+}
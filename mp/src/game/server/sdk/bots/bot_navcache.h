@@ -0,0 +1,78 @@
+#pragma once
+
+#include "utlmap.h"
+#include "utllinkedlist.h"
+
+#include "bot_main.h"
+
+// Paths between nav areas, shared by all bots. A bot going somewhere another bot went from the
+// same area a moment ago gets the same waypoints without searching the mesh again. Least
+// recently used paths get dropped once the cache is full, and paths expire after a few seconds
+// so doors and blocked areas get noticed.
+class CBotPathCache : public CAutoGameSystem
+{
+public:
+	CBotPathCache( char const *name );
+
+public:
+	virtual void LevelInitPostEntity();
+	virtual void LevelShutdownPostEntity();
+
+	void Clear();
+
+	// Nearest area to vecPos. iLastArea is the caller's previous answer, if vecPos is still on
+	// that area the mesh isn't searched. Updated with the new answer.
+	CNavArea *GetNavArea( const Vector &vecPos, unsigned int &iLastArea );
+
+	// Copies the waypoints from pStart to pGoal into aWaypoints, building them if need be.
+	// Returns false and no waypoints if there's no path. That answer is cached like any other,
+	// so bots don't search the whole mesh again for a goal they can't reach.
+	bool GetPath( CNavArea *pStart, CNavArea *pGoal, const Vector &vecGoal, CUtlVector<NavAreaData_t> &aWaypoints );
+
+	// The ladder that CreatePath sends bots up from pArea. False if there's none.
+	bool GetLadderUp( CNavArea *pArea, Vector &vecTop, unsigned int &iLadder );
+
+	void CountReuse() { m_iReuses++; }
+
+	void PrintStats();
+	void ResetStats();
+
+private:
+	void BuildPath( CNavArea *pStart, CNavArea *pGoal, const Vector &vecGoal, CUtlVector<NavAreaData_t> &aWaypoints, bool &bFound );
+	void BuildLadders();
+
+private:
+	struct CachedPath
+	{
+		uint64 m_iKey;
+		float  m_flExpire;
+		bool   m_bFound;
+		CUtlVector<NavAreaData_t> m_aWaypoints;
+	};
+
+	struct LadderUp
+	{
+		Vector       m_vecTop;
+		unsigned int m_iLadder;
+	};
+
+	// Most recently used at the head.
+	CUtlLinkedList<CachedPath*> m_apPaths;
+	CUtlMap<uint64, unsigned short> m_PathsByKey;
+
+	CUtlMap<unsigned int, LadderUp> m_LaddersByArea;
+	bool         m_bLaddersBuilt;
+
+	int          m_iRequests;
+	int          m_iHits;
+	int          m_iBuilds;
+	int          m_iFailures;
+	int          m_iExpired;
+	int          m_iEvictions;
+	int          m_iReuses;
+	int          m_iAreaLookups;
+	int          m_iAreaHits;
+	double       m_flBuildTime;
+};
+
+CBotPathCache &BotPathCache();
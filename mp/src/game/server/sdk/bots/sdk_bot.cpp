@@ -47,6 +47,8 @@ void CSDKBot::Spawn()
 
 	hEnemy.Set(NULL);
 	ResetNavigationParams();
+	m_iStartArea = 0;
+	m_iGoalArea = 0;
 	m_AlreadyCheckedHideSpots.RemoveAll();
 	m_flNextDealObstacles = 0;
 	m_flCreateRandomPathCoolDown = 0;
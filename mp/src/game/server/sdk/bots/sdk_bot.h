@@ -35,7 +35,7 @@ protected:
 
 	void ResetNavigationParams();
 	void AddWaypoint( Vector center, NavTraverseType transient, int attribute, int id, bool AddToTail = false );
-	void ResetWaypoints( void ) { m_Waypoints.RemoveAll(); }
+	void ResetWaypoints( void ) { m_Waypoints.RemoveAll(); m_iPathGoalArea = 0; }
 
 	void DealWithObstacles( CBaseEntity *pTouchEnt, CUserCmd &cmd );
 	void AddRandomPath( float randomStartAngle = 0 );
@@ -71,6 +71,9 @@ protected:
 	float m_flNextJump;
 	bool m_bIsOnLadder;
 	CUtlVector <NavAreaData_t> m_Waypoints;
+	unsigned int m_iPathGoalArea; // the area m_Waypoints lead to, if they came from CreatePath
+	unsigned int m_iStartArea; // last areas CreatePath found, to skip searching the mesh when they haven't changed
+	unsigned int m_iGoalArea;
 	float m_flNextPathCheck;
 	float m_flDontUseDirectNav;
 	float m_flTimeToRecheckStuck;
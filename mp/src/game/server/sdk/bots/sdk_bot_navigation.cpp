@@ -1,5 +1,6 @@
 #include "cbase.h"
 #include "sdk_bot.h"
+#include "bot_navcache.h"
 
 #include "BasePropDoor.h"
 #include "in_buttons.h"
@@ -17,6 +18,7 @@ void CSDKBot::ResetNavigationParams()
 	m_bIsOnLadder = false;
 	m_flNextPathCheck = 0;
 	m_flDontUseDirectNav = 0;
+	m_iPathGoalArea = 0;
 }
 
 void CSDKBot::AddWaypoint( Vector center, NavTraverseType transient, int attribute, int id, bool AddToTail)
@@ -285,68 +287,27 @@ void CSDKBot::CheckNavMeshAttrib( trace_t *ptr, CUserCmd &cmd )
 bool CSDKBot::CreatePath( CBasePlayer *pPlayer, Vector OptionalOrg )
 {
 	m_flNextPathCheck = gpGlobals->curtime + 0.25f; // this function is expensive, make sure bot cannot use it every tick
-	ResetWaypoints();
 
 	Vector vEnd = (pPlayer != NULL) ? pPlayer->GetLocalOrigin() : OptionalOrg;
 
-	CNavArea *closestArea = NULL;
-	CNavArea *startArea = TheNavMesh->GetNearestNavArea(GetLocalOrigin());
-	CNavArea *goalArea = TheNavMesh->GetNearestNavArea(vEnd);
-
-	if( startArea == goalArea )
-		return false;
-
-	ShortestPathCost costfunc;
+	CNavArea *startArea = BotPathCache().GetNavArea( GetLocalOrigin(), m_iStartArea );
+	CNavArea *goalArea = BotPathCache().GetNavArea( vEnd, m_iGoalArea );
 
-	// if you want to understand how waypoint gathering process work, read NavAreaBuildPath notes, very informative
-	// nav areas are parented creating a path to goalArea. So we determine which ones are parented, and then they added to our waypoint list
-	if( NavAreaBuildPath( startArea, goalArea, &vEnd, costfunc, &closestArea ) )
+	// still following a path to the area the goal is in, keep going
+	if( goalArea && m_Waypoints.Count() > 0 && m_iPathGoalArea == goalArea->GetID() )
 	{
-		Vector center, center_portal, delta;
-		float hwidth;
-		NavDirType dir;
-
-		goalArea = closestArea;
-
-		Vector closestpoint;
-
-		// waypopints are returned from last one (goal area) to closest one (start area)
-
-		while( goalArea->GetParent() )
-		{
-			center = goalArea->GetParent()->GetCenter();
-			dir = goalArea->ComputeDirection(&center);
-			goalArea->ComputePortal( goalArea->GetParent(), dir, &center_portal, &hwidth );
-			goalArea->ComputeClosestPointInPortal( goalArea->GetParent(), dir, goalArea->GetParent()->GetCenter(), &closestpoint );
-
-			closestpoint.z = goalArea->GetZ( closestpoint );
-
-			NavTraverseType trav = goalArea->GetParentHow();
-
-			// if previous waypoint is a ladder top dismount point, increase height a bit
-			if( m_Waypoints.Count() > 0 && (m_Waypoints[0].Center.z - closestpoint.z ) > 64.0f && m_Waypoints[0].TransientType == GO_LADDER_UP )
-			{
-				FOR_EACH_VEC( TheNavMesh->GetLadders(), it )
-				{
-					CNavLadder *ladder = TheNavMesh->GetLadders()[ it ];
-
-					// may be tricky to understand what I'm doing here, so here's some info:
-					// if bot is meant to go up the ladder, some extra height is added to the ladder top end waypoint so the unmount operation can be completed successfully
-					// gets an extra impulse when leaving ladder, let's say
-					if( goalArea->IsConnected( ladder, CNavLadder::LADDER_UP) )
-					{
-						AddWaypoint( ladder->m_top+LADDER_EXTRA_HEIGHT_VEC, GO_LADDER_UP, goalArea->GetAttributes(), ladder->GetID() ); // extra height to ladder top waypoint
-						break;
-					}
-				}
-				trav = GO_NORTH; // since the new waypoint we just created is the reference for this ladder, set the original ladder waypoint to a non ladder traverse property
-			}
+		BotPathCache().CountReuse();
+		return true;
+	}
 
-			AddWaypoint( closestpoint, trav, goalArea->GetAttributes(), goalArea->GetID() );
+	ResetWaypoints();
 
-			goalArea = goalArea->GetParent();
-		}
+	if( startArea == goalArea || !startArea || !goalArea )
+		return false;
 
+	if( BotPathCache().GetPath( startArea, goalArea, vEnd, m_Waypoints ) )
+	{
+		m_iPathGoalArea = goalArea->GetID();
 		return true;
 	}
 
@@ -70,7 +70,8 @@ void CBriefcase::AnimateThink()
 
 	SetPlaybackRate(1);
 
-	SetNextThink(gpGlobals->curtime);
+	// The client animates it in between, StudioFrameAdvance catches up on however long it's been.
+	SetNextThink(gpGlobals->curtime + 0.1f);
 
 	StudioFrameAdvance();
 }
@@ -188,11 +189,17 @@ void CBriefcaseCaptureZone::Spawn( void )
 {
 	BaseClass::Spawn( );
 
-	SetThink(&CBriefcaseCaptureZone::CaptureThink);
-	SetNextThink( gpGlobals->curtime + 0.1f );
-
 	SetAbsOrigin(GetAbsOrigin() + Vector(0, 0, 20));
 	UTIL_DropToFloor(this, MASK_SOLID_BRUSHONLY, this);
+
+	PlayerProximity().AddListener(this, this, m_flCaptureRadius);
+}
+
+void CBriefcaseCaptureZone::UpdateOnRemove( void )
+{
+	PlayerProximity().RemoveListener(this);
+
+	BaseClass::UpdateOnRemove();
 }
 
 int CBriefcaseCaptureZone::UpdateTransmitState()
@@ -200,30 +207,16 @@ int CBriefcaseCaptureZone::UpdateTransmitState()
 	return SetTransmitState( FL_EDICT_ALWAYS );
 }
 
-void CBriefcaseCaptureZone::CaptureThink()
+void CBriefcaseCaptureZone::PlayerInRadius( CSDKPlayer* pPlayer, bool bEntered )
 {
-	SetNextThink( gpGlobals->curtime + 0.1f );
-
-	float flCaptureRadiusSqr = m_flCaptureRadius * m_flCaptureRadius;
-
-	for (int i = 1; i <= gpGlobals->maxClients; i++)
-	{
-		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
-		if (!pPlayer)
-			continue;
-
-		if (!pPlayer->IsAlive())
-			continue;
+	// Not just when entering, the briefcase can be picked up inside the zone.
+	if (!pPlayer->HasBriefcase())
+		return;
 
-		if (pPlayer->HasBriefcase() && (pPlayer->GetAbsOrigin() - GetAbsOrigin()).LengthSqr() < flCaptureRadiusSqr)
-		{
-			StopParticleEffects( SDKGameRules()->GetBriefcase() );
-			DispatchParticleEffect( "dinero_splode", GetAbsOrigin(), GetAbsAngles() );
+	StopParticleEffects( SDKGameRules()->GetBriefcase() );
+	DispatchParticleEffect( "dinero_splode", GetAbsOrigin(), GetAbsAngles() );
 
-			SDKGameRules()->PlayerCapturedBriefcase(pPlayer);
-			return;
-		}
-	}
+	SDKGameRules()->PlayerCapturedBriefcase(pPlayer);
 }
 
 BEGIN_DATADESC( CRatRaceWaypoint )
@@ -252,11 +245,17 @@ void CRatRaceWaypoint::Spawn( void )
 {
 	BaseClass::Spawn( );
 
-	SetThink(&CRatRaceWaypoint::WaypointThink);
-	SetNextThink( gpGlobals->curtime + 0.1f );
-
 	SetAbsOrigin(GetAbsOrigin() + Vector(0, 0, 20));
 	UTIL_DropToFloor(this, MASK_SOLID_BRUSHONLY, this);
+
+	PlayerProximity().AddListener(this, this, m_flRadius);
+}
+
+void CRatRaceWaypoint::UpdateOnRemove( void )
+{
+	PlayerProximity().RemoveListener(this);
+
+	BaseClass::UpdateOnRemove();
 }
 
 int CRatRaceWaypoint::UpdateTransmitState()
@@ -264,22 +263,8 @@ int CRatRaceWaypoint::UpdateTransmitState()
 	return SetTransmitState( FL_EDICT_ALWAYS );
 }
 
-void CRatRaceWaypoint::WaypointThink()
+void CRatRaceWaypoint::PlayerInRadius( CSDKPlayer* pPlayer, bool bEntered )
 {
-	SetNextThink( gpGlobals->curtime + 0.1f );
-
-	float flRadiusSqr = m_flRadius * m_flRadius;
-
-	for (int i = 1; i <= gpGlobals->maxClients; i++)
-	{
-		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
-		if (!pPlayer)
-			continue;
-
-		if (!pPlayer->IsAlive())
-			continue;
-
-		if ((pPlayer->GetAbsOrigin() - GetAbsOrigin()).LengthSqr() < flRadiusSqr)
-			SDKGameRules()->PlayerReachedWaypoint(pPlayer, this);
-	}
+	// Every tick they're inside, they might have been a waypoint behind when they came in.
+	SDKGameRules()->PlayerReachedWaypoint(pPlayer, this);
 }
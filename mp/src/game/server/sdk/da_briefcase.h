@@ -10,6 +10,7 @@
 #pragma once
 
 #include "items.h"
+#include "da_playerproximity.h"
 
 class CBriefcase : public CItem
 {
@@ -38,7 +39,7 @@ private:
 	float m_flLastTouched;
 };
 
-class CBriefcaseCaptureZone : public CBaseEntity
+class CBriefcaseCaptureZone : public CBaseEntity, public IPlayerProximityListener
 {
 	DECLARE_CLASS( CBriefcaseCaptureZone, CBaseEntity );
 	DECLARE_SERVERCLASS();
@@ -51,15 +52,17 @@ public:
 	void Precache( void );
 	void Spawn( void );
 
+	void UpdateOnRemove( void );
+
 	int UpdateTransmitState();
 
-	void CaptureThink();
+	void PlayerInRadius( CSDKPlayer* pPlayer, bool bEntered );
 
 private:
 	CNetworkVar( float, m_flCaptureRadius );
 };
 
-class CRatRaceWaypoint : public CBaseEntity
+class CRatRaceWaypoint : public CBaseEntity, public IPlayerProximityListener
 {
 	DECLARE_CLASS( CRatRaceWaypoint, CBaseEntity );
 	DECLARE_SERVERCLASS();
@@ -72,9 +75,11 @@ public:
 	void Precache( void );
 	void Spawn( void );
 
+	void UpdateOnRemove( void );
+
 	int UpdateTransmitState();
 
-	void WaypointThink();
+	void PlayerInRadius( CSDKPlayer* pPlayer, bool bEntered );
 
 	void SetWaypoint(int i) { m_iWaypoint = i; }
 	int  GetWaypoint() { return m_iWaypoint; }
@@ -18,6 +18,7 @@ using namespace std;
 
 #include "../datanetworking/math.pb.h"
 #include "../datanetworking/data.pb.h"
+#include "../datanetworking/datanetworking.h"
 
 #endif
 
@@ -41,21 +42,100 @@ CDataManager& DataManager()
 }
 
 ConVar da_telemetry_enable("da_telemetry_enable", "1", 0, "Send telemetry to master server");
+ConVar da_data_stream_interval("da_data_stream_interval", "0", 0, "How often (in seconds) to send the data collected so far during a map. 0 (default) sends it all at the end of the map.");
+ConVar da_data_stream_max_chunks("da_data_stream_max_chunks", "8", 0, "How many chunks of data can wait to be sent. If the sender falls this far behind, positions and kills are dropped until it catches up.", true, 1, false, 0);
+ConVar da_data_stream_max_records("da_data_stream_max_records", "4096", 0, "How many positions and kills a chunk can hold. A chunk that fills up is sent early, even if da_data_stream_interval is 0.", true, 1, false, 0);
 
-extern bool DASendData(const da::protobuf::GameData& pbGameData, std::string& sError);
-static void SendData( CFunctor **pData, unsigned int nCount )
+static void SinkSettingsChanged( IConVar *var, const char *pOldValue, float flOldValue )
 {
-	if (!da_telemetry_enable.GetBool())
-		return;
+	DataManager().UpdateSinkSettings();
+}
 
-	da::protobuf::GameData pbGameData;
+ConVar da_data_url("da_data_url", "http://data.doubleactiongame.com/data/receive.php", 0, "Where to send game data. Leave empty to only write it to the spool file.", SinkSettingsChanged);
+ConVar da_data_spool_file("da_data_spool_file", "", 0, "File in the game directory that keeps game data that couldn't be sent until it can be, e.g. data_spool.dat for offline or LAN servers. Empty (default) drops it instead.", SinkSettingsChanged);
+ConVar da_data_spool_size("da_data_spool_size", "16", 0, "Size of the spool file in megabytes.", true, 1, true, 1024, SinkSettingsChanged);
 
-	g_DataManager.FillProtoBuffer(&pbGameData);
+static void StopLocalReceiver();
 
-	std::string sError;
-	if (!DASendData(pbGameData, sError))
-		Msg("Error sending game data: %s", sError.c_str());
-}
+// Seconds between attempts to send what's in the spool when there's nothing new to send.
+#define SENDER_RETRY_INTERVAL 5
+
+class CDataSender : public CThread
+{
+public:
+	CDataSender()
+	{
+		m_bQuit = false;
+		m_bSettingsChanged = false;
+		m_iSpoolSize = 0;
+		SetName("DataSender");
+	}
+
+	void SetSinkSettings(const char* pszURL, const char* pszSpoolFile, size_t iSpoolSize)
+	{
+		AUTO_LOCK( m_SettingsMutex );
+		m_sURL = pszURL;
+		m_sSpoolFile = pszSpoolFile;
+		m_iSpoolSize = iSpoolSize;
+		m_bSettingsChanged = true;
+	}
+
+	// Only the counters are safe to read from another thread.
+	const CDataSink& GetSink() const
+	{
+		return m_Sink;
+	}
+
+	void Wake()
+	{
+		m_Wake.Set();
+	}
+
+	// Sends whatever is still queued, then exits.
+	void Stop()
+	{
+		m_bQuit = true;
+		m_Wake.Set();
+		Join();
+	}
+
+protected:
+	virtual int Run()
+	{
+		while (true)
+		{
+			m_Wake.Wait(SENDER_RETRY_INTERVAL * 1000);
+
+			if (m_bSettingsChanged)
+			{
+				AUTO_LOCK( m_SettingsMutex );
+				m_Sink.Configure(m_sURL.Get(), m_sSpoolFile.Get(), m_iSpoolSize);
+				m_bSettingsChanged = false;
+			}
+
+			g_DataManager.SendQueuedChunks(m_Sink);
+
+			std::string sError;
+			if (!m_Sink.FlushSpool(sError) && sError.length())
+				Msg("Error sending spooled game data: %s", sError.c_str());
+
+			if (m_bQuit)
+				return 0;
+		}
+	}
+
+private:
+	CThreadEvent  m_Wake;
+	volatile bool m_bQuit;
+
+	CDataSink     m_Sink;
+
+	CThreadFastMutex m_SettingsMutex;
+	CUtlString    m_sURL;
+	CUtlString    m_sSpoolFile;
+	size_t        m_iSpoolSize;
+	volatile bool m_bSettingsChanged;
+};
 
 static bool Account_LessFunc( AccountID_t const &a, AccountID_t const &b )
 {
@@ -67,7 +147,15 @@ CDataManager::CDataManager( char const* name )
 {
 	m_aiConnectedClients.SetLessFunc(Account_LessFunc);
 
-	m_pSendData = NULL;
+	m_pbChunk = NULL;
+	m_iChunk = 0;
+	m_flNextChunk = 0;
+	m_iMapStartTimestamp = 0;
+
+	m_iChunksAllocated = 0;
+	m_iChunksDropped = 0;
+
+	m_pSender = NULL;
 
 	d = NULL;
 
@@ -80,19 +168,51 @@ CDataManager::~CDataManager()
 	delete d;
 }
 
+bool CDataManager::Init()
+{
+	DAInitDataNetworking();
+	return true;
+}
+
+void CDataManager::Shutdown()
+{
+	// Let the sender finish off the last map's data.
+	if (m_pSender)
+	{
+		m_pSender->Stop();
+		delete m_pSender;
+		m_pSender = NULL;
+	}
+
+	da::protobuf::GameData* pbChunk;
+	while (m_apFreeQueue.PopItem(&pbChunk))
+		delete pbChunk;
+
+	delete m_pbChunk;
+	m_pbChunk = NULL;
+
+	StopLocalReceiver();
+
+	DAShutdownDataNetworking();
+}
+
 void CDataManager::LevelInitPostEntity( void )
 {
-	// If the thread is executing, then wait for it to finish
-	if ( m_pSendData )
+	// Protobuf messages can't be made during static initialization, so the first chunk is made here.
+	if (!m_pbChunk)
 	{
-		m_pSendData->WaitForFinishAndRelease();
-		m_pSendData = NULL;
+		m_pbChunk = new da::protobuf::GameData();
+		m_iChunksAllocated++;
 	}
 
 	m_bLevelStarted = true;
 	d->z.m_flStartTime = gpGlobals->curtime;
 	d->z.m_flNextPositionsUpdate = gpGlobals->curtime;
 
+	m_iChunk = 0;
+	m_flNextChunk = gpGlobals->curtime + da_data_stream_interval.GetFloat();
+	m_iMapStartTimestamp = (unsigned)time(NULL);
+
 	CUtlMap<AccountID_t, char>::IndexType_t it = m_aiConnectedClients.FirstInorder();
 	while (it != m_aiConnectedClients.InvalidIndex())
 	{
@@ -113,21 +233,42 @@ void CDataManager::LevelInitPostEntity( void )
 	}
 }
 
+ConVar da_data_enabled("da_data_enabled", "1", 0, "Turn on and off data sending.");
+
 void CDataManager::FrameUpdatePostEntityThink( void )
 {
+	if (!m_bLevelStarted)
+		return;
+
 	if (gpGlobals->curtime > d->z.m_flNextPositionsUpdate)
 		SavePositions();
+
+	if (!da_data_enabled.GetBool())
+		return;
+
+	bool bStreamDue = da_data_stream_interval.GetFloat() > 0 && gpGlobals->curtime > m_flNextChunk;
+
+	// A busy server can collect a lot between flushes, so don't let one chunk grow without bound.
+	bool bChunkFull = m_pbChunk && m_pbChunk->positions().position_size() + m_pbChunk->kill_details_size() >= da_data_stream_max_records.GetInt();
+
+	if (bStreamDue || bChunkFull)
+	{
+		m_flNextChunk = gpGlobals->curtime + da_data_stream_interval.GetFloat();
+		FlushChunk(false);
+	}
 }
 
 ConVar da_data_positions_interval("da_data_positions_interval", "10", FCVAR_DEVELOPMENTONLY, "How often to query player positions");
 
 void CDataManager::SavePositions()
 {
-	if (IsSendingData())
+	if (!m_pbChunk)
 		return;
 
 	d->z.m_flNextPositionsUpdate = gpGlobals->curtime + da_data_positions_interval.GetFloat();
 
+	google::protobuf::RepeatedPtrField<da::protobuf::Vector>* pPositions = m_pbChunk->mutable_positions()->mutable_position();
+
 	for (int i = 1; i <= gpGlobals->maxClients; i++)
 	{
 		CSDKPlayer *pPlayer = ToSDKPlayer(UTIL_PlayerByIndex( i ));
@@ -140,7 +281,7 @@ void CDataManager::SavePositions()
 		if (!pPlayer->IsAlive())
 			continue;
 
-		d->m_avecPlayerPositions.AddToTail(pPlayer->GetAbsOrigin());
+		FillProtoBufVector(pPositions->Add(), pPlayer->GetAbsOrigin());
 
 		if (pPlayer->IsInThirdPerson())
 			d->z.m_iThirdPersonActive += da_data_positions_interval.GetFloat();
@@ -260,8 +401,10 @@ void FillPlayerInfo(da::protobuf::PlayerInfo* pbPlayerInfo, CSDKPlayer* pPlayer)
 
 void CDataManager::AddKillInfo(const CTakeDamageInfo& info, CSDKPlayer* pVictim)
 {
-	d->m_apKillInfos.AddToTail(new da::protobuf::KillInfo());
-	da::protobuf::KillInfo* pbKillInfo = d->m_apKillInfos.Tail();
+	if (!m_pbChunk)
+		return;
+
+	da::protobuf::KillInfo* pbKillInfo = m_pbChunk->add_kill_details();
 
 	CBaseEntity* pAttacker = info.GetAttacker();
 
@@ -409,32 +552,307 @@ void CDataManager::VoteFailed(const char* pszIssue)
 	d->m_aVoteResults[i].m_sIssue = pszIssue;
 }
 
-ConVar da_data_enabled("da_data_enabled", "1", 0, "Turn on and off data sending.");
-
 void CDataManager::LevelShutdownPostEntity()
 {
 	if (!gpGlobals->maxClients)
 		return;
 
-	if (!da_data_enabled.GetBool())
-		return;
-
 	// This function is sometimes called twice for every LevelInitPostEntity(), so remove duplicates.
 	if (!m_bLevelStarted)
 		return;
 
-	// If the thread is executing, then wait for it to finish
-	if ( m_pSendData )
-		m_pSendData->WaitForFinishAndRelease();
+	if (da_data_enabled.GetBool())
+		FlushChunk(true);
+	else if (m_pbChunk)
+		m_pbChunk->Clear();
 
-	m_pSendData = ThreadExecute( &SendData, (CFunctor**)NULL, 0 );
+	ClearData();
 
 	m_bLevelStarted = false;
 }
 
 bool CDataManager::IsSendingData()
 {
-	return !!m_pSendData;
+	return m_iChunksQueued > 0;
+}
+
+void CDataManager::FlushChunk(bool bLastChunk)
+{
+	if (!m_pbChunk)
+		return;
+
+	// The sender has fallen behind. Rather than let the queue grow without bound, throw away the
+	// positions and kills in this chunk. The counters stay in d and go out with the next chunk.
+	// The last chunk of a map always goes out so the totals for the map are complete.
+	if (!bLastChunk && m_iChunksQueued >= da_data_stream_max_chunks.GetInt())
+	{
+		m_pbChunk->Clear();
+		m_iChunksDropped++;
+		return;
+	}
+
+	da::protobuf::GameData* pbNextChunk;
+	if (!m_apFreeQueue.PopItem(&pbNextChunk))
+	{
+		pbNextChunk = new da::protobuf::GameData();
+		m_iChunksAllocated++;
+	}
+
+	FillProtoBuffer(m_pbChunk);
+
+	m_pbChunk->set_map_start_timestamp(m_iMapStartTimestamp);
+	m_pbChunk->set_chunk(m_iChunk++);
+	m_pbChunk->set_last_chunk(bLastChunk);
+
+	m_iChunksQueued++;
+	m_apSendQueue.PushItem(m_pbChunk);
+
+	m_pbChunk = pbNextChunk;
+
+	if (!m_pSender)
+	{
+		m_pSender = new CDataSender();
+		UpdateSinkSettings();
+		m_pSender->Start();
+	}
+
+	m_pSender->Wake();
+}
+
+void CDataManager::SendQueuedChunks(CDataSink& oSink)
+{
+	da::protobuf::GameData* pbChunk;
+	while (m_apSendQueue.PopItem(&pbChunk))
+	{
+		if (da_telemetry_enable.GetBool())
+		{
+			std::string sError;
+			if (!oSink.Send(*pbChunk, sError))
+				Msg("Error sending game data: %s", sError.c_str());
+		}
+
+		// Clear() keeps the repeated fields' messages around, so the next
+		// chunk to use this one doesn't have to allocate them again.
+		pbChunk->Clear();
+		m_apFreeQueue.PushItem(pbChunk);
+
+		m_iChunksQueued--;
+	}
+}
+
+static void GetSpoolPath(char* pszPath, int iLength)
+{
+	if (!da_data_spool_file.GetString()[0])
+	{
+		pszPath[0] = '\0';
+		return;
+	}
+
+	char szGameDir[MAX_PATH];
+	engine->GetGameDir(szGameDir, sizeof(szGameDir));
+	V_MakeAbsolutePath(pszPath, iLength, da_data_spool_file.GetString(), szGameDir);
+}
+
+void CDataManager::UpdateSinkSettings()
+{
+	if (!m_pSender)
+		return;
+
+	char szSpoolPath[MAX_PATH];
+	GetSpoolPath(szSpoolPath, sizeof(szSpoolPath));
+
+	m_pSender->SetSinkSettings(da_data_url.GetString(), szSpoolPath, (size_t)da_data_spool_size.GetInt()*1024*1024);
+	m_pSender->Wake();
+}
+
+void CDataManager::PrintStreamStats()
+{
+	Msg("Data chunks: %d allocated, %d waiting to be sent, %d dropped\n", m_iChunksAllocated, (int)m_iChunksQueued, m_iChunksDropped);
+	Msg("Current chunk: %d positions, %d kills\n", m_pbChunk?m_pbChunk->positions().position_size():0, m_pbChunk?m_pbChunk->kill_details_size():0);
+
+	if (m_pSender)
+	{
+		const CDataSink& oSink = m_pSender->GetSink();
+		Msg("Sink: %d uploads, %d failures, %d dropped, next retry in %d seconds\n", oSink.GetUploads(), oSink.GetFailures(), oSink.GetDropped(), oSink.GetSecondsUntilRetry());
+		Msg("Spool: %d records, %d/%d bytes\n", (int)oSink.GetSpool().GetRecordCount(), (int)oSink.GetSpool().GetUsedBytes(), (int)oSink.GetSpool().GetCapacity());
+	}
+}
+
+CON_COMMAND(da_data_stream_stats, "Show the state of the game data stream.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	DataManager().PrintStreamStats();
+}
+
+class CDataReceiverThread : public CThread
+{
+public:
+	CDataReceiverThread(int iPort)
+	{
+		m_iPort = iPort;
+		m_bQuit = false;
+		memset(&m_Stats, 0, sizeof(m_Stats));
+		SetName("DataReceiver");
+	}
+
+	void Stop()
+	{
+		m_bQuit = true;
+		Join();
+	}
+
+	int GetPort() const { return m_iPort; }
+	const DAReceiverStats& GetStats() const { return m_Stats; }
+
+protected:
+	virtual int Run()
+	{
+		std::string sError;
+		if (!DARunLocalReceiver(m_iPort, &m_bQuit, &m_Stats, sError))
+			Msg("Local data receiver: %s", sError.c_str());
+
+		return 0;
+	}
+
+private:
+	int             m_iPort;
+	volatile bool   m_bQuit;
+	DAReceiverStats m_Stats;
+};
+
+static CDataReceiverThread* g_pDataReceiver = NULL;
+
+static void StopLocalReceiver()
+{
+	if (!g_pDataReceiver)
+		return;
+
+	const DAReceiverStats& oStats = g_pDataReceiver->GetStats();
+	Msg("Local data receiver got %d requests (%d invalid), %lld bytes\n", oStats.m_iRequests, oStats.m_iInvalid, oStats.m_iBytes);
+
+	g_pDataReceiver->Stop();
+	delete g_pDataReceiver;
+	g_pDataReceiver = NULL;
+}
+
+CON_COMMAND(da_data_local_receiver, "Start a stand-in for the data collection server on this machine: da_data_local_receiver <port>. 0 stops it.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	if (args.ArgC() < 2)
+	{
+		if (g_pDataReceiver)
+		{
+			const DAReceiverStats& oStats = g_pDataReceiver->GetStats();
+			Msg("Local data receiver on port %d: %d requests (%d invalid), %lld bytes\n", g_pDataReceiver->GetPort(), oStats.m_iRequests, oStats.m_iInvalid, oStats.m_iBytes);
+		}
+		else
+			Msg("Local data receiver isn't running.\n");
+		return;
+	}
+
+	StopLocalReceiver();
+
+	int iPort = atoi(args[1]);
+	if (iPort <= 0)
+		return;
+
+	g_pDataReceiver = new CDataReceiverThread(iPort);
+	g_pDataReceiver->Start();
+
+	Msg("Local data receiver started. To send to it: da_data_url http://127.0.0.1:%d/\n", iPort);
+}
+
+static void FillBenchmarkData(da::protobuf::GameData* pbGameData, int iPositions, int iKills)
+{
+	pbGameData->set_da_version(atoi(DA_VERSION));
+	pbGameData->set_map_name("benchmark");
+	pbGameData->set_debug(true);
+
+	for (int i = 0; i < iPositions; i++)
+		FillProtoBufVector(pbGameData->mutable_positions()->add_position(), Vector(RandomFloat(-4096, 4096), RandomFloat(-4096, 4096), RandomFloat(-512, 512)));
+
+	for (int i = 0; i < iKills; i++)
+	{
+		da::protobuf::KillInfo* pbKillInfo = pbGameData->add_kill_details();
+		FillProtoBufVector(pbKillInfo->mutable_victim()->mutable_position(), Vector(RandomFloat(-4096, 4096), RandomFloat(-4096, 4096), 0));
+		pbKillInfo->mutable_victim()->set_health(0);
+		pbKillInfo->mutable_victim()->set_weapon("beretta");
+		FillProtoBufVector(pbKillInfo->mutable_killer()->mutable_position(), Vector(RandomFloat(-4096, 4096), RandomFloat(-4096, 4096), 0));
+		pbKillInfo->mutable_killer()->set_health(100);
+		pbKillInfo->mutable_killer()->set_weapon("mossberg");
+	}
+}
+
+CON_COMMAND(da_data_sink_bench, "Time sending game data to da_data_url directly and through a spool file: da_data_sink_bench [chunks] [positions] [kills]. Blocks the server while it runs.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	int iChunks = (args.ArgC() > 1)?atoi(args[1]):100;
+	if (iChunks < 1)
+		iChunks = 1;
+
+	int iPositions = (args.ArgC() > 2)?atoi(args[2]):1000;
+	int iKills = (args.ArgC() > 3)?atoi(args[3]):50;
+
+	da::protobuf::GameData pbGameData;
+	FillBenchmarkData(&pbGameData, iPositions, iKills);
+
+	int iBytes = pbGameData.ByteSize();
+	Msg("%d chunks of %d bytes (%d positions, %d kills)\n", iChunks, iBytes, iPositions, iKills);
+
+	std::string sError;
+
+	{
+		CDataSink oSink;
+		oSink.Configure(da_data_url.GetString(), "", 0);
+
+		double flStart = Plat_FloatTime();
+		int iSent = 0;
+		for (int i = 0; i < iChunks; i++)
+			iSent += oSink.Send(pbGameData, sError);
+		double flTime = Plat_FloatTime() - flStart;
+
+		Msg("Upload: %d/%d sent in %.3fs, %.3fms per chunk, %.2f MB/s\n", iSent, iChunks, flTime, flTime*1000/iChunks, iBytes*(double)iSent/flTime/(1024*1024));
+		if (iSent < iChunks)
+			Msg("  Last error: %s", sError.c_str());
+	}
+
+	char szSpoolPath[MAX_PATH];
+	char szGameDir[MAX_PATH];
+	engine->GetGameDir(szGameDir, sizeof(szGameDir));
+	V_ComposeFileName(szGameDir, "data_spool_bench.dat", szSpoolPath, sizeof(szSpoolPath));
+
+	{
+		CDataSink oSink;
+		oSink.Configure("", szSpoolPath, (size_t)da_data_spool_size.GetInt()*1024*1024);
+
+		double flStart = Plat_FloatTime();
+		for (int i = 0; i < iChunks; i++)
+		{
+			if (!oSink.Send(pbGameData, sError))
+				break;
+		}
+		double flTime = Plat_FloatTime() - flStart;
+
+		int iSpooled = (int)oSink.GetSpool().GetRecordCount();
+		Msg("Spool: %d/%d written in %.3fs, %.3fms per chunk\n", iSpooled, iChunks, flTime, flTime*1000/iChunks);
+
+		oSink.Configure(da_data_url.GetString(), szSpoolPath, (size_t)da_data_spool_size.GetInt()*1024*1024);
+
+		flStart = Plat_FloatTime();
+		oSink.FlushSpool(sError);
+		flTime = Plat_FloatTime() - flStart;
+
+		int iReplayed = iSpooled - (int)oSink.GetSpool().GetRecordCount();
+		Msg("Replay: %d/%d sent from the spool in %.3fs, %.3fms per chunk\n", iReplayed, iSpooled, flTime, iSpooled?flTime*1000/iSpooled:0);
+	}
+
+	remove(szSpoolPath);
 }
 
 void CDataManager::FillProtoBuffer(da::protobuf::GameData* pbGameData)
@@ -473,15 +891,10 @@ void CDataManager::FillProtoBuffer(da::protobuf::GameData* pbGameData)
 	pbGameData->set_platform_linux(d->z.m_iLinux);
 	pbGameData->set_platform_osx(d->z.m_iMac);
 
-	google::protobuf::RepeatedPtrField<da::protobuf::Vector>* pPositions = pbGameData->mutable_positions()->mutable_position();
-	size_t iDataSize = d->m_avecPlayerPositions.Count();
-	pPositions->Reserve(iDataSize);
-
-	for (size_t i = 0; i < iDataSize; i++)
-		FillProtoBufVector(pPositions->Add(), d->m_avecPlayerPositions[i]);
+	// Positions and kills were written into the chunk as they happened.
 
 	google::protobuf::RepeatedPtrField<std::string>* pCharacters = pbGameData->mutable_characters_chosen();
-	iDataSize = d->m_asCharactersChosen.Count();
+	size_t iDataSize = d->m_asCharactersChosen.Count();
 	pCharacters->Reserve(iDataSize);
 
 	for (CUtlMap<CUtlString, int>::IndexType_t it = d->m_asCharactersChosen.FirstInorder(); it != d->m_asCharactersChosen.InvalidIndex(); it = d->m_asCharactersChosen.NextInorder(it))
@@ -516,13 +929,6 @@ void CDataManager::FillProtoBuffer(da::protobuf::GameData* pbGameData)
 		pVR->set_details(d->m_aVoteResults[i].m_sDetails);
 	}
 
-	google::protobuf::RepeatedPtrField<da::protobuf::KillInfo>* pKillInfos = pbGameData->mutable_kill_details();
-	iDataSize = d->m_apKillInfos.Count();
-	pKillInfos->Reserve(iDataSize);
-
-	for (size_t i = 0; i < iDataSize; i++)
-		pKillInfos->Add()->CopyFrom(*d->m_apKillInfos[i]);
-
 	google::protobuf::RepeatedPtrField<da::protobuf::PlayerList>* pPlayerList = pbGameData->mutable_player_list();
 	iDataSize = d->m_apPlayerList.Count();
 	pPlayerList->Reserve(iDataSize);
@@ -530,7 +936,7 @@ void CDataManager::FillProtoBuffer(da::protobuf::GameData* pbGameData)
 	for (CUtlMap<AccountID_t, class da::protobuf::PlayerList*>::IndexType_t it = d->m_apPlayerList.FirstInorder(); it != d->m_apPlayerList.InvalidIndex(); it = d->m_apPlayerList.NextInorder(it))
 		pPlayerList->Add()->CopyFrom(*d->m_apPlayerList[it]);
 
-	ClearData();
+	ClearDelta();
 }
 
 void CDataManager::ClearData()
@@ -541,9 +947,25 @@ void CDataManager::ClearData()
 	d = new CDataContainer();
 }
 
+void CDataManager::ClearDelta()
+{
+	// Everything that was just sent starts over from zero for the next chunk,
+	// except for what describes the level itself.
+	float flStartTime = d->z.m_flStartTime;
+	bool bTeamplay = d->z.m_bTeamplay;
+	float flNextPositionsUpdate = d->z.m_flNextPositionsUpdate;
+	bool bCheated = d->z.m_bCheated;
+
+	ClearData();
+
+	d->z.m_flStartTime = flStartTime;
+	d->z.m_bTeamplay = bTeamplay;
+	d->z.m_flNextPositionsUpdate = flNextPositionsUpdate;
+	d->z.m_bCheated = bCheated;
+}
+
 CDataManager::CDataContainer::~CDataContainer()
 {
-	m_apKillInfos.PurgeAndDeleteElements();
 	m_apPlayerList.PurgeAndDeleteElements();
 }
 
@@ -2,7 +2,8 @@
 
 #ifdef WITH_DATA_COLLECTION
 
-#include "vstdlib/jobthread.h"
+#include "tier0/threadtools.h"
+#include "tier0/tslist.h"
 
 #include "sdk_shareddefs.h"
 #include "sdk_player.h"
@@ -24,6 +25,8 @@ public:
 	virtual ~CDataManager();
 
 public:
+	virtual bool Init();
+	virtual void Shutdown();
 	virtual void LevelInitPostEntity();
 	virtual void FrameUpdatePostEntityThink();
 	virtual void LevelShutdownPostEntity();
@@ -52,6 +55,19 @@ public:
 	void FillProtoBuffer(da::protobuf::GameData* pbGameData);
 	void ClearData();
 
+	void ClearDelta();
+
+	// Hand the data collected so far to the sender thread and start a new chunk.
+	void FlushChunk(bool bLastChunk);
+
+	// Called on the sender thread.
+	void SendQueuedChunks(class CDataSink& oSink);
+
+	// Hands the da_data_url/da_data_spool_* settings to the sender thread.
+	void UpdateSinkSettings();
+
+	void PrintStreamStats();
+
 private:
 	class CDataContainer
 	{
@@ -90,7 +106,6 @@ private:
 			bool  m_bCheated;
 		} z; // Stuff that needs to be initialized to 0
 
-		CUtlVector<Vector> m_avecPlayerPositions;
 		CUtlMap<CUtlString, int> m_asCharactersChosen;
 		CUtlVector<SDKWeaponID> m_aeWeaponsChosen;
 		CUtlVector<SkillID>     m_aeSkillsChosen;
@@ -103,7 +118,6 @@ private:
 		};
 		CUtlVector<VoteResult> m_aVoteResults;
 
-		CUtlVector<class da::protobuf::KillInfo*> m_apKillInfos;
 		CUtlMap<AccountID_t, class da::protobuf::PlayerList*> m_apPlayerList;
 	}* d;
 
@@ -112,7 +126,22 @@ private:
 	CUtlMap<AccountID_t, char> m_aiConnectedClients;
 
 	bool  m_bLevelStarted;
-	CJob* m_pSendData;
+
+	// Positions and kills are written straight into the chunk that's being built.
+	// Sent chunks come back through the free queue and get reused, their repeated
+	// fields keep the messages they allocated so they don't have to be allocated again.
+	da::protobuf::GameData* m_pbChunk;
+	int   m_iChunk;
+	float m_flNextChunk;
+	int   m_iMapStartTimestamp;
+
+	CTSQueue<da::protobuf::GameData*> m_apSendQueue;
+	CTSQueue<da::protobuf::GameData*> m_apFreeQueue;
+	CInterlockedInt m_iChunksQueued;
+	int   m_iChunksAllocated;
+	int   m_iChunksDropped;
+
+	class CDataSender* m_pSender;
 };
 
 CDataManager& DataManager();
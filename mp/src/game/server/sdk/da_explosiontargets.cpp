@@ -0,0 +1,203 @@
+#include "cbase.h"
+
+#include "da_explosiontargets.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar da_explosion_merge("da_explosion_merge", "1", FCVAR_GAMEDLL, "Overlapping explosions in the same tick share one search for targets.");
+
+CExplosionTargets g_ExplosionTargets( "CExplosionTargets" );
+
+CExplosionTargets& ExplosionTargets()
+{
+	return g_ExplosionTargets;
+}
+
+CExplosionTargets::CExplosionTargets( char const *name )
+	: CAutoGameSystem(name)
+{
+	m_iTick = -1;
+	m_bValid = false;
+	m_iCandidates = 0;
+
+	m_iExplosions = 0;
+	m_iQueries = 0;
+	m_iCandidatesTested = 0;
+	m_iTargets = 0;
+}
+
+bool CExplosionTargets::Init()
+{
+	gEntList.AddListenerEntity(this);
+	return true;
+}
+
+void CExplosionTargets::Shutdown()
+{
+	gEntList.RemoveListenerEntity(this);
+}
+
+void CExplosionTargets::LevelShutdownPostEntity()
+{
+	m_bValid = false;
+	m_iCandidates = 0;
+}
+
+void CExplosionTargets::OnEntityCreated( CBaseEntity *pEntity )
+{
+	// It might be in the sphere, and the query wouldn't know about it.
+	m_bValid = false;
+}
+
+void CExplosionTargets::Query( const Vector &vecCenter, float flRadius )
+{
+	m_iQueries++;
+
+	CBaseEntity* apEntities[MAX_SPHERE_QUERY];
+	m_iCandidates = UTIL_EntitiesInSphere( apEntities, ARRAYSIZE(apEntities), vecCenter, flRadius, 0 );
+
+	for (int i = 0; i < m_iCandidates; i++)
+	{
+		m_ahCandidates[i] = apEntities[i];
+		m_aiClass[i] = apEntities[i]->Classify();
+	}
+
+	m_iTick = gpGlobals->tickcount;
+	m_vecCenter = vecCenter;
+	m_flRadius = flRadius;
+
+	// If it filled up there might be more out there, a bigger explosion could miss them.
+	m_bValid = m_iCandidates < MAX_SPHERE_QUERY;
+}
+
+int CExplosionTargets::Gather( const Vector &vecSrc, float flRadius, int iClassIgnore, CBaseEntity *pIgnore, bool bInWater, CBaseEntity **ppTargets, int iMaxTargets )
+{
+	m_iExplosions++;
+
+	float flQueryRadius = flRadius + EXPLOSION_QUERY_PAD;
+
+	bool bReuse = da_explosion_merge.GetBool() && m_bValid && m_iTick == gpGlobals->tickcount;
+	float flDistance = bReuse?(vecSrc - m_vecCenter).Length():0;
+
+	if (!bReuse)
+		Query(vecSrc, flQueryRadius);
+	else if (flDistance + flRadius > m_flRadius)
+	{
+		// Grow the query to take in both explosions, if they're close enough that it's worth it.
+		float flMerged = (flDistance + flQueryRadius + m_flRadius)/2;
+
+		if (flDistance + m_flRadius <= flQueryRadius || flMerged >= flQueryRadius*2)
+			Query(vecSrc, flQueryRadius);
+		else
+		{
+			Query(m_vecCenter + (vecSrc - m_vecCenter) * ((flMerged - m_flRadius)/flDistance), flMerged);
+
+			// The bigger sphere filled up and might have left out something this explosion reaches.
+			if (m_iCandidates == MAX_SPHERE_QUERY)
+				Query(vecSrc, flQueryRadius);
+		}
+	}
+
+	m_iCandidatesTested += m_iCandidates;
+
+	// Things may have moved or been removed since the query, so bounds and water level are fetched again.
+	const Vector vecFar(1e30f, 1e30f, 1e30f);
+	int iGroups = (m_iCandidates+3)/4;
+	for (int i = 0; i < iGroups*4; i++)
+	{
+		FourVectors& vecMins = m_avecMins[i/4];
+		FourVectors& vecMaxs = m_avecMaxs[i/4];
+
+		CBaseEntity* pEntity = (i < m_iCandidates)?m_ahCandidates[i].Get():NULL;
+
+		Vector vecEntityMins = vecFar, vecEntityMaxs = vecFar;
+		int iWaterLevel = -1;
+
+		if (pEntity)
+		{
+			pEntity->CollisionProp()->WorldSpaceSurroundingBounds(&vecEntityMins, &vecEntityMaxs);
+			iWaterLevel = pEntity->GetWaterLevel();
+		}
+
+		vecMins.X(i%4) = vecEntityMins.x;
+		vecMins.Y(i%4) = vecEntityMins.y;
+		vecMins.Z(i%4) = vecEntityMins.z;
+		vecMaxs.X(i%4) = vecEntityMaxs.x;
+		vecMaxs.Y(i%4) = vecEntityMaxs.y;
+		vecMaxs.Z(i%4) = vecEntityMaxs.z;
+		SubFloat(m_aflWaterLevel[i/4], i%4) = (float)iWaterLevel;
+	}
+
+	FourVectors vecCenter;
+	vecCenter.DuplicateVector(vecSrc);
+
+	fltx4 flRadiusSqr = ReplicateX4(flRadius*flRadius);
+	fltx4 flZero = Four_Zeros;
+
+	// Blasts don't travel into or out of water.
+	fltx4 flBlockedWaterLevel = ReplicateX4(bInWater?0.0f:3.0f);
+
+	int iTargets = 0;
+
+	for (int i = 0; i < iGroups; i++)
+	{
+		// Distance from the center to the closest point of each box.
+		FourVectors vecBelow = m_avecMins[i];
+		vecBelow -= vecCenter;
+		FourVectors vecAbove = vecCenter;
+		vecAbove -= m_avecMaxs[i];
+
+		FourVectors vecOutside;
+		vecOutside.x = AddSIMD(MaxSIMD(vecBelow.x, flZero), MaxSIMD(vecAbove.x, flZero));
+		vecOutside.y = AddSIMD(MaxSIMD(vecBelow.y, flZero), MaxSIMD(vecAbove.y, flZero));
+		vecOutside.z = AddSIMD(MaxSIMD(vecBelow.z, flZero), MaxSIMD(vecAbove.z, flZero));
+
+		fltx4 bInSphere = CmpLeSIMD(vecOutside*vecOutside, flRadiusSqr);
+		fltx4 bBlocked = CmpEqSIMD(m_aflWaterLevel[i], flBlockedWaterLevel);
+
+		int iMask = TestSignSIMD(AndNotSIMD(bBlocked, bInSphere));
+		if (!iMask)
+			continue;
+
+		for (int j = 0; j < 4; j++)
+		{
+			if (!(iMask & (1<<j)))
+				continue;
+
+			int iCandidate = i*4 + j;
+			CBaseEntity* pEntity = m_ahCandidates[iCandidate];
+
+			if (pEntity == pIgnore)
+				continue;
+
+			// UNDONE: this should check a damage mask, not an ignore
+			if (iClassIgnore != CLASS_NONE && m_aiClass[iCandidate] == iClassIgnore)
+				continue;
+
+			if (iTargets >= iMaxTargets)
+				break;
+
+			ppTargets[iTargets++] = pEntity;
+		}
+	}
+
+	m_iTargets += iTargets;
+
+	return iTargets;
+}
+
+void CExplosionTargets::PrintStats()
+{
+	Msg("Explosions: %d\n", m_iExplosions);
+	Msg("Partition queries: %d (%d explosions shared a query)\n", m_iQueries, m_iExplosions - m_iQueries);
+	Msg("Candidates tested: %d, targets found: %d\n", m_iCandidatesTested, m_iTargets);
+}
+
+CON_COMMAND(da_explosion_stats, "Show how many explosions shared a search for targets.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	ExplosionTargets().PrintStats();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mathlib/ssemath.h"
+
+// --------------------------------------------------------------------------------------------------- //
+// Finds what an explosion might damage. Explosions in the same tick that overlap share one query of the
+// spatial partition, and the per-explosion filtering (distance, water, class) is done four entities at a
+// time. A query is thrown away at the end of the tick or as soon as an entity is created.
+// --------------------------------------------------------------------------------------------------- //
+
+#define EXPLOSION_QUERY_PAD 64 // Room for things that move during the tick.
+
+class CExplosionTargets : public CAutoGameSystem, public IEntityListener
+{
+public:
+	CExplosionTargets( char const *name );
+
+public:
+	virtual bool Init();
+	virtual void Shutdown();
+	virtual void LevelShutdownPostEntity();
+
+	virtual void OnEntityCreated( CBaseEntity *pEntity );
+
+	// Entities whose bounds touch the sphere, skipping pIgnore, anything of iClassIgnore and anything
+	// the blast can't reach through the water. Doesn't check m_takedamage, damaging one target can
+	// change it for the next.
+	int  Gather( const Vector &vecSrc, float flRadius, int iClassIgnore, CBaseEntity *pIgnore, bool bInWater, CBaseEntity **ppTargets, int iMaxTargets );
+
+	void PrintStats();
+
+private:
+	void Query( const Vector &vecCenter, float flRadius );
+
+private:
+	int     m_iTick;
+	bool    m_bValid;
+	Vector  m_vecCenter;
+	float   m_flRadius;
+
+	int     m_iCandidates;
+	EHANDLE m_ahCandidates[MAX_SPHERE_QUERY];
+	int     m_aiClass[MAX_SPHERE_QUERY];
+
+	// Refreshed from the entities for every explosion, four to an entry.
+	FourVectors m_avecMins[MAX_SPHERE_QUERY/4];
+	FourVectors m_avecMaxs[MAX_SPHERE_QUERY/4];
+	fltx4   m_aflWaterLevel[MAX_SPHERE_QUERY/4];
+
+	int     m_iExplosions;
+	int     m_iQueries;
+	int     m_iCandidatesTested;
+	int     m_iTargets;
+};
+
+CExplosionTargets& ExplosionTargets();
@@ -0,0 +1,375 @@
+#include "cbase.h"
+
+#include "da_movementbench.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define MOVEMENTREPLAY_MAGIC   (('D'<<0)|('A'<<8)|('M'<<16)|('V'<<24))
+#define MOVEMENTREPLAY_VERSION 1
+
+ConVar da_movement_bench_tolerance("da_movement_bench_tolerance", "1", FCVAR_GAMEDLL, "How far in units a replay can end from where its recording did before da_movement_bench fails it.");
+
+extern void RunPlayerMovement( CBasePlayer *player, CUserCmd *ucmd );
+extern void GetMovementTraceTotals( int &iTraces, int &iMemoHits );
+
+CMovementBench g_MovementBench( "CMovementBench" );
+
+CMovementBench& MovementBench()
+{
+	return g_MovementBench;
+}
+
+CMovementBench::CMovementBench( char const *name )
+	: CAutoGameSystem(name)
+{
+	m_szRecording[0] = '\0';
+}
+
+void CMovementBench::LevelShutdownPreEntity()
+{
+	if (m_szRecording[0])
+		StopRecording();
+}
+
+void CMovementBench::StartRecording( CSDKPlayer *pPlayer, const char *pszName )
+{
+	if (m_szRecording[0])
+		StopRecording();
+
+	V_snprintf(m_szRecording, sizeof(m_szRecording), "movement/%s.dmr", pszName);
+	m_hRecording = pPlayer;
+	m_aRecording.RemoveAll();
+
+	// Same starting state a replay gets. Keep whatever speed they had, the header records it.
+	m_oRecordingHeader.m_vecStartVelocity = pPlayer->GetAbsVelocity();
+	ResetPlayer(pPlayer, pPlayer->GetAbsOrigin(), m_oRecordingHeader.m_vecStartVelocity, pPlayer->pl.v_angle, 0);
+
+	Msg("Recording %s's movement to %s\n", pPlayer->GetPlayerName(), m_szRecording);
+}
+
+void CMovementBench::StopRecording()
+{
+	if (!m_szRecording[0])
+		return;
+
+	if (!m_hRecording || !m_aRecording.Count())
+	{
+		Warning("Nothing recorded for %s\n", m_szRecording);
+		m_szRecording[0] = '\0';
+		return;
+	}
+
+	ReplayHeader& oHeader = m_oRecordingHeader;
+	oHeader.m_iMagic = MOVEMENTREPLAY_MAGIC;
+	oHeader.m_iVersion = MOVEMENTREPLAY_VERSION;
+	V_strncpy(oHeader.m_szMap, STRING(gpGlobals->mapname), sizeof(oHeader.m_szMap));
+	oHeader.m_vecEndOrigin = m_hRecording->GetAbsOrigin();
+	oHeader.m_iCommands = m_aRecording.Count();
+
+	CUtlBuffer oBuffer;
+	oBuffer.Put(&oHeader, sizeof(oHeader));
+	oBuffer.Put(m_aRecording.Base(), m_aRecording.Count()*sizeof(ReplayCommand));
+
+	filesystem->CreateDirHierarchy("movement", "MOD");
+
+	if (filesystem->WriteFile(m_szRecording, "MOD", oBuffer))
+		Msg("Saved %d commands to %s\n", m_aRecording.Count(), m_szRecording);
+	else
+		Warning("Unable to save %d bytes to %s\n", oBuffer.TellPut(), m_szRecording);
+
+	m_szRecording[0] = '\0';
+	m_hRecording = NULL;
+	m_aRecording.Purge();
+}
+
+void CMovementBench::RecordCommand( CSDKPlayer *pPlayer, const CUserCmd *pCmd )
+{
+	if (pPlayer != m_hRecording)
+		return;
+
+	if (!m_aRecording.Count())
+	{
+		m_oRecordingHeader.m_vecStartOrigin = pPlayer->GetAbsOrigin();
+		m_oRecordingHeader.m_vecStartVelocity = pPlayer->GetAbsVelocity();
+		m_oRecordingHeader.m_angStart = pPlayer->pl.v_angle;
+		m_oRecordingHeader.m_iStartOldButtons = pPlayer->m_Local.m_nOldButtons;
+	}
+
+	ReplayCommand& oCommand = m_aRecording[m_aRecording.AddToTail()];
+	oCommand.m_angView = pCmd->viewangles;
+	oCommand.m_flForwardMove = pCmd->forwardmove;
+	oCommand.m_flSideMove = pCmd->sidemove;
+	oCommand.m_flUpMove = pCmd->upmove;
+	oCommand.m_iButtons = pCmd->buttons;
+}
+
+bool CMovementBench::Load( const char *pszName, ReplayHeader &oHeader, CUtlVector<ReplayCommand> &aCommands )
+{
+	char szFile[MAX_PATH];
+	V_snprintf(szFile, sizeof(szFile), "movement/%s.dmr", pszName);
+
+	CUtlBuffer oBuffer;
+	if (!filesystem->ReadFile(szFile, "MOD", oBuffer))
+	{
+		Warning("Couldn't read %s\n", szFile);
+		return false;
+	}
+
+	if (oBuffer.TellPut() < (int)sizeof(ReplayHeader))
+	{
+		Warning("%s is too short\n", szFile);
+		return false;
+	}
+
+	oBuffer.Get(&oHeader, sizeof(oHeader));
+
+	if (oHeader.m_iMagic != MOVEMENTREPLAY_MAGIC || oHeader.m_iVersion != MOVEMENTREPLAY_VERSION)
+	{
+		Warning("%s isn't a movement recording or is from an older version\n", szFile);
+		return false;
+	}
+
+	if (oHeader.m_iCommands < 0 || oBuffer.TellPut() != (int)(sizeof(ReplayHeader) + oHeader.m_iCommands*sizeof(ReplayCommand)))
+	{
+		Warning("%s is damaged\n", szFile);
+		return false;
+	}
+
+	oHeader.m_szMap[sizeof(oHeader.m_szMap)-1] = '\0';
+
+	aCommands.SetCount(oHeader.m_iCommands);
+	oBuffer.Get(aCommands.Base(), oHeader.m_iCommands*sizeof(ReplayCommand));
+
+	return true;
+}
+
+void CMovementBench::ResetPlayer( CSDKPlayer *pPlayer, const Vector &vecOrigin, const Vector &vecVelocity, const QAngle &angView, int iOldButtons )
+{
+	pPlayer->RemoveFlag(FL_DUCKING);
+	pPlayer->m_Local.m_bDucked = false;
+	pPlayer->m_Local.m_bDucking = false;
+	pPlayer->m_Local.m_flDucktime = 0;
+
+	// Clears dives, slides, rolls, prone, wall flips, mantels and superfalls. CSDKPlayer's override is private.
+	static_cast<CBasePlayer*>(pPlayer)->SharedSpawn();
+
+	pPlayer->SetViewOffset(VEC_VIEW);
+	pPlayer->SetGroundEntity(NULL);
+	pPlayer->SetAbsOrigin(vecOrigin);
+	pPlayer->SetAbsVelocity(vecVelocity);
+	pPlayer->SetBaseVelocity(vec3_origin);
+	pPlayer->pl.v_angle = angView;
+	pPlayer->m_Local.m_nOldButtons = iOldButtons;
+	pPlayer->m_nButtons = iOldButtons;
+}
+
+double CMovementBench::Replay( CSDKPlayer *pPlayer, const ReplayHeader &oHeader, const CUtlVector<ReplayCommand> &aCommands )
+{
+	ResetPlayer(pPlayer, oHeader.m_vecStartOrigin, oHeader.m_vecStartVelocity, oHeader.m_angStart, oHeader.m_iStartOldButtons);
+
+	float flCurTime = gpGlobals->curtime;
+
+	CUserCmd oCmd;
+
+	double flStart = Plat_FloatTime();
+
+	for (int i = 0; i < aCommands.Count(); i++)
+	{
+		const ReplayCommand& oCommand = aCommands[i];
+
+		oCmd.Reset();
+		oCmd.command_number = i+1;
+		oCmd.tick_count = gpGlobals->tickcount;
+		oCmd.viewangles = oCommand.m_angView;
+		oCmd.forwardmove = oCommand.m_flForwardMove;
+		oCmd.sidemove = oCommand.m_flSideMove;
+		oCmd.upmove = oCommand.m_flUpMove;
+		oCmd.buttons = oCommand.m_iButtons;
+
+		gpGlobals->curtime = flCurTime + i*TICK_INTERVAL;
+		gpGlobals->frametime = TICK_INTERVAL;
+
+		// PreThink isn't run, but the movement timers depend on this.
+		pPlayer->UpdateCurrentTime();
+
+		RunPlayerMovement(pPlayer, &oCmd);
+	}
+
+	double flTime = Plat_FloatTime() - flStart;
+
+	gpGlobals->curtime = flCurTime;
+
+	return flTime;
+}
+
+bool CMovementBench::Run( CSDKPlayer *pPlayer, const CUtlVector<CUtlString> &asNames, int iIterations )
+{
+	if (pPlayer == m_hRecording)
+		StopRecording();
+
+	// Everything that gets changed, to put the player back afterwards.
+	Vector vecOrigin = pPlayer->GetAbsOrigin();
+	Vector vecVelocity = pPlayer->GetAbsVelocity();
+	QAngle angView = pPlayer->pl.v_angle;
+	int iOldButtons = pPlayer->m_Local.m_nOldButtons;
+	float flPlayerTime = pPlayer->m_flCurrentTime;
+	float flCurTime = gpGlobals->curtime;
+	float flFrameTime = gpGlobals->frametime;
+
+	bool bPassed = true;
+
+	ReplayHeader oHeader;
+	CUtlVector<ReplayCommand> aCommands;
+
+	Msg("%-16s %8s %12s %14s %12s %8s\n", "replay", "commands", "commands/s", "traces/command", "heap bytes", "drift");
+
+	for (int i = 0; i < asNames.Count(); i++)
+	{
+		if (!Load(asNames[i], oHeader, aCommands))
+		{
+			bPassed = false;
+			continue;
+		}
+
+		if (!FStrEq(oHeader.m_szMap, STRING(gpGlobals->mapname)))
+		{
+			Warning("%s was recorded on %s\n", asNames[i].Get(), oHeader.m_szMap);
+			bPassed = false;
+			continue;
+		}
+
+		// The first time through warms the caches and is the one that gets checked against the recording.
+		Replay(pPlayer, oHeader, aCommands);
+		float flDrift = (pPlayer->GetAbsOrigin() - oHeader.m_vecEndOrigin).Length();
+
+		int iTracesBefore, iMemoHitsBefore;
+		GetMovementTraceTotals(iTracesBefore, iMemoHitsBefore);
+
+		// Not every allocator keeps track, in which case this reads zero.
+		size_t iUsedBefore, iUsedAfter, iFree;
+		g_pMemAlloc->GlobalMemoryStatus(&iUsedBefore, &iFree);
+
+		double flTime = 0;
+		for (int j = 0; j < iIterations; j++)
+			flTime += Replay(pPlayer, oHeader, aCommands);
+
+		g_pMemAlloc->GlobalMemoryStatus(&iUsedAfter, &iFree);
+
+		int iTracesAfter, iMemoHitsAfter;
+		GetMovementTraceTotals(iTracesAfter, iMemoHitsAfter);
+
+		int iCommands = aCommands.Count()*iIterations;
+		bool bDrifted = flDrift > da_movement_bench_tolerance.GetFloat();
+
+		Msg("%-16s %8d %12.0f %14.2f %12d %8.2f%s\n", asNames[i].Get(), aCommands.Count(),
+			flTime > 0?iCommands/flTime:0.0,
+			iCommands?(float)(iTracesAfter - iTracesBefore)/iCommands:0.0f,
+			(int)((int64)iUsedAfter - (int64)iUsedBefore),
+			flDrift, bDrifted?" DRIFTED":"");
+
+		if (iTracesAfter - iTracesBefore > 0 && iMemoHitsAfter > iMemoHitsBefore)
+			Msg("%-16s %d%% of traces reused\n", "", 100*(iMemoHitsAfter - iMemoHitsBefore)/(iTracesAfter - iTracesBefore));
+
+		if (bDrifted)
+			bPassed = false;
+	}
+
+	ResetPlayer(pPlayer, vecOrigin, vecVelocity, angView, iOldButtons);
+	pPlayer->m_flCurrentTime = flPlayerTime;
+	gpGlobals->curtime = flCurTime;
+	gpGlobals->frametime = flFrameTime;
+
+	Msg("Movement bench %s\n", bPassed?"passed":"FAILED");
+
+	return bPassed;
+}
+
+static CSDKPlayer* MovementBenchPlayer()
+{
+	CSDKPlayer *pPlayer = ToSDKPlayer( UTIL_GetCommandClient() );
+	if (pPlayer)
+		return pPlayer->IsAlive()?pPlayer:NULL;
+
+	// From the server console, use whoever is around. Bots work fine.
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		pPlayer = ToSDKPlayer( UTIL_PlayerByIndex(i) );
+		if (pPlayer && pPlayer->IsAlive())
+			return pPlayer;
+	}
+
+	return NULL;
+}
+
+CON_COMMAND_F(da_movement_record, "Record your movement to movement/<name>.dmr until da_movement_record_stop.", FCVAR_CHEAT)
+{
+	if (args.ArgC() < 2)
+	{
+		Msg("Usage: da_movement_record <name>\n");
+		return;
+	}
+
+	CSDKPlayer *pPlayer = ToSDKPlayer( UTIL_GetCommandClient() );
+	if (!pPlayer || !pPlayer->IsAlive())
+	{
+		Msg("Only a living player can record movement.\n");
+		return;
+	}
+
+	MovementBench().StartRecording(pPlayer, args[1]);
+}
+
+CON_COMMAND_F(da_movement_record_stop, "Save the movement recording.", FCVAR_CHEAT)
+{
+	MovementBench().StopRecording();
+}
+
+CON_COMMAND_F(da_movement_bench, "Replay recorded movement through the movement code and time it. da_movement_bench <name|*> [iterations]", FCVAR_CHEAT)
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	if (args.ArgC() < 2)
+	{
+		Msg("Usage: da_movement_bench <name|*> [iterations]\n");
+		return;
+	}
+
+	CSDKPlayer *pPlayer = MovementBenchPlayer();
+	if (!pPlayer)
+	{
+		Msg("Need a living player or bot to move around.\n");
+		return;
+	}
+
+	int iIterations = 100;
+	if (args.ArgC() > 2)
+		iIterations = max(atoi(args[2]), 1);
+
+	CUtlVector<CUtlString> asNames;
+
+	if (FStrEq(args[1], "*"))
+	{
+		FileFindHandle_t hFind;
+		for (const char *pszFile = filesystem->FindFirstEx("movement/*.dmr", "MOD", &hFind); pszFile; pszFile = filesystem->FindNext(hFind))
+		{
+			char szName[MAX_PATH];
+			V_StripExtension(pszFile, szName, sizeof(szName));
+			asNames.AddToTail(szName);
+		}
+		filesystem->FindClose(hFind);
+
+		if (!asNames.Count())
+		{
+			Msg("No recordings in movement/\n");
+			return;
+		}
+	}
+	else
+		asNames.AddToTail(args[1]);
+
+	MovementBench().Run(pPlayer, asNames, iIterations);
+}
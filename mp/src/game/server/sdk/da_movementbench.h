@@ -0,0 +1,69 @@
+#pragma once
+
+#include "sdk_player.h"
+#include "utlstring.h"
+
+// --------------------------------------------------------------------------------------------------- //
+// Records a player's usercmds to movement/<name>.dmr and replays them through the movement code on the
+// server, no client or network involved. The replay reports commands per second, traces per command and
+// heap growth, and checks that the player still ends up where the recording did, so it can be used to
+// measure and to catch behavior changes when sdk_gamemovement changes.
+// --------------------------------------------------------------------------------------------------- //
+
+class CMovementBench : public CAutoGameSystem
+{
+public:
+	CMovementBench( char const *name );
+
+public:
+	virtual void LevelShutdownPreEntity();
+
+	void StartRecording( CSDKPlayer *pPlayer, const char *pszName );
+	void StopRecording();
+
+	// Called with every command a player runs, before it moves.
+	void RecordCommand( CSDKPlayer *pPlayer, const CUserCmd *pCmd );
+
+	// Replays each file iIterations times on pPlayer, who is put back afterwards. False if any replay
+	// couldn't be loaded or didn't end where its recording did.
+	bool Run( CSDKPlayer *pPlayer, const CUtlVector<CUtlString> &asNames, int iIterations );
+
+private:
+	struct ReplayHeader
+	{
+		unsigned int m_iMagic;
+		unsigned int m_iVersion;
+		char         m_szMap[64];
+		Vector       m_vecStartOrigin;
+		Vector       m_vecStartVelocity;
+		QAngle       m_angStart;
+		int          m_iStartOldButtons;
+		Vector       m_vecEndOrigin;
+		int          m_iCommands;
+	};
+
+	struct ReplayCommand
+	{
+		QAngle       m_angView;
+		float        m_flForwardMove;
+		float        m_flSideMove;
+		float        m_flUpMove;
+		int          m_iButtons;
+	};
+
+	bool Load( const char *pszName, ReplayHeader &oHeader, CUtlVector<ReplayCommand> &aCommands );
+
+	// Puts the player at vecOrigin standing, with no dive, slide, roll, flip or mantel going on.
+	void ResetPlayer( CSDKPlayer *pPlayer, const Vector &vecOrigin, const Vector &vecVelocity, const QAngle &angView, int iOldButtons );
+
+	// Returns how long, in seconds, running the commands took. The player is left where they ended up.
+	double Replay( CSDKPlayer *pPlayer, const ReplayHeader &oHeader, const CUtlVector<ReplayCommand> &aCommands );
+
+private:
+	CHandle<CSDKPlayer>       m_hRecording;
+	char                      m_szRecording[MAX_PATH];
+	ReplayHeader              m_oRecordingHeader;
+	CUtlVector<ReplayCommand> m_aRecording;
+};
+
+CMovementBench& MovementBench();
@@ -0,0 +1,256 @@
+#include "cbase.h"
+
+#include "da_playerproximity.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CPlayerProximity g_PlayerProximity( "CPlayerProximity" );
+
+CPlayerProximity& PlayerProximity()
+{
+	return g_PlayerProximity;
+}
+
+CPlayerProximity::CPlayerProximity( char const* name )
+	: CAutoGameSystemPerFrame(name)
+{
+	m_iUpdateTick = -1;
+	m_bNotifying = false;
+}
+
+void CPlayerProximity::LevelInitPostEntity()
+{
+	Invalidate();
+}
+
+void CPlayerProximity::LevelShutdownPostEntity()
+{
+	m_aListeners.Purge();
+}
+
+void CPlayerProximity::AddListener(IPlayerProximityListener* pListener, CBaseEntity* pCenter, float flRadius)
+{
+	ProximityListener& oListener = m_aListeners[m_aListeners.AddToTail()];
+	oListener.m_pListener = pListener;
+	oListener.m_hCenter = pCenter;
+	oListener.m_flRadius = flRadius;
+	oListener.m_abInside.ClearAll();
+}
+
+void CPlayerProximity::RemoveListener(IPlayerProximityListener* pListener)
+{
+	for (int i = m_aListeners.Count()-1; i >= 0; i--)
+	{
+		if (m_aListeners[i].m_pListener != pListener)
+			continue;
+
+		// Listeners commonly go away from inside their own callback. Leave the slot for the loop to clean up.
+		if (m_bNotifying)
+			m_aListeners[i].m_pListener = NULL;
+		else
+			m_aListeners.Remove(i);
+	}
+}
+
+void CPlayerProximity::FrameUpdatePostEntityThink()
+{
+	if (!m_aListeners.Count())
+		return;
+
+	m_bNotifying = true;
+
+	CUtlVector<CSDKPlayer*> apPlayers;
+	CBitVec<MAX_PLAYERS+1> abInside;
+
+	// Listeners added by a callback start next tick.
+	int iListeners = m_aListeners.Count();
+	for (int i = 0; i < iListeners; i++)
+	{
+		CBaseEntity* pCenter = m_aListeners[i].m_hCenter;
+		if (!m_aListeners[i].m_pListener || !pCenter)
+			continue;
+
+		GetPlayersInRadius(pCenter->GetAbsOrigin(), m_aListeners[i].m_flRadius, apPlayers);
+
+		abInside.ClearAll();
+
+		for (int j = 0; j < apPlayers.Count(); j++)
+		{
+			// An earlier callback could have removed the listener or killed the player.
+			if (!m_aListeners[i].m_pListener)
+				break;
+
+			CSDKPlayer* pPlayer = apPlayers[j];
+			if (!pPlayer->IsAlive())
+				continue;
+
+			int iEntIndex = pPlayer->entindex();
+			abInside.Set(iEntIndex);
+
+			m_aListeners[i].m_pListener->PlayerInRadius(pPlayer, !m_aListeners[i].m_abInside.IsBitSet(iEntIndex));
+		}
+
+		m_aListeners[i].m_abInside = abInside;
+	}
+
+	m_bNotifying = false;
+
+	for (int i = m_aListeners.Count()-1; i >= 0; i--)
+	{
+		if (!m_aListeners[i].m_pListener)
+			m_aListeners.Remove(i);
+	}
+}
+
+void CPlayerProximity::Invalidate()
+{
+	m_iUpdateTick = -1;
+}
+
+void CPlayerProximity::CellForOrigin(const Vector& vecOrigin, int& x, int& y, int& z) const
+{
+	x = (int)floor(vecOrigin.x / PROXIMITY_CELL_SIZE);
+	y = (int)floor(vecOrigin.y / PROXIMITY_CELL_SIZE);
+	z = (int)floor(vecOrigin.z / PROXIMITY_CELL_SIZE);
+}
+
+int CPlayerProximity::HashCell(int x, int y, int z) const
+{
+	return ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & (PROXIMITY_HASH_BUCKETS-1);
+}
+
+int CPlayerProximity::GetProximityIndex(CSDKPlayer* pPlayer) const
+{
+	if (!pPlayer)
+		return -1;
+
+	int iEntIndex = pPlayer->entindex();
+	if (iEntIndex < 1 || iEntIndex > MAX_PLAYERS)
+		return -1;
+
+	int iProximity = m_aiPlayerToProximity[iEntIndex];
+
+	// Somebody else could have taken the slot since the cache was built.
+	if (iProximity >= 0 && m_aPlayers[iProximity].m_hPlayer != pPlayer)
+		return -1;
+
+	return iProximity;
+}
+
+void CPlayerProximity::Update()
+{
+	if (m_iUpdateTick == gpGlobals->tickcount)
+		return;
+
+	m_iUpdateTick = gpGlobals->tickcount;
+
+	m_aPlayers.RemoveAll();
+
+	for (int i = 0; i < PROXIMITY_HASH_BUCKETS; i++)
+		m_aiBuckets[i] = -1;
+
+	for (int i = 0; i <= MAX_PLAYERS; i++)
+		m_aiPlayerToProximity[i] = -1;
+
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
+		if (!pPlayer)
+			continue;
+
+		if (!pPlayer->IsAlive())
+			continue;
+
+		int iProximity = m_aPlayers.AddToTail();
+		ProximityPlayer& oPlayer = m_aPlayers[iProximity];
+
+		oPlayer.m_hPlayer = pPlayer;
+		oPlayer.m_vecOrigin = pPlayer->GetAbsOrigin();
+		pPlayer->CollisionProp()->WorldSpaceSurroundingBounds(&oPlayer.m_vecSurroundMins, &oPlayer.m_vecSurroundMaxs);
+		oPlayer.m_bPVSValid = false;
+
+		CellForOrigin(oPlayer.m_vecOrigin, oPlayer.m_iCellX, oPlayer.m_iCellY, oPlayer.m_iCellZ);
+
+		int iBucket = HashCell(oPlayer.m_iCellX, oPlayer.m_iCellY, oPlayer.m_iCellZ);
+		oPlayer.m_iNextInBucket = m_aiBuckets[iBucket];
+		m_aiBuckets[iBucket] = iProximity;
+
+		m_aiPlayerToProximity[i] = iProximity;
+	}
+}
+
+void CPlayerProximity::GetPlayersInRadius(const Vector& vecOrigin, float flRadius, CUtlVector<CSDKPlayer*>& apPlayers)
+{
+	Update();
+
+	apPlayers.RemoveAll();
+
+	int iMinX, iMinY, iMinZ;
+	int iMaxX, iMaxY, iMaxZ;
+	CellForOrigin(vecOrigin - Vector(flRadius, flRadius, flRadius), iMinX, iMinY, iMinZ);
+	CellForOrigin(vecOrigin + Vector(flRadius, flRadius, flRadius), iMaxX, iMaxY, iMaxZ);
+
+	float flRadiusSqr = flRadius*flRadius;
+
+	for (int x = iMinX; x <= iMaxX; x++)
+	{
+		for (int y = iMinY; y <= iMaxY; y++)
+		{
+			for (int z = iMinZ; z <= iMaxZ; z++)
+			{
+				for (int i = m_aiBuckets[HashCell(x, y, z)]; i >= 0; i = m_aPlayers[i].m_iNextInBucket)
+				{
+					const ProximityPlayer& oPlayer = m_aPlayers[i];
+
+					// Other cells can share the bucket. Only take players from this cell so nobody is added twice.
+					if (oPlayer.m_iCellX != x || oPlayer.m_iCellY != y || oPlayer.m_iCellZ != z)
+						continue;
+
+					if ((oPlayer.m_vecOrigin - vecOrigin).LengthSqr() > flRadiusSqr)
+						continue;
+
+					// Left the server since the cache was built.
+					if (!oPlayer.m_hPlayer)
+						continue;
+
+					apPlayers.AddToTail(oPlayer.m_hPlayer);
+				}
+			}
+		}
+	}
+}
+
+void CPlayerProximity::GetPlayersInPVS(CSDKPlayer* pPlayer, CUtlVector<CSDKPlayer*>& apPlayers)
+{
+	Update();
+
+	apPlayers.RemoveAll();
+
+	int iProximity = GetProximityIndex(pPlayer);
+	if (iProximity < 0)
+		return;
+
+	ProximityPlayer& oPlayer = m_aPlayers[iProximity];
+	if (!oPlayer.m_bPVSValid)
+	{
+		int iCluster = engine->GetClusterForOrigin( pPlayer->EyePosition() );
+		engine->GetPVSForCluster( iCluster, sizeof(oPlayer.m_abPVS), oPlayer.m_abPVS );
+		oPlayer.m_bPVSValid = true;
+	}
+
+	for (int i = 0; i < m_aPlayers.Count(); i++)
+	{
+		if (i == iProximity)
+			continue;
+
+		const ProximityPlayer& oOther = m_aPlayers[i];
+		if (!oOther.m_hPlayer)
+			continue;
+
+		if (!engine->CheckBoxInPVS( oOther.m_vecSurroundMins, oOther.m_vecSurroundMaxs, oPlayer.m_abPVS, sizeof(oPlayer.m_abPVS) ))
+			continue;
+
+		apPlayers.AddToTail(oOther.m_hPlayer);
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "sdk_player.h"
+
+#include "utlvector.h"
+#include "bitvec.h"
+
+// --------------------------------------------------------------------------------------------------- //
+// Per-tick index of living players: a spatial hash of their positions and their PVS. Rebuilt lazily
+// the first time it's queried each tick. Line of sight is cached per part by CSDKPlayer::IsVisible.
+// Objectives can also listen for players inside a radius instead of checking every player themselves.
+// --------------------------------------------------------------------------------------------------- //
+
+#define PROXIMITY_CELL_SIZE 512 // Should be around the largest radius that gets queried.
+#define PROXIMITY_HASH_BUCKETS 128 // Power of two
+
+abstract_class IPlayerProximityListener
+{
+public:
+	// Called once a tick for every living player within the listener's radius. bEntered is set the
+	// first tick the player is inside.
+	virtual void PlayerInRadius( CSDKPlayer* pPlayer, bool bEntered ) = 0;
+};
+
+class CPlayerProximity : public CAutoGameSystemPerFrame
+{
+public:
+	CPlayerProximity( char const *name );
+
+public:
+	virtual void LevelInitPostEntity();
+	virtual void LevelShutdownPostEntity();
+	virtual void FrameUpdatePostEntityThink();
+
+	// Players spawned or died, rebuild on the next query even if it's the same tick.
+	void Invalidate();
+
+	// Listen for players within flRadius of pCenter. Remove the listener before it's deleted.
+	void AddListener(IPlayerProximityListener* pListener, CBaseEntity* pCenter, float flRadius);
+	void RemoveListener(IPlayerProximityListener* pListener);
+
+	// Living players within flRadius of vecOrigin.
+	void GetPlayersInRadius(const Vector& vecOrigin, float flRadius, CUtlVector<CSDKPlayer*>& apPlayers);
+
+	// Living players (besides pPlayer) that are in pPlayer's PVS.
+	void GetPlayersInPVS(CSDKPlayer* pPlayer, CUtlVector<CSDKPlayer*>& apPlayers);
+
+private:
+	void Update();
+
+	void CellForOrigin(const Vector& vecOrigin, int& x, int& y, int& z) const;
+	int  HashCell(int x, int y, int z) const;
+
+	int  GetProximityIndex(CSDKPlayer* pPlayer) const;
+
+private:
+	struct ProximityListener
+	{
+		IPlayerProximityListener* m_pListener; // NULL once it's been removed.
+		EHANDLE     m_hCenter;
+		float       m_flRadius;
+		CBitVec<MAX_PLAYERS+1> m_abInside;
+	};
+
+	struct ProximityPlayer
+	{
+		CHandle<CSDKPlayer> m_hPlayer;
+		Vector      m_vecOrigin;
+		Vector      m_vecSurroundMins;
+		Vector      m_vecSurroundMaxs;
+		int         m_iCellX, m_iCellY, m_iCellZ;
+		int         m_iNextInBucket;
+		bool        m_bPVSValid;
+		byte        m_abPVS[MAX_MAP_CLUSTERS/8];
+	};
+
+	int  m_iUpdateTick;
+
+	CUtlVector<ProximityPlayer> m_aPlayers;
+	int  m_aiBuckets[PROXIMITY_HASH_BUCKETS];
+	int  m_aiPlayerToProximity[MAX_PLAYERS+1];
+
+	CUtlVector<ProximityListener> m_aListeners;
+	bool m_bNotifying;
+};
+
+CPlayerProximity& PlayerProximity();
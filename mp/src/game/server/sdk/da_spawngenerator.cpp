@@ -5,15 +5,33 @@
 #include "cbase.h"
 #include "da_spawngenerator.h"
 #include "sdk_shareddefs.h"
+#include "bspfile.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
+
+// For mapping the spawn grid cache.
+#if defined( _WIN32 )
+#include "winlite.h"
+#elif defined( POSIX )
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
 
 // set up initialization values and populate the grid
-CSpawnPointGenerator::CSpawnPointGenerator( CBaseEntity *pRefEnt, int team, int numSpawns)
+CSpawnPointGenerator::CSpawnPointGenerator( CBaseEntity *pRefEnt, int team, int numSpawns, bool bCreateSpawns)
 {
 	m_vecCenter = pRefEnt->GetAbsOrigin();
 	m_angles = pRefEnt->GetAbsAngles();
 	m_pszPointName = (team == SDK_TEAM_BLUE ? "info_player_blue" : "info_player_red");
 	m_iSpawnsDesired = numSpawns;
 	m_iSpawnsCreated = 0;
+	m_bCreateSpawns = bCreateSpawns;
 	
 	// make our trace hull very short so we can account for small z changes in geometry
 	TRACE_HULL_MIN = VEC_DUCK_HULL_MIN;
@@ -291,9 +309,13 @@ int CSpawnPointGenerator::FillInDir( SpawnGridLoc *refLoc, int dir )
 
 	// create a new spot in each open space
 	do {
-		CBaseEntity *newSpot = CreateEntityByName( m_pszPointName );
-		newSpot->SetAbsAngles(m_angles);
-		newSpot->SetAbsOrigin(refLoc->vecOrigin);
+		if (m_bCreateSpawns)
+		{
+			CBaseEntity *newSpot = CreateEntityByName( m_pszPointName );
+			newSpot->SetAbsAngles(m_angles);
+			newSpot->SetAbsOrigin(refLoc->vecOrigin);
+		}
+		m_avecSpawns.AddToTail(refLoc->vecOrigin);
 		refLoc->iStatus = OCCUPIED;
 		m_iSpawnsCreated++;
 		numCreated++;
@@ -304,6 +326,19 @@ int CSpawnPointGenerator::FillInDir( SpawnGridLoc *refLoc, int dir )
 	return numCreated;
 }
 
+// create spawn points that were worked out earlier
+void CSpawnPointGenerator::CreateSpawns( const Vector* pOrigins, int iCount, const QAngle& angles, int team )
+{
+	const char *pszPointName = (team == SDK_TEAM_BLUE ? "info_player_blue" : "info_player_red");
+
+	for (int i = 0; i < iCount; i++)
+	{
+		CBaseEntity *newSpot = CreateEntityByName( pszPointName );
+		newSpot->SetAbsAngles(angles);
+		newSpot->SetAbsOrigin(pOrigins[i]);
+	}
+}
+
 // return status 1 point from the given point in the direction specified
 CSpawnPointGenerator::SpawnGridLoc* CSpawnPointGenerator::CheckStatusInDir( SpawnGridLoc *pLoc, int dir )
 {
@@ -463,4 +498,321 @@ int CSpawnPointGenerator::CalculateIndex(int x, int y)
 CSpawnPointGenerator::SpawnGridLoc* CSpawnPointGenerator::GridLoc(int x, int y)
 {
 	return &m_arrSpawnGrid[CalculateIndex(x,y)];
-}
\ No newline at end of file
+}
+
+#define SPAWNGRID_MAGIC   (('D'<<0)|('A'<<8)|('S'<<16)|('G'<<24))
+#define SPAWNGRID_VERSION 1
+
+ConVar da_spawngrid_cache("da_spawngrid_cache", "1", FCVAR_DEVELOPMENTONLY, "Keep generated team spawns in maps/<mapname>.spawngrid instead of tracing them out every map load.");
+
+CSpawnGridCache::CSpawnGridCache()
+{
+	m_pMap = NULL;
+	m_iMapSize = 0;
+
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#endif
+}
+
+CSpawnGridCache::~CSpawnGridCache()
+{
+	Close();
+}
+
+void CSpawnGridCache::Close()
+{
+#ifdef _WIN32
+	if (m_pMap)
+		UnmapViewOfFile(m_pMap);
+
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#elif defined( POSIX )
+	if (m_pMap)
+		munmap((void*)m_pMap, m_iMapSize);
+#endif
+
+	m_pMap = NULL;
+	m_iMapSize = 0;
+}
+
+bool CSpawnGridCache::ComputeKeys( CRC32_t &iMapCRC, CRC32_t &iSpotsCRC )
+{
+	m_ahSpots.RemoveAll();
+
+	// CRCing the whole BSP would cost more than the traces we're saving. The header has the
+	// map revision and every lump's size and offset, which is enough to tell a recompile.
+	char szBSP[MAX_PATH];
+	V_snprintf(szBSP, sizeof(szBSP), "maps/%s.bsp", STRING(gpGlobals->mapname));
+
+	FileHandle_t hBSP = filesystem->Open(szBSP, "rb", "GAME");
+	if (!hBSP)
+		return false;
+
+	dheader_t oHeader;
+	int iRead = filesystem->Read(&oHeader, sizeof(oHeader), hBSP);
+	filesystem->Close(hBSP);
+
+	if (iRead != sizeof(oHeader))
+		return false;
+
+	CRC32_Init(&iMapCRC);
+	CRC32_ProcessBuffer(&iMapCRC, &oHeader, sizeof(oHeader));
+	CRC32_Final(&iMapCRC);
+
+	// The entity lump can change without the header changing, so key the spawn points too.
+	CRC32_Init(&iSpotsCRC);
+
+	CBaseEntity* pSpot = NULL;
+	while ((pSpot = gEntList.FindEntityByClassname( pSpot, "info_player_deathmatch" )) != NULL)
+	{
+		m_ahSpots.AddToTail(pSpot);
+
+		Vector vecOrigin = pSpot->GetAbsOrigin();
+		QAngle angAngles = pSpot->GetAbsAngles();
+		CRC32_ProcessBuffer(&iSpotsCRC, &vecOrigin, sizeof(vecOrigin));
+		CRC32_ProcessBuffer(&iSpotsCRC, &angAngles, sizeof(angAngles));
+	}
+
+	CRC32_Final(&iSpotsCRC);
+
+	return m_ahSpots.Count() > 0;
+}
+
+bool CSpawnGridCache::Map( const char *pszFullPath )
+{
+	Close();
+
+#ifdef _WIN32
+	m_hFile = CreateFileA(pszFullPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_iMapSize = GetFileSize(m_hFile, NULL);
+	if (m_iMapSize < sizeof(SpawnGridHeader))
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping)
+		m_pMap = (const char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+#elif defined( POSIX )
+	int iFile = open(pszFullPath, O_RDONLY);
+	if (iFile < 0)
+		return false;
+
+	struct stat oStat;
+	if (fstat(iFile, &oStat) != 0 || (size_t)oStat.st_size < sizeof(SpawnGridHeader))
+	{
+		close(iFile);
+		return false;
+	}
+
+	m_iMapSize = oStat.st_size;
+
+	void* pMap = mmap(NULL, m_iMapSize, PROT_READ, MAP_PRIVATE, iFile, 0);
+	if (pMap != MAP_FAILED)
+		m_pMap = (const char*)pMap;
+
+	// The mapping stays good after the file is closed.
+	close(iFile);
+#endif
+
+	if (!m_pMap)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool CSpawnGridCache::IsValid( CRC32_t iMapCRC, CRC32_t iSpotsCRC, int numSpawns ) const
+{
+	if (!m_pMap)
+		return false;
+
+	const SpawnGridHeader* pHeader = Header();
+
+	if (pHeader->m_iMagic != SPAWNGRID_MAGIC || pHeader->m_iVersion != SPAWNGRID_VERSION)
+		return false;
+
+	if (pHeader->m_iMapCRC != iMapCRC || pHeader->m_iSpotsCRC != iSpotsCRC)
+		return false;
+
+	if (pHeader->m_iNumSpawns != numSpawns || pHeader->m_iSpots != m_ahSpots.Count())
+		return false;
+
+	if (pHeader->m_iSpawns < 0 || m_iMapSize != sizeof(SpawnGridHeader) + pHeader->m_iSpots*sizeof(SpawnGridSpot) + pHeader->m_iSpawns*sizeof(Vector))
+		return false;
+
+	for (int i = 0; i < pHeader->m_iSpots; i++)
+	{
+		const SpawnGridSpot& oSpot = Spots()[i];
+		if (oSpot.m_iFirstSpawn < 0 || oSpot.m_iSpawnCount < 0 || oSpot.m_iFirstSpawn + oSpot.m_iSpawnCount > pHeader->m_iSpawns)
+			return false;
+
+		if (oSpot.m_iFarthestCount < 0 || oSpot.m_iFarthestCount > SPAWNGRID_FARTHEST_SET)
+			return false;
+
+		for (int k = 0; k < oSpot.m_iFarthestCount; k++)
+		{
+			if (oSpot.m_aiFarthest[k] < 0 || oSpot.m_aiFarthest[k] >= pHeader->m_iSpots)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool CSpawnGridCache::Build( const char *pszFile, CRC32_t iMapCRC, CRC32_t iSpotsCRC, int numSpawns )
+{
+	CUtlVector<SpawnGridSpot> aSpots;
+	CUtlVector<Vector> avecSpawns;
+
+	aSpots.SetCount(m_ahSpots.Count());
+
+	for (int i = 0; i < m_ahSpots.Count(); i++)
+	{
+		SpawnGridSpot& oSpot = aSpots[i];
+		memset(&oSpot, 0, sizeof(oSpot));
+
+		// The team only picks the entity name, the grid is the same for both.
+		CSpawnPointGenerator oGenerator(m_ahSpots[i], SDK_TEAM_BLUE, numSpawns, false);
+
+		oSpot.m_iFirstSpawn = avecSpawns.Count();
+		oSpot.m_iSpawnCount = oGenerator.GetSpawns().Count();
+		avecSpawns.AddVectorToTail(oGenerator.GetSpawns());
+
+		for (int k = 0; k < DIAMETER*DIAMETER; k++)
+			oSpot.m_aiGridStatus[k] = (unsigned char)oGenerator.GetGridStatus(k);
+
+		// Farthest to closest
+		float aflDistSqr[SPAWNGRID_FARTHEST_SET];
+		Vector vecRefOrig = m_ahSpots[i]->GetAbsOrigin();
+
+		for (int j = 0; j < m_ahSpots.Count(); j++)
+		{
+			if (j == i)
+				continue;
+
+			float flDistSqr = (m_ahSpots[j]->GetAbsOrigin() - vecRefOrig).LengthSqr();
+
+			int iInsert = oSpot.m_iFarthestCount;
+			while (iInsert > 0 && flDistSqr > aflDistSqr[iInsert-1])
+				iInsert--;
+
+			if (iInsert >= SPAWNGRID_FARTHEST_SET)
+				continue;
+
+			int iLast = min(oSpot.m_iFarthestCount, SPAWNGRID_FARTHEST_SET-1);
+			for (int k = iLast; k > iInsert; k--)
+			{
+				aflDistSqr[k] = aflDistSqr[k-1];
+				oSpot.m_aiFarthest[k] = oSpot.m_aiFarthest[k-1];
+			}
+
+			aflDistSqr[iInsert] = flDistSqr;
+			oSpot.m_aiFarthest[iInsert] = j;
+			oSpot.m_iFarthestCount = min(oSpot.m_iFarthestCount+1, SPAWNGRID_FARTHEST_SET);
+		}
+	}
+
+	SpawnGridHeader oHeader;
+	oHeader.m_iMagic = SPAWNGRID_MAGIC;
+	oHeader.m_iVersion = SPAWNGRID_VERSION;
+	oHeader.m_iMapCRC = iMapCRC;
+	oHeader.m_iSpotsCRC = iSpotsCRC;
+	oHeader.m_iNumSpawns = numSpawns;
+	oHeader.m_iSpots = aSpots.Count();
+	oHeader.m_iSpawns = avecSpawns.Count();
+
+	CUtlBuffer oBuffer;
+	oBuffer.Put(&oHeader, sizeof(oHeader));
+	oBuffer.Put(aSpots.Base(), aSpots.Count()*sizeof(SpawnGridSpot));
+	oBuffer.Put(avecSpawns.Base(), avecSpawns.Count()*sizeof(Vector));
+
+	if (!filesystem->WriteFile(pszFile, "MOD", oBuffer))
+	{
+		Warning("Unable to save %d bytes to %s\n", oBuffer.TellPut(), pszFile);
+		return false;
+	}
+
+	return true;
+}
+
+bool CSpawnGridCache::Open( int numSpawns )
+{
+	Close();
+
+	if (!da_spawngrid_cache.GetBool())
+		return false;
+
+	CRC32_t iMapCRC, iSpotsCRC;
+	if (!ComputeKeys(iMapCRC, iSpotsCRC))
+		return false;
+
+	char szFile[MAX_PATH];
+	V_snprintf(szFile, sizeof(szFile), "maps/%s.spawngrid", STRING(gpGlobals->mapname));
+
+	// Mapped from wherever the filesystem finds it in the same search path it's written to. Only loose
+	// files can be mapped.
+	char szFullPath[MAX_PATH];
+	if (filesystem->RelativePathToFullPath(szFile, "MOD", szFullPath, sizeof(szFullPath), FILTER_CULLPACK) && Map(szFullPath)
+		&& IsValid(iMapCRC, iSpotsCRC, numSpawns))
+		return true;
+
+	// Missing or stale. Work everything out with live traces, once.
+	Close();
+
+	DevMsg("Building spawn grid cache %s\n", szFile);
+
+	if (!Build(szFile, iMapCRC, iSpotsCRC, numSpawns))
+		return false;
+
+	if (!filesystem->RelativePathToFullPath(szFile, "MOD", szFullPath, sizeof(szFullPath), FILTER_CULLPACK))
+		return false;
+
+	return Map(szFullPath) && IsValid(iMapCRC, iSpotsCRC, numSpawns);
+}
+
+int CSpawnGridCache::FindSpot( CBaseEntity *pSpot ) const
+{
+	if (!m_pMap)
+		return -1;
+
+	for (int i = 0; i < m_ahSpots.Count(); i++)
+	{
+		if (m_ahSpots[i] == pSpot)
+			return i;
+	}
+
+	return -1;
+}
+
+const Vector* CSpawnGridCache::GetSpawns( int iSpot, int &iCount ) const
+{
+	const SpawnGridSpot& oSpot = Spots()[iSpot];
+	iCount = oSpot.m_iSpawnCount;
+	return Spawns() + oSpot.m_iFirstSpawn;
+}
+
+int CSpawnGridCache::GetFarthestCount( int iSpot ) const
+{
+	return Spots()[iSpot].m_iFarthestCount;
+}
+
+int CSpawnGridCache::GetFarthest( int iSpot, int i ) const
+{
+	return Spots()[iSpot].m_aiFarthest[i];
+}
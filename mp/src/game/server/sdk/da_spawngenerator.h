@@ -34,7 +34,8 @@ public:
 		int iStatus;
 	};
 
-	CSpawnPointGenerator( CBaseEntity *pRefSpot, int team, int numSpawns);
+	// With bCreateSpawns false the grid is only worked out, see GetSpawns().
+	CSpawnPointGenerator( CBaseEntity *pRefSpot, int team, int numSpawns, bool bCreateSpawns = true);
     CSpawnPointGenerator( const CSpawnPointGenerator& o )
     {
         *this = o;
@@ -43,6 +44,11 @@ public:
 
 	int SpawnsCreated() { return m_iSpawnsCreated; }
 
+	const CUtlVector<Vector>& GetSpawns() const { return m_avecSpawns; }
+	int GetGridStatus(int i) const { return m_arrSpawnGrid[i].iStatus; }
+
+	static void CreateSpawns( const Vector* pOrigins, int iCount, const QAngle& angles, int team );
+
 private:
 	void InitSpawnGrid();
 	void PopulateSpawnGrid();
@@ -77,6 +83,9 @@ private:
 	int m_iSpawnsDesired;
 	int m_iSpawnsCreated;
 	bool m_bWaterOk;
+	bool m_bCreateSpawns;
+
+	CUtlVector<Vector> m_avecSpawns;
 
 	Vector m_vecCenter;
 	Vector TRACE_HULL_MIN;
@@ -88,3 +97,76 @@ private:
 	QAngle m_angles;
 	const char *m_pszPointName;
 };
+
+#include "checksum_crc.h"
+
+// --------------------------------------------------------------------------------------------------- //
+// The spawn grid for every deathmatch spawn point of a map, and the farthest spawn points from each,
+// worked out once and kept in maps/<mapname>.spawngrid. The file is keyed by the BSP header and the
+// deathmatch spawn points, so it's rebuilt if the map or its spawns change.
+// --------------------------------------------------------------------------------------------------- //
+
+#define SPAWNGRID_FARTHEST_SET 6
+
+class CSpawnGridCache
+{
+public:
+	CSpawnGridCache();
+	~CSpawnGridCache();
+
+	// Maps the cache for the current map, building and saving it first if it's missing or stale.
+	bool Open( int numSpawns );
+	void Close();
+
+	// -1 if pSpot isn't one of the deathmatch spawn points the cache was built with.
+	int  FindSpot( CBaseEntity *pSpot ) const;
+
+	const Vector* GetSpawns( int iSpot, int &iCount ) const;
+
+	CBaseEntity* GetSpot( int iSpot ) const { return m_ahSpots[iSpot]; }
+
+	// Spot indices, farthest first.
+	int  GetFarthestCount( int iSpot ) const;
+	int  GetFarthest( int iSpot, int i ) const;
+
+private:
+	struct SpawnGridHeader
+	{
+		unsigned int m_iMagic;
+		unsigned int m_iVersion;
+		CRC32_t      m_iMapCRC;
+		CRC32_t      m_iSpotsCRC;
+		int          m_iNumSpawns;
+		int          m_iSpots;
+		int          m_iSpawns;
+	};
+
+	struct SpawnGridSpot
+	{
+		int           m_iFirstSpawn;
+		int           m_iSpawnCount;
+		int           m_iFarthestCount;
+		int           m_aiFarthest[SPAWNGRID_FARTHEST_SET];
+		unsigned char m_aiGridStatus[DIAMETER*DIAMETER];
+	};
+
+	bool ComputeKeys( CRC32_t &iMapCRC, CRC32_t &iSpotsCRC );
+	bool Map( const char *pszFullPath );
+	bool IsValid( CRC32_t iMapCRC, CRC32_t iSpotsCRC, int numSpawns ) const;
+	bool Build( const char *pszFile, CRC32_t iMapCRC, CRC32_t iSpotsCRC, int numSpawns );
+
+	const SpawnGridHeader* Header() const { return (const SpawnGridHeader*)m_pMap; }
+	const SpawnGridSpot*   Spots() const { return (const SpawnGridSpot*)(m_pMap + sizeof(SpawnGridHeader)); }
+	const Vector*          Spawns() const { return (const Vector*)(m_pMap + sizeof(SpawnGridHeader) + Header()->m_iSpots*sizeof(SpawnGridSpot)); }
+
+private:
+	CUtlVector<EHANDLE> m_ahSpots;
+
+	const char* m_pMap;
+	size_t      m_iMapSize;
+
+#ifdef _WIN32
+	void*       m_hFile;
+	void*       m_hMapping;
+#endif
+};
@@ -0,0 +1,510 @@
+#include "cbase.h"
+
+#include "da_spawnscoring.h"
+#include "sdk_gamerules.h"
+#include "da_briefcase.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar da_spawn_scoring("da_spawn_scoring", "1", FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "Use cached spawn point threats instead of tracing to players every time a spawn point is checked.");
+ConVar da_spawn_threat_move("da_spawn_threat_move", "32", FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How far a player has to move before the spawn points they can see are checked again.");
+ConVar da_spawn_threat_refresh("da_spawn_threat_refresh", "0.5", FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How often the spawn points a player can see are checked again even if they didn't move.");
+ConVar da_spawn_threat_budget("da_spawn_threat_budget", "4", FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How many players' spawn point threats can be checked again each frame.");
+
+#define BRIEFCASE_SPAWN_DISTANCE 300
+#define CAPTURE_SPAWN_DISTANCE 500
+
+CSpawnScoring g_SpawnScoring( "CSpawnScoring" );
+
+// The threats are shared by everybody who spawns, so the trace can't skip just the spawning player the
+// way the uncached check does. Skip every player but the one being checked instead.
+class CTraceFilterOnlyThreat : public CTraceFilterSimple
+{
+public:
+	CTraceFilterOnlyThreat( CBasePlayer* pThreat )
+		: CTraceFilterSimple( NULL, COLLISION_GROUP_NONE )
+	{
+		m_pThreat = pThreat;
+	}
+
+	virtual bool ShouldHitEntity( IHandleEntity* pHandleEntity, int contentsMask )
+	{
+		CBaseEntity* pEntity = EntityFromEntityHandle( pHandleEntity );
+		if (pEntity && pEntity->IsPlayer() && pEntity != m_pThreat)
+			return false;
+
+		return CTraceFilterSimple::ShouldHitEntity( pHandleEntity, contentsMask );
+	}
+
+private:
+	CBasePlayer* m_pThreat;
+};
+
+CSpawnScoring& SpawnScoring()
+{
+	return g_SpawnScoring;
+}
+
+CSpawnScoring::CSpawnScoring( char const* name )
+	: CAutoGameSystemPerFrame(name)
+{
+	m_bBuilt = false;
+	m_iTraces = 0;
+}
+
+void CSpawnScoring::LevelShutdownPostEntity()
+{
+	m_bBuilt = false;
+	m_aSpots.RemoveAll();
+
+	for (int i = 0; i <= MAX_PLAYERS; i++)
+	{
+		m_aPlayers[i].m_bEvaluated = false;
+		m_aPlayers[i].m_iTeam = 0;
+		m_aPlayers[i].m_aiThreatenedSpots.RemoveAll();
+	}
+}
+
+void CSpawnScoring::CellForOrigin(const Vector& vecOrigin, int& x, int& y, int& z) const
+{
+	x = (int)floor(vecOrigin.x / SPAWN_CELL_SIZE);
+	y = (int)floor(vecOrigin.y / SPAWN_CELL_SIZE);
+	z = (int)floor(vecOrigin.z / SPAWN_CELL_SIZE);
+}
+
+int CSpawnScoring::HashCell(int x, int y, int z) const
+{
+	return ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & (SPAWN_HASH_BUCKETS-1);
+}
+
+void CSpawnScoring::Build()
+{
+	LevelShutdownPostEntity();
+
+	for (int i = 0; i < SPAWN_HASH_BUCKETS; i++)
+		m_aiBuckets[i] = -1;
+
+	for (int i = 0; i < MAX_EDICTS; i++)
+		m_aiEntityToSpot[i] = -1;
+
+	m_hCaptureZone = NULL;
+
+	// Same order as gEntList so picking the next spot works the same as it always has.
+	CBaseEntity* pSpot = NULL;
+	while ((pSpot = gEntList.FindEntityByClassname( pSpot, "info_player_deathmatch" )) != NULL)
+	{
+		int iSpot = m_aSpots.AddToTail();
+		SpawnSpot& oSpot = m_aSpots[iSpot];
+
+		oSpot.m_hSpot = pSpot;
+		oSpot.m_vecOrigin = pSpot->GetAbsOrigin();
+		oSpot.m_vecCenter = pSpot->WorldSpaceCenter();
+		oSpot.m_iCluster = engine->GetClusterForOrigin(oSpot.m_vecCenter);
+		oSpot.m_flCaptureDistanceSqr = FLT_MAX;
+		oSpot.m_abThreats.ClearAll();
+		oSpot.m_iThreats = 0;
+		memset(oSpot.m_aiTeamThreats, 0, sizeof(oSpot.m_aiTeamThreats));
+		oSpot.m_iOnlyTeam = -1;
+
+		CellForOrigin(oSpot.m_vecOrigin, oSpot.m_iCellX, oSpot.m_iCellY, oSpot.m_iCellZ);
+
+		int iBucket = HashCell(oSpot.m_iCellX, oSpot.m_iCellY, oSpot.m_iCellZ);
+		oSpot.m_iNextInBucket = m_aiBuckets[iBucket];
+		m_aiBuckets[iBucket] = iSpot;
+
+		if (pSpot->entindex() >= 0 && pSpot->entindex() < MAX_EDICTS)
+			m_aiEntityToSpot[pSpot->entindex()] = iSpot;
+	}
+
+	m_abUnthreatened.Resize(m_aSpots.Count());
+	m_abUnthreatened.SetAll();
+
+	for (int i = 0; i < MAX_TEAMS; i++)
+		m_abOnlyTeam[i].Resize(m_aSpots.Count(), true);
+
+	m_bBuilt = true;
+}
+
+int CSpawnScoring::GetSpotIndex(CBaseEntity* pSpot) const
+{
+	if (!m_bBuilt || !pSpot)
+		return -1;
+
+	int iEntIndex = pSpot->entindex();
+	if (iEntIndex < 0 || iEntIndex >= MAX_EDICTS)
+		return -1;
+
+	int iSpot = m_aiEntityToSpot[iEntIndex];
+	if (iSpot < 0 || m_aSpots[iSpot].m_hSpot != pSpot)
+		return -1;
+
+	return iSpot;
+}
+
+bool CSpawnScoring::IsEnabled() const
+{
+	return m_bBuilt && da_spawn_scoring.GetBool();
+}
+
+void CSpawnScoring::MarkAllDirty()
+{
+	for (int i = 0; i <= MAX_PLAYERS; i++)
+		m_aPlayers[i].m_bEvaluated = false;
+}
+
+void CSpawnScoring::FrameUpdatePostEntityThink()
+{
+	if (!IsEnabled())
+		return;
+
+	UpdateThreats(da_spawn_threat_budget.GetInt());
+}
+
+void CSpawnScoring::ClearPlayer(int iPlayer)
+{
+	ThreatPlayer& oPlayer = m_aPlayers[iPlayer];
+
+	for (int i = 0; i < oPlayer.m_aiThreatenedSpots.Count(); i++)
+		RemoveThreat(oPlayer.m_aiThreatenedSpots[i], iPlayer);
+
+	oPlayer.m_aiThreatenedSpots.RemoveAll();
+	oPlayer.m_bEvaluated = false;
+}
+
+void CSpawnScoring::UpdateThreats(int iBudget)
+{
+	float flMoveSqr = da_spawn_threat_move.GetFloat()*da_spawn_threat_move.GetFloat();
+
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
+
+		ThreatPlayer& oPlayer = m_aPlayers[i];
+
+		if (!pPlayer || !pPlayer->IsAlive())
+		{
+			if (oPlayer.m_bEvaluated || oPlayer.m_aiThreatenedSpots.Count())
+				ClearPlayer(i);
+			continue;
+		}
+
+		// The team decides who the threats count against, a team change can't wait for the refresh.
+		if (oPlayer.m_bEvaluated && gpGlobals->curtime < oPlayer.m_flNextRefresh
+			&& (pPlayer->GetAbsOrigin() - oPlayer.m_vecEvaluated).LengthSqr() < flMoveSqr
+			&& pPlayer->GetTeamNumber() == oPlayer.m_iTeam)
+			continue;
+
+		if (iBudget == 0)
+			break;
+
+		EvaluatePlayer(pPlayer);
+
+		if (iBudget > 0)
+			iBudget--;
+	}
+}
+
+void CSpawnScoring::EvaluatePlayer(CSDKPlayer* pPlayer)
+{
+	int iPlayer = pPlayer->entindex();
+	ThreatPlayer& oPlayer = m_aPlayers[iPlayer];
+
+	ClearPlayer(iPlayer);
+
+	oPlayer.m_bEvaluated = true;
+	oPlayer.m_vecEvaluated = pPlayer->GetAbsOrigin();
+	oPlayer.m_iTeam = clamp(pPlayer->GetTeamNumber(), 0, MAX_TEAMS-1);
+	oPlayer.m_flNextRefresh = gpGlobals->curtime + da_spawn_threat_refresh.GetFloat();
+
+	Vector vecCenter = pPlayer->WorldSpaceCenter();
+
+	CTraceFilterOnlyThreat oFilter(pPlayer);
+
+	int iCluster = engine->GetClusterForOrigin(vecCenter);
+
+	byte abPVS[MAX_MAP_CLUSTERS/8];
+	if (iCluster >= 0)
+		engine->GetPVSForCluster(iCluster, sizeof(abPVS), abPVS);
+
+	int iMinX, iMinY, iMinZ;
+	int iMaxX, iMaxY, iMaxZ;
+	Vector vecRadius(SPAWN_THREAT_RADIUS, SPAWN_THREAT_RADIUS, SPAWN_THREAT_RADIUS);
+	CellForOrigin(oPlayer.m_vecEvaluated - vecRadius, iMinX, iMinY, iMinZ);
+	CellForOrigin(oPlayer.m_vecEvaluated + vecRadius, iMaxX, iMaxY, iMaxZ);
+
+	for (int x = iMinX; x <= iMaxX; x++)
+	{
+		for (int y = iMinY; y <= iMaxY; y++)
+		{
+			for (int z = iMinZ; z <= iMaxZ; z++)
+			{
+				for (int i = m_aiBuckets[HashCell(x, y, z)]; i >= 0; i = m_aSpots[i].m_iNextInBucket)
+				{
+					SpawnSpot& oSpot = m_aSpots[i];
+
+					if (oSpot.m_iCellX != x || oSpot.m_iCellY != y || oSpot.m_iCellZ != z)
+						continue;
+
+					if ((oSpot.m_vecOrigin - oPlayer.m_vecEvaluated).LengthSqr() > SPAWN_THREAT_RADIUS*SPAWN_THREAT_RADIUS)
+						continue;
+
+					// Outside the player's PVS there's no way the trace gets to them.
+					if (iCluster >= 0 && oSpot.m_iCluster >= 0 && !(abPVS[oSpot.m_iCluster >> 3] & (1 << (oSpot.m_iCluster & 7))))
+						continue;
+
+					m_iTraces++;
+
+					trace_t tr;
+					UTIL_TraceLine( oSpot.m_vecCenter, vecCenter, MASK_VISIBLE_AND_NPCS, &oFilter, &tr );
+					if (tr.m_pEnt != pPlayer)
+						continue;
+
+					AddThreat(i, iPlayer);
+					oPlayer.m_aiThreatenedSpots.AddToTail(i);
+				}
+			}
+		}
+	}
+}
+
+void CSpawnScoring::AddThreat(int iSpot, int iPlayer)
+{
+	SpawnSpot& oSpot = m_aSpots[iSpot];
+
+	oSpot.m_abThreats.Set(iPlayer);
+	oSpot.m_iThreats++;
+	oSpot.m_aiTeamThreats[m_aPlayers[iPlayer].m_iTeam]++;
+
+	UpdateSafeSpots(iSpot);
+}
+
+void CSpawnScoring::RemoveThreat(int iSpot, int iPlayer)
+{
+	SpawnSpot& oSpot = m_aSpots[iSpot];
+
+	oSpot.m_abThreats.Clear(iPlayer);
+	oSpot.m_iThreats--;
+	oSpot.m_aiTeamThreats[m_aPlayers[iPlayer].m_iTeam]--;
+
+	UpdateSafeSpots(iSpot);
+}
+
+void CSpawnScoring::UpdateSafeSpots(int iSpot)
+{
+	SpawnSpot& oSpot = m_aSpots[iSpot];
+
+	if (oSpot.m_iOnlyTeam >= 0)
+		m_abOnlyTeam[oSpot.m_iOnlyTeam].Clear(iSpot);
+
+	oSpot.m_iOnlyTeam = -1;
+
+	if (!oSpot.m_iThreats)
+	{
+		m_abUnthreatened.Set(iSpot);
+		return;
+	}
+
+	m_abUnthreatened.Clear(iSpot);
+
+	for (int i = 0; i < MAX_TEAMS; i++)
+	{
+		if (oSpot.m_aiTeamThreats[i] == oSpot.m_iThreats)
+		{
+			oSpot.m_iOnlyTeam = i;
+			m_abOnlyTeam[i].Set(iSpot);
+			break;
+		}
+	}
+}
+
+int CSpawnScoring::NextSafeSpot(int iStart, int iTeam, CSDKPlayer* pPlayer) const
+{
+	if (iStart >= m_aSpots.Count())
+		return -1;
+
+	int iNext = m_abUnthreatened.FindNextSetBit(iStart);
+
+	// Teammates don't count as threats.
+	if (iTeam >= 0)
+	{
+		int iTeamNext = m_abOnlyTeam[iTeam].FindNextSetBit(iStart);
+		if (iTeamNext >= 0 && (iNext < 0 || iTeamNext < iNext))
+			iNext = iTeamNext;
+	}
+
+	// Nor does the player themselves, who is still where they were before spawning. In teamplay
+	// they're counted with their team already.
+	int iPlayer = pPlayer?pPlayer->entindex():0;
+	if (iTeam < 0 && iPlayer > 0 && iPlayer <= MAX_PLAYERS)
+	{
+		const CUtlVector<int>& aiThreatened = m_aPlayers[iPlayer].m_aiThreatenedSpots;
+		for (int i = 0; i < aiThreatened.Count(); i++)
+		{
+			int iSpot = aiThreatened[i];
+			if (iSpot < iStart || (iNext >= 0 && iSpot >= iNext))
+				continue;
+
+			if (m_aSpots[iSpot].m_iThreats == 1)
+				iNext = iSpot;
+		}
+	}
+
+	return iNext;
+}
+
+bool CSpawnScoring::IsSpotThreatened(int iSpot, CBasePlayer* pPlayer)
+{
+	// Bring anybody who moved since the last frame up to date. After the first spawn
+	// of a mass respawn this finds nothing to do.
+	UpdateThreats(-1);
+
+	const CBitVec<MAX_PLAYERS+1>& abThreats = m_aSpots[iSpot].m_abThreats;
+
+	for (int i = abThreats.FindNextSetBit(0); i >= 0; i = abThreats.FindNextSetBit(i+1))
+	{
+		CBasePlayer* pOther = UTIL_PlayerByIndex(i);
+		if (!pOther || pOther == pPlayer)
+			continue;
+
+		if (SDKGameRules()->PlayerRelationship(pPlayer, pOther) != GR_TEAMMATE)
+			return true;
+	}
+
+	return false;
+}
+
+bool CSpawnScoring::IsSpotNearObjective(int iSpot)
+{
+	SpawnSpot& oSpot = m_aSpots[iSpot];
+
+	CBriefcase* pBriefcase = SDKGameRules()->GetBriefcase();
+	if (pBriefcase && (oSpot.m_vecOrigin - pBriefcase->GetAbsOrigin()).LengthSqr() < BRIEFCASE_SPAWN_DISTANCE*BRIEFCASE_SPAWN_DISTANCE)
+		return true;
+
+	CBriefcaseCaptureZone* pCapture = SDKGameRules()->GetCaptureZone();
+	if (!pCapture)
+		return false;
+
+	// The capture zone doesn't move, so work out every spot's distance to it once when it shows up.
+	if (m_hCaptureZone != pCapture)
+	{
+		m_hCaptureZone = pCapture;
+
+		for (int i = 0; i < m_aSpots.Count(); i++)
+			m_aSpots[i].m_flCaptureDistanceSqr = (m_aSpots[i].m_vecOrigin - pCapture->GetAbsOrigin()).LengthSqr();
+	}
+
+	return oSpot.m_flCaptureDistanceSqr < CAPTURE_SPAWN_DISTANCE*CAPTURE_SPAWN_DISTANCE;
+}
+
+bool CSpawnScoring::SelectSpawnSpot(CSDKPlayer* pPlayer, CBaseEntity* &pSpot)
+{
+	if (!m_aSpots.Count())
+		return false;
+
+	// The safe spot sets have to be current before they're used to skip spots.
+	UpdateThreats(-1);
+
+	int iLast = GetSpotIndex(pSpot);
+	int iFirst = (iLast + 1) % m_aSpots.Count();
+
+	int iTeam = -1;
+	if (g_pGameRules->IsTeamplay() && pPlayer && pPlayer->GetTeamNumber() >= 0 && pPlayer->GetTeamNumber() < MAX_TEAMS)
+		iTeam = pPlayer->GetTeamNumber();
+
+	// Same order as always, from the spot after the last one used around to it, but only the safe spots.
+	for (int iPass = 0; iPass < 2; iPass++)
+	{
+		int iEnd = iPass?iFirst:m_aSpots.Count();
+
+		for (int i = NextSafeSpot(iPass?0:iFirst, iTeam, pPlayer); i >= 0 && i < iEnd; i = NextSafeSpot(i+1, iTeam, pPlayer))
+		{
+			SpawnSpot& oSpot = m_aSpots[i];
+
+			CBaseEntity* pCandidate = oSpot.m_hSpot;
+			if (!pCandidate)
+				continue;
+
+			if (oSpot.m_vecOrigin == Vector(0, 0, 0))
+				continue;
+
+			if (g_pGameRules->IsSpawnPointValid( pCandidate, pPlayer ))
+			{
+				pSpot = pCandidate;
+				return true;
+			}
+		}
+	}
+
+	// if we're searching deathmatch spawns in teamplay and didn't get a valid one return false
+	if (g_pGameRules->IsTeamplay())
+		return false;
+
+	DevMsg("CSDKPlayer::SelectSpawnSpot: couldn't find valid spawn point.\n");
+
+	pSpot = m_aSpots[iFirst].m_hSpot;
+	return true;
+}
+
+CON_COMMAND(da_spawn_bench, "Time picking spawn points for a mass respawn, with and without cached threats: da_spawn_bench [spawns]")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	if (!SpawnScoring().IsBuilt())
+	{
+		Msg("No spawn points have been set up.\n");
+		return;
+	}
+
+	CUtlVector<CSDKPlayer*> apPlayers;
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
+		if (pPlayer && pPlayer->GetTeamNumber() != TEAM_SPECTATOR)
+			apPlayers.AddToTail(pPlayer);
+	}
+
+	if (!apPlayers.Count())
+	{
+		Msg("Need at least one player in the game.\n");
+		return;
+	}
+
+	int iSpawns = (args.ArgC() > 1)?atoi(args[1]):32;
+	if (iSpawns < 1)
+		iSpawns = 1;
+
+	bool bScoring = da_spawn_scoring.GetBool();
+
+	for (int iPass = 0; iPass < 2; iPass++)
+	{
+		da_spawn_scoring.SetValue(iPass == 1);
+
+		// Everybody counts as having moved, like at the start of a round.
+		SpawnScoring().MarkAllDirty();
+
+		int iTraces = SpawnScoring().GetTraces();
+		int iFound = 0;
+
+		CBaseEntity* pSpot = NULL;
+
+		double flStart = Plat_FloatTime();
+
+		for (int i = 0; i < iSpawns; i++)
+		{
+			if (SpawnScoring().SelectSpawnSpot(apPlayers[i%apPlayers.Count()], pSpot) && pSpot)
+				iFound++;
+		}
+
+		double flTime = Plat_FloatTime() - flStart;
+
+		Msg("%s: %d spawns (%d found) in %.3fms, %.3fms per spawn", iPass?"Cached":"Traced", iSpawns, iFound, flTime*1000, flTime*1000/iSpawns);
+		if (iPass)
+			Msg(", %d threat traces", SpawnScoring().GetTraces() - iTraces);
+		Msg("\n");
+	}
+
+	da_spawn_scoring.SetValue(bScoring);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "bitvec.h"
+
+#include "sdk_player.h"
+
+// --------------------------------------------------------------------------------------------------- //
+// Keeps track of which deathmatch spawn points can be seen by which players, so picking a spawn point
+// doesn't have to trace to every nearby player for every spot it considers. Spot data is built once
+// at level start. A player's threats are re-traced only after they move or once in a while, and a few
+// players at a time each frame, so a mass respawn finds nearly everything already up to date. Each spot
+// keeps a count of its threats by team, and the spots nobody (or only one team) can see are kept in bit
+// vectors as the counts change, so picking a spawn point only looks at spots that are actually safe.
+// --------------------------------------------------------------------------------------------------- //
+
+#define SPAWN_THREAT_RADIUS 512
+#define SPAWN_CELL_SIZE SPAWN_THREAT_RADIUS
+#define SPAWN_HASH_BUCKETS 256 // Power of two
+
+class CSpawnScoring : public CAutoGameSystemPerFrame
+{
+public:
+	CSpawnScoring( char const *name );
+
+public:
+	virtual void LevelShutdownPostEntity();
+	virtual void FrameUpdatePostEntityThink();
+
+	// Call once the level's spawn points have all been created.
+	void Build();
+
+	// -1 if pSpot isn't a spot we know about.
+	int  GetSpotIndex(CBaseEntity* pSpot) const;
+
+	// An enemy of pPlayer can see the spot.
+	bool IsSpotThreatened(int iSpot, CBasePlayer* pPlayer);
+
+	// Too close to the briefcase or its capture zone.
+	bool IsSpotNearObjective(int iSpot);
+
+	// Same as CSDKPlayer::SelectSpawnSpot: the first valid spot after pSpot. Spots an enemy of pPlayer
+	// can see are skipped without being looked at.
+	bool SelectSpawnSpot(CSDKPlayer* pPlayer, CBaseEntity* &pSpot);
+
+	bool IsBuilt() const { return m_bBuilt; }
+
+	// Built and da_spawn_scoring is on.
+	bool IsEnabled() const;
+
+	// Forget every player's threats, as if they had all just moved.
+	void MarkAllDirty();
+
+	int  GetTraces() const { return m_iTraces; }
+
+private:
+	void UpdateThreats(int iBudget);
+	void EvaluatePlayer(CSDKPlayer* pPlayer);
+	void ClearPlayer(int iPlayer);
+
+	void AddThreat(int iSpot, int iPlayer);
+	void RemoveThreat(int iSpot, int iPlayer);
+	void UpdateSafeSpots(int iSpot);
+
+	// The first spot at or after iStart that none of pPlayer's enemies can see, or -1.
+	int  NextSafeSpot(int iStart, int iTeam, CSDKPlayer* pPlayer) const;
+
+	void CellForOrigin(const Vector& vecOrigin, int& x, int& y, int& z) const;
+	int  HashCell(int x, int y, int z) const;
+
+private:
+	struct SpawnSpot
+	{
+		EHANDLE  m_hSpot;
+		Vector   m_vecOrigin;
+		Vector   m_vecCenter;
+		int      m_iCluster;
+		int      m_iCellX, m_iCellY, m_iCellZ;
+		int      m_iNextInBucket;
+		float    m_flCaptureDistanceSqr;
+
+		CBitVec<MAX_PLAYERS+1> m_abThreats; // Indexed by entindex
+		int      m_iThreats;
+		unsigned char m_aiTeamThreats[MAX_TEAMS];
+		int      m_iOnlyTeam;                // The one team that can see it, or -1
+	};
+
+	struct ThreatPlayer
+	{
+		bool     m_bEvaluated;
+		Vector   m_vecEvaluated;
+		float    m_flNextRefresh;
+		int      m_iTeam;                    // When the threats were counted
+
+		CUtlVector<int> m_aiThreatenedSpots;
+	};
+
+	bool   m_bBuilt;
+
+	CUtlVector<SpawnSpot> m_aSpots;
+	int    m_aiBuckets[SPAWN_HASH_BUCKETS];
+	short  m_aiEntityToSpot[MAX_EDICTS];
+
+	CVarBitVec m_abUnthreatened;             // Spots nobody can see
+	CVarBitVec m_abOnlyTeam[MAX_TEAMS];      // Spots only that team can see, safe for its players in teamplay
+
+	EHANDLE m_hCaptureZone;
+
+	ThreatPlayer m_aPlayers[MAX_PLAYERS+1];
+
+	int    m_iTraces;
+};
+
+CSpawnScoring& SpawnScoring();
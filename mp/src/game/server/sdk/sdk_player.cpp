@@ -32,7 +32,10 @@
 #include "ammodef.h"
 #include "dove.h"
 #include "da_datamanager.h"
+#include "da_playerproximity.h"
+#include "da_spawnscoring.h"
 #include "da_briefcase.h"
+#include "da_movementbench.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -100,6 +103,42 @@ PRECACHE_REGISTER(player);
 // CSDKPlayerShared Data Tables
 //=============================
 
+static void SendProxy_PlayerTimer( const SendProp *pProp, const void *pStruct, const void *pVarData, DVariant *pOut, int iElement, int objectID )
+{
+	pOut->m_Int = PlayerTimerToNetwork( *(float*)pVarData, ((const CSDKPlayerShared*)pStruct)->GetOuter()->GetCurrentTime() );
+}
+
+static void SendProxy_ServerTimer( const SendProp *pProp, const void *pStruct, const void *pVarData, DVariant *pOut, int iElement, int objectID )
+{
+	pOut->m_Int = PlayerTimerToNetwork( *(float*)pVarData, gpGlobals->curtime );
+}
+
+// See PlayerTimerToNetwork. Unlike SendPropTime, a timer that doesn't change doesn't get sent.
+// For timers stamped with the player's GetCurrentTime().
+static SendProp SendPropPlayerTimer( const char *pVarName, int offset, int sizeofVar )
+{
+	return SendPropInt( pVarName, offset, sizeofVar, PLAYER_TIMER_BITS, SPROP_UNSIGNED, SendProxy_PlayerTimer );
+}
+
+// For timers stamped with gpGlobals->curtime.
+static SendProp SendPropServerTimer( const char *pVarName, int offset, int sizeofVar )
+{
+	return SendPropInt( pVarName, offset, sizeofVar, PLAYER_TIMER_BITS, SPROP_UNSIGNED, SendProxy_ServerTimer );
+}
+
+static int GetPlayerTimeLag( float flCurrentTime )
+{
+	// In milliseconds so that float error in the accumulated player time doesn't cost a delta every tick.
+	int iLag = (int)floor(((double)TICKS_TO_TIME(gpGlobals->tickcount) - flCurrentTime)*1000 + 0.5);
+	int iMaxLag = (1<<(PLAYER_TIME_LAG_BITS-1))-1;
+	return clamp(iLag, -iMaxLag, iMaxLag);
+}
+
+static void SendProxy_PlayerCurrentTime( const SendProp *pProp, const void *pStruct, const void *pVarData, DVariant *pOut, int iElement, int objectID )
+{
+	pOut->m_Int = GetPlayerTimeLag( *(float*)pVarData );
+}
+
 // specific to the local player
 BEGIN_SEND_TABLE_NOBASE( CSDKPlayerShared, DT_SDKSharedLocalPlayerExclusive )
 #if defined ( SDK_USE_PLAYERCLASSES )
@@ -113,52 +152,43 @@ BEGIN_SEND_TABLE_NOBASE( CSDKPlayerShared, DT_SDKPlayerShared )
 	SendPropFloat( SENDINFO( m_flStamina ), 0, SPROP_NOSCALE | SPROP_CHANGES_OFTEN ),
 #endif
 
+	// Prone, slide, roll, dive, wall flip and mantel bools. Packed in PreClientUpdate.
+	SendPropInt( SENDINFO( m_iMovementBits ), MOVEMENT_BITS_COUNT, SPROP_UNSIGNED ),
+
 #if defined ( SDK_USE_PRONE )
-	SendPropBool( SENDINFO( m_bProne ) ),
-	SendPropTime( SENDINFO( m_flGoProneTime ) ),
-	SendPropTime( SENDINFO( m_flUnProneTime ) ),
-	SendPropTime( SENDINFO( m_flDisallowUnProneTime ) ),
-	SendPropBool( SENDINFO( m_bProneSliding ) ),
+	SendPropPlayerTimer( SENDINFO( m_flGoProneTime ) ),
+	SendPropPlayerTimer( SENDINFO( m_flUnProneTime ) ),
+	SendPropPlayerTimer( SENDINFO( m_flDisallowUnProneTime ) ),
 #endif
 #if defined ( SDK_USE_SPRINTING )
 	SendPropBool( SENDINFO( m_bIsSprinting ) ),
 #endif
-	SendPropBool( SENDINFO( m_bSliding ) ),
-	SendPropBool( SENDINFO( m_bInAirSlide ) ),
-	SendPropVector( SENDINFO(m_vecSlideDirection) ),
-	SendPropTime( SENDINFO( m_flSlideStartTime ) ),
-	SendPropTime( SENDINFO( m_flSlideAutoEndTime ) ),
-	SendPropTime( SENDINFO( m_flLastUnSlideTime ) ),
+	SendPropVector( SENDINFO(m_vecSlideDirection), 0, SPROP_NORMAL ),
+	SendPropPlayerTimer( SENDINFO( m_flSlideStartTime ) ),
+	SendPropPlayerTimer( SENDINFO( m_flSlideAutoEndTime ) ),
+	SendPropPlayerTimer( SENDINFO( m_flLastUnSlideTime ) ),
 	SendPropVector( SENDINFO(m_vecUnSlideEyeStartOffset) ),
-	SendPropBool( SENDINFO( m_bDiveSliding ) ),
-	SendPropTime( SENDINFO( m_flLastDuckPress ) ),
-	SendPropBool( SENDINFO( m_bRolling ) ),
-	SendPropBool( SENDINFO( m_bRollingFromDive ) ),
-	SendPropVector( SENDINFO(m_vecRollDirection) ),
-	SendPropTime( SENDINFO( m_flRollTime ) ),
-	SendPropBool( SENDINFO( m_bDiving ) ),
-	SendPropVector( SENDINFO(m_vecDiveDirection) ),
-	SendPropBool( SENDINFO( m_bRollAfterDive ) ),
-	SendPropTime( SENDINFO( m_flDiveTime ) ),
-	SendPropTime( SENDINFO( m_flTimeLeftGround ) ),
+	SendPropServerTimer( SENDINFO( m_flLastDuckPress ) ),
+	SendPropVector( SENDINFO(m_vecRollDirection), 0, SPROP_NORMAL ),
+	SendPropPlayerTimer( SENDINFO( m_flRollTime ) ),
+	SendPropVector( SENDINFO(m_vecDiveDirection), 0, SPROP_NORMAL ),
+	SendPropPlayerTimer( SENDINFO( m_flDiveTime ) ),
+	SendPropPlayerTimer( SENDINFO( m_flTimeLeftGround ) ),
 	SendPropFloat( SENDINFO( m_flDiveLerped ) ),
-	SendPropFloat( SENDINFO( m_flDiveToProneLandTime ) ),
+	SendPropPlayerTimer( SENDINFO( m_flDiveToProneLandTime ) ),
 	SendPropBool( SENDINFO( m_bAimedIn ) ),
-	SendPropFloat( SENDINFO( m_flAimIn ) ),
-	SendPropFloat( SENDINFO( m_flSlowAimIn ) ),
+	SendPropFloat( SENDINFO( m_flAimIn ), PLAYER_RAMP_BITS, SPROP_CHANGES_OFTEN, 0.0f, 1.0f ),
+	SendPropFloat( SENDINFO( m_flSlowAimIn ), PLAYER_RAMP_BITS, SPROP_CHANGES_OFTEN, 0.0f, 1.0f ),
 	SendPropInt( SENDINFO( m_iStyleSkill ) ),
 	SendPropInt( SENDINFO( m_iStyleSkillAfterRespawn ) ),
 	SendPropBool( SENDINFO( m_bSuperSkill ) ),
 	
 	SendPropInt (SENDINFO (m_iWallFlipCount)),
-	SendPropBool (SENDINFO (m_bIsWallFlipping)),
-	SendPropFloat (SENDINFO (m_flWallFlipEndTime)),
-	SendPropBool (SENDINFO (m_bIsManteling)),
-	SendPropVector (SENDINFO (m_vecMantelWallNormal)),
+	SendPropPlayerTimer (SENDINFO (m_flWallFlipEndTime)),
+	SendPropVector (SENDINFO (m_vecMantelWallNormal), 0, SPROP_NORMAL),
 
 	SendPropBool( SENDINFO( m_bSuperFalling ) ),
-	SendPropBool( SENDINFO( m_bSuperFallOthersVisible ) ),
-	SendPropTime( SENDINFO( m_flSuperFallOthersNextCheck ) ),
+	SendPropServerTimer( SENDINFO( m_flSuperFallOthersNextCheck ) ),
 
 	SendPropDataTable( "sdksharedlocaldata", 0, &REFERENCE_SEND_TABLE(DT_SDKSharedLocalPlayerExclusive), SendProxy_SendLocalDataTable ),
 END_SEND_TABLE()
@@ -246,7 +276,7 @@ IMPLEMENT_SERVERCLASS_ST( CSDKPlayer, DT_SDKPlayer )
 	SendPropFloat		( SENDINFO( m_flSlowMoSeconds ) ),
 	SendPropTime		( SENDINFO( m_flSlowMoTime ) ),
 	SendPropTime		( SENDINFO( m_flSlowMoMultiplier ) ),
-	SendPropFloat( SENDINFO( m_flCurrentTime ), -1, SPROP_CHANGES_OFTEN ),
+	SendPropInt( SENDINFO( m_flCurrentTime ), PLAYER_TIME_LAG_BITS, SPROP_CHANGES_OFTEN|SPROP_ENCODED_AGAINST_TICKCOUNT, SendProxy_PlayerCurrentTime ),
 	SendPropFloat( SENDINFO( m_flLastSpawnTime ) ),
 	SendPropTime		( SENDINFO( m_flReadyWeaponUntil ) ),
 
@@ -492,67 +522,82 @@ bool CSDKPlayer::IsVisible(CSDKPlayer *pPlayer, bool testFOV, unsigned char *vis
 		return false;
 	}
 
-	unsigned char testVisParts = VIS_NONE;
+	// gut, top of head, feet, then the "edges"
+	static const VisiblePartType aeParts[] = { VIS_GUT, VIS_HEAD, VIS_FEET, VIS_LEFT_SIDE, VIS_RIGHT_SIDE };
 
-	// check gut
-	Vector partPos = GetPartPosition( pPlayer, VIS_GUT );
+	unsigned char testVisParts = VIS_NONE;
 
-	// finish gut check
-	if (IsVisible( partPos, testFOV ))
+	for (int i = 0; i < ARRAYSIZE(aeParts); i++)
 	{
-		if (visParts == NULL)
-			return true;
+		if (IsPartVisible( pPlayer, aeParts[i], testFOV ))
+		{
+			if (visParts == NULL)
+				return true;
 
-		testVisParts |= VIS_GUT;
+			testVisParts |= aeParts[i];
+		}
 	}
 
+	if (visParts)
+		*visParts = testVisParts;
 
-	// check top of head
-	partPos = GetPartPosition( pPlayer, VIS_HEAD );
-	if (IsVisible( partPos, testFOV ))
-	{
-		if (visParts == NULL)
-			return true;
+	if (testVisParts)
+		return true;
 
-		testVisParts |= VIS_HEAD;
-	}
+	return false;
+}
 
-	// check feet
-	partPos = GetPartPosition( pPlayer, VIS_FEET );
-	if (IsVisible( partPos, testFOV ))
-	{
-		if (visParts == NULL)
-			return true;
+static int g_iVisibilityCacheHits = 0;
+static int g_iVisibilityCacheMisses = 0;
 
-		testVisParts |= VIS_FEET;
-	}
+bool CSDKPlayer::IsPartVisible(CSDKPlayer* player, VisiblePartType part, bool testFOV) const
+{
+	Vector partPos = GetPartPosition( player, part );
 
-	// check "edges"
-	partPos = GetPartPosition( pPlayer, VIS_LEFT_SIDE );
-	if (IsVisible( partPos, testFOV ))
-	{
-		if (visParts == NULL)
-			return true;
+	// The view cone is cheap and depends on where we're looking, so it isn't cached.
+	if (testFOV && !const_cast<CSDKPlayer*>(this)->FInViewCone( partPos ))
+		return false;
 
-		testVisParts |= VIS_LEFT_SIDE;
-	}
+	// which VisibilityInfo corresponds to this pair of players
+	VisibilityInfo* info = &m_visibilityInfo[ entindex() % MAX_PLAYERS ][ player->entindex() % MAX_PLAYERS ];
 
-	partPos = GetPartPosition( pPlayer, VIS_RIGHT_SIDE );
-	if (IsVisible( partPos, testFOV ))
+	if (gpGlobals->framecount != info->m_validFrame)
 	{
-		if (visParts == NULL)
-			return true;
+		info->m_testedParts = VIS_NONE;
+		info->m_visibleParts = VIS_NONE;
+		info->m_validFrame = gpGlobals->framecount;
+	}
 
-		testVisParts |= VIS_RIGHT_SIDE;
+	if (info->m_testedParts & part)
+	{
+		g_iVisibilityCacheHits++;
+		return !!(info->m_visibleParts & part);
 	}
 
-	if (visParts)
-		*visParts = testVisParts;
+	g_iVisibilityCacheMisses++;
 
-	if (testVisParts)
-		return true;
+	bool bVisible = IsVisible( partPos );
 
-	return false;
+	info->m_testedParts |= part;
+	if (bVisible)
+		info->m_visibleParts |= part;
+
+	return bVisible;
+}
+
+CSDKPlayer::VisibilityInfo CSDKPlayer::m_visibilityInfo[ MAX_PLAYERS ][ MAX_PLAYERS ];
+
+CON_COMMAND( sv_visibility_cache_stats, "Print and reset player visibility cache hit rate." )
+{
+	int iQueries = g_iVisibilityCacheHits + g_iVisibilityCacheMisses;
+
+	Msg("Player visibility cache: %d queries, %d hits, %d traces", iQueries, g_iVisibilityCacheHits, g_iVisibilityCacheMisses);
+	if (iQueries)
+		Msg(" (%.1f%% hit rate)", 100.0f * g_iVisibilityCacheHits / iQueries);
+	Msg("\n");
+
+	g_iVisibilityCacheHits = 0;
+	g_iVisibilityCacheMisses = 0;
 }
 
 Vector CSDKPlayer::GetPartPosition(CSDKPlayer* player, VisiblePartType part) const
@@ -740,6 +785,9 @@ void CSDKPlayer::PreThink(void)
 
 	UpdateCurrentTime();
 
+	if (GetCurrentCommand())
+		MovementBench().RecordCommand(this, GetCurrentCommand());
+
 	if (IsAlive())
 	{
 		if (!IsStyleSkillActive() && m_flCurrentTime > m_flNextHealthDecay && GetHealth() > GetMaxHealth())
@@ -885,7 +933,10 @@ void CSDKPlayer::PostThink()
 	m_PlayerAnimState->Update( m_angEyeAngles[YAW], m_angEyeAngles[PITCH], angCharacterEyeAngles[YAW], angCharacterEyeAngles[PITCH] );
 
 	if ( sv_drawserverhitbox.GetBool() )
+	{
+		m_PlayerAnimState->FinishPoseUpdate();
 		DrawServerHitboxes( 2*gpGlobals->frametime, true );
+	}
 
 	if (SDKGameRules()->CoderHacks())
 		m_nCoderHacksButtons = m_nButtons;
@@ -1145,8 +1196,14 @@ void CSDKPlayer::Spawn()
 	m_bSpawnInterpCounter = !m_bSpawnInterpCounter;
 
 	for( int p=0; p<MAX_PLAYERS; ++p )
+	{
 		m_partInfo[p].m_validFrame = 0;
 
+		// I moved, forget what I could see and who could see me.
+		m_visibilityInfo[ entindex() % MAX_PLAYERS ][p].m_validFrame = 0;
+		m_visibilityInfo[p][ entindex() % MAX_PLAYERS ].m_validFrame = 0;
+	}
+
 	InitSpeeds(); //Tony; initialize player speeds.
 
 	SetArmorValue(SpawnArmorValue());
@@ -1182,6 +1239,9 @@ void CSDKPlayer::Spawn()
 	if (m_Shared.m_iStyleSkill == SKILL_REFLEXES)
 		GiveSlowMo(1);
 
+	// Spawn checks for the players spawning after me need to know I'm here now.
+	PlayerProximity().Invalidate();
+
 	SDKGameRules()->CalculateSlowMoForPlayer(this);
 
 	m_flLastSpawnTime = gpGlobals->curtime;
@@ -1206,6 +1266,9 @@ void CSDKPlayer::Spawn()
 
 bool CSDKPlayer::SelectSpawnSpot( const char *pEntClassName, CBaseEntity* &pSpot )
 {
+	if (SpawnScoring().IsEnabled() && !stricmp(pEntClassName, "info_player_deathmatch"))
+		return SpawnScoring().SelectSpawnSpot(this, pSpot);
+
 	// Find the next spawn spot.
 	pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
 
@@ -1748,6 +1811,8 @@ ConVar da_stylemetertotalcharge( "da_stylemetertotalcharge", "100", FCVAR_CHEAT|
 
 void CSDKPlayer::Event_Killed( const CTakeDamageInfo &info )
 {
+	PlayerProximity().Invalidate();
+
 	CTakeDamageInfo subinfo = info;
 	subinfo.SetDamageForce( m_vecTotalBulletForce );
 
@@ -3809,7 +3874,7 @@ bool CSDKPlayer::WantsLagCompensationOnEntity( const CBasePlayer *pPlayer, const
 	const Vector &vMyOrigin = GetAbsOrigin();
 	const Vector &vHisOrigin = pPlayer->GetAbsOrigin();
 
-	ConVarRef sv_maxunlag("sv_maxunlag");
+	static ConVarRef sv_maxunlag("sv_maxunlag");
 
 	// get max distance player could have moved within max lag compensation time, 
 	// multiply by 1.5 to to avoid "dead zones"  (sqrt(2) would be the exact value)
@@ -4153,6 +4218,212 @@ void CSDKPlayer::DropBriefcase()
 	SendBroadcastSound("MiniObjective.BriefcaseDrop");
 }
 
+// Bits each prop cost before and after DT_SDKPlayerShared was packed down, for sv_player_network_stats.
+#define NETSTAT_PROP_INDEX_BITS 7	// Roughly what the delta writer spends saying which prop changed
+#define NETSTAT_NORMAL_BITS 25		// Two 12 bit normal components and the sign of the third
+
+#ifdef SDK_USE_PRONE
+#define NETSTAT_TIMERS 13
+#else
+#define NETSTAT_TIMERS 10
+#endif
+#define NETSTAT_DIRECTIONS 4
+#define NETSTAT_RAMPS 2
+
+struct PlayerNetworkState_t
+{
+	float  m_aflTimers[NETSTAT_TIMERS];
+	bool   m_abServerTimers[NETSTAT_TIMERS];	// Stamped with gpGlobals->curtime instead of the player's time
+	Vector m_avecDirections[NETSTAT_DIRECTIONS];
+	float  m_aflRamps[NETSTAT_RAMPS];
+	int    m_iMovementBits;
+	float  m_flCurrentTime;
+};
+
+void CSDKPlayer::GetNetworkState(PlayerNetworkState_t& oState) const
+{
+	V_memset(oState.m_abServerTimers, 0, sizeof(oState.m_abServerTimers));
+
+	int i = 0;
+#ifdef SDK_USE_PRONE
+	oState.m_aflTimers[i++] = m_Shared.m_flGoProneTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flUnProneTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flDisallowUnProneTime;
+#endif
+	oState.m_aflTimers[i++] = m_Shared.m_flSlideStartTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flSlideAutoEndTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flLastUnSlideTime;
+	oState.m_abServerTimers[i] = true;
+	oState.m_aflTimers[i++] = m_Shared.m_flLastDuckPress;
+	oState.m_aflTimers[i++] = m_Shared.m_flRollTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flDiveTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flTimeLeftGround;
+	oState.m_aflTimers[i++] = m_Shared.m_flDiveToProneLandTime;
+	oState.m_aflTimers[i++] = m_Shared.m_flWallFlipEndTime;
+	oState.m_abServerTimers[i] = true;
+	oState.m_aflTimers[i++] = m_Shared.m_flSuperFallOthersNextCheck;
+	Assert(i == NETSTAT_TIMERS);
+
+	oState.m_avecDirections[0] = m_Shared.m_vecSlideDirection;
+	oState.m_avecDirections[1] = m_Shared.m_vecRollDirection;
+	oState.m_avecDirections[2] = m_Shared.m_vecDiveDirection;
+	oState.m_avecDirections[3] = m_Shared.m_vecMantelWallNormal;
+
+	oState.m_aflRamps[0] = m_Shared.m_flAimIn;
+	oState.m_aflRamps[1] = m_Shared.m_flSlowAimIn;
+
+	oState.m_iMovementBits = m_Shared.GetMovementBits();
+	oState.m_flCurrentTime = m_flCurrentTime;
+}
+
+static int NormalComponentToNetwork(float flComponent)
+{
+	return RoundFloatToInt(flComponent*((1<<(NETSTAT_NORMAL_BITS/2 - 1))-1));
+}
+
+static int RampToNetwork(float flRamp)
+{
+	return RoundFloatToInt(clamp(flRamp, 0.0f, 1.0f)*((1<<PLAYER_RAMP_BITS)-1));
+}
+
+static PlayerNetworkState_t s_aLastNetworkStates[MAX_PLAYERS+1];
+static EHANDLE s_ahLastNetworkStatePlayers[MAX_PLAYERS+1];
+
+static int s_iNetStatSnapshots = 0;		// Player snapshots, one per player per tick
+static double s_flNetStatOldBits = 0;
+static double s_flNetStatNewBits = 0;
+
+void CSDKPlayer::PreClientUpdate()
+{
+	m_Shared.UpdateMovementBits();
+
+	PlayerNetworkState_t oState;
+	GetNetworkState(oState);
+
+	int iIndex = entindex();
+	Assert(iIndex > 0 && iIndex <= MAX_PLAYERS);
+
+	// First snapshot for this player, nothing to delta against.
+	if (s_ahLastNetworkStatePlayers[iIndex] != this)
+	{
+		s_ahLastNetworkStatePlayers[iIndex] = this;
+		s_aLastNetworkStates[iIndex] = oState;
+		return;
+	}
+
+	PlayerNetworkState_t& oLast = s_aLastNetworkStates[iIndex];
+
+	int iOldBits = 0;
+	int iNewBits = 0;
+
+	for (int i = 0; i < NETSTAT_TIMERS; i++)
+	{
+		if (oState.m_aflTimers[i] != oLast.m_aflTimers[i])
+			iOldBits += 32 + NETSTAT_PROP_INDEX_BITS;
+
+		float flNow = oState.m_abServerTimers[i]?gpGlobals->curtime:oState.m_flCurrentTime;
+		float flLastNow = oLast.m_abServerTimers[i]?gpGlobals->curtime-TICK_INTERVAL:oLast.m_flCurrentTime;
+
+		if (PlayerTimerToNetwork(oState.m_aflTimers[i], flNow) != PlayerTimerToNetwork(oLast.m_aflTimers[i], flLastNow))
+			iNewBits += PLAYER_TIMER_BITS + NETSTAT_PROP_INDEX_BITS;
+	}
+
+	for (int i = 0; i < NETSTAT_DIRECTIONS; i++)
+	{
+		const Vector& vecDirection = oState.m_avecDirections[i];
+		const Vector& vecLast = oLast.m_avecDirections[i];
+
+		if (vecDirection != vecLast)
+			iOldBits += 3*32 + NETSTAT_PROP_INDEX_BITS;
+
+		if (NormalComponentToNetwork(vecDirection.x) != NormalComponentToNetwork(vecLast.x) ||
+			NormalComponentToNetwork(vecDirection.y) != NormalComponentToNetwork(vecLast.y) ||
+			(vecDirection.z <= 0) != (vecLast.z <= 0))
+			iNewBits += NETSTAT_NORMAL_BITS + NETSTAT_PROP_INDEX_BITS;
+	}
+
+	for (int i = 0; i < NETSTAT_RAMPS; i++)
+	{
+		if (oState.m_aflRamps[i] != oLast.m_aflRamps[i])
+			iOldBits += 32 + NETSTAT_PROP_INDEX_BITS;
+
+		if (RampToNetwork(oState.m_aflRamps[i]) != RampToNetwork(oLast.m_aflRamps[i]))
+			iNewBits += PLAYER_RAMP_BITS + NETSTAT_PROP_INDEX_BITS;
+	}
+
+	// Each bool used to be its own prop.
+	int iChangedBits = oState.m_iMovementBits ^ oLast.m_iMovementBits;
+	for (int i = 0; i < MOVEMENT_BITS_COUNT; i++)
+	{
+		if (iChangedBits & (1<<i))
+			iOldBits += 1 + NETSTAT_PROP_INDEX_BITS;
+	}
+
+	if (iChangedBits)
+		iNewBits += MOVEMENT_BITS_COUNT + NETSTAT_PROP_INDEX_BITS;
+
+	if (oState.m_flCurrentTime != oLast.m_flCurrentTime)
+		iOldBits += 32 + NETSTAT_PROP_INDEX_BITS;
+
+	// The tick count went up by one since the last snapshot.
+	int iLag = (int)floor(((double)TICKS_TO_TIME(gpGlobals->tickcount) - oState.m_flCurrentTime)*1000 + 0.5);
+	int iLastLag = (int)floor(((double)TICKS_TO_TIME(gpGlobals->tickcount-1) - oLast.m_flCurrentTime)*1000 + 0.5);
+	if (iLag != iLastLag)
+		iNewBits += PLAYER_TIME_LAG_BITS + NETSTAT_PROP_INDEX_BITS;
+
+	s_iNetStatSnapshots++;
+	s_flNetStatOldBits += iOldBits;
+	s_flNetStatNewBits += iNewBits;
+
+	oLast = oState;
+}
+
+CON_COMMAND(sv_player_network_stats, "Estimate how many bytes a snapshot of each player spends on the player timers, directions, aim in ramps, movement bools and current time, with the old full precision encoding and the packed one. sv_player_network_stats reset to zero them.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	if (!s_iNetStatSnapshots)
+		Msg("No player snapshots yet\n");
+	else
+	{
+		float flOldBytes = (float)(s_flNetStatOldBits/8/s_iNetStatSnapshots);
+		float flNewBytes = (float)(s_flNetStatNewBits/8/s_iNetStatSnapshots);
+
+		Msg("%d player snapshots\n", s_iNetStatSnapshots);
+		Msg("  full precision: %.2f bytes per snapshot per player\n", flOldBytes);
+		Msg("  packed:         %.2f bytes per snapshot per player (%.0f%%)\n", flNewBytes, flOldBytes>0?flNewBytes*100/flOldBytes:0.0f);
+	}
+
+	if (args.ArgC() > 1 && FStrEq(args[1], "reset"))
+	{
+		s_iNetStatSnapshots = 0;
+		s_flNetStatOldBits = 0;
+		s_flNetStatNewBits = 0;
+	}
+}
+
+class CSDKPlayerNetworkSystem : public CAutoGameSystemPerFrame
+{
+public:
+	CSDKPlayerNetworkSystem( char const* name )
+		: CAutoGameSystemPerFrame(name)
+	{
+	}
+
+	virtual void PreClientUpdate()
+	{
+		for (int i = 1; i <= gpGlobals->maxClients; i++)
+		{
+			CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
+			if (pPlayer)
+				pPlayer->PreClientUpdate();
+		}
+	}
+};
+
+CSDKPlayerNetworkSystem g_SDKPlayerNetworkSystem( "CSDKPlayerNetworkSystem" );
+
 bool CSDKPlayer::CanDoCoderHacks()
 {
 	// Steam ID to account ID conversion:
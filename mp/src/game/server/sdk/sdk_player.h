@@ -63,6 +63,13 @@ public:
 		int m_validFrame;											///< frame of last computation (for lazy evaluation)
 	};
 
+	struct VisibilityInfo
+	{
+		unsigned char m_testedParts;								///< parts that have been traced this frame
+		unsigned char m_visibleParts;								///< which of the tested parts were in line of sight
+		int m_validFrame;											///< frame the results are for
+	};
+
 	CSDKPlayer();
 	~CSDKPlayer();
 
@@ -114,6 +121,7 @@ public:
 	virtual bool        IsVisible(const Vector &pos, bool testFOV = false, const CBaseEntity *ignore = NULL) const;	///< return true if we can see the point
 	virtual bool        IsVisible(CSDKPlayer* pPlayer, bool testFOV = false, unsigned char* visParts = NULL) const;
 	virtual Vector      GetPartPosition(CSDKPlayer* player, VisiblePartType part) const;	///< return world space position of given part on player
+	bool                IsPartVisible(CSDKPlayer* player, VisiblePartType part, bool testFOV) const;	///< line of sight to a part, cached per frame
 	virtual void        ComputePartPositions(CSDKPlayer *player);					///< compute part positions from bone location
 	virtual Vector      GetCentroid() const;
 	virtual CSDKPlayer* FindClosestFriend(float flMaxDistance, bool bFOV = true);
@@ -343,6 +351,10 @@ public:
 
 	float GetCurrentTime() const { return m_flCurrentTime; }
 
+	// Called before each snapshot is sent.
+	void PreClientUpdate();
+	void GetNetworkState(struct PlayerNetworkState_t& oState) const;
+
 	bool CanDoCoderHacks();
 	void CoderHacks(bool bOn);
 
@@ -559,6 +571,7 @@ public:
 
 protected:
 	static PartInfo m_partInfo[ MAX_PLAYERS ];						///< part positions for each player
+	static VisibilityInfo m_visibilityInfo[ MAX_PLAYERS ][ MAX_PLAYERS ];	///< part visibility for each observer/target pair
 };
 
 
@@ -12,6 +12,7 @@
 #include "ipredictionsystem.h"
 #include "sdk_player.h"
 #include "iservervehicle.h"
+#include "movehelper_server.h"
 
 
 static CMoveData g_MoveData;
@@ -31,6 +32,9 @@ public:
 	virtual void	StartCommand( CBasePlayer *player, CUserCmd *cmd );
 	virtual void	SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper *pHelper, CMoveData *move );
 	virtual void	FinishMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move );
+
+	// Just the movement part of RunCommand, no thinking or touching.
+	void			RunMovement( CBasePlayer *player, CUserCmd *ucmd, IMoveHelperServer *moveHelper );
 };
 
 // PlayerMove Interface
@@ -70,6 +74,34 @@ void CSDKPlayerMove::SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Runs a command through the movement code without the rest of
+//          RunCommand, for da_movement_bench. The caller sets up the time.
+//-----------------------------------------------------------------------------
+void CSDKPlayerMove::RunMovement( CBasePlayer *player, CUserCmd *ucmd, IMoveHelperServer *moveHelper )
+{
+	StartCommand( player, ucmd );
+
+	moveHelper->SetHost( player );
+
+	player->UpdateButtonState( ucmd->buttons );
+	player->pl.v_angle = ucmd->viewangles;
+
+	SetupMove( player, ucmd, moveHelper, g_pMoveData );
+	g_pGameMovement->ProcessMovement( player, g_pMoveData );
+	FinishMove( player, ucmd, g_pMoveData );
+
+	// Clears the touch list too, nothing gets touched.
+	moveHelper->SetHost( NULL );
+
+	FinishCommand( player );
+}
+
+void RunPlayerMovement( CBasePlayer *player, CUserCmd *ucmd )
+{
+	g_PlayerMove.RunMovement( player, ucmd, MoveHelperServer() );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: This is called post player movement to copy back all data that
 //          movement could have modified and that is necessary for future
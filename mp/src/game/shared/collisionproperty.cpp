@@ -1373,6 +1373,8 @@ void CCollisionProperty::MarkPartitionHandleDirty()
 }
 
 
+int g_iSpatialPartitionUpdates = 0;
+
 //-----------------------------------------------------------------------------
 // Updates the spatial partition
 //-----------------------------------------------------------------------------
@@ -1402,6 +1404,8 @@ void CCollisionProperty::UpdatePartition( )
 		// We don't need to bother if it's not a trigger or solid
 		if ( IsSolid() || IsSolidFlagSet( FSOLID_TRIGGER ) || m_pOuter->IsEFlagSet( EFL_USE_PARTITION_WHEN_NOT_SOLID ) )
 		{
+			g_iSpatialPartitionUpdates++;
+
 			// Bloat a little bit...
 			if ( BoundingRadius() != 0.0f )
 			{
@@ -33,6 +33,9 @@ class IPhysicsObject;
 //-----------------------------------------------------------------------------
 void UpdateDirtySpatialPartitionEntities();
 
+// How many times an entity has been moved in the spatial partition, for profiling.
+extern int g_iSpatialPartitionUpdates;
+
 
 //-----------------------------------------------------------------------------
 // Specifies how to compute the surrounding box
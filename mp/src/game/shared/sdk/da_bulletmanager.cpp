@@ -5,6 +5,8 @@
 #include "engine/ivdebugoverlay.h"
 #include "effect_dispatch_data.h"
 #include "ammodef.h"
+#include "ispatialpartition.h"
+#include "collisionutils.h"
 
 #ifdef CLIENT_DLL
 #include "view.h"
@@ -26,14 +28,163 @@ CBulletManager& BulletManager()
 CBulletManager::CBulletManager( char const* name )
 	: CAutoGameSystemPerFrame(name)
 {
+	m_iHighWaterMark = 0;
+	m_iPoolOverflows = 0;
+
+	m_bInShot = false;
+	m_iShotPartitionStart = 0;
+	ResetShotStats();
+}
+
+CBulletManager::~CBulletManager()
+{
+	for (int i = 0; i < m_apBulletChunks.Count(); i++)
+		delete [] m_apBulletChunks[i];
+
+	m_apBulletChunks.Purge();
 }
 
 void CBulletManager::LevelInitPostEntity()
 {
-	m_aBullets.SetSize(200);
+	if (!m_apBulletChunks.Count())
+		GrowPool();
+
+	m_aiActiveBullets.RemoveAll();
+	m_aiFreeBullets.RemoveAll();
+
+	for (int i = m_apBulletChunks.Count() * BULLET_POOL_CHUNK_SIZE - 1; i >= 0; i--)
+	{
+		CBullet& oBullet = GetBullet(i);
+		oBullet.Deactivate();
+
+		if (!oBullet.m_bActive)
+			m_aiFreeBullets.AddToTail(i);
+	}
+
+	for (int i = 0; i < m_apBulletChunks.Count() * BULLET_POOL_CHUNK_SIZE; i++)
+	{
+		if (GetBullet(i).m_bActive)
+			m_aiActiveBullets.AddToTail(i);
+	}
+}
+
+void CBulletManager::GrowPool()
+{
+	int iFirst = m_apBulletChunks.Count() * BULLET_POOL_CHUNK_SIZE;
+
+	m_apBulletChunks.AddToTail(new CBullet[BULLET_POOL_CHUNK_SIZE]);
+
+	// Hand out the new chunk lowest index first.
+	for (int i = iFirst + BULLET_POOL_CHUNK_SIZE - 1; i >= iFirst; i--)
+		m_aiFreeBullets.AddToTail(i);
+}
+
+int CBulletManager::AllocateBullet()
+{
+	if (!m_aiFreeBullets.Count())
+	{
+		// Out of bullets. Don't drop the shot, make room for more.
+		m_iPoolOverflows++;
+		GrowPool();
+	}
+
+	int iBullet = m_aiFreeBullets.Tail();
+	m_aiFreeBullets.RemoveMultipleFromTail(1);
+
+	return iBullet;
+}
+
+void CBulletManager::PrintPoolStats() const
+{
+	Msg("Bullet pool: %d active, %d free, %d allocated in %d chunks of %d\n",
+		m_aiActiveBullets.Count(), m_aiFreeBullets.Count(), m_apBulletChunks.Count() * BULLET_POOL_CHUNK_SIZE, m_apBulletChunks.Count(), BULLET_POOL_CHUNK_SIZE);
+	Msg("High water mark: %d, overflows: %d\n", m_iHighWaterMark, m_iPoolOverflows);
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND(cl_bullet_pool_stats, "Print client bullet pool usage.")
+#else
+CON_COMMAND(sv_bullet_pool_stats, "Print server bullet pool usage.")
+#endif
+{
+	BulletManager().PrintPoolStats();
+}
+
+void CBulletManager::PrintShotStats() const
+{
+	Msg("Hitscan shots: %d, bullet traces: %d\n", m_iShots, m_iShotTraces);
+	Msg("Players inside enlarged volumes: %d (%.2f per trace), hit: %d\n",
+		m_iShotCandidates, m_iShotTraces?(float)m_iShotCandidates/m_iShotTraces:0.0f, m_iShotPlayerHits);
+	Msg("Spatial partition updates during shots: %d (%d at most in one shot)\n", m_iShotPartitionUpdates, m_iMostShotPartitionUpdates);
+}
+
+void CBulletManager::ResetShotStats()
+{
+	m_iShots = 0;
+	m_iShotTraces = 0;
+	m_iShotCandidates = 0;
+	m_iShotPlayerHits = 0;
+	m_iShotPartitionUpdates = 0;
+	m_iMostShotPartitionUpdates = 0;
+}
+
+#ifndef CLIENT_DLL
+CON_COMMAND(sv_bullet_shot_stats, "Print how many players hitscan shots tested and how many spatial partition updates they caused. sv_bullet_shot_stats reset to zero them.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	BulletManager().PrintShotStats();
+
+	if (args.ArgC() > 1 && FStrEq(args[1], "reset"))
+		BulletManager().ResetShotStats();
+}
+#endif
+
+void CBulletManager::BeginShot()
+{
+	Assert(!m_bInShot);
+
+	// Apply the lag compensation moves now so they aren't counted against the shot.
+	UpdateDirtySpatialPartitionEntities();
+	m_iShotPartitionStart = g_iSpatialPartitionUpdates;
+
+	m_aShotVolumes.RemoveAll();
+
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		CBasePlayer* pPlayer = UTIL_PlayerByIndex(i);
+		if (!pPlayer)
+			continue;
+
+		// Same as the partition, which only has solid players in it.
+		if (!pPlayer->IsSolid())
+			continue;
+
+		const Vector& vecOrigin = pPlayer->CollisionProp()->GetCollisionOrigin();
+
+		ShotVolume& oVolume = m_aShotVolumes[m_aShotVolumes.AddToTail()];
+		oVolume.m_iPlayer = i;
+		oVolume.m_vecMins = vecOrigin + pPlayer->CollisionProp()->OBBMins() * BULLET_PLAYER_VOLUME_SCALE - Vector(1, 1, 1);
+		oVolume.m_vecMaxs = vecOrigin + pPlayer->CollisionProp()->OBBMaxs() * BULLET_PLAYER_VOLUME_SCALE + Vector(1, 1, 1);
+	}
+
+	m_bInShot = true;
+	m_iShots++;
+}
+
+void CBulletManager::EndShot()
+{
+	Assert(m_bInShot);
 
-	for (int i = 0; i < m_aBullets.Count(); i++)
-		m_aBullets[i].Deactivate();
+	m_bInShot = false;
+
+	// Anything the shot moved would be relinked by the next trace anyway.
+	UpdateDirtySpatialPartitionEntities();
+
+	int iUpdates = g_iSpatialPartitionUpdates - m_iShotPartitionStart;
+	m_iShotPartitionUpdates += iUpdates;
+	m_iMostShotPartitionUpdates = max(m_iMostShotPartitionUpdates, iUpdates);
 }
 
 CBulletManager::CBullet CBulletManager::MakeBullet(CSDKPlayer* pShooter, const Vector& vecSrc, const Vector& vecDirection, SDKWeaponID eWeapon, CWeaponSDKBase* pWeapon, int iDamage, int iBulletType, bool bDoEffects)
@@ -67,23 +218,17 @@ void CBulletManager::AddBullet(const CBullet& oBullet)
 		return;
 #endif
 
-	// Find an empty spot
-	int iEmpty = -1;
-	for (int i = 0; i < m_aBullets.Count(); i++)
-	{
-		if (!m_aBullets[i].m_bActive)
-		{
-			iEmpty = i;
-			break;
-		}
-	}
+	int iBullet = AllocateBullet();
 
-	Assert(iEmpty >= 0);
-	if (iEmpty < 0)
-		return;
+	CBullet& oNewBullet = GetBullet(iBullet);
+	oNewBullet = oBullet;
+	oNewBullet.m_bWorldClearValid = false;
+	oNewBullet.Activate();
 
-	m_aBullets[iEmpty] = oBullet;
-	m_aBullets[iEmpty].Activate();
+	m_aiActiveBullets.AddToTail(iBullet);
+
+	if (m_aiActiveBullets.Count() > m_iHighWaterMark)
+		m_iHighWaterMark = m_aiActiveBullets.Count();
 }
 
 void CBulletManager::Update(float frametime)
@@ -99,12 +244,17 @@ void CBulletManager::FrameUpdatePreEntityThink()
 ConVar da_bullet_speed("da_bullet_speed", "4000", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How fast do bullets go during slow motion?" );
 ConVar da_bullet_speed_active("da_bullet_speed_active", "6000", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How fast do bullets go during slow motion?" );
 ConVar da_bullet_debug("da_bullet_debug", "0", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "Shows client (red) and server (blue) bullet path" );
+ConVar da_bullet_penetrations("da_bullet_penetrations", "5", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How many times will a bullet penetrate a wall?" );
+
+ConVar da_bullet_broadphase("da_bullet_broadphase", "1", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "Skip bullet traces for slow motion bullets that can't hit anything this frame" );
 
 void CBulletManager::BulletsThink(float flFrameTime)
 {
-	for (int i = 0; i < m_aBullets.Count(); i++)
+	m_oBatch.Clear();
+
+	for (int k = 0; k < m_aiActiveBullets.Count(); k++)
 	{
-		CBullet& oBullet = m_aBullets[i];
+		CBullet& oBullet = GetBullet(m_aiActiveBullets[k]);
 		if (!oBullet.m_bActive)
 			continue;
 
@@ -148,15 +298,333 @@ void CBulletManager::BulletsThink(float flFrameTime)
 		else
 			dt = flSpeed * oBullet.m_hShooter->GetSlowMoMultiplier() * flFrameTime;
 
-		SimulateBullet(oBullet, dt);
+		m_oBatch.AddSegment(m_aiActiveBullets[k], oBullet.m_hShooter->entindex(), dt, oBullet.m_vecOrigin, oBullet.m_vecOrigin + oBullet.m_vecDirection * dt);
+	}
+
+	BroadphaseCull();
+
+	// Narrowphase. Bullets are still processed in the order they were fired
+	// so that damage is applied in the same order as before.
+	for (int k = 0; k < m_oBatch.Count(); k++)
+	{
+		CBullet& oBullet = GetBullet(m_oBatch.m_aiBullet[k]);
+
+		if (m_oBatch.m_abNarrowphase[k])
+			SimulateBullet(oBullet, m_oBatch.m_aflDT[k]);
+		else
+			AdvanceBullet(oBullet, m_oBatch.m_aflDT[k]);
+	}
+
+	// Return finished bullets to the pool.
+	int iActive = 0;
+	for (int k = 0; k < m_aiActiveBullets.Count(); k++)
+	{
+		if (GetBullet(m_aiActiveBullets[k]).m_bActive)
+			m_aiActiveBullets[iActive++] = m_aiActiveBullets[k];
+		else
+			m_aiFreeBullets.AddToTail(m_aiActiveBullets[k]);
+	}
+
+	m_aiActiveBullets.SetCountNonDestructively(iActive);
+}
+
+void CBulletManager::CBulletBatch::Clear()
+{
+	m_aiBullet.RemoveAll();
+	m_aiShooter.RemoveAll();
+	m_aflDT.RemoveAll();
+	m_aflMinsX.RemoveAll();
+	m_aflMinsY.RemoveAll();
+	m_aflMinsZ.RemoveAll();
+	m_aflMaxsX.RemoveAll();
+	m_aflMaxsY.RemoveAll();
+	m_aflMaxsZ.RemoveAll();
+	m_abNarrowphase.RemoveAll();
+}
+
+void CBulletManager::CBulletBatch::AddSegment(int iBullet, int iShooter, float dt, const Vector& vecStart, const Vector& vecEnd)
+{
+	m_aiBullet.AddToTail(iBullet);
+	m_aiShooter.AddToTail(iShooter);
+	m_aflDT.AddToTail(dt);
+	m_aflMinsX.AddToTail(min(vecStart.x, vecEnd.x));
+	m_aflMinsY.AddToTail(min(vecStart.y, vecEnd.y));
+	m_aflMinsZ.AddToTail(min(vecStart.z, vecEnd.z));
+	m_aflMaxsX.AddToTail(max(vecStart.x, vecEnd.x));
+	m_aflMaxsY.AddToTail(max(vecStart.y, vecEnd.y));
+	m_aflMaxsZ.AddToTail(max(vecStart.z, vecEnd.z));
+
+	// Bullets that aren't in slow motion travel their full range in one go, always trace those.
+	m_abNarrowphase.AddToTail(true);
+}
+
+void CBulletManager::BuildPlayerBounds()
+{
+	m_aiPlayerIndex.RemoveAll();
+	m_aflPlayerMinsX.RemoveAll();
+	m_aflPlayerMinsY.RemoveAll();
+	m_aflPlayerMinsZ.RemoveAll();
+	m_aflPlayerMaxsX.RemoveAll();
+	m_aflPlayerMaxsY.RemoveAll();
+	m_aflPlayerMaxsZ.RemoveAll();
+
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		CBasePlayer* pPlayer = UTIL_PlayerByIndex(i);
+		if (!pPlayer)
+			continue;
+
+		// Use the same bounds the spatial partition uses, they enclose the hitboxes.
+		Vector vecMins, vecMaxs;
+		pPlayer->CollisionProp()->WorldSpaceSurroundingBounds(&vecMins, &vecMaxs);
+
+		m_aiPlayerIndex.AddToTail(i);
+		m_aflPlayerMinsX.AddToTail(vecMins.x);
+		m_aflPlayerMinsY.AddToTail(vecMins.y);
+		m_aflPlayerMinsZ.AddToTail(vecMins.z);
+		m_aflPlayerMaxsX.AddToTail(vecMaxs.x);
+		m_aflPlayerMaxsY.AddToTail(vecMaxs.y);
+		m_aflPlayerMaxsZ.AddToTail(vecMaxs.z);
+	}
+}
+
+void CBulletManager::BroadphaseCull()
+{
+	if (!da_bullet_broadphase.GetBool())
+		return;
+
+	if (!m_oBatch.Count())
+		return;
+
+	BuildPlayerBounds();
+
+	const float flTolerance = 1;
+
+	// First pass: any bullet whose swept box this frame overlaps a player's
+	// bounds (other than the shooter's) needs a real trace.
+	for (int k = 0; k < m_oBatch.Count(); k++)
+	{
+		if (m_oBatch.m_aflDT[k] < 0)
+			continue;
+
+		bool bTouches = false;
+		for (int p = 0; p < m_aiPlayerIndex.Count(); p++)
+		{
+			if (m_aiPlayerIndex[p] == m_oBatch.m_aiShooter[k])
+				continue;
+
+			bTouches |= m_oBatch.m_aflMinsX[k] <= m_aflPlayerMaxsX[p] + flTolerance && m_oBatch.m_aflMaxsX[k] >= m_aflPlayerMinsX[p] - flTolerance &&
+				m_oBatch.m_aflMinsY[k] <= m_aflPlayerMaxsY[p] + flTolerance && m_oBatch.m_aflMaxsY[k] >= m_aflPlayerMinsY[p] - flTolerance &&
+				m_oBatch.m_aflMinsZ[k] <= m_aflPlayerMaxsZ[p] + flTolerance && m_oBatch.m_aflMaxsZ[k] >= m_aflPlayerMinsZ[p] - flTolerance;
+		}
+
+		m_oBatch.m_abNarrowphase[k] = bTouches;
+	}
+
+	// Second pass: the remaining bullets can only hit the world or some other
+	// entity. The world doesn't move, so check against the cached world hit
+	// along the bullet's line, then ask the partition about everything else.
+	for (int k = 0; k < m_oBatch.Count(); k++)
+	{
+		if (m_oBatch.m_abNarrowphase[k])
+			continue;
+
+		m_oBatch.m_abNarrowphase[k] = true;
+
+		CBullet& oBullet = GetBullet(m_oBatch.m_aiBullet[k]);
+
+		if (oBullet.m_iPenetrations >= da_bullet_penetrations.GetInt())
+			continue;
+
+		UpdateWorldClearance(oBullet);
+
+		Vector vecEnd = oBullet.m_vecOrigin + oBullet.m_vecDirection * m_oBatch.m_aflDT[k];
+		if (DotProduct(oBullet.m_vecWorldClear - vecEnd, oBullet.m_vecDirection) <= flTolerance)
+			continue;
+
+		if (SegmentTouchesEntity(oBullet, vecEnd))
+			continue;
+
+		m_oBatch.m_abNarrowphase[k] = false;
+	}
+}
+
+void CBulletManager::UpdateWorldClearance(CBullet& oBullet)
+{
+	// Still valid as long as the bullet hasn't gone past it.
+	if (oBullet.m_bWorldClearValid && DotProduct(oBullet.m_vecWorldClear - oBullet.m_vecOrigin, oBullet.m_vecDirection) > 0)
+		return;
+
+	CTraceFilterWorldOnly tf;
+	trace_t tr;
+	UTIL_TraceLine( oBullet.m_vecOrigin, oBullet.m_vecOrigin + oBullet.m_vecDirection * MAX_TRACE_LENGTH, MASK_SOLID|CONTENTS_DEBRIS|CONTENTS_HITBOX, &tf, &tr );
+
+	// If we're embedded in something then don't cull until we're out of it.
+	if (tr.startsolid)
+		oBullet.m_vecWorldClear = oBullet.m_vecOrigin;
+	else
+		oBullet.m_vecWorldClear = tr.endpos;
+
+	oBullet.m_bWorldClearValid = true;
+}
+
+class CBulletBroadphaseEnum : public IPartitionEnumerator
+{
+public:
+	CBulletBroadphaseEnum(const CBaseEntity* pShooter)
+	{
+		m_pShooter = pShooter;
+		m_bTouches = false;
+	}
+
+	virtual IterationRetval_t EnumElement( IHandleEntity *pHandleEntity )
+	{
+		CBaseEntity* pEntity = EntityFromEntityHandle( pHandleEntity );
+
+		// Players were already tested against their bounds.
+		if (pEntity && (pEntity == m_pShooter || pEntity->IsPlayer()))
+			return ITERATION_CONTINUE;
+
+		// Anything else (including static props) could stop the bullet.
+		m_bTouches = true;
+		return ITERATION_STOP;
+	}
+
+	const CBaseEntity* m_pShooter;
+	bool m_bTouches;
+};
+
+#ifdef CLIENT_DLL
+#define BULLET_PARTITION_MASK (PARTITION_CLIENT_SOLID_EDICTS|PARTITION_CLIENT_STATIC_PROPS)
+#else
+#define BULLET_PARTITION_MASK (PARTITION_ENGINE_SOLID_EDICTS|PARTITION_ENGINE_STATIC_PROPS)
+#endif
+
+bool CBulletManager::SegmentTouchesEntity(const CBullet& oBullet, const Vector& vecEnd) const
+{
+	Ray_t ray;
+	ray.Init( oBullet.m_vecOrigin, vecEnd );
+
+	CBulletBroadphaseEnum oEnum(oBullet.m_hShooter);
+	partition->EnumerateElementsAlongRay( BULLET_PARTITION_MASK, ray, false, &oEnum );
+
+	return oEnum.m_bTouches;
+}
+
+// Same as what SimulateBullet does when the first trace hits nothing.
+void CBulletManager::AdvanceBullet(CBullet& oBullet, float dt)
+{
+	Vector vecOriginal = oBullet.m_vecOrigin;
+	Vector vecEnd = oBullet.m_vecOrigin + oBullet.m_vecDirection * dt;
+
+	bool bHasTraveledBefore = false;
+	if (oBullet.m_flDistanceTraveled > 0)
+		bHasTraveledBefore = true;
+
+	oBullet.m_flDistanceTraveled += (oBullet.m_vecOrigin - vecEnd).Length();
+	oBullet.m_vecOrigin = vecEnd;
+
+#ifdef CLIENT_DLL
+	if (oBullet.m_hRenderHandle != INVALID_CLIENT_RENDER_HANDLE)
+		ClientLeafSystem()->RenderableChanged( oBullet.m_hRenderHandle );
+#endif
+
+	if (!bHasTraveledBefore && oBullet.m_flCurrAlpha == 0 && oBullet.m_flGoalAlpha == 0)
+		oBullet.m_bActive = false;
+
+	if (da_bullet_debug.GetBool())
+	{
+#ifdef CLIENT_DLL
+		DebugDrawLine(vecOriginal, oBullet.m_vecOrigin, 0, 0, 255, true, 0.1);
+#else
+		DebugDrawLine(vecOriginal, oBullet.m_vecOrigin, 255, 0, 0, true, 0.1);
+#endif
 	}
 }
 
 ConVar sv_showimpacts("sv_showimpacts", "0", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "Shows client (red) and server (blue) bullet impact point" );
-ConVar da_bullet_penetrations("da_bullet_penetrations", "5", FCVAR_REPLICATED|FCVAR_CHEAT|FCVAR_DEVELOPMENTONLY, "How many times will a bullet penetrate a wall?" );
 
 void DispatchEffect( const char *pName, const CEffectData &data );
 
+class CTraceFilterBullet : public CTraceFilterSimpleList
+{
+public:
+	CTraceFilterBullet(int iCollisionGroup)
+		: CTraceFilterSimpleList(iCollisionGroup)
+	{
+		m_bSkipPlayers = false;
+	}
+
+	virtual bool ShouldHitEntity( IHandleEntity *pHandleEntity, int contentsMask )
+	{
+		if (m_bSkipPlayers)
+		{
+			CBaseEntity* pEntity = EntityFromEntityHandle( pHandleEntity );
+			if (pEntity && pEntity->IsPlayer())
+				return false;
+		}
+
+		return CTraceFilterSimpleList::ShouldHitEntity(pHandleEntity, contentsMask);
+	}
+
+	bool m_bSkipPlayers;
+};
+
+// Clips the bullet's trace to the hitboxes of the players whose enlarged volumes it passes through
+// before it hits anything else.
+void CBulletManager::ClipBulletToPlayers(const Vector& vecStart, const Vector& vecEnd, unsigned int fMask, CTraceFilterBullet& tf, trace_t& tr)
+{
+	m_iShotTraces++;
+
+	Ray_t ray;
+	ray.Init( vecStart, vecEnd );
+
+	// Let the filter decide on players again, it still ignores the shooter and whatever was already hit.
+	tf.m_bSkipPlayers = false;
+
+	for (int i = 0; i < m_aShotVolumes.Count(); i++)
+	{
+		const ShotVolume& oVolume = m_aShotVolumes[i];
+
+		if (!IsBoxIntersectingRay(oVolume.m_vecMins, oVolume.m_vecMaxs, vecStart, tr.endpos - vecStart))
+			continue;
+
+		CBasePlayer* pPlayer = UTIL_PlayerByIndex(oVolume.m_iPlayer);
+		if (!pPlayer || !tf.ShouldHitEntity(pPlayer, fMask))
+			continue;
+
+		// The volumes are from the start of the volley. Anybody an earlier pellet killed is a corpse now.
+		if (!pPlayer->IsAlive() || !pPlayer->IsSolid())
+			continue;
+
+		m_iShotCandidates++;
+
+		trace_t trPlayer;
+		enginetrace->ClipRayToEntity( ray, fMask, pPlayer, &trPlayer );
+
+		if (!trPlayer.allsolid && !trPlayer.startsolid && trPlayer.fraction >= tr.fraction)
+			continue;
+
+		// Merge the way the engine does when a trace hits more than one entity.
+		if (tr.startsolid)
+		{
+			Vector vecStartPos = tr.startpos;
+			float flFractionLeftSolid = max(tr.fractionleftsolid, trPlayer.fractionleftsolid);
+			tr = trPlayer;
+			tr.startsolid = true;
+			tr.fractionleftsolid = flFractionLeftSolid;
+			tr.startpos = vecStartPos;
+		}
+		else
+			tr = trPlayer;
+
+		if (tr.m_pEnt == pPlayer)
+			m_iShotPlayerHits++;
+	}
+
+	tf.m_bSkipPlayers = true;
+}
+
 void CBulletManager::SimulateBullet(CBullet& oBullet, float dt)
 {
 	Vector vecOriginal = oBullet.m_vecOrigin;
@@ -182,17 +650,26 @@ void CBulletManager::SimulateBullet(CBullet& oBullet, float dt)
 
 	Vector vecEnd = oBullet.m_vecOrigin + oBullet.m_vecDirection * flRange;
 
+	// One filter for the whole penetration loop, objects are added to it as they're hit.
+	CTraceFilterBullet tf(COLLISION_GROUP_NONE);
+	tf.AddEntityToIgnore(oBullet.m_hShooter);
+
+	// During a shot the engine trace leaves players out, they're tested against their enlarged volumes.
+	tf.m_bSkipPlayers = m_bInShot;
+
+	int iObjectsFiltered = 0;
+
 	int i;
 	for (i = oBullet.m_iPenetrations; i < da_bullet_penetrations.GetInt(); i++)
 	{
-		CTraceFilterSimpleList tf(COLLISION_GROUP_NONE);
-		tf.AddEntityToIgnore(oBullet.m_hShooter);
-
-		for (int j = 0; j < oBullet.m_ahObjectsHit.Count(); j++)
-			tf.AddEntityToIgnore(oBullet.m_ahObjectsHit[j]);
+		for (; iObjectsFiltered < oBullet.m_ahObjectsHit.Count(); iObjectsFiltered++)
+			tf.AddEntityToIgnore(oBullet.m_ahObjectsHit[iObjectsFiltered]);
 
 		UTIL_TraceLine( oBullet.m_vecOrigin, vecEnd, MASK_SOLID|CONTENTS_DEBRIS|CONTENTS_HITBOX, &tf, &tr );
 
+		if (m_bInShot)
+			ClipBulletToPlayers(oBullet.m_vecOrigin, vecEnd, MASK_SOLID|CONTENTS_DEBRIS|CONTENTS_HITBOX, tf, tr);
+
 		if (da_bullet_debug.GetBool())
 		{
 #ifdef CLIENT_DLL
@@ -263,43 +740,11 @@ void CBulletManager::SimulateBullet(CBullet& oBullet, float dt)
 			break; // we didn't hit anything, stop tracing shoot
 		}
 
-		weapontype_t eWeaponType = WT_NONE;
-
-		CSDKWeaponInfo *pWeaponInfo = CSDKWeaponInfo::GetWeaponInfo(oBullet.m_eWeaponID);
-		Assert(pWeaponInfo);
-		if (pWeaponInfo)
-			eWeaponType = pWeaponInfo->m_eWeaponType;
-
-		float flDamageMultiplier = 1;
-		float flMaxRange = 3000;
-
-		// Power formula works like so:
-		// pow( x, distance/y )
-		// The damage will be at 1 when the distance is 0 units, and at
-		// x% when the distance is y units, with a gradual decay approaching zero
-		switch (eWeaponType)
-		{
-		case WT_RIFLE:
-			flDamageMultiplier = 0.75f;
-			flMaxRange = 3000;
-			break;
-
-		case WT_SHOTGUN:
-			flDamageMultiplier = 0.40f;
-			flMaxRange = 500;
-			break;
-
-		case WT_SMG:
-			flDamageMultiplier = 0.50f;
-			flMaxRange = 1000;
-			break;
+		// Range falloff and penetration come from the weapon script, see CSDKWeaponInfo::Parse.
+		const SDKWeaponStats_t& oStats = CSDKWeaponInfo::GetWeaponStats(oBullet.m_eWeaponID);
 
-		case WT_PISTOL:
-		default:
-			flDamageMultiplier = 0.55f;
-			flMaxRange = 1500;
-			break;
-		}
+		float flDamageMultiplier = oStats.m_flRangeModifier;
+		float flMaxRange = oStats.m_flMaxRange;
 
 		flMaxRange *= oBullet.m_hShooter->m_Shared.ModifySkillValue(1, 0.5f, SKILL_MARKSMAN);
 
@@ -308,11 +753,8 @@ void CBulletManager::SimulateBullet(CBullet& oBullet, float dt)
 
 		float flCurrentDistance = oBullet.m_flDistanceTraveled;
 
-		// First 500 units, no decrease in damage.
-		if (eWeaponType == WT_SHOTGUN)
-			flCurrentDistance -= 350;
-		else
-			flCurrentDistance -= 500;
+		// No decrease in damage until the falloff starts.
+		flCurrentDistance -= oStats.m_flFalloffStart;
 
 		if (flCurrentDistance < 0)
 			flCurrentDistance = 0;
@@ -393,26 +835,7 @@ void CBulletManager::SimulateBullet(CBullet& oBullet, float dt)
 		if (tr.m_pEnt && !FStrEq(tr.m_pEnt->GetClassname(), "worldspawn"))
 			oBullet.m_ahObjectsHit.AddToTail(tr.m_pEnt);
 
-		float flPenetrationDistance;
-		switch (eWeaponType)
-		{
-		case WT_RIFLE:
-			flPenetrationDistance = 25;
-			break;
-
-		case WT_SHOTGUN:
-			flPenetrationDistance = 5;
-			break;
-
-		case WT_SMG:
-			flPenetrationDistance = 15;
-			break;
-
-		case WT_PISTOL:
-		default:
-			flPenetrationDistance = 15;
-			break;
-		}
+		float flPenetrationDistance = oStats.m_flPenetration;
 
 		flPenetrationDistance = oBullet.m_hShooter->m_Shared.ModifySkillValue(flPenetrationDistance, 1, SKILL_MARKSMAN);
 
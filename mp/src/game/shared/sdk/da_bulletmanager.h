@@ -6,10 +6,24 @@
 #include "sdk_player.h"
 #endif
 
+// Bullets are pooled in chunks of this many. Chunks are never freed or moved,
+// the client leaf system holds pointers to the bullets.
+#define BULLET_POOL_CHUNK_SIZE 128
+
+// Objects a bullet can pass through before its hit list spills to the heap.
+#define BULLET_MAX_OBJECTS_HIT 16
+
+// Hitscan shots test players whose collision hull, scaled up this much around their origin, the
+// bullet passes through. Hitboxes can reach well outside the hull, when diving for instance.
+#define BULLET_PLAYER_VOLUME_SCALE 3
+
+class CTraceFilterBullet;
+
 class CBulletManager : public CAutoGameSystemPerFrame
 {
 public:
 	CBulletManager( char const *name );
+	~CBulletManager();
 
 public:
 	class CBullet
@@ -28,6 +42,7 @@ public:
 			m_iBulletType = -1;
 			m_flGoalAlpha = 0;
 			m_flCurrAlpha = 0;
+			m_bWorldClearValid = false;
 		}
 
 #ifdef CLIENT_DLL
@@ -61,7 +76,12 @@ public:
 		int         m_iBulletDamage;
 		float       m_flGoalAlpha;
 		float       m_flCurrAlpha;
-		CCopyableUtlVector<CHandle<CBaseEntity> > m_ahObjectsHit;
+		CCopyableUtlVector<CHandle<CBaseEntity>, CUtlMemoryFixedGrowable<CHandle<CBaseEntity>, BULLET_MAX_OBJECTS_HIT> > m_ahObjectsHit;
+
+		// First world hit along the bullet's line of flight, used by the
+		// broadphase to skip traces while the bullet is in open air.
+		Vector      m_vecWorldClear;
+		bool        m_bWorldClearValid;
 	};
 
 public:
@@ -76,8 +96,79 @@ public:
 	void BulletsThink(float flFrameTime);
 	void SimulateBullet(CBullet& oBullet, float dt);
 
+	// Bullets simulated between these are tested against players' enlarged volumes instead of
+	// through the spatial partition. Call with the players already lag compensated.
+	void BeginShot();
+	void EndShot();
+
+	void PrintPoolStats() const;
+	void PrintShotStats() const;
+	void ResetShotStats();
+
 private:
-	CUtlVector<CBullet> m_aBullets;
+	CBullet& GetBullet(int iBullet) { return m_apBulletChunks[iBullet / BULLET_POOL_CHUNK_SIZE][iBullet % BULLET_POOL_CHUNK_SIZE]; }
+	int      AllocateBullet();
+	void     GrowPool();
+
+	void BuildPlayerBounds();
+	void BroadphaseCull();
+	bool SegmentTouchesEntity(const CBullet& oBullet, const Vector& vecEnd) const;
+	void UpdateWorldClearance(CBullet& oBullet);
+	void AdvanceBullet(CBullet& oBullet, float dt);
+
+	void ClipBulletToPlayers(const Vector& vecStart, const Vector& vecEnd, unsigned int fMask, CTraceFilterBullet& tf, trace_t& tr);
+
+private:
+	CUtlVector<CBullet*> m_apBulletChunks;
+	CUtlVector<int>     m_aiFreeBullets;
+
+	// Pool indices of every active bullet, in firing order.
+	CUtlVector<int>     m_aiActiveBullets;
+
+	int                 m_iHighWaterMark;
+	int                 m_iPoolOverflows;
+
+	// Structure-of-arrays view of the bullets being moved this frame.
+	class CBulletBatch
+	{
+	public:
+		void Clear();
+		void AddSegment(int iBullet, int iShooter, float dt, const Vector& vecStart, const Vector& vecEnd);
+		int  Count() const { return m_aiBullet.Count(); }
+
+		CUtlVector<int>   m_aiBullet;
+		CUtlVector<int>   m_aiShooter;
+		CUtlVector<float> m_aflDT;
+		CUtlVector<float> m_aflMinsX, m_aflMinsY, m_aflMinsZ;
+		CUtlVector<float> m_aflMaxsX, m_aflMaxsY, m_aflMaxsZ;
+		CUtlVector<bool>  m_abNarrowphase;
+	};
+
+	CBulletBatch        m_oBatch;
+
+	// Surrounding bounds of every living player, gathered once per frame.
+	CUtlVector<int>     m_aiPlayerIndex;
+	CUtlVector<float>   m_aflPlayerMinsX, m_aflPlayerMinsY, m_aflPlayerMinsZ;
+	CUtlVector<float>   m_aflPlayerMaxsX, m_aflPlayerMaxsY, m_aflPlayerMaxsZ;
+
+	// Enlarged player volumes for the shot in progress.
+	struct ShotVolume
+	{
+		int     m_iPlayer;
+		Vector  m_vecMins;
+		Vector  m_vecMaxs;
+	};
+
+	CUtlVector<ShotVolume> m_aShotVolumes;
+	bool                m_bInShot;
+	int                 m_iShotPartitionStart;
+
+	int                 m_iShots;
+	int                 m_iShotTraces;
+	int                 m_iShotCandidates;
+	int                 m_iShotPlayerHits;
+	int                 m_iShotPartitionUpdates;
+	int                 m_iMostShotPartitionUpdates;
 };
 
 CBulletManager& BulletManager();
@@ -8,6 +8,7 @@
 #include "sdk_fx_shared.h"
 #include "weapon_sdkbase.h"
 #include "weapon_akimbobase.h"
+#include "da_bulletmanager.h"
 
 #ifdef CLIENT_DLL
 #include "prediction.h"
@@ -222,21 +223,9 @@ void FX_FireBullets(
 	// Move other players back to history positions based on local player's lag
 	lagcompensation->StartLagCompensation( pPlayer, pPlayer->GetCurrentCommand() );
 
-	const int iMaxPlayers = 64;
-	Vector avecMins[iMaxPlayers];
-	Vector avecMaxs[iMaxPlayers];
-
-	for (int i = 1; i <= min(iMaxPlayers, gpGlobals->maxClients); i++)
-	{
-		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
-		if (!pPlayer)
-			continue;
-
-		avecMins[i] = pPlayer->CollisionProp()->OBBMins();
-		avecMaxs[i] = pPlayer->CollisionProp()->OBBMaxs();
-
-		pPlayer->SetSize(avecMins[i]*3, avecMaxs[i]*3);
-	}
+	// Test the bullets against enlarged player volumes so hitboxes outside the collision hull
+	// still get hit, without resizing the players.
+	BulletManager().BeginShot();
 #endif
 
 	for ( int iBullet=0; iBullet < pWeaponInfo->m_iBullets; iBullet++ )
@@ -266,14 +255,7 @@ void FX_FireBullets(
 	pPlayer->UseStyleCharge(SKILL_MARKSMAN, pWeaponInfo->m_flCycleTime * 10);
 
 #if !defined (CLIENT_DLL)
-	for (int i = 1; i <= min(iMaxPlayers, gpGlobals->maxClients); i++)
-	{
-		CSDKPlayer* pPlayer = ToSDKPlayer(UTIL_PlayerByIndex(i));
-		if (!pPlayer)
-			continue;
-
-		pPlayer->SetSize(avecMins[i], avecMaxs[i]);
-	}
+	BulletManager().EndShot();
 
 	lagcompensation->FinishLagCompensation( pPlayer );
 #endif
@@ -57,8 +57,68 @@ ConVar  da_physpush_base ("da_physpush_base", "0.2", FCVAR_NOTIFY|FCVAR_REPLICAT
 
 ConVar  da_auto_unstick("da_auto_unstick", "1", FCVAR_REPLICATED|FCVAR_DEVELOPMENTONLY);
 
+ConVar  da_movement_trace_memo("da_movement_trace_memo", "1", FCVAR_REPLICATED|FCVAR_CHEAT, "Identical hull traces in one movement command reuse the first result.");
+
 extern bool g_bMovementOptimizations;
 
+// What movement was doing when it traced, for the trace stats.
+typedef enum
+{
+	MTF_MOVE = 0,	// Walking, air moving and finding the ground
+	MTF_STEP,
+	MTF_STAND,
+	MTF_DUCK,
+	MTF_PRONE,
+	MTF_SLIDE,
+	MTF_DIVE,
+	MTF_MANTEL,
+	MTF_WALLFLIP,
+	MTF_LADDER,
+	MTF_STUCK,
+	MTF_PHYSPUSH,
+
+	MTF_COUNT,
+} MovementTraceFeature_t;
+
+static const char* s_apszMovementTraceFeatures[MTF_COUNT] =
+{
+	"move",
+	"step",
+	"stand",
+	"duck",
+	"prone",
+	"slide",
+	"dive",
+	"mantel",
+	"wallflip",
+	"ladder",
+	"stuck",
+	"physpush",
+};
+
+// Traces made while one of these is in scope are counted under its feature.
+class CMovementTraceScope
+{
+public:
+	CMovementTraceScope( MovementTraceFeature_t& eFeature, MovementTraceFeature_t eScope )
+		: m_eFeature(eFeature)
+	{
+		m_eOuter = eFeature;
+		eFeature = eScope;
+	}
+
+	~CMovementTraceScope()
+	{
+		m_eFeature = m_eOuter;
+	}
+
+private:
+	MovementTraceFeature_t& m_eFeature;
+	MovementTraceFeature_t  m_eOuter;
+};
+
+#define MOVEMENT_TRACE_MEMO_SIZE 16
+
 class CSDKGameMovement : public CGameMovement
 {
 public:
@@ -124,9 +184,47 @@ public:
 
 	bool PlayerIsStuck();
 
+	virtual void	TracePlayerBBox( const Vector& start, const Vector& end, unsigned int fMask, int collisionGroup, trace_t& pm );
+	virtual void	TryTouchGround( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm );
+	virtual CBaseHandle TestPlayerPosition( const Vector& pos, int collisionGroup, trace_t& pm );
+
+	void PrintTraceStats();
+	void ResetTraceStats();
+	void GetTraceTotals( int &iTraces, int &iMemoHits ) const;
+
 protected:
 	bool ResolveStanding( void );
 	void TracePlayerBBoxWithStep( const Vector &vStart, const Vector &vEnd, unsigned int fMask, int collisionGroup, trace_t &trace );
+
+	// All of movement's traces go through here. A trace identical to one already done during this
+	// command gets the earlier result, nothing moves in the middle of a player's movement.
+	void TraceMovementRay( const Ray_t &ray, unsigned int fMask, int collisionGroup, trace_t &pm, ShouldHitFunc_t pExtraShouldHitCheckFn = NULL );
+
+	struct MovementTrace_t
+	{
+		Ray_t           m_Ray;
+		unsigned int    m_fMask;
+		int             m_iCollisionGroup;
+		ShouldHitFunc_t m_pfnShouldHit;
+		trace_t         m_Trace;
+	};
+
+	// Only lives for one ProcessMovement call. Oldest entries get written over once it's full.
+	MovementTrace_t m_aTraceMemo[MOVEMENT_TRACE_MEMO_SIZE];
+	int             m_iTraceMemoCount;
+	int             m_iTraceMemoNext;
+
+	MovementTraceFeature_t m_eTraceFeature;
+
+	int m_aiCommandTraces[MTF_COUNT];
+	int m_aiCommandMemoHits[MTF_COUNT];
+
+	int m_iTraceCommands;
+	int m_iMostCommandTraces;
+	int m_aiTotalTraces[MTF_COUNT];
+	int m_aiTotalMemoHits[MTF_COUNT];
+	int m_aiMostTraces[MTF_COUNT];
+
 public:
 	// A reference to the player whose movement is currently being considered.
 	// If additional per-player data is needed, put it into CSDKPlayer and refer to it via m_pSDKPlayer.
@@ -164,6 +262,15 @@ CSDKGameMovement::CSDKGameMovement()
 #ifdef STUCK_DEBUG
 	m_flStuckCheck = 0;
 #endif
+
+	m_iTraceMemoCount = 0;
+	m_iTraceMemoNext = 0;
+	m_eTraceFeature = MTF_MOVE;
+
+	memset(m_aiCommandTraces, 0, sizeof(m_aiCommandTraces));
+	memset(m_aiCommandMemoHits, 0, sizeof(m_aiCommandMemoHits));
+
+	ResetTraceStats();
 }
 
 CSDKGameMovement::~CSDKGameMovement()
@@ -389,9 +496,166 @@ void CSDKGameMovement::ProcessMovement( CBasePlayer *pBasePlayer, CMoveData *pMo
 
 	gpGlobals->frametime *= m_pSDKPlayer->GetSlowMoMultiplier();
 
+	m_iTraceMemoCount = 0;
+	m_iTraceMemoNext = 0;
+	m_eTraceFeature = MTF_MOVE;
+
+	memset(m_aiCommandTraces, 0, sizeof(m_aiCommandTraces));
+	memset(m_aiCommandMemoHits, 0, sizeof(m_aiCommandMemoHits));
+
 	BaseClass::ProcessMovement( pBasePlayer, pMove );
 
 	gpGlobals->frametime = flFrameTime;
+
+	// The memo holds entity pointers, don't let them outlive the command.
+	m_iTraceMemoCount = 0;
+
+	int iCommandTraces = 0;
+	for (int i = 0; i < MTF_COUNT; i++)
+	{
+		iCommandTraces += m_aiCommandTraces[i];
+		m_aiTotalTraces[i] += m_aiCommandTraces[i];
+		m_aiTotalMemoHits[i] += m_aiCommandMemoHits[i];
+		m_aiMostTraces[i] = max(m_aiMostTraces[i], m_aiCommandTraces[i]);
+	}
+
+	m_iTraceCommands++;
+	m_iMostCommandTraces = max(m_iMostCommandTraces, iCommandTraces);
+}
+
+void CSDKGameMovement::TraceMovementRay( const Ray_t &ray, unsigned int fMask, int collisionGroup, trace_t &pm, ShouldHitFunc_t pExtraShouldHitCheckFn )
+{
+	m_aiCommandTraces[m_eTraceFeature]++;
+
+	bool bMemo = da_movement_trace_memo.GetBool();
+
+	if (bMemo)
+	{
+		for (int i = 0; i < m_iTraceMemoCount; i++)
+		{
+			const MovementTrace_t& oTrace = m_aTraceMemo[i];
+
+			if (oTrace.m_fMask != fMask || oTrace.m_iCollisionGroup != collisionGroup || oTrace.m_pfnShouldHit != pExtraShouldHitCheckFn)
+				continue;
+
+			if (oTrace.m_Ray.m_Start != ray.m_Start || oTrace.m_Ray.m_Delta != ray.m_Delta)
+				continue;
+
+			if (oTrace.m_Ray.m_Extents != ray.m_Extents || oTrace.m_Ray.m_StartOffset != ray.m_StartOffset)
+				continue;
+
+			m_aiCommandMemoHits[m_eTraceFeature]++;
+			pm = oTrace.m_Trace;
+			return;
+		}
+	}
+
+	UTIL_TraceRay(ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm, pExtraShouldHitCheckFn);
+
+	if (!bMemo)
+		return;
+
+	MovementTrace_t& oTrace = m_aTraceMemo[m_iTraceMemoNext];
+	oTrace.m_Ray = ray;
+	oTrace.m_fMask = fMask;
+	oTrace.m_iCollisionGroup = collisionGroup;
+	oTrace.m_pfnShouldHit = pExtraShouldHitCheckFn;
+	oTrace.m_Trace = pm;
+
+	m_iTraceMemoNext = (m_iTraceMemoNext + 1) % MOVEMENT_TRACE_MEMO_SIZE;
+	if (m_iTraceMemoCount < MOVEMENT_TRACE_MEMO_SIZE)
+		m_iTraceMemoCount++;
+}
+
+void CSDKGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, unsigned int fMask, int collisionGroup, trace_t& pm )
+{
+	VPROF( "CSDKGameMovement::TracePlayerBBox" );
+
+	Ray_t ray;
+	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
+	TraceMovementRay( ray, fMask, collisionGroup, pm );
+}
+
+void CSDKGameMovement::TryTouchGround( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm )
+{
+	VPROF( "CSDKGameMovement::TryTouchGround" );
+
+	Ray_t ray;
+	ray.Init( start, end, mins, maxs );
+	TraceMovementRay( ray, fMask, collisionGroup, pm );
+}
+
+CBaseHandle CSDKGameMovement::TestPlayerPosition( const Vector& pos, int collisionGroup, trace_t& pm )
+{
+	Ray_t ray;
+	ray.Init( pos, pos, GetPlayerMins(), GetPlayerMaxs() );
+	TraceMovementRay( ray, PlayerSolidMask(), collisionGroup, pm );
+	if ( (pm.contents & PlayerSolidMask()) && pm.m_pEnt )
+		return pm.m_pEnt->GetRefEHandle();
+	else
+		return INVALID_EHANDLE_INDEX;
+}
+
+void CSDKGameMovement::PrintTraceStats()
+{
+	int iTraces, iMemoHits;
+	GetTraceTotals(iTraces, iMemoHits);
+
+	Msg("Movement commands: %d, hull traces: %d (%.2f per command, %d at most)\n", m_iTraceCommands, iTraces, m_iTraceCommands?(float)iTraces/m_iTraceCommands:0.0f, m_iMostCommandTraces);
+	Msg("Reused from earlier in the command: %d (%.1f%%)%s\n", iMemoHits, iTraces?100.0f*iMemoHits/iTraces:0.0f, da_movement_trace_memo.GetBool()?"":", da_movement_trace_memo is off");
+
+	Msg("%-10s %10s %10s %12s %8s\n", "feature", "traces", "reused", "per command", "most");
+	for (int i = 0; i < MTF_COUNT; i++)
+	{
+		if (!m_aiTotalTraces[i])
+			continue;
+
+		Msg("%-10s %10d %10d %12.3f %8d\n", s_apszMovementTraceFeatures[i], m_aiTotalTraces[i], m_aiTotalMemoHits[i], m_iTraceCommands?(float)m_aiTotalTraces[i]/m_iTraceCommands:0.0f, m_aiMostTraces[i]);
+	}
+}
+
+void CSDKGameMovement::GetTraceTotals( int &iTraces, int &iMemoHits ) const
+{
+	iTraces = 0;
+	iMemoHits = 0;
+	for (int i = 0; i < MTF_COUNT; i++)
+	{
+		iTraces += m_aiTotalTraces[i];
+		iMemoHits += m_aiTotalMemoHits[i];
+	}
+}
+
+void CSDKGameMovement::ResetTraceStats()
+{
+	m_iTraceCommands = 0;
+	m_iMostCommandTraces = 0;
+
+	memset(m_aiTotalTraces, 0, sizeof(m_aiTotalTraces));
+	memset(m_aiTotalMemoHits, 0, sizeof(m_aiTotalMemoHits));
+	memset(m_aiMostTraces, 0, sizeof(m_aiMostTraces));
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND(cl_movement_trace_stats, "Print how many hull traces client movement and prediction did, by feature. cl_movement_trace_stats reset to zero them.")
+#else
+CON_COMMAND(sv_movement_trace_stats, "Print how many hull traces server movement did, by feature. sv_movement_trace_stats reset to zero them.")
+#endif
+{
+#ifndef CLIENT_DLL
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+#endif
+
+	g_GameMovement.PrintTraceStats();
+
+	if (args.ArgC() > 1 && FStrEq(args[1], "reset"))
+		g_GameMovement.ResetTraceStats();
+}
+
+// Traces done since the stats were last reset, for da_movement_bench.
+void GetMovementTraceTotals( int &iTraces, int &iMemoHits )
+{
+	g_GameMovement.GetTraceTotals(iTraces, iMemoHits);
 }
 
 bool CSDKGameMovement::CanAccelerate()
@@ -875,7 +1139,7 @@ void CSDKGameMovement::CategorizePosition( void )
 	if (trace.plane.normal.LengthSqr() > 0 && trace.plane.normal.z < 0.7f)
 	{
 		// Test four sub-boxes, to see if any of them would have found shallower slope we could actually stand on.
-		TracePlayerBBoxForGround( vecStartPos, vecEndPos, GetPlayerMins(), GetPlayerMaxs(), mv->m_nPlayerHandle.Get(), PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, trace );
+		TryTouchGroundInQuadrants( vecStartPos, vecEndPos, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, trace );
 		if (trace.plane.normal[2] < 0.7f)
 		{
 			// Too steep.
@@ -935,7 +1199,7 @@ inline void CSDKGameMovement::TracePlayerBBoxWithStep( const Vector &vStart, con
 
 	Ray_t ray;
 	ray.Init( vStart, vEnd, vHullMin, vHullMax );
-	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &trace );
+	TraceMovementRay( ray, fMask, collisionGroup, trace );
 }
 
 // Taken from TF2 to prevent bouncing down slopes
@@ -943,6 +1207,8 @@ bool CSDKGameMovement::ResolveStanding( void )
 {
 	VPROF( "CSDKGameMovement::ResolveStanding" );
 
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_STAND );
+
 	//
 	// Attempt to move down twice your step height.  Anything between 0.5 and 1.0
 	// is a valid "stand" value.
@@ -1207,6 +1473,8 @@ bool CSDKGameMovement::CheckJumpButton( void )
 //-----------------------------------------------------------------------------
 bool CSDKGameMovement::CanUnduck()
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_DUCK );
+
 	int i;
 	trace_t trace;
 	Vector newOrigin;
@@ -1244,6 +1512,8 @@ bool CSDKGameMovement::CanUnduck()
 #if defined ( SDK_USE_PRONE )
 bool CSDKGameMovement::CanUnprone()
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_PRONE );
+
 	if (m_pSDKPlayer->m_Shared.IsGoingProne())
 		return false;
 
@@ -1492,6 +1762,8 @@ void CSDKGameMovement::FinishUnSlide( void )
 
 bool CSDKGameMovement::LadderMove()
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_LADDER );
+
 	trace_t pm;
 	bool onFloor;
 	Vector floor;
@@ -1706,6 +1978,8 @@ void CSDKGameMovement::SetRollEyeOffset( float flFraction )
 //-----------------------------------------------------------------------------
 void CSDKGameMovement::FixPlayerDiveStuck( bool upward )
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_STUCK );
+
 	EntityHandle_t hitent;
 	int i;
 	Vector test;
@@ -1738,6 +2012,8 @@ void CSDKGameMovement::FixPlayerDiveStuck( bool upward )
 //-----------------------------------------------------------------------------
 void CSDKGameMovement::Duck( void )
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_DUCK );
+
 	int buttonsChanged	= ( mv->m_nOldButtons ^ mv->m_nButtons );	// These buttons have changed this frame
 	int buttonsPressed	=  buttonsChanged & mv->m_nButtons;			// The changed ones still down are "pressed"
 	int buttonsReleased	=  buttonsChanged & mv->m_nOldButtons;		// The changed ones which were previously down are "released"
@@ -1854,10 +2130,12 @@ void CSDKGameMovement::Duck( void )
 	{
 		if (!m_pSDKPlayer->m_Shared.IsGettingUpFromSlide() && !m_pSDKPlayer->m_Shared.IsAirSliding())
 		{
+			CMovementTraceScope traceScope( m_eTraceFeature, MTF_SLIDE );
+
 			trace_t tr;
 			Ray_t vecRay;
 			vecRay.Init(mv->GetAbsOrigin(), mv->GetAbsOrigin() - Vector(0, 0, 20), Vector(0, 0, 0), Vector(0, 0, 0));
-			UTIL_TraceRay(vecRay, PlayerSolidMask(), mv->m_nPlayerHandle.Get(), COLLISION_GROUP_PLAYER_MOVEMENT, &tr);
+			TraceMovementRay(vecRay, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, tr);
 
 			if (tr.DidHitWorld())
 			{
@@ -2488,7 +2766,7 @@ inline void CSDKGameMovement::TraceBBox(const Vector& start, const Vector& end,
 {
 	Ray_t ray;
 	ray.Init (start, end, mins, maxs);
-	UTIL_TraceRay(ray, mask, mv->m_nPlayerHandle.Get(), COLLISION_GROUP_PLAYER_MOVEMENT, &pm, pExtraShouldHitCheckFn);
+	TraceMovementRay(ray, mask, COLLISION_GROUP_PLAYER_MOVEMENT, pm, pExtraShouldHitCheckFn);
 }
 
 inline void CSDKGameMovement::TraceBBox(const Vector& start, const Vector& end, const Vector &mins, const Vector &maxs, trace_t &pm, ShouldHitFunc_t pExtraShouldHitCheckFn)
@@ -2509,6 +2787,8 @@ static bool ShouldHitFuncIgnoreBreakables(IHandleEntity *pHandleEntity, int cont
 
 bool CSDKGameMovement::CheckMantel()
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_MANTEL );
+
 	trace_t tr;
 	Vector vecMins, vecMaxs;
 	Vector pr1, pr2;
@@ -2597,6 +2877,8 @@ void CSDKGameMovement::AccumulateWallFlipTime()
 	if (m_pSDKPlayer->GetCurrentTime() < m_pSDKPlayer->m_Shared.GetWallFlipEndTime())
 		return;
 
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_WALLFLIP );
+
 	trace_t traceresult;
 
 	//temporarily set player bounds to represent a standing position
@@ -2699,6 +2981,8 @@ void CSDKGameMovement::FullWalkMove ()
 				// Don't flip if the player is sliding or getting up from sliding.
 				&& !m_pSDKPlayer->m_Shared.IsSliding() && !m_pSDKPlayer->m_Shared.IsGettingUpFromProne() && !m_pSDKPlayer->m_Shared.IsGettingUpFromSlide())
 			{
+				CMovementTraceScope traceScope( m_eTraceFeature, MTF_WALLFLIP );
+
 				trace_t tr;
 				Vector org, mins, maxs;
 				Vector dir;
@@ -2859,6 +3143,8 @@ void CSDKGameMovement::FullWalkMove ()
 	{
 		/*Move up the height of the bbox over the time of the animation
 		TODO: How get animation duration? Make this use the crouch bbox.*/
+		CMovementTraceScope traceScope( m_eTraceFeature, MTF_MANTEL );
+
 		trace_t tr;
 		Vector mins, maxs;
 		Vector pr1, pr2;
@@ -2911,6 +3197,8 @@ void CSDKGameMovement::FullWalkMove ()
 	{/*Raise player off the ground*/
 		if (m_pSDKPlayer->m_Shared.GetDiveLerped() < 1)
 		{
+			CMovementTraceScope traceScope( m_eTraceFeature, MTF_DIVE );
+
 			trace_t trace;
 			float flDiveLerpTime = DIVE_RISE_TIME;
 			float flBiasAmount = 0.7f;
@@ -2982,6 +3270,8 @@ void CSDKGameMovement::FullWalkMove ()
 #ifdef GAME_DLL
 	/*The great door hack*/
 	{
+		CMovementTraceScope traceScope( m_eTraceFeature, MTF_PHYSPUSH );
+
 		trace_t tr;
 		float dt, slop;
 		int msec, loss;
@@ -3016,6 +3306,8 @@ void CSDKGameMovement::FullWalkMove ()
 
 void CSDKGameMovement::StepMove( Vector &vecDestination, trace_t &trace )
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_STEP );
+
 	Vector vecEndPos;
 	VectorCopy( vecDestination, vecEndPos );
 
@@ -3109,6 +3401,8 @@ void CSDKGameMovement::StepMove( Vector &vecDestination, trace_t &trace )
 
 bool CSDKGameMovement::PlayerIsStuck()
 {
+	CMovementTraceScope traceScope( m_eTraceFeature, MTF_STUCK );
+
 	trace_t traceresult;
 	EntityHandle_t hitent = TestPlayerPosition( mv->GetAbsOrigin(), COLLISION_GROUP_PLAYER_MOVEMENT, traceresult );
 	if ( hitent == INVALID_ENTITY_HANDLE )
@@ -33,6 +33,9 @@
 	#include "da_briefcase.h"
 	#include "vote_controller.h"
 	#include "da_datamanager.h"
+	#include "da_playerproximity.h"
+	#include "da_explosiontargets.h"
+	#include "da_spawnscoring.h"
 
 #endif
 
@@ -380,6 +383,8 @@ void CSDKGameRules::LevelInitPostEntity()
 #ifdef WITH_DATA_COLLECTION
 	DataManager().SetTeamplay(m_bIsTeamplay);
 #endif
+
+	SpawnScoring().Build();
 #endif
 }
 
@@ -407,6 +412,9 @@ void CSDKGameRules::ClientDisconnected( edict_t *pClient )
 	if (pSDKPlayer == GetBountyPlayer())
 		CleanupMiniObjective();
 
+	// Don't hand out this player from the cache for the rest of the tick.
+	PlayerProximity().Invalidate();
+
 #ifdef WITH_DATA_COLLECTION
 	if (!pSDKPlayer->IsBot())
 		DataManager().ClientDisconnected(engine->GetClientSteamID(pSDKPlayer->edict())->GetAccountID());
@@ -466,7 +474,11 @@ void CSDKGameRules::ReCalculateSlowMo()
 			pSDKPlayer->SetSlowMoType(SLOWMO_NONE);
 	}
 
-	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	// Everybody who still has slow is a source. One flood fill from all of them
+	// reaches every player who would otherwise have pulled slow from a neighbor.
+	CUtlVector<CSDKPlayer*> apGivers;
+
+	for (int i = gpGlobals->maxClients; i >= 1; i--)
 	{
 		CBasePlayer* pPlayer = UTIL_PlayerByIndex(i);
 		if (!pPlayer)
@@ -476,16 +488,18 @@ void CSDKGameRules::ReCalculateSlowMo()
 
 #ifdef SLOWMO_DEBUG
 		if (pSDKPlayer->IsBot())
-			GiveSlowMoToNearbyPlayers(pSDKPlayer);
-		else
+		{
+			apGivers.AddToTail(pSDKPlayer);
+			continue;
+		}
 #endif
 
-		if (pSDKPlayer->GetSlowMoType() == SLOWMO_NONE)
-			CalculateSlowMoForPlayer(pSDKPlayer);
-		else
-			GiveSlowMoToNearbyPlayers(pSDKPlayer);
+		if (pSDKPlayer->GetSlowMoType() != SLOWMO_NONE)
+			apGivers.AddToTail(pSDKPlayer);
 	}
 
+	SpreadSlowMo(apGivers);
+
 	m_flNextSlowMoUpdate = gpGlobals->curtime + 0.2f;
 }
 
@@ -521,28 +535,12 @@ void CSDKGameRules::CalculateSlowMoForPlayer(CSDKPlayer* pPlayer)
 	slowmo_type eOtherInSlow = SLOWMO_NONE;
 
 	CUtlVector<CSDKPlayer*> apOthersInPVS;
-
-	CBaseEntity* pOther = NULL;
-
-	while ((pOther = UTIL_EntitiesInPVS(pPlayer, pOther)) != NULL)
-	{
-		CSDKPlayer* pOtherPlayer = ToSDKPlayer(pOther);
-		if (!pOtherPlayer)
-			continue;
-
-		if (pOtherPlayer == pPlayer)
-			continue;
-
-		apOthersInPVS.AddToTail(pOtherPlayer);
-	}
+	PlayerProximity().GetPlayersInPVS(pPlayer, apOthersInPVS);
 
 	for (int i = 0; i < apOthersInPVS.Size(); i++)
 	{
 		CSDKPlayer* pOtherPlayer = apOthersInPVS[i];
 
-		if (!pOtherPlayer->IsAlive())
-			continue;
-
 		if (pOtherPlayer->GetSlowMoType() != SLOWMO_NONE)
 		{
 			if ((pOtherPlayer->GetAbsOrigin() - pPlayer->GetAbsOrigin()).LengthSqr() < da_slow_force_distance.GetFloat()*da_slow_force_distance.GetFloat() || pOtherPlayer->IsVisible(pPlayer))
@@ -592,95 +590,96 @@ void CSDKGameRules::GiveSlowMoToNearbyPlayers(CSDKPlayer* pPlayer)
 	if (!pPlayer)
 		return;
 
-	if (!pPlayer->IsAlive())
+	CUtlVector<CSDKPlayer*> apGivers;
+	apGivers.AddToTail(pPlayer);
+
+	SpreadSlowMo(apGivers);
+}
+
+// Flood fill slow from the players on the stack to everybody near or visible to them.
+void CSDKGameRules::SpreadSlowMo(CUtlVector<CSDKPlayer*>& apGivers)
+{
+	// Nobody gets slow passed to them on background maps.
+	if (gpGlobals->eLoadType == MapLoad_Background)
 	{
-		pPlayer->SetSlowMoType(SLOWMO_NONE);
+		apGivers.RemoveAll();
 		return;
 	}
 
-	if (pPlayer->GetSlowMoType() == SLOWMO_NONE)
-		return;
-
-	// I have some slowmo on me. Pass it to other players nearby.
-
 	CUtlVector<CSDKPlayer*> apOthersInPVS;
 
-	CBaseEntity* pOther = NULL;
-
-	slowmo_type eGiveType;
-
-	if (pPlayer->GetSlowMoType() == SLOWMO_STYLESKILL || pPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
-		eGiveType = SLOWMO_PASSIVE_SUPER;
-	else
-		eGiveType = SLOWMO_PASSIVE;
-
-	while ((pOther = UTIL_EntitiesInPVS(pPlayer, pOther)) != NULL)
+	while (apGivers.Count())
 	{
-		CSDKPlayer* pOtherPlayer = ToSDKPlayer(pOther);
-		if (!pOtherPlayer)
-			continue;
+		CSDKPlayer* pPlayer = apGivers.Tail();
+		apGivers.RemoveMultipleFromTail(1);
 
-		if (pOtherPlayer == pPlayer)
+		if (!pPlayer->IsAlive())
+		{
+			pPlayer->SetSlowMoType(SLOWMO_NONE);
 			continue;
+		}
 
-		// If they already have slow mo, we don't need to pass it to them.
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_STYLESKILL)
+		if (pPlayer->GetSlowMoType() == SLOWMO_NONE)
 			continue;
 
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_ACTIVATED)
-			continue;
+		// I have some slowmo on me. Pass it to other players nearby.
 
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
-			continue;
+		slowmo_type eGiveType;
 
-		if (pOtherPlayer->GetSlowMoType() == eGiveType)
-			continue;
+		if (pPlayer->GetSlowMoType() == SLOWMO_STYLESKILL || pPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
+			eGiveType = SLOWMO_PASSIVE_SUPER;
+		else
+			eGiveType = SLOWMO_PASSIVE;
 
-		if ((pOtherPlayer->GetAbsOrigin() - pPlayer->GetAbsOrigin()).LengthSqr() > da_slow_force_distance.GetFloat()*da_slow_force_distance.GetFloat())
+		PlayerProximity().GetPlayersInPVS(pPlayer, apOthersInPVS);
+
+		for (int i = 0; i < apOthersInPVS.Size(); i++)
 		{
-			if (!pOtherPlayer->IsVisible(pPlayer))
-				continue;
-		}
+			CSDKPlayer* pOtherPlayer = apOthersInPVS[i];
 
-		apOthersInPVS.AddToTail(pOtherPlayer);
-	}
+			if (enginetrace->PointOutsideWorld(pOtherPlayer->EyePosition()))
+				continue;
 
-	for (int i = 0; i < apOthersInPVS.Size(); i++)
-	{
-		CSDKPlayer* pOtherPlayer = apOthersInPVS[i];
+			// If they already have slow mo, we don't need to pass it to them.
+			if (pOtherPlayer->GetSlowMoType() == SLOWMO_STYLESKILL)
+				continue;
 
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_STYLESKILL)
-			continue;
+			if (pOtherPlayer->GetSlowMoType() == SLOWMO_ACTIVATED)
+				continue;
 
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_ACTIVATED)
-			continue;
+			if (pOtherPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
+				continue;
 
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
-			continue;
+			if (pOtherPlayer->GetSlowMoType() == eGiveType)
+				continue;
 
-		if (pOtherPlayer->GetSlowMoType() == SLOWMO_SUPERFALL)
-		{
-			// He has superfall. Superfall is special and we only give it to him under certain conditions.
+			if (pOtherPlayer->GetSlowMoType() == SLOWMO_SUPERFALL)
+			{
+				// He has superfall. Superfall is special and we only give it to him under certain conditions.
 
-			// Do I have a passive? Then don't pass it on, sucks to be me.
-			if (pPlayer->GetSlowMoType() == SLOWMO_PASSIVE || pPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
-				continue;
+				// Do I have a passive? Then don't pass it on, sucks to be me.
+				if (pPlayer->GetSlowMoType() == SLOWMO_PASSIVE || pPlayer->GetSlowMoType() == SLOWMO_PASSIVE_SUPER)
+					continue;
 
-			// Are we both in superfall? Good that's the way we want to stay.
-			if (pPlayer->GetSlowMoType() == SLOWMO_SUPERFALL)
-				continue;
-		}
+				// Are we both in superfall? Good that's the way we want to stay.
+				if (pPlayer->GetSlowMoType() == SLOWMO_SUPERFALL)
+					continue;
+			}
 
-		if (pOtherPlayer->GetSlowMoType() == eGiveType)
-			continue;
+			if ((pOtherPlayer->GetAbsOrigin() - pPlayer->GetAbsOrigin()).LengthSqr() > da_slow_force_distance.GetFloat()*da_slow_force_distance.GetFloat())
+			{
+				if (!pOtherPlayer->IsVisible(pPlayer))
+					continue;
+			}
 
-		// This guy is superfalling and we want to give him some slowmo? Give him superfall-slowmo instead.
-		if ((eGiveType == SLOWMO_PASSIVE || eGiveType == SLOWMO_PASSIVE_SUPER) && pOtherPlayer->m_Shared.IsSuperFalling())
-			pOtherPlayer->SetSlowMoType(SLOWMO_SUPERFALL);
-		else
-			pOtherPlayer->SetSlowMoType(eGiveType);
+			// This guy is superfalling and we want to give him some slowmo? Give him superfall-slowmo instead.
+			if ((eGiveType == SLOWMO_PASSIVE || eGiveType == SLOWMO_PASSIVE_SUPER) && pOtherPlayer->m_Shared.IsSuperFalling())
+				pOtherPlayer->SetSlowMoType(SLOWMO_SUPERFALL);
+			else
+				pOtherPlayer->SetSlowMoType(eGiveType);
 
-		GiveSlowMoToNearbyPlayers(pOtherPlayer);
+			apGivers.AddToTail(pOtherPlayer);
+		}
 	}
 }
 
@@ -829,28 +828,18 @@ void CSDKGameRules::RadiusDamage( const CTakeDamageInfo &info, const Vector &vec
 
 	vecSrc.z += 1;// in case grenade is lying on the ground
 
-	// iterate on all entities in the vicinity.
-	for ( CEntitySphereQuery sphere( vecSrc, flRadius ); ( pEntity = sphere.GetCurrentEntity() ) != NULL; sphere.NextEntity() )
+	// iterate on all entities in the vicinity. The ignored entity, ignored class and
+	// anything on the other side of the water line have already been left out.
+	CBaseEntity *apTargets[MAX_SPHERE_QUERY];
+	int iTargets = ExplosionTargets().Gather( vecSrc, flRadius, iClassIgnore, pEntityIgnore, !!bInWater, apTargets, ARRAYSIZE(apTargets) );
+
+	for ( int iTarget = 0; iTarget < iTargets; iTarget++ )
 	{
-		if ( pEntity == pEntityIgnore )
-			continue;
+		pEntity = apTargets[iTarget];
 
 		if ( pEntity->m_takedamage == DAMAGE_NO )
 			continue;
 
-		// UNDONE: this should check a damage mask, not an ignore
-		if ( iClassIgnore != CLASS_NONE && pEntity->Classify() == iClassIgnore )
-		{// houndeyes don't hurt other houndeyes with their attack
-			continue;
-		}
-
-		// blast's don't tavel into or out of water
-		if (bInWater && pEntity->GetWaterLevel() == 0)
-			continue;
-
-		if (!bInWater && pEntity->GetWaterLevel() == 3)
-			continue;
-
 		// Check that the explosion can 'see' this entity.
 		vecSpot = pEntity->BodyTarget( vecSrc, false );
 		UTIL_TraceLine( vecSrc, vecSpot, MASK_RADIUS_DAMAGE, info.GetInflictor(), COLLISION_GROUP_NONE, &tr );
@@ -1134,39 +1123,62 @@ bool CSDKGameRules::IsSpawnPointValid( CBaseEntity *pSpot, CBasePlayer *pPlayer
 
 	bNeedTeamMate &= bTeammatesAlive;
 
-	for (int i = 0; i <= gpGlobals->maxClients; i++)
+	// Spawn points the spawn scoring knows about already know which players can see them.
+	int iScoredSpot = SpawnScoring().IsEnabled()?SpawnScoring().GetSpotIndex(pSpot):-1;
+
+	if (iScoredSpot >= 0)
 	{
-		CBasePlayer *pOtherPlayer = UTIL_PlayerByIndex( i );
-		if (!pOtherPlayer)
-			continue;
+		if (SpawnScoring().IsSpotThreatened(iScoredSpot, pPlayer))
+			return false;
 
-		CSDKPlayer* pOtherSDKPlayer = ToSDKPlayer(pOtherPlayer);
+		if (bNeedTeamMate)
+		{
+			CUtlVector<CSDKPlayer*> apNearbyPlayers;
+			PlayerProximity().GetPlayersInRadius(pSpot->GetAbsOrigin(), 384, apNearbyPlayers);
 
-		if (pOtherPlayer == pPlayer)
-			continue;
+			for (int i = 0; i < apNearbyPlayers.Count(); i++)
+			{
+				if (apNearbyPlayers[i] != pPlayer && PlayerRelationship(pPlayer, apNearbyPlayers[i]) == GR_TEAMMATE)
+				{
+					bNeedTeamMate = false;
+					break;
+				}
+			}
+		}
+	}
+	else
+	{
+		CUtlVector<CSDKPlayer*> apNearbyPlayers;
+		PlayerProximity().GetPlayersInRadius(pSpot->GetAbsOrigin(), 512, apNearbyPlayers);
 
-		if (!pOtherSDKPlayer->IsAlive())
-			continue;
+		for (int i = 0; i < apNearbyPlayers.Count(); i++)
+		{
+			CSDKPlayer* pOtherSDKPlayer = apNearbyPlayers[i];
+			CBasePlayer *pOtherPlayer = pOtherSDKPlayer;
 
-		if ((pSpot->GetAbsOrigin() - pOtherPlayer->GetAbsOrigin()).LengthSqr() > 512*512)
-			continue;
+			if (pOtherPlayer == pPlayer)
+				continue;
 
-		trace_t tr;
-		UTIL_TraceLine( pSpot->WorldSpaceCenter(), pOtherSDKPlayer->WorldSpaceCenter(), MASK_VISIBLE_AND_NPCS, pPlayer, COLLISION_GROUP_NONE, &tr );
-		if (tr.m_pEnt == pOtherPlayer)
-		{
-			if (PlayerRelationship(pPlayer, pOtherPlayer) != GR_TEAMMATE)
-				return false;
-		}
+			if (!pOtherSDKPlayer->IsAlive())
+				continue;
 
-		if (PlayerRelationship(pPlayer, pOtherPlayer) == GR_TEAMMATE)
-		{
-			if (bNeedTeamMate)
+			trace_t tr;
+			UTIL_TraceLine( pSpot->WorldSpaceCenter(), pOtherSDKPlayer->WorldSpaceCenter(), MASK_VISIBLE_AND_NPCS, pPlayer, COLLISION_GROUP_NONE, &tr );
+			if (tr.m_pEnt == pOtherPlayer)
 			{
-				if ((pSpot->GetAbsOrigin() - pOtherPlayer->GetAbsOrigin()).LengthSqr() <= 384*384)
-					bNeedTeamMate = false;
+				if (PlayerRelationship(pPlayer, pOtherPlayer) != GR_TEAMMATE)
+					return false;
+			}
+
+			if (PlayerRelationship(pPlayer, pOtherPlayer) == GR_TEAMMATE)
+			{
+				if (bNeedTeamMate)
+				{
+					if ((pSpot->GetAbsOrigin() - pOtherPlayer->GetAbsOrigin()).LengthSqr() <= 384*384)
+						bNeedTeamMate = false;
+				}
+				continue;
 			}
-			continue;
 		}
 	}
 
@@ -1184,24 +1196,22 @@ bool CSDKGameRules::IsSpawnPointValid( CBaseEntity *pSpot, CBasePlayer *pPlayer
 		pGrenade = gEntList.FindEntityByClassname( pGrenade, "grenade_projectile" );
 	}*/
 
-	// Don't spawn players on top of the briefcase.
-	CBaseEntity* pBriefcase = gEntList.FindEntityByClassname( NULL, "da_briefcase" );
-	while (pBriefcase)
+	if (iScoredSpot >= 0)
 	{
-		if ((pSpot->GetAbsOrigin() - pBriefcase->GetAbsOrigin()).LengthSqr() < 300*300)
+		if (SpawnScoring().IsSpotNearObjective(iScoredSpot))
 			return false;
-
-		pBriefcase = gEntList.FindEntityByClassname( pBriefcase, "da_briefcase" );
 	}
-
-	// Don't start me near a capture point, it's probably a hot area.
-	CBaseEntity* pCapture = gEntList.FindEntityByClassname( NULL, "da_briefcase_capture" );
-	while (pCapture)
+	else
 	{
-		if ((pSpot->GetAbsOrigin() - pCapture->GetAbsOrigin()).LengthSqr() < 500*500)
+		// Don't spawn players on top of the briefcase.
+		CBriefcase* pBriefcase = GetBriefcase();
+		if (pBriefcase && (pSpot->GetAbsOrigin() - pBriefcase->GetAbsOrigin()).LengthSqr() < 300*300)
 			return false;
 
-		pCapture = gEntList.FindEntityByClassname( pCapture, "da_briefcase_capture" );
+		// Don't start me near a capture point, it's probably a hot area.
+		CBriefcaseCaptureZone* pCapture = GetCaptureZone();
+		if (pCapture && (pSpot->GetAbsOrigin() - pCapture->GetAbsOrigin()).LengthSqr() < 500*500)
+			return false;
 	}
 
 	Vector mins = GetViewVectors()->m_vHullMin;
@@ -1229,6 +1239,27 @@ bool CSDKGameRules::InitTeamSpawns()
 	// the second refpoint will tend to have a pattern so mix up which team gets it
 	int iLastTeam = random->RandomInt(SDK_TEAM_BLUE,SDK_TEAM_RED);
 
+	// Use the grids and farthest sets worked out on an earlier load of this map if we can.
+	CSpawnGridCache oCache;
+	int iRefSpot = oCache.Open(iNumSpawns)?oCache.FindSpot(pRefSpot):-1;
+	if (iRefSpot >= 0 && oCache.GetFarthestCount(iRefSpot) > 0)
+	{
+		int iSpawns;
+		const Vector* pSpawns = oCache.GetSpawns(iRefSpot, iSpawns);
+		CSpawnPointGenerator::CreateSpawns(pSpawns, iSpawns, pRefSpot->GetAbsAngles(), iLastTeam);
+
+		int iFarSpot = oCache.GetFarthest(iRefSpot, random->RandomInt(0, oCache.GetFarthestCount(iRefSpot)-1));
+		CBaseEntity* pFarSpot = oCache.GetSpot(iFarSpot);
+		if (!pFarSpot)
+			return false;
+
+		iLastTeam = (iLastTeam == SDK_TEAM_BLUE ? SDK_TEAM_RED : SDK_TEAM_BLUE);
+		pSpawns = oCache.GetSpawns(iFarSpot, iSpawns);
+		CSpawnPointGenerator::CreateSpawns(pSpawns, iSpawns, pFarSpot->GetAbsAngles(), iLastTeam);
+
+		return (iSpawns >= 1);
+	}
+
 	// create spawn grid
 	CSpawnPointGenerator m_SpawnGen(pRefSpot, iLastTeam, iNumSpawns);
 	bSuccess = (m_SpawnGen.SpawnsCreated() >= 1);
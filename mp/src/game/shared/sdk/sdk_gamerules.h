@@ -198,6 +198,7 @@ public:
 
 protected:
 	void	GiveSlowMoToNearbyPlayers(CSDKPlayer* pPlayer);
+	void	SpreadSlowMo(CUtlVector<CSDKPlayer*>& apGivers);
 
 protected:
 	void CheckPlayerPositions( void );
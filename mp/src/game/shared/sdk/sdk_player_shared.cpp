@@ -649,12 +649,120 @@ CSDKPlayerShared::CSDKPlayerShared()
 	m_bRolling = false;
 	m_flSlideStartTime = 0;
 	m_flSlideAutoEndTime = 0;
+
+#ifndef CLIENT_DLL
+	m_iMovementBits = 0;
+#endif
 }
 
 CSDKPlayerShared::~CSDKPlayerShared()
 {
 }
 
+int CSDKPlayerShared::GetMovementBits() const
+{
+	int iBits = 0;
+
+#if defined( SDK_USE_PRONE )
+	if (m_bProne)
+		iBits |= MOVEMENT_BIT_PRONE;
+	if (m_bProneSliding)
+		iBits |= MOVEMENT_BIT_PRONE_SLIDING;
+#endif
+
+	if (m_bSliding)
+		iBits |= MOVEMENT_BIT_SLIDING;
+	if (m_bInAirSlide)
+		iBits |= MOVEMENT_BIT_IN_AIR_SLIDE;
+	if (m_bDiveSliding)
+		iBits |= MOVEMENT_BIT_DIVE_SLIDING;
+	if (m_bRolling)
+		iBits |= MOVEMENT_BIT_ROLLING;
+	if (m_bRollingFromDive)
+		iBits |= MOVEMENT_BIT_ROLLING_FROM_DIVE;
+	if (m_bDiving)
+		iBits |= MOVEMENT_BIT_DIVING;
+	if (m_bRollAfterDive)
+		iBits |= MOVEMENT_BIT_ROLL_AFTER_DIVE;
+	if (m_bIsWallFlipping)
+		iBits |= MOVEMENT_BIT_WALL_FLIPPING;
+	if (m_bIsManteling)
+		iBits |= MOVEMENT_BIT_MANTELING;
+	if (m_bSuperFallOthersVisible)
+		iBits |= MOVEMENT_BIT_SUPER_FALL_OTHERS_VISIBLE;
+
+	return iBits;
+}
+
+void CSDKPlayerShared::SetMovementBits( int iBits )
+{
+#if defined( SDK_USE_PRONE )
+	m_bProne = !!(iBits & MOVEMENT_BIT_PRONE);
+	m_bProneSliding = !!(iBits & MOVEMENT_BIT_PRONE_SLIDING);
+#endif
+
+	m_bSliding = !!(iBits & MOVEMENT_BIT_SLIDING);
+	m_bInAirSlide = !!(iBits & MOVEMENT_BIT_IN_AIR_SLIDE);
+	m_bDiveSliding = !!(iBits & MOVEMENT_BIT_DIVE_SLIDING);
+	m_bRolling = !!(iBits & MOVEMENT_BIT_ROLLING);
+	m_bRollingFromDive = !!(iBits & MOVEMENT_BIT_ROLLING_FROM_DIVE);
+	m_bDiving = !!(iBits & MOVEMENT_BIT_DIVING);
+	m_bRollAfterDive = !!(iBits & MOVEMENT_BIT_ROLL_AFTER_DIVE);
+	m_bIsWallFlipping = !!(iBits & MOVEMENT_BIT_WALL_FLIPPING);
+	m_bIsManteling = !!(iBits & MOVEMENT_BIT_MANTELING);
+	m_bSuperFallOthersVisible = !!(iBits & MOVEMENT_BIT_SUPER_FALL_OTHERS_VISIBLE);
+}
+
+#define PLAYER_TIMER_MASK ((1<<PLAYER_TIMER_BITS)-1)
+#define PLAYER_TIMER_HALF (1<<(PLAYER_TIMER_BITS-1))
+
+// Reserved codes for the "not set" values. Real times that land on them are moved to the next code.
+#define PLAYER_TIMER_ZERO 0
+#define PLAYER_TIMER_NEGATIVE_ONE 1
+#define PLAYER_TIMER_FIRST 2
+
+int PlayerTimerToNetwork( float flTimer, float flNow )
+{
+	if (flTimer == 0)
+		return PLAYER_TIMER_ZERO;
+
+	if (flTimer == -1)
+		return PLAYER_TIMER_NEGATIVE_ONE;
+
+	// Anything further away than this wouldn't unwrap to the right time. Nothing cares exactly how
+	// long ago something that old was, so pull it in to the edge. The edge is snapped to a minute
+	// so it doesn't change, and cost a delta, every snapshot.
+	double flWindow = PLAYER_TIMER_HALF/1000.0 - 60;
+	if (flTimer < flNow - flWindow)
+		flTimer = ceil((flNow - flWindow)/60)*60;
+	else if (flTimer > flNow + flWindow)
+		flTimer = floor((flNow + flWindow)/60)*60;
+
+	int iNetwork = (int)floor((double)flTimer*1000 + 0.5) & PLAYER_TIMER_MASK;
+
+	if (iNetwork < PLAYER_TIMER_FIRST)
+		iNetwork = PLAYER_TIMER_FIRST;
+
+	return iNetwork;
+}
+
+float PlayerTimerFromNetwork( int iNetwork, float flNow )
+{
+	if (iNetwork == PLAYER_TIMER_ZERO)
+		return 0;
+
+	if (iNetwork == PLAYER_TIMER_NEGATIVE_ONE)
+		return -1;
+
+	int iNow = (int)floor((double)flNow*1000 + 0.5);
+
+	int iDelta = (iNetwork - iNow) & PLAYER_TIMER_MASK;
+	if (iDelta >= PLAYER_TIMER_HALF)
+		iDelta -= (1<<PLAYER_TIMER_BITS);
+
+	return (float)((iNow + iDelta)/1000.0);
+}
+
 void CSDKPlayerShared::Init( CSDKPlayer *pPlayer )
 {
 	m_pOuter = pPlayer;
@@ -19,6 +19,42 @@ class C_SDKPlayer;
 class CSDKPlayer;
 #endif
 
+// Timers in DT_SDKPlayerShared go over the network as milliseconds modulo 2^PLAYER_TIMER_BITS
+// and come back as the value nearest the clock they were stamped with, about 8 minutes either
+// way. Most are stamped with the player's own time, which falls behind the server's in slow
+// motion, so they're sent against the player's m_flCurrentTime. The "not set" values 0 and -1
+// come back exactly.
+#define PLAYER_TIMER_BITS 20
+
+int   PlayerTimerToNetwork( float flTimer, float flNow );
+float PlayerTimerFromNetwork( int iNetwork, float flNow );
+
+// Aim in ramps go from 0 to 1.
+#define PLAYER_RAMP_BITS 10
+
+// Player time only drifts from the tick count in slow motion, so it's sent as how many
+// milliseconds behind the tick count it is.
+#define PLAYER_TIME_LAG_BITS 24
+
+// Movement state that goes over the network together, in m_iMovementBits.
+enum
+{
+	MOVEMENT_BIT_PRONE                    = (1<<0),
+	MOVEMENT_BIT_PRONE_SLIDING            = (1<<1),
+	MOVEMENT_BIT_SLIDING                  = (1<<2),
+	MOVEMENT_BIT_IN_AIR_SLIDE             = (1<<3),
+	MOVEMENT_BIT_DIVE_SLIDING             = (1<<4),
+	MOVEMENT_BIT_ROLLING                  = (1<<5),
+	MOVEMENT_BIT_ROLLING_FROM_DIVE        = (1<<6),
+	MOVEMENT_BIT_DIVING                   = (1<<7),
+	MOVEMENT_BIT_ROLL_AFTER_DIVE          = (1<<8),
+	MOVEMENT_BIT_WALL_FLIPPING            = (1<<9),
+	MOVEMENT_BIT_MANTELING                = (1<<10),
+	MOVEMENT_BIT_SUPER_FALL_OTHERS_VISIBLE = (1<<11),
+};
+
+#define MOVEMENT_BITS_COUNT 12
+
 class CSDKPlayerShared
 {
 public:
@@ -44,6 +80,7 @@ public:
 #endif // SDK_USE_STAMINA || SDK_USE_SPRINTING
 
 	void	Init( OuterClass *pOuter );
+	OuterClass *GetOuter() const { return m_pOuter; }
 
 	bool	IsSniperZoomed( void ) const;
 	bool	IsDucking( void ) const; 
@@ -163,8 +200,20 @@ public:
 
 	void ComputeWorldSpaceSurroundingBox( Vector *pVecWorldMins, Vector *pVecWorldMaxs );
 
+	int		GetMovementBits() const;
+	void	SetMovementBits( int iBits );
+
+#ifndef CLIENT_DLL
+	// The bools are packed once before each snapshot rather than on every change.
+	void	UpdateMovementBits() { m_iMovementBits = GetMovementBits(); }
+#endif
+
 private:
 
+#ifndef CLIENT_DLL
+	CNetworkVar( int, m_iMovementBits );
+#endif
+
 #if defined ( SDK_USE_PRONE )
 	CNetworkVar( bool, m_bProne );
 #endif
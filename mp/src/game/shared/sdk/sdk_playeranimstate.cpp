@@ -23,6 +23,7 @@
 #include "da_viewback.h"
 #else
 #include "sdk_player.h"
+#include "vstdlib/jobthread.h"
 #endif
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -32,6 +33,13 @@
 #define SDK_WALK_SPEED				120.0f
 #define SDK_CROUCHWALK_SPEED		110.0f
 
+#ifndef CLIENT_DLL
+ConVar da_animstate_parallel( "da_animstate_parallel", "1", FCVAR_GAMEDLL, "Compute player pose parameters on the job pool once all players have moved. 0 computes them in each player's PostThink, the results are the same." );
+
+// States with an update waiting for FinishAllPoseUpdates.
+static CUtlVector<CSDKPlayerAnimState *> s_apPendingPoseUpdates;
+#endif
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *pPlayer - 
@@ -65,6 +73,10 @@ CSDKPlayerAnimState::CSDKPlayerAnimState()
 {
 	m_pSDKPlayer = NULL;
 
+#ifndef CLIENT_DLL
+	m_bPosePending = false;
+#endif
+
 	// Don't initialize SDK specific variables here. Init them in InitSDKAnimState()
 }
 
@@ -78,6 +90,10 @@ CSDKPlayerAnimState::CSDKPlayerAnimState( CBasePlayer *pPlayer, MultiPlayerMovem
 {
 	m_pSDKPlayer = NULL;
 
+#ifndef CLIENT_DLL
+	m_bPosePending = false;
+#endif
+
 	// Don't initialize SDK specific variables here. Init them in InitSDKAnimState()
 }
 
@@ -87,6 +103,10 @@ CSDKPlayerAnimState::CSDKPlayerAnimState( CBasePlayer *pPlayer, MultiPlayerMovem
 //-----------------------------------------------------------------------------
 CSDKPlayerAnimState::~CSDKPlayerAnimState()
 {
+#ifndef CLIENT_DLL
+	if ( m_bPosePending )
+		s_apPendingPoseUpdates.FindAndFastRemove( this );
+#endif
 }
 
 //-----------------------------------------------------------------------------
@@ -129,6 +149,10 @@ void CSDKPlayerAnimState::InitSDKAnimState( CSDKPlayer *pPlayer )
 //-----------------------------------------------------------------------------
 void CSDKPlayerAnimState::ClearAnimationState( void )
 {
+#ifndef CLIENT_DLL
+	FinishPoseUpdate();
+#endif
+
 #if defined ( SDK_USE_PRONE )
 	m_bProneTransition = false;
 	m_bProneTransitionFirstFrame = false;
@@ -190,6 +214,11 @@ void CSDKPlayerAnimState::Update( float eyeYaw, float eyePitch, float flCharacte
 		return;
 	}
 
+#ifndef CLIENT_DLL
+	// The last update's pose parameters go into this one's ground speed.
+	FinishPoseUpdate();
+#endif
+
 	// Store the eye angles.
 	m_flEyeYaw = AngleNormalize( eyeYaw );
 	m_flEyePitch = AngleNormalize( eyePitch );
@@ -219,16 +248,23 @@ void CSDKPlayerAnimState::Update( float eyeYaw, float eyePitch, float flCharacte
 
 	if ( SetupPoseParameters( pStudioHdr ) )
 	{
-		// Pose parameter - what direction are the player's legs running in.
-		ComputePoseParam_MoveYaw( pStudioHdr );
-
-		ComputePoseParam_StuntYaw( pStudioHdr );
-
-		// Pose parameter - Torso aiming (up/down).
-		ComputePoseParam_AimPitch( pStudioHdr );
+		PoseInputs_t inputs;
+		GatherPoseInputs( inputs );
 
-		// Pose parameter - Torso aiming (rotation).
-		ComputePoseParam_AimYaw( pStudioHdr );
+#ifndef CLIENT_DLL
+		if ( da_animstate_parallel.GetBool() )
+		{
+			m_PendingInputs = inputs;
+			m_bPosePending = true;
+			s_apPendingPoseUpdates.AddToTail( this );
+		}
+		else
+#endif
+		{
+			PoseOutputs_t outputs;
+			ComputePoseParameters( inputs, outputs );
+			CommitPoseParameters( pStudioHdr, outputs );
+		}
 	}
 
 #ifdef CLIENT_DLL 
@@ -302,58 +338,164 @@ void CSDKPlayerAnimState::GetOuterAbsVelocity(Vector& vel)
 #endif
 }
 
-void CSDKPlayerAnimState::ComputePoseParam_AimPitch( CStudioHdr *pStudioHdr )
+void CSDKPlayerAnimState::GatherPoseInputs( PoseInputs_t &inputs )
+{
+	inputs.m_flFrameTime = gpGlobals->frametime;
+	inputs.m_flDeltaTime = gpGlobals->frametime * m_pSDKPlayer->GetSlowMoMultiplier();
+	inputs.m_flCurrentTime = m_pSDKPlayer->GetCurrentTime();
+
+	GetOuterAbsVelocity( inputs.m_vecVelocity );
+	m_pSDKPlayer->GetVectors( &inputs.m_vecForward, NULL, NULL );
+	inputs.m_flLocalYaw = GetBasePlayer()->GetLocalAngles()[YAW];
+	inputs.m_vecMantelWallNormal = m_pSDKPlayer->m_Shared.GetMantelWallNormal();
+
+	// Get the current speed the character is running.
+	inputs.m_flPlaybackRate = CalcMovementPlaybackRate( &inputs.m_bMoving );
+
+	inputs.m_bSliding = m_pSDKPlayer->m_Shared.IsSliding();
+	inputs.m_bDiveSliding = m_pSDKPlayer->m_Shared.IsDiveSliding();
+	inputs.m_bSuperFalling = m_pSDKPlayer->m_Shared.IsSuperFalling();
+	inputs.m_bOnGround = !!m_pSDKPlayer->GetGroundEntity();
+	inputs.m_bDiving = m_pSDKPlayer->m_Shared.IsDiving();
+	inputs.m_bRolling = m_pSDKPlayer->m_Shared.IsRolling();
+	inputs.m_bProne = m_pSDKPlayer->m_Shared.IsProne();
+	inputs.m_bManteling = m_pSDKPlayer->m_Shared.IsManteling();
+	inputs.m_bAimedIn = m_pSDKPlayer->m_Shared.IsAimedIn();
+	inputs.m_bThirdPerson = m_pSDKPlayer->IsInThirdPerson();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Only reads the inputs and writes this state, never the player.
+//-----------------------------------------------------------------------------
+void CSDKPlayerAnimState::ComputePoseParameters( const PoseInputs_t &inputs, PoseOutputs_t &outputs )
+{
+	// Pose parameter - what direction are the player's legs running in.
+	ComputePoseParam_MoveYaw( inputs, outputs );
+
+	ComputePoseParam_StuntYaw( inputs, outputs );
+
+	// Pose parameter - Torso aiming (up/down).
+	ComputePoseParam_AimPitch( inputs, outputs );
+
+	// Pose parameter - Torso aiming (rotation).
+	ComputePoseParam_AimYaw( inputs, outputs );
+}
+
+void CSDKPlayerAnimState::CommitPoseParameters( CStudioHdr *pStudioHdr, const PoseOutputs_t &outputs )
+{
+	if ( !pStudioHdr )
+		return;
+
+	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iMoveX, outputs.m_vecMoveYaw.x );
+	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iMoveY, outputs.m_vecMoveYaw.y );
+	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_iStuntYawPose, outputs.m_flStuntYaw );
+	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimPitch, outputs.m_flAimPitch );
+
+	if ( outputs.m_bAimYaw )
+		GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimYaw, outputs.m_flAimYaw );
+
+#ifndef CLIENT_DLL
+	QAngle angle = GetBasePlayer()->GetAbsAngles();
+	angle[YAW] = outputs.m_flAbsYaw;
+
+	GetBasePlayer()->SetAbsAngles( angle );
+#endif
+}
+
+#ifndef CLIENT_DLL
+void CSDKPlayerAnimState::FinishPoseUpdate()
+{
+	if ( !m_bPosePending )
+		return;
+
+	s_apPendingPoseUpdates.FindAndFastRemove( this );
+	m_bPosePending = false;
+
+	ComputePoseParameters( m_PendingInputs, m_PendingOutputs );
+	CommitPoseParameters( GetBasePlayer()->GetModelPtr(), m_PendingOutputs );
+}
+
+void CSDKPlayerAnimState::ComputePendingPose( CSDKPlayerAnimState *&pState )
+{
+	pState->ComputePoseParameters( pState->m_PendingInputs, pState->m_PendingOutputs );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called once all players have run their commands for the frame.
+//-----------------------------------------------------------------------------
+void CSDKPlayerAnimState::FinishAllPoseUpdates()
 {
-	if (m_pSDKPlayer->m_Shared.IsSliding() && !m_pSDKPlayer->m_Shared.IsDiveSliding())
+	if ( !s_apPendingPoseUpdates.Count() )
+		return;
+
+	VPROF( "CSDKPlayerAnimState::FinishAllPoseUpdates" );
+
+	// Every state only touches itself, so they can all be computed at once. Setting the results on the
+	// players has to happen back on this thread.
+	ParallelProcess( "CSDKPlayerAnimState::ComputePendingPose", s_apPendingPoseUpdates.Base(), s_apPendingPoseUpdates.Count(), &ComputePendingPose );
+
+	for ( int i = 0; i < s_apPendingPoseUpdates.Count(); i++ )
 	{
-		Vector vecVelocity;
-		GetOuterAbsVelocity( vecVelocity );
+		CSDKPlayerAnimState *pState = s_apPendingPoseUpdates[i];
 
+		pState->m_bPosePending = false;
+		pState->CommitPoseParameters( pState->GetBasePlayer()->GetModelPtr(), pState->m_PendingOutputs );
+	}
+
+	s_apPendingPoseUpdates.RemoveAll();
+}
+#endif
+
+void CSDKPlayerAnimState::ComputePoseParam_AimPitch( const PoseInputs_t &inputs, PoseOutputs_t &outputs )
+{
+	if (inputs.m_bSliding && !inputs.m_bDiveSliding)
+	{
 		QAngle angSlide;
-		VectorAngles(vecVelocity, angSlide);
+		VectorAngles(inputs.m_vecVelocity, angSlide);
 		m_angRender[YAW] = angSlide.y;
 
-		Vector vecForward;
-		m_pSDKPlayer->GetVectors(&vecForward, NULL, NULL);
-
-		float flAimPitch = DotProduct(Vector(0, 0, 1), vecForward) * 90;
+		float flAimPitch = DotProduct(Vector(0, 0, 1), inputs.m_vecForward) * 90;
 
 		// Set the aim yaw and save.
-		GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimPitch, flAimPitch );
+		outputs.m_flAimPitch = flAimPitch;
 		m_DebugAnimData.m_flAimPitch = flAimPitch;
 
 		return;
 	}
 
-	if (m_pSDKPlayer->m_Shared.IsSuperFalling() && !m_pSDKPlayer->GetGroundEntity() && m_pSDKPlayer->m_Shared.IsDiving())
-		m_angRender[PITCH] = Approach(m_flEyePitch, m_angRender[PITCH], gpGlobals->frametime * 200);
+	if (inputs.m_bSuperFalling && !inputs.m_bOnGround && inputs.m_bDiving)
+		m_angRender[PITCH] = Approach(m_flEyePitch, m_angRender[PITCH], inputs.m_flFrameTime * 200);
 	else
 		m_angRender[PITCH] = 0;
 
-	if (m_pSDKPlayer->IsInThirdPerson())
+	if (inputs.m_bThirdPerson)
 	{
 		// Use the character's eye direction instead of the actual.
 		float flAimPitch = m_flCharacterEyePitch;
 
 		// Set the aim pitch pose parameter and save.
-		GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimPitch, -flAimPitch );
+		outputs.m_flAimPitch = -flAimPitch;
 		m_DebugAnimData.m_flAimPitch = flAimPitch;
 
 		return;
 	}
 
-	BaseClass::ComputePoseParam_AimPitch(pStudioHdr);
+	// Get the view pitch.
+	float flAimPitch = m_flEyePitch;
+
+	// Set the aim pitch pose parameter and save.
+	outputs.m_flAimPitch = -flAimPitch;
+	m_DebugAnimData.m_flAimPitch = flAimPitch;
 }
 
-void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
+void CSDKPlayerAnimState::ComputePoseParam_AimYaw( const PoseInputs_t &inputs, PoseOutputs_t &outputs )
 {
-	if (m_pSDKPlayer->m_Shared.IsSliding() && !m_pSDKPlayer->m_Shared.IsDiveSliding())
-	{
-		Vector vecVelocity;
-		GetOuterAbsVelocity( vecVelocity );
+	outputs.m_bAimYaw = true;
 
+	if (inputs.m_bSliding && !inputs.m_bDiveSliding)
+	{
 		QAngle angDir;
-		VectorAngles(vecVelocity, angDir);
+		VectorAngles(inputs.m_vecVelocity, angDir);
 
 		//if (m_bFacingForward)
 		m_flGoalFeetYaw = angDir[YAW];
@@ -363,8 +505,8 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 		m_flGoalFeetYaw = AngleNormalize( m_flGoalFeetYaw );
 		if ( m_flGoalFeetYaw != m_flCurrentFeetYaw )
 		{
-			ConvergeYawAngles( m_flGoalFeetYaw, 720.0f, gpGlobals->frametime * m_pSDKPlayer->GetSlowMoMultiplier(), m_flCurrentFeetYaw );
-			m_flLastAimTurnTime = m_pSDKPlayer->GetCurrentTime();
+			ConvergeYawAngles( m_flGoalFeetYaw, 720.0f, inputs.m_flDeltaTime, m_flCurrentFeetYaw );
+			m_flLastAimTurnTime = inputs.m_flCurrentTime;
 		}
 
 		m_angRender[YAW] = angDir.y;
@@ -377,18 +519,13 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 		flAimYaw = AngleNormalize( flAimYaw );
 
 		// Set the aim yaw and save.
-		GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimYaw, flAimYaw );
+		outputs.m_flAimYaw = flAimYaw;
 		m_DebugAnimData.m_flAimYaw	= flAimYaw;
 
 		// Turn off a force aim yaw - either we have already updated or we don't need to.
 		m_bForceAimYaw = false;
 
-#ifndef CLIENT_DLL
-		QAngle angle = GetBasePlayer()->GetAbsAngles();
-		angle[YAW] = m_flCurrentFeetYaw;
-
-		GetBasePlayer()->SetAbsAngles( angle );
-#endif
+		outputs.m_flAbsYaw = m_flCurrentFeetYaw;
 
 		return;
 	}
@@ -396,44 +533,33 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 	{
 		m_flGoalFeetYaw = m_angRender[YAW] = m_flEyeYaw;
 
-#ifndef CLIENT_DLL
-		QAngle angle = GetBasePlayer()->GetAbsAngles();
-		angle[YAW] = m_flCurrentFeetYaw;
-
-		GetBasePlayer()->SetAbsAngles( angle );
-#endif
+		outputs.m_flAbsYaw = m_flCurrentFeetYaw;
 
-		GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimYaw, 0 );
+		outputs.m_flAimYaw = 0;
 		m_DebugAnimData.m_flAimYaw = 0;
 
 		return;
 	}
-	else if (m_pSDKPlayer->m_Shared.IsManteling())
+	else if (inputs.m_bManteling)
 	{
 		m_angRender[YAW] = m_PoseParameterData.m_flEstimateYaw;
-#ifndef CLIENT_DLL
-		QAngle angle = GetBasePlayer()->GetAbsAngles();
-		angle[YAW] = m_PoseParameterData.m_flEstimateYaw;
 
-		GetBasePlayer()->SetAbsAngles( angle );
-#endif
+		outputs.m_bAimYaw = false;
+		outputs.m_flAbsYaw = m_PoseParameterData.m_flEstimateYaw;
+
 		return;
 	}
 
-	// Get the movement velocity.
-	Vector vecVelocity;
-	GetOuterAbsVelocity( vecVelocity );
-
 	// Check to see if we are moving.
-	bool bMoving = ( vecVelocity.Length2DSqr() > 1.0f ) ? true : false;
+	bool bMoving = ( inputs.m_vecVelocity.Length2DSqr() > 1.0f ) ? true : false;
 
-	if ( m_pSDKPlayer->m_Shared.IsProne() )
+	if ( inputs.m_bProne )
 	{
 		m_flGoalFeetYaw = m_flCurrentFeetYaw = m_flEyeYaw;
 	}
 	else if ( bMoving || m_bForceAimYaw )
 	{
-		if (m_pSDKPlayer->m_Shared.IsAimedIn() || m_pSDKPlayer->m_Shared.IsDiving() || m_pSDKPlayer->m_Shared.IsRolling() || m_pSDKPlayer->m_Shared.IsSliding())
+		if (inputs.m_bAimedIn || inputs.m_bDiving || inputs.m_bRolling || inputs.m_bSliding)
 		{
 			// The feet match the eye direction when moving - the move yaw takes care of the rest.
 			m_flGoalFeetYaw = m_flEyeYaw;
@@ -441,7 +567,7 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 		else
 		{
 			QAngle angDir;
-			VectorAngles(vecVelocity, angDir);
+			VectorAngles(inputs.m_vecVelocity, angDir);
 
 			if (m_bFacingForward)
 			{
@@ -461,7 +587,7 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 		{
 			m_flGoalFeetYaw	= m_flEyeYaw;
 			m_flCurrentFeetYaw = m_flEyeYaw;
-			m_PoseParameterData.m_flLastAimTurnTime = m_pSDKPlayer->GetCurrentTime();
+			m_PoseParameterData.m_flLastAimTurnTime = inputs.m_flCurrentTime;
 		}
 		// Make sure the feet yaw isn't too far out of sync with the eye yaw.
 		// TODO: Do something better here!
@@ -487,12 +613,12 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 		}
 		else
 		{
-			ConvergeYawAnglesThroughZero( m_flGoalFeetYaw, 720.0f, gpGlobals->frametime * m_pSDKPlayer->GetSlowMoMultiplier(), m_flCurrentFeetYaw );
-			m_flLastAimTurnTime = m_pSDKPlayer->GetCurrentTime();
+			ConvergeYawAnglesThroughZero( m_flGoalFeetYaw, 720.0f, inputs.m_flDeltaTime, m_flCurrentFeetYaw );
+			m_flLastAimTurnTime = inputs.m_flCurrentTime;
 		}
 	}
 
-	if (m_pSDKPlayer->m_Shared.IsDiving())
+	if (inputs.m_bDiving)
 		m_flCurrentFeetYaw = m_flGoalFeetYaw;
 
 	// Rotate the body into position.
@@ -501,32 +627,27 @@ void CSDKPlayerAnimState::ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr )
 	// Find the aim(torso) yaw base on the eye and feet yaws.
 	float flAimYaw = m_flEyeYaw - m_flCurrentFeetYaw;
 
-	if (m_pSDKPlayer->IsInThirdPerson())
+	if (inputs.m_bThirdPerson)
 		flAimYaw = m_flCharacterEyeYaw - m_flCurrentFeetYaw;
 
 	flAimYaw = AngleNormalize( flAimYaw );
 
 	// Set the aim yaw and save.
-	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iAimYaw, -flAimYaw );
+	outputs.m_flAimYaw = -flAimYaw;
 	m_DebugAnimData.m_flAimYaw	= flAimYaw;
 
 	// Turn off a force aim yaw - either we have already updated or we don't need to.
 	m_bForceAimYaw = false;
 
-#ifndef CLIENT_DLL
-	QAngle angle = GetBasePlayer()->GetAbsAngles();
-	angle[YAW] = m_flCurrentFeetYaw;
-
-	GetBasePlayer()->SetAbsAngles( angle );
-#endif
+	outputs.m_flAbsYaw = m_flCurrentFeetYaw;
 }
 
 extern ConVar mp_slammoveyaw;
 float SnapYawTo( float flValue );
-void CSDKPlayerAnimState::ComputePoseParam_MoveYaw( CStudioHdr *pStudioHdr )
+void CSDKPlayerAnimState::ComputePoseParam_MoveYaw( const PoseInputs_t &inputs, PoseOutputs_t &outputs )
 {
 	// Get the estimated movement yaw.
-	EstimateYaw();
+	EstimateYaw( inputs );
 
 	// Get the view yaw.
 	float flAngle = AngleNormalize( m_flEyeYaw );
@@ -535,16 +656,14 @@ void CSDKPlayerAnimState::ComputePoseParam_MoveYaw( CStudioHdr *pStudioHdr )
 	float flYaw = flAngle - m_PoseParameterData.m_flEstimateYaw;
 	flYaw = AngleNormalize( -flYaw );
 
-	// Get the current speed the character is running.
-	bool bIsMoving;
-	float flPlaybackRate = CalcMovementPlaybackRate( &bIsMoving );
+	float flPlaybackRate = inputs.m_flPlaybackRate;
 
 	// Setup the 9-way blend parameters based on our speed and direction.
 	Vector2D vecCurrentMoveYaw( 0.0f, 0.0f );
-	if ( bIsMoving )
+	if ( inputs.m_bMoving )
 	{
-		if (m_pSDKPlayer->m_Shared.IsAimedIn() || m_pSDKPlayer->m_Shared.IsDiving() || m_pSDKPlayer->m_Shared.IsRolling()
-			|| m_pSDKPlayer->m_Shared.IsSliding() || m_bFlipping)
+		if (inputs.m_bAimedIn || inputs.m_bDiving || inputs.m_bRolling
+			|| inputs.m_bSliding || m_bFlipping)
 		{
 			vecCurrentMoveYaw.x = cos( DEG2RAD( flYaw ) ) * flPlaybackRate;
 			vecCurrentMoveYaw.y = -sin( DEG2RAD( flYaw ) ) * flPlaybackRate;
@@ -557,13 +676,12 @@ void CSDKPlayerAnimState::ComputePoseParam_MoveYaw( CStudioHdr *pStudioHdr )
 	}
 
 	// Set the 9-way blend movement pose parameters.
-	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iMoveX, vecCurrentMoveYaw.x );
-	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_PoseParameterData.m_iMoveY, vecCurrentMoveYaw.y );
+	outputs.m_vecMoveYaw = vecCurrentMoveYaw;
 
 	m_DebugAnimData.m_vecMoveYaw = vecCurrentMoveYaw;
 }
 
-void CSDKPlayerAnimState::ComputePoseParam_StuntYaw( CStudioHdr *pStudioHdr )
+void CSDKPlayerAnimState::ComputePoseParam_StuntYaw( const PoseInputs_t &inputs, PoseOutputs_t &outputs )
 {
 	// Get the view yaw.
 	float flAngle = AngleNormalize( m_flEyeYaw );
@@ -572,34 +690,32 @@ void CSDKPlayerAnimState::ComputePoseParam_StuntYaw( CStudioHdr *pStudioHdr )
 	float flYaw = flAngle - m_PoseParameterData.m_flEstimateYaw;
 	flYaw = AngleNormalize( flYaw );
 
-	GetBasePlayer()->SetPoseParameter( pStudioHdr, m_iStuntYawPose, flYaw );
+	outputs.m_flStuntYaw = flYaw;
 }
 
-void CSDKPlayerAnimState::EstimateYaw( void )
+void CSDKPlayerAnimState::EstimateYaw( const PoseInputs_t &inputs )
 {
 	// Get the frame time.
-	float flDeltaTime = gpGlobals->frametime * m_pSDKPlayer->GetSlowMoMultiplier();
+	float flDeltaTime = inputs.m_flDeltaTime;
 	if ( flDeltaTime == 0.0f )
 		return;
 
 	// Get the player's velocity and angles.
-	Vector vecEstVelocity;
-	GetOuterAbsVelocity( vecEstVelocity );
-	QAngle angles = GetBasePlayer()->GetLocalAngles();
+	const Vector &vecEstVelocity = inputs.m_vecVelocity;
 
 	// If we are not moving, sync up the feet and eyes slowly.
-	if (m_pSDKPlayer->m_Shared.IsProne())
+	if (inputs.m_bProne)
 	{
 		// Don't touch it
 	}
-	else if (m_pSDKPlayer->m_Shared.IsManteling() || m_bFlipping)
+	else if (inputs.m_bManteling || m_bFlipping)
 	{
-		Vector vecWallNormal = m_pSDKPlayer->m_Shared.GetMantelWallNormal();
+		const Vector &vecWallNormal = inputs.m_vecMantelWallNormal;
 		m_PoseParameterData.m_flEstimateYaw = ( atan2( -vecWallNormal.y, -vecWallNormal.x ) * 180.0f / M_PI );
 	}
 	else if ( vecEstVelocity.x == 0.0f && vecEstVelocity.y == 0.0f )
 	{
-		float flYawDelta = angles[YAW] - m_PoseParameterData.m_flEstimateYaw;
+		float flYawDelta = inputs.m_flLocalYaw - m_PoseParameterData.m_flEstimateYaw;
 		flYawDelta = AngleNormalize( flYawDelta );
 
 		if ( flDeltaTime < 0.25f )
@@ -614,7 +730,7 @@ void CSDKPlayerAnimState::EstimateYaw( void )
 		m_PoseParameterData.m_flEstimateYaw += flYawDelta;
 		m_PoseParameterData.m_flEstimateYaw = AngleNormalize( m_PoseParameterData.m_flEstimateYaw );
 	}
-	else if (m_pSDKPlayer->m_Shared.IsAimedIn() || m_pSDKPlayer->m_Shared.IsDiving() || m_pSDKPlayer->m_Shared.IsRolling() || m_pSDKPlayer->m_Shared.IsSliding())
+	else if (inputs.m_bAimedIn || inputs.m_bDiving || inputs.m_bRolling || inputs.m_bSliding)
 	{
 		m_PoseParameterData.m_flEstimateYaw = ( atan2( vecEstVelocity.y, vecEstVelocity.x ) * 180.0f / M_PI );
 		m_PoseParameterData.m_flEstimateYaw = clamp( m_PoseParameterData.m_flEstimateYaw, -180.0f, 180.0f );
@@ -674,6 +790,10 @@ void CSDKPlayerAnimState::ConvergeYawAnglesThroughZero( float flGoalYaw, float f
 //-----------------------------------------------------------------------------
 void CSDKPlayerAnimState::DoAnimationEvent( PlayerAnimEvent_t event, int nData )
 {
+#ifndef CLIENT_DLL
+	FinishPoseUpdate();
+#endif
+
 	Activity iGestureActivity = ACT_INVALID;
 
 	switch( event )
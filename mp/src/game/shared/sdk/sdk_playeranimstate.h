@@ -69,19 +69,75 @@ public:
 	bool	HandleSprinting( Activity &idealActivity );
 #endif
 
-	virtual void		ComputePoseParam_AimPitch( CStudioHdr *pStudioHdr );
-	virtual void		ComputePoseParam_AimYaw( CStudioHdr *pStudioHdr );
-	virtual void		ComputePoseParam_MoveYaw( CStudioHdr *pStudioHdr );
-	virtual void		ComputePoseParam_StuntYaw( CStudioHdr *pStudioHdr );
-
-	virtual void		EstimateYaw( void );
 	void                ConvergeYawAnglesThroughZero( float flGoalYaw, float flYawRate, float flDeltaTime, float &flCurrentYaw );
 
 	virtual Activity CalcMainActivity();	
 
 	virtual bool        ShouldUseAimInAnims();
 
+#ifndef CLIENT_DLL
+	// Apply a pose update that was queued for the job pool, see da_animstate_parallel.
+	void                FinishPoseUpdate();
+	static void         FinishAllPoseUpdates();
+#endif
+
 private:
+	// What the pose parameters are computed from besides this state, captured by Update so the
+	// computation doesn't touch the player and can run on another thread.
+	struct PoseInputs_t
+	{
+		float   m_flFrameTime;
+		float   m_flDeltaTime;		// Frame time scaled by slow motion.
+		float   m_flCurrentTime;
+
+		Vector  m_vecVelocity;
+		Vector  m_vecForward;
+		float   m_flLocalYaw;
+		Vector  m_vecMantelWallNormal;
+
+		float   m_flPlaybackRate;
+		bool    m_bMoving;
+
+		bool    m_bSliding;
+		bool    m_bDiveSliding;
+		bool    m_bSuperFalling;
+		bool    m_bOnGround;
+		bool    m_bDiving;
+		bool    m_bRolling;
+		bool    m_bProne;
+		bool    m_bManteling;
+		bool    m_bAimedIn;
+		bool    m_bThirdPerson;
+	};
+
+	struct PoseOutputs_t
+	{
+		Vector2D m_vecMoveYaw;
+		float   m_flStuntYaw;
+		float   m_flAimPitch;
+		bool    m_bAimYaw;			// Manteling leaves the aim yaw where it was.
+		float   m_flAimYaw;
+		float   m_flAbsYaw;
+	};
+
+	void    GatherPoseInputs( PoseInputs_t &inputs );
+	void    ComputePoseParameters( const PoseInputs_t &inputs, PoseOutputs_t &outputs );
+	void    CommitPoseParameters( CStudioHdr *pStudioHdr, const PoseOutputs_t &outputs );
+
+	void    ComputePoseParam_AimPitch( const PoseInputs_t &inputs, PoseOutputs_t &outputs );
+	void    ComputePoseParam_AimYaw( const PoseInputs_t &inputs, PoseOutputs_t &outputs );
+	void    ComputePoseParam_MoveYaw( const PoseInputs_t &inputs, PoseOutputs_t &outputs );
+	void    ComputePoseParam_StuntYaw( const PoseInputs_t &inputs, PoseOutputs_t &outputs );
+	void    EstimateYaw( const PoseInputs_t &inputs );
+
+#ifndef CLIENT_DLL
+	static void ComputePendingPose( CSDKPlayerAnimState *&pState );
+
+	bool          m_bPosePending;
+	PoseInputs_t  m_PendingInputs;
+	PoseOutputs_t m_PendingOutputs;
+#endif
+
 	
 	CSDKPlayer   *m_pSDKPlayer;
 	bool		m_bInAirWalk;
@@ -7,15 +7,45 @@
 #include "cbase.h"
 #include <KeyValues.h>
 #include "sdk_weapon_parse.h"
+#include "filesystem.h"
+#include "tier0/fasttimer.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+ConVar da_weapon_scripts_autoreload("da_weapon_scripts_autoreload", "0", FCVAR_CHEAT, "Re-read weapon scripts when they change on disk.");
+
+// Filled by CSDKWeaponInfo::Parse. The infos live in the weapon info database, which is never
+// emptied, and reloads parse over the top of them, so the pointers stay good.
+static CSDKWeaponInfo* s_apWeaponInfo[WEAPON_MAX];
+static SDKWeaponStats_t s_aWeaponStats[WEAPON_MAX];
+static long s_alWeaponScriptTimes[WEAPON_MAX];
+
+// For weapons that haven't been parsed. Same as an unknown weapon type.
+static SDKWeaponStats_t s_oDefaultWeaponStats = { 42, 1, 0.15f, 0.55f, 1500, 500, 15, WT_NONE };
+
 FileWeaponInfo_t* CreateWeaponInfo()
 {
 	return new CSDKWeaponInfo;
 }
 
+static SDKWeaponID ScriptNameToWeaponID( const char* pszScriptName )
+{
+	if (Q_strncmp(pszScriptName, "weapon_", 7) != 0)
+		return WEAPON_NONE;
+
+	return AliasToWeaponID(pszScriptName + 7);
+}
+
+static long GetWeaponScriptTime( const char* pszScriptName )
+{
+	char szFile[MAX_PATH];
+	Q_snprintf( szFile, sizeof( szFile ), "scripts/%s.txt", pszScriptName );
+
+	// ReadEncryptedKVFile reads from MOD when there's an encryption key.
+	return filesystem->GetFileTime( szFile, "MOD" );
+}
+
 
 CSDKWeaponInfo::CSDKWeaponInfo()
 {
@@ -69,13 +99,72 @@ void CSDKWeaponInfo::Parse( KeyValues *pKeyValuesData, const char *szWeaponName
 
 	Q_strncpy(m_szAkimbo, pKeyValuesData->GetString("akimbo", ""), sizeof(m_szAkimbo));
 	Q_strncpy(m_szSingle, pKeyValuesData->GetString("single", ""), sizeof(m_szSingle));
+
+	// Power formula works like so:
+	// pow( RangeModifier, distance/MaxRange )
+	// The damage will be at 1 when the distance is 0 units, and at RangeModifier
+	// when the distance is MaxRange units, with a gradual decay approaching zero
+	float flRangeModifier, flMaxRange, flFalloffStart, flPenetration;
+	switch (m_eWeaponType)
+	{
+	case WT_RIFLE:
+		flRangeModifier = 0.75f;
+		flMaxRange = 3000;
+		flFalloffStart = 500;
+		flPenetration = 25;
+		break;
+
+	case WT_SHOTGUN:
+		flRangeModifier = 0.40f;
+		flMaxRange = 500;
+		flFalloffStart = 350;
+		flPenetration = 5;
+		break;
+
+	case WT_SMG:
+		flRangeModifier = 0.50f;
+		flMaxRange = 1000;
+		flFalloffStart = 500;
+		flPenetration = 15;
+		break;
+
+	case WT_PISTOL:
+	default:
+		flRangeModifier = s_oDefaultWeaponStats.m_flRangeModifier;
+		flMaxRange = s_oDefaultWeaponStats.m_flMaxRange;
+		flFalloffStart = s_oDefaultWeaponStats.m_flFalloffStart;
+		flPenetration = s_oDefaultWeaponStats.m_flPenetration;
+		break;
+	}
+
+	m_flRangeModifier	= pKeyValuesData->GetFloat( "RangeModifier", flRangeModifier );
+	m_flMaxRange		= max( pKeyValuesData->GetFloat( "MaxRange", flMaxRange ), 1.0f );
+	m_flFalloffStart	= pKeyValuesData->GetFloat( "FalloffStart", flFalloffStart );
+	m_flPenetration		= pKeyValuesData->GetFloat( "Penetration", flPenetration );
+
+	SDKWeaponID eWeapon = ScriptNameToWeaponID( szWeaponName );
+	if (eWeapon <= WEAPON_NONE || eWeapon >= WEAPON_MAX)
+		return;
+
+	s_apWeaponInfo[eWeapon] = this;
+	s_alWeaponScriptTimes[eWeapon] = GetWeaponScriptTime( szWeaponName );
+
+	SDKWeaponStats_t& oStats = s_aWeaponStats[eWeapon];
+	oStats.m_iDamage         = m_iDamage;
+	oStats.m_iBullets        = m_iBullets;
+	oStats.m_flCycleTime     = m_flCycleTime;
+	oStats.m_flRangeModifier = m_flRangeModifier;
+	oStats.m_flMaxRange      = m_flMaxRange;
+	oStats.m_flFalloffStart  = m_flFalloffStart;
+	oStats.m_flPenetration   = m_flPenetration;
+	oStats.m_eWeaponType     = m_eWeaponType;
 }
 
-CSDKWeaponInfo* CSDKWeaponInfo::GetWeaponInfo(SDKWeaponID eWeapon)
+// The old way, by name. Still used for weapons that haven't been parsed yet.
+static CSDKWeaponInfo* LookupWeaponInfoByName(SDKWeaponID eWeapon)
 {
 	const char* pszAlias = WeaponIDToAlias( eWeapon );
 
-	Assert(pszAlias);
 	if (!pszAlias)
 		return NULL;
 
@@ -84,14 +173,180 @@ CSDKWeaponInfo* CSDKWeaponInfo::GetWeaponInfo(SDKWeaponID eWeapon)
 
 	WEAPON_FILE_INFO_HANDLE hWeaponFile = LookupWeaponInfoSlot( szName );
 	if (hWeaponFile == GetInvalidWeaponInfoHandle())
-	{
-		Assert(hWeaponFile != GetInvalidWeaponInfoHandle());
 		return NULL;
-	}
 
 	return static_cast< CSDKWeaponInfo* >( GetFileWeaponInfoFromHandle( hWeaponFile ) );
 }
 
+CSDKWeaponInfo* CSDKWeaponInfo::GetWeaponInfo(SDKWeaponID eWeapon)
+{
+	Assert(eWeapon >= 0 && eWeapon < WEAPON_MAX);
+	if (eWeapon < 0 || eWeapon >= WEAPON_MAX)
+		return NULL;
+
+	if (s_apWeaponInfo[eWeapon])
+		return s_apWeaponInfo[eWeapon];
+
+	CSDKWeaponInfo* pInfo = LookupWeaponInfoByName(eWeapon);
+	Assert(pInfo);
+	return pInfo;
+}
+
+const SDKWeaponStats_t& CSDKWeaponInfo::GetWeaponStats(SDKWeaponID eWeapon)
+{
+	if (eWeapon <= WEAPON_NONE || eWeapon >= WEAPON_MAX || !s_apWeaponInfo[eWeapon])
+		return s_oDefaultWeaponStats;
+
+	return s_aWeaponStats[eWeapon];
+}
+
+void CSDKWeaponInfo::ReloadChangedScripts(bool bForce)
+{
+	for (int i = WEAPON_NONE+1; i < WEAPON_MAX; i++)
+	{
+		// Never loaded, so nothing is using it yet.
+		CSDKWeaponInfo* pInfo = s_apWeaponInfo[i];
+		if (!pInfo)
+			continue;
+
+		long lScriptTime = GetWeaponScriptTime( pInfo->szClassName );
+		if (!bForce && lScriptTime == s_alWeaponScriptTimes[i])
+			continue;
+
+		// Parse over the top of the existing info, weapons hold on to its handle.
+		pInfo->bParsedScript = false;
+
+		WEAPON_FILE_INFO_HANDLE hWeaponFile;
+		if (ReadWeaponDataFromFileForSlot( filesystem, pInfo->szClassName, &hWeaponFile, g_pGameRules?g_pGameRules->GetEncryptionKey():NULL ))
+			DevMsg("Reloaded weapon script %s\n", pInfo->szClassName);
+		else
+		{
+			// Keep the old values and don't try again until the file changes.
+			Warning("Couldn't reload weapon script %s\n", pInfo->szClassName);
+			pInfo->bParsedScript = true;
+			s_alWeaponScriptTimes[i] = lScriptTime;
+		}
+	}
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND(cl_reload_weapon_scripts, "Re-read the client's weapon scripts.")
+#else
+CON_COMMAND(sv_reload_weapon_scripts, "Re-read the server's weapon scripts.")
+#endif
+{
+#ifndef CLIENT_DLL
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+#endif
+
+	CSDKWeaponInfo::ReloadChangedScripts(true);
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND(cl_weaponinfo_benchmark, "Time weapon info lookups by name and through the weapon ID table.")
+#else
+CON_COMMAND(sv_weaponinfo_benchmark, "Time weapon info lookups by name and through the weapon ID table.")
+#endif
+{
+#ifndef CLIENT_DLL
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+#endif
+
+	int iPasses = 10000;
+	if (args.ArgC() > 1)
+		iPasses = max(atoi(args[1]), 1);
+
+	int iLookups = iPasses * (WEAPON_MAX-1);
+
+	// Sum something out of each lookup so the loops can't be thrown away.
+	int iCheck = 0;
+
+	CFastTimer oTimer;
+	oTimer.Start();
+	for (int i = 0; i < iPasses; i++)
+	{
+		for (int j = WEAPON_NONE+1; j < WEAPON_MAX; j++)
+		{
+			CSDKWeaponInfo* pInfo = LookupWeaponInfoByName((SDKWeaponID)j);
+			if (pInfo)
+				iCheck += pInfo->m_iDamage;
+		}
+	}
+	oTimer.End();
+	float flByName = oTimer.GetDuration().GetSeconds();
+
+	oTimer.Start();
+	for (int i = 0; i < iPasses; i++)
+	{
+		for (int j = WEAPON_NONE+1; j < WEAPON_MAX; j++)
+		{
+			CSDKWeaponInfo* pInfo = CSDKWeaponInfo::GetWeaponInfo((SDKWeaponID)j);
+			if (pInfo)
+				iCheck += pInfo->m_iDamage;
+		}
+	}
+	oTimer.End();
+	float flTable = oTimer.GetDuration().GetSeconds();
+
+	oTimer.Start();
+	for (int i = 0; i < iPasses; i++)
+	{
+		for (int j = WEAPON_NONE+1; j < WEAPON_MAX; j++)
+			iCheck += CSDKWeaponInfo::GetWeaponStats((SDKWeaponID)j).m_iDamage;
+	}
+	oTimer.End();
+	float flStats = oTimer.GetDuration().GetSeconds();
+
+	Msg("%d lookups each (%d)\n", iLookups, iCheck);
+	Msg("  by name:      %.3fms, %.0f lookups/sec\n", flByName*1000, flByName>0?iLookups/flByName:0.0f);
+	Msg("  info table:   %.3fms, %.0f lookups/sec\n", flTable*1000, flTable>0?iLookups/flTable:0.0f);
+	Msg("  stats table:  %.3fms, %.0f lookups/sec\n", flStats*1000, flStats>0?iLookups/flStats:0.0f);
+}
+
+class CWeaponScriptWatcher : public CAutoGameSystemPerFrame
+{
+public:
+	CWeaponScriptWatcher( char const* name )
+		: CAutoGameSystemPerFrame(name)
+	{
+		m_flNextCheck = 0;
+	}
+
+#ifdef CLIENT_DLL
+	virtual void Update( float frametime )
+	{
+		CheckScripts();
+	}
+#else
+	virtual void FrameUpdatePreEntityThink()
+	{
+		CheckScripts();
+	}
+#endif
+
+private:
+	void CheckScripts()
+	{
+		if (!da_weapon_scripts_autoreload.GetBool())
+			return;
+
+		// Stat'ing every script every frame is too much, once a second is plenty for editing.
+		float flTime = Plat_FloatTime();
+		if (flTime < m_flNextCheck)
+			return;
+
+		m_flNextCheck = flTime + 1;
+
+		CSDKWeaponInfo::ReloadChangedScripts(false);
+	}
+
+	float m_flNextCheck;
+};
+
+CWeaponScriptWatcher g_WeaponScriptWatcher( "CWeaponScriptWatcher" );
+
 static char* g_szWeaponTypes[] =
 {
 	"none",
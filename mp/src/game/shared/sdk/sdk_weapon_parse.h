@@ -15,6 +15,20 @@
 #include "networkvar.h"
 #include "sdk_shareddefs.h"
 
+//--------------------------------------------------------------------------------------------------------
+// The fields the bullet code reads for every shot, packed into one cache line per weapon.
+struct ALIGN32 SDKWeaponStats_t
+{
+	int		m_iDamage;
+	int		m_iBullets;
+	float	m_flCycleTime;
+	float	m_flRangeModifier;		// Damage multiplier once the bullet has gone m_flMaxRange past m_flFalloffStart
+	float	m_flMaxRange;
+	float	m_flFalloffStart;		// Distance before damage starts falling off
+	float	m_flPenetration;		// How far the bullet can go through a solid
+	weapontype_t	m_eWeaponType;
+} ALIGN32_POST;
+
 //--------------------------------------------------------------------------------------------------------
 class CSDKWeaponInfo : public FileWeaponInfo_t
 {
@@ -54,7 +68,18 @@ public:
 
 	weapontype_t	m_eWeaponType;
 
+	float	m_flRangeModifier;
+	float	m_flMaxRange;
+	float	m_flFalloffStart;
+	float	m_flPenetration;
+
+	// Both of these are filled when the script is parsed, so they don't cost a string lookup.
 	static CSDKWeaponInfo* GetWeaponInfo(SDKWeaponID eWeapon);
+	static const SDKWeaponStats_t& GetWeaponStats(SDKWeaponID eWeapon);
+
+	// Re-parses any weapon script that changed on disk since it was last read, or all of them if bForce.
+	static void            ReloadChangedScripts(bool bForce);
+
 	static weapontype_t    StringToWeaponType( const char* szString );
 	static const char*     WeaponTypeToString( weapontype_t eWeapon );
 };
@@ -193,6 +193,45 @@ protected:
 };
 
 
+#define MAX_BVH_DEPTH 64									// nodes this deep are made into leaves
+#define MAX_BVH_STACK_LEN MAX_BVH_DEPTH
+
+// BVH node, 32 bytes. Interior nodes keep their two children next to each other, like the kd
+// tree does, and the axis the triangles were split on so rays can visit the nearer child first.
+struct CacheOptimizedBVHNode
+{
+	float m_flMins[3];
+	int32 m_nChild;											// left child, or for leaves the first
+															// entry in TriangleIndexList
+	float m_flMaxs[3];
+	int32 m_nTypeAndCount;									// KDNODE_STATE_xxx in the low 2 bits,
+															// and for leaves the triangle count
+
+	inline int NodeType(void) const
+	{
+		return m_nTypeAndCount & 3;
+	}
+
+	inline int LeftChild(void) const
+	{
+		assert(NodeType()!=KDNODE_STATE_LEAF);
+		return m_nChild;
+	}
+
+	inline int32 TriangleIndexStart(void) const
+	{
+		assert(NodeType()==KDNODE_STATE_LEAF);
+		return m_nChild;
+	}
+
+	inline int NumberOfTrianglesInLeaf(void) const
+	{
+		assert(NodeType()==KDNODE_STATE_LEAF);
+		return m_nTypeAndCount>>2;
+	}
+};
+
+
 struct RayTracingSingleResult
 {
 	Vector surface_normal;									// surface normal at intersection
@@ -220,6 +259,7 @@ public:
 #define RTE_FLAGS_FAST_TREE_GENERATION 1
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_COLORS 2				// saves memory if not needed
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_MATERIALS 4
+#define RTE_FLAGS_USE_BVH 8									// build a bvh instead of a kd tree
 
 enum RayTraceLightingMode_t {
 	DIRECT_LIGHTING,										// just dot product lighting
@@ -262,6 +302,8 @@ public:
 
 	FourVectors BackgroundColor;							//< color where no intersection
 	CUtlVector<CacheOptimizedKDNode> OptimizedKDTree;		//< the packed kdtree. root is 0
+	CUtlVector<CacheOptimizedBVHNode> OptimizedBVH;			//< the bvh, with RTE_FLAGS_USE_BVH. root is 0
+	int m_nBuildThreads;									//< threads building the bvh, 0 for one per cpu
 	CUtlBlockVector<CacheOptimizedTriangle> OptimizedTriangleList; //< the packed triangles
 	CUtlVector<int32> TriangleIndexList;					//< the list of triangle indices.
 	CUtlVector<LightDesc_t> LightList;						//< the list of lights
@@ -273,6 +315,7 @@ public:
 	{
 		BackgroundColor.DuplicateVector(Vector(1,0,0));		// red
 		Flags=0;
+		m_nBuildThreads=0;
 	}
 
 
@@ -297,6 +340,10 @@ public:
 	// SetupAccelerationStructure to prepare for tracing
 	void SetupAccelerationStructure(void);
 
+	// builds OptimizedBVH with binned SAH splits, over m_nBuildThreads threads. called by
+	// SetupAccelerationStructure when RTE_FLAGS_USE_BVH is set.
+	void BuildBVH(void);
+
 
 	// lowest level intersection routine - fire 4 rays through the scene. all 4 rays must pass the
 	// Check() function, and t extents must be initialized. skipid can be set to exclude a
@@ -305,11 +352,27 @@ public:
 					RayTracingResult *rslt_out,
 					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
 
+	// Trace4Rays for the bvh
+	void Trace4RaysBVH(const FourRays &rays, fltx4 TMin, fltx4 TMax,int DirectionSignMask,
+					   RayTracingResult *rslt_out,
+					   int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
+
 	// higher level intersection routine that handles computing the mask and handling rays which do not match in direciton sign
 	void Trace4Rays(const FourRays &rays, fltx4 TMin, fltx4 TMax,
 					RayTracingResult *rslt_out,
 					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
 
+	// trace 2 sets of 4 rays, each with its own t extents and results. When the cpu has AVX and
+	// both sets have the same direction signs they go through the tree as one 8 wide packet,
+	// otherwise this is two calls to Trace4Rays. The results are the same either way. There's
+	// no transparent triangle callback, rays that need one have to use Trace4Rays.
+	void Trace8Rays(const FourRays *pRays, const fltx4 *pTMin, const fltx4 *pTMax,
+					RayTracingResult *pRsltOut, int32 skip_id=-1);
+
+	// whether Trace8Rays can use the 8 wide tracer. it's on by default when the cpu supports it.
+	static bool Is8WideTracerEnabled( void );
+	static void Set8WideTracerEnabled( bool bEnabled );
+
 	// compute virtual light sources to model inter-reflection
 	void ComputeVirtualLightSources(void);
 
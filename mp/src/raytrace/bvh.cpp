@@ -0,0 +1,335 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Binned SAH bvh builder for RayTracingEnvironment.
+//
+//			The top of the tree is split on the calling thread until there's
+//			a few subtrees for every build thread, then the threads take
+//			subtrees until they run out, each into its own node list. The
+//			lists are copied in after the top of the tree in the order the
+//			subtrees were found, so the tree doesn't depend on how many
+//			threads built it.
+//
+//=============================================================================//
+
+#include "raytrace.h"
+#include "tier0/threadtools.h"
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF_TRIS 16						// split bigger leaves even if SAH says not to
+#define BVH_SUBTREES_PER_THREAD 8
+
+// same as the kd tree
+#define COST_OF_TRAVERSAL 75
+#define COST_OF_INTERSECTION 167
+
+struct BVHBuildTri_t
+{
+	Vector m_Mins;
+	Vector m_Maxs;
+	Vector m_Center;
+};
+
+struct BVHSubtree_t
+{
+	int m_nNode;									// placeholder node in the top of the tree
+	int m_nFirstTri;
+	int m_nTris;
+	int m_nDepth;
+	CUtlVector<CacheOptimizedBVHNode> m_Nodes;		// root is 0
+};
+
+struct BVHBuildContext_t
+{
+	BVHBuildTri_t const *m_pTris;
+	int32 *m_pIndices;
+	CUtlVector<BVHSubtree_t> *m_pSubtrees;
+	CInterlockedInt m_nNextSubtree;
+};
+
+
+static float BoundsSurfaceArea( Vector const &mins, Vector const &maxs )
+{
+	Vector dim = maxs - mins;
+	return 2.0f * ( dim.x * dim.y + dim.x * dim.z + dim.y * dim.z );
+}
+
+static FORCEINLINE int CenterBin( float flCenter, float flMin, float flScale )
+{
+	int nBin = (int)( ( flCenter - flMin ) * flScale );
+	return clamp( nBin, 0, BVH_BINS - 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Fills in node iNode for pIndices[nFirst] to pIndices[nFirst+nTris-1], splitting it and its
+// children until they're leaves. With pSubtrees, ranges of nSubtreeTris or fewer are left for
+// later and added to pSubtrees instead.
+//-----------------------------------------------------------------------------
+static void BuildBVHNode( BVHBuildTri_t const *pTris, int32 *pIndices,
+						  CUtlVector<CacheOptimizedBVHNode> &nodes, int iNode,
+						  int nFirst, int nTris, int nDepth,
+						  CUtlVector<BVHSubtree_t> *pSubtrees, int nSubtreeTris )
+{
+	int32 *pList = pIndices + nFirst;
+
+	Vector mins( 1.0e23, 1.0e23, 1.0e23 ), maxs( -1.0e23, -1.0e23, -1.0e23 );
+	Vector centerMins = mins, centerMaxs = maxs;
+	for ( int i = 0; i < nTris; i++ )
+	{
+		BVHBuildTri_t const &tri = pTris[pList[i]];
+		VectorMin( mins, tri.m_Mins, mins );
+		VectorMax( maxs, tri.m_Maxs, maxs );
+		VectorMin( centerMins, tri.m_Center, centerMins );
+		VectorMax( centerMaxs, tri.m_Center, centerMaxs );
+	}
+
+	CacheOptimizedBVHNode &node = nodes[iNode];
+	for ( int c = 0; c < 3; c++ )
+	{
+		node.m_flMins[c] = mins[c];
+		node.m_flMaxs[c] = maxs[c];
+	}
+
+	if ( pSubtrees && nTris <= nSubtreeTris )
+	{
+		int iSubtree = pSubtrees->AddToTail();
+		BVHSubtree_t &subtree = (*pSubtrees)[iSubtree];
+		subtree.m_nNode = iNode;
+		subtree.m_nFirstTri = nFirst;
+		subtree.m_nTris = nTris;
+		subtree.m_nDepth = nDepth;
+		return;
+	}
+
+	// find the cheapest split between bins on any axis
+	float flBestCost = 1.0e30f;
+	int nBestAxis = -1;
+	int nBestBin = 0;
+	float flBestScale = 0;
+	if ( nTris > 2 && nDepth < MAX_BVH_DEPTH )
+	{
+		float flOneOverArea = 1.0f / MAX( BoundsSurfaceArea( mins, maxs ), 1.0e-10f );
+		for ( int c = 0; c < 3; c++ )
+		{
+			float flExtent = centerMaxs[c] - centerMins[c];
+			if ( flExtent <= 0 )
+				continue;
+			float flScale = BVH_BINS / flExtent;
+
+			int nBinTris[BVH_BINS];
+			Vector binMins[BVH_BINS], binMaxs[BVH_BINS];
+			for ( int b = 0; b < BVH_BINS; b++ )
+			{
+				nBinTris[b] = 0;
+				binMins[b].Init( 1.0e23, 1.0e23, 1.0e23 );
+				binMaxs[b].Init( -1.0e23, -1.0e23, -1.0e23 );
+			}
+			for ( int i = 0; i < nTris; i++ )
+			{
+				BVHBuildTri_t const &tri = pTris[pList[i]];
+				int b = CenterBin( tri.m_Center[c], centerMins[c], flScale );
+				nBinTris[b]++;
+				VectorMin( binMins[b], tri.m_Mins, binMins[b] );
+				VectorMax( binMaxs[b], tri.m_Maxs, binMaxs[b] );
+			}
+
+			// sweep from the right to get the cost of everything right of each split, then from
+			// the left to add the other side
+			float flRightCost[BVH_BINS];
+			Vector sweepMins = binMins[BVH_BINS - 1], sweepMaxs = binMaxs[BVH_BINS - 1];
+			int nSweepTris = nBinTris[BVH_BINS - 1];
+			for ( int b = BVH_BINS - 2; b >= 0; b-- )
+			{
+				flRightCost[b] = nSweepTris ? nSweepTris * BoundsSurfaceArea( sweepMins, sweepMaxs ) : 0;
+				VectorMin( sweepMins, binMins[b], sweepMins );
+				VectorMax( sweepMaxs, binMaxs[b], sweepMaxs );
+				nSweepTris += nBinTris[b];
+			}
+
+			sweepMins.Init( 1.0e23, 1.0e23, 1.0e23 );
+			sweepMaxs.Init( -1.0e23, -1.0e23, -1.0e23 );
+			nSweepTris = 0;
+			for ( int b = 0; b < BVH_BINS - 1; b++ )
+			{
+				VectorMin( sweepMins, binMins[b], sweepMins );
+				VectorMax( sweepMaxs, binMaxs[b], sweepMaxs );
+				nSweepTris += nBinTris[b];
+				if ( nSweepTris == 0 || nSweepTris == nTris )
+					continue;
+
+				float flCost = COST_OF_TRAVERSAL + COST_OF_INTERSECTION * flOneOverArea *
+					( nSweepTris * BoundsSurfaceArea( sweepMins, sweepMaxs ) + flRightCost[b] );
+				if ( flCost < flBestCost )
+				{
+					flBestCost = flCost;
+					nBestAxis = c;
+					nBestBin = b;
+					flBestScale = flScale;
+				}
+			}
+		}
+	}
+
+	bool bLeaf;
+	if ( nDepth >= MAX_BVH_DEPTH || nTris <= 2 )
+		bLeaf = true;
+	else if ( nTris > BVH_MAX_LEAF_TRIS )
+		bLeaf = false;
+	else
+		bLeaf = ( nBestAxis < 0 ) || ( flBestCost >= COST_OF_INTERSECTION * nTris );
+
+	if ( bLeaf )
+	{
+		node.m_nChild = nFirst;
+		node.m_nTypeAndCount = KDNODE_STATE_LEAF + ( nTris << 2 );
+		return;
+	}
+
+	int nLeft;
+	if ( nBestAxis >= 0 )
+	{
+		// partition in place, the left side is everything in nBestBin or below
+		int i = 0, j = nTris - 1;
+		while ( i <= j )
+		{
+			if ( CenterBin( pTris[pList[i]].m_Center[nBestAxis], centerMins[nBestAxis], flBestScale ) <= nBestBin )
+			{
+				i++;
+			}
+			else
+			{
+				V_swap( pList[i], pList[j] );
+				j--;
+			}
+		}
+		nLeft = i;
+	}
+	else
+	{
+		// every center is in the same place, so any split is as good as another
+		nBestAxis = 0;
+		nLeft = nTris / 2;
+	}
+
+	if ( nLeft == 0 || nLeft == nTris )
+		nLeft = nTris / 2;
+
+	// node isn't valid once nodes grows
+	int iLeft = nodes.AddMultipleToTail( 2 );
+	nodes[iNode].m_nChild = iLeft;
+	nodes[iNode].m_nTypeAndCount = nBestAxis;
+
+	BuildBVHNode( pTris, pIndices, nodes, iLeft, nFirst, nLeft, nDepth + 1, pSubtrees, nSubtreeTris );
+	BuildBVHNode( pTris, pIndices, nodes, iLeft + 1, nFirst + nLeft, nTris - nLeft, nDepth + 1,
+				  pSubtrees, nSubtreeTris );
+}
+
+static unsigned BuildBVHSubtreesThread( void *pParam )
+{
+	BVHBuildContext_t *pContext = (BVHBuildContext_t *)pParam;
+	CUtlVector<BVHSubtree_t> &subtrees = *pContext->m_pSubtrees;
+
+	while ( 1 )
+	{
+		int iSubtree = pContext->m_nNextSubtree++;
+		if ( iSubtree >= subtrees.Count() )
+			break;
+
+		BVHSubtree_t &subtree = subtrees[iSubtree];
+		subtree.m_Nodes.EnsureCapacity( 2 * subtree.m_nTris );
+		subtree.m_Nodes.AddToTail();
+		BuildBVHNode( pContext->m_pTris, pContext->m_pIndices, subtree.m_Nodes, 0,
+					  subtree.m_nFirstTri, subtree.m_nTris, subtree.m_nDepth, NULL, 0 );
+	}
+	return 0;
+}
+
+
+void RayTracingEnvironment::BuildBVH(void)
+{
+	int ntris = OptimizedTriangleList.Count();
+
+	OptimizedBVH.RemoveAll();
+	TriangleIndexList.SetCount( ntris );
+
+	// leaves point into TriangleIndexList, which gets put in order as the tree is built
+	BVHBuildTri_t *pTris = new BVHBuildTri_t[ntris];
+	for ( int t = 0; t < ntris; t++ )
+	{
+		BVHBuildTri_t &tri = pTris[t];
+		tri.m_Mins = tri.m_Maxs = OptimizedTriangleList[t].Vertex( 0 );
+		for ( int v = 1; v < 3; v++ )
+		{
+			VectorMin( tri.m_Mins, OptimizedTriangleList[t].Vertex( v ), tri.m_Mins );
+			VectorMax( tri.m_Maxs, OptimizedTriangleList[t].Vertex( v ), tri.m_Maxs );
+		}
+		tri.m_Center = 0.5f * ( tri.m_Mins + tri.m_Maxs );
+		TriangleIndexList[t] = t;
+	}
+
+	CalculateTriangleListBounds( TriangleIndexList.Base(), ntris, m_MinBound, m_MaxBound );
+
+	if ( !ntris )
+	{
+		delete[] pTris;
+		return;
+	}
+
+	int nThreads = m_nBuildThreads;
+	if ( nThreads <= 0 )
+		nThreads = GetCPUInformation()->m_nLogicalProcessors;
+	nThreads = clamp( nThreads, 1, 32 );
+
+	// about 2n nodes for n triangles in leaves of 1
+	OptimizedBVH.EnsureCapacity( 2 * ntris );
+	OptimizedBVH.AddToTail();
+
+	int nSubtreeTris = ntris / ( nThreads * BVH_SUBTREES_PER_THREAD );
+	if ( nThreads == 1 || nSubtreeTris < 1024 )
+	{
+		BuildBVHNode( pTris, TriangleIndexList.Base(), OptimizedBVH, 0, 0, ntris, 0, NULL, 0 );
+		delete[] pTris;
+		return;
+	}
+
+	CUtlVector<BVHSubtree_t> subtrees;
+	BuildBVHNode( pTris, TriangleIndexList.Base(), OptimizedBVH, 0, 0, ntris, 0, &subtrees, nSubtreeTris );
+
+	BVHBuildContext_t context;
+	context.m_pTris = pTris;
+	context.m_pIndices = TriangleIndexList.Base();
+	context.m_pSubtrees = &subtrees;
+	context.m_nNextSubtree = 0;
+
+	// the calling thread builds subtrees too
+	ThreadHandle_t hThreads[32];
+	int nStarted = MIN( nThreads, subtrees.Count() ) - 1;
+	for ( int i = 0; i < nStarted; i++ )
+		hThreads[i] = CreateSimpleThread( BuildBVHSubtreesThread, &context );
+	BuildBVHSubtreesThread( &context );
+	for ( int i = 0; i < nStarted; i++ )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+	}
+
+	// the subtree roots replace their placeholders, and the rest are appended with their
+	// children moved to match
+	for ( int s = 0; s < subtrees.Count(); s++ )
+	{
+		CUtlVector<CacheOptimizedBVHNode> &nodes = subtrees[s].m_Nodes;
+		int nOffset = OptimizedBVH.Count() - 1;
+		for ( int i = 0; i < nodes.Count(); i++ )
+		{
+			CacheOptimizedBVHNode node = nodes[i];
+			if ( node.NodeType() != KDNODE_STATE_LEAF )
+				node.m_nChild += nOffset;
+			if ( i == 0 )
+				OptimizedBVH[subtrees[s].m_nNode] = node;
+			else
+				OptimizedBVH.AddToTail( node );
+		}
+		nodes.Purge();
+	}
+
+	delete[] pTris;
+}
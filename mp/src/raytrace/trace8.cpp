@@ -0,0 +1,333 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: 8 wide ray packets. On cpus with AVX both groups of 4 rays go down
+//			the kd tree together, otherwise they're traced as two packets of 4.
+//
+//			The kernel does the same math per ray as Trace4Rays, in the same
+//			order, and the reciprocal directions come from the same 4 wide code,
+//			so a ray gets the same hit from either one.
+//
+//=============================================================================//
+
+#include "raytrace.h"
+
+#if defined( _MSC_VER ) && ( _MSC_VER >= 1600 ) && !defined( _X360 )
+#define RAYTRACE_AVX 1
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// same as raytrace.cpp
+#define MAILBOX_HASH_SIZE 256
+#define MAX_TREE_DEPTH 21
+#define MAX_NODE_STACK_LEN (40*MAX_TREE_DEPTH)
+
+extern int n_intersection_calculations;
+
+// -1 until the cpu has been checked
+static int s_n8WideTracer = -1;
+
+#ifdef RAYTRACE_AVX
+
+static bool CPUSupportsAVX( void )
+{
+	int info[4];
+	__cpuid( info, 1 );
+
+	// the cpu has to have AVX, and the OS has to be saving the ymm registers on context switches
+	if ( !( info[2] & ( 1 << 27 ) ) || !( info[2] & ( 1 << 28 ) ) )
+		return false;
+
+	return ( _xgetbv( 0 ) & 6 ) == 6;
+}
+
+// Everything the kernel needs, as plain floats so it only has to use VEX encoded loads and stores.
+// Mixing those with the legacy SSE code the rest of the tracer compiles to is slow on a lot of cpus.
+struct EightRays_t
+{
+	float m_Origin[3][8];
+	float m_Direction[3][8];
+	float m_OneOverDirection[3][8];
+	float m_TMin[8];
+	float m_TMax[8];
+};
+
+struct EightRaysResult_t
+{
+	int32 m_HitIds[8];
+	float m_HitDistance[8];
+	float m_SurfaceNormal[3][8];
+};
+
+struct NodeToVisit8 {
+	CacheOptimizedKDNode const *node;
+	__m256 TMin;
+	__m256 TMax;
+};
+
+static void Trace8RaysAVX( RayTracingEnvironment const &env, EightRays_t const &rays, int DirectionSignMask,
+						   EightRaysResult_t &rslt, int32 skip_id )
+{
+	__m256 Origin[3], Direction[3], OneOverRayDir[3];
+	for ( int c = 0; c < 3; c++ )
+	{
+		Origin[c] = _mm256_loadu_ps( rays.m_Origin[c] );
+		Direction[c] = _mm256_loadu_ps( rays.m_Direction[c] );
+		OneOverRayDir[c] = _mm256_loadu_ps( rays.m_OneOverDirection[c] );
+	}
+	__m256 TMin = _mm256_loadu_ps( rays.m_TMin );
+	__m256 TMax = _mm256_loadu_ps( rays.m_TMax );
+
+	const __m256 Zero = _mm256_setzero_ps();
+	const __m256 One = _mm256_set1_ps( 1.0f );
+	const __m256 EightEpsilons = _mm256_set1_ps( 1.0e-10f );
+	const __m256 EightNegativeEpsilons = _mm256_set1_ps( -1.0e-10f );
+	const __m256 EightZeros = EightEpsilons;				// Trace4Rays' FourZeros are really 1e-10
+
+	__m256 HitIds = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+	__m256 HitDistance = _mm256_set1_ps( 1.0e23f );
+	__m256 Normal[3] = { Zero, Zero, Zero };
+
+	// now, clip rays against bounding box
+	for ( int c = 0; c < 3; c++ )
+	{
+		__m256 isect_min_t = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( env.m_MinBound[c] ), Origin[c] ), OneOverRayDir[c] );
+		__m256 isect_max_t = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( env.m_MaxBound[c] ), Origin[c] ), OneOverRayDir[c] );
+		TMin = _mm256_max_ps( TMin, _mm256_min_ps( isect_min_t, isect_max_t ) );
+		TMax = _mm256_min_ps( TMax, _mm256_max_ps( isect_min_t, isect_max_t ) );
+	}
+
+	if ( _mm256_movemask_ps( _mm256_cmp_ps( TMin, TMax, _CMP_LE_OQ ) ) )
+	{
+		int32 mailboxids[MAILBOX_HASH_SIZE];				// used to avoid redundant triangle tests
+		memset( mailboxids, 0xff, sizeof( mailboxids ) );
+
+		int front_idx[3], back_idx[3];						// based on ray direction, whether to
+															// visit left or right node first
+		for ( int c = 0; c < 3; c++ )
+		{
+			back_idx[c] = ( DirectionSignMask & ( 1 << c ) ) ? 0 : 1;
+			front_idx[c] = 1 - back_idx[c];
+		}
+
+		NodeToVisit8 NodeQueue[MAX_NODE_STACK_LEN];
+		CacheOptimizedKDNode const *CurNode = &( env.OptimizedKDTree[0] );
+		NodeToVisit8 *stack_ptr = &NodeQueue[MAX_NODE_STACK_LEN];
+		while ( 1 )
+		{
+			while ( CurNode->NodeType() != KDNODE_STATE_LEAF )	// traverse until next leaf
+			{
+				int split_plane_number = CurNode->NodeType();
+				CacheOptimizedKDNode const *FrontChild = &( env.OptimizedKDTree[CurNode->LeftChild()] );
+
+				__m256 dist_to_sep_plane =					// dist=(split-org)/dir
+					_mm256_mul_ps(
+						_mm256_sub_ps( _mm256_broadcast_ss( &CurNode->SplittingPlaneValue ),
+									   Origin[split_plane_number] ), OneOverRayDir[split_plane_number] );
+				__m256 active = _mm256_cmp_ps( TMin, TMax, _CMP_LE_OQ );
+
+				__m256 hits_front = _mm256_and_ps( active, _mm256_cmp_ps( dist_to_sep_plane, TMin, _CMP_GE_OQ ) );
+				if ( !_mm256_movemask_ps( hits_front ) )
+				{
+					// missed the front. only traverse back
+					CurNode = FrontChild + back_idx[split_plane_number];
+					TMin = _mm256_max_ps( TMin, dist_to_sep_plane );
+				}
+				else
+				{
+					__m256 hits_back = _mm256_and_ps( active, _mm256_cmp_ps( dist_to_sep_plane, TMax, _CMP_LE_OQ ) );
+					if ( !_mm256_movemask_ps( hits_back ) )
+					{
+						// missed the back - only need to traverse front node
+						CurNode = FrontChild + front_idx[split_plane_number];
+						TMax = _mm256_min_ps( TMax, dist_to_sep_plane );
+					}
+					else
+					{
+						// at least some rays hit both nodes.
+						// must push far, traverse near
+						Assert( stack_ptr > NodeQueue );
+						--stack_ptr;
+						stack_ptr->node = FrontChild + back_idx[split_plane_number];
+						stack_ptr->TMin = _mm256_max_ps( TMin, dist_to_sep_plane );
+						stack_ptr->TMax = TMax;
+						CurNode = FrontChild + front_idx[split_plane_number];
+						TMax = _mm256_min_ps( TMax, dist_to_sep_plane );
+					}
+				}
+			}
+
+			// hit a leaf! must do intersection check
+			int ntris = CurNode->NumberOfTrianglesInLeaf();
+			if ( ntris )
+			{
+				int32 const *tlist = &( env.TriangleIndexList[CurNode->TriangleIndexStart()] );
+				do
+				{
+					int tnum = *( tlist++ );
+					// check mailbox
+					int mbox_slot = tnum & ( MAILBOX_HASH_SIZE - 1 );
+					TriIntersectData_t const *tri = &( env.OptimizedTriangleList[tnum].m_Data.m_IntersectData );
+					if ( ( mailboxids[mbox_slot] == tnum ) || ( tri->m_nTriangleID == skip_id ) )
+						continue;
+
+					n_intersection_calculations++;
+					mailboxids[mbox_slot] = tnum;
+
+					// compute plane intersection
+					__m256 Nx = _mm256_broadcast_ss( &tri->m_flNx );
+					__m256 Ny = _mm256_broadcast_ss( &tri->m_flNy );
+					__m256 Nz = _mm256_broadcast_ss( &tri->m_flNz );
+
+					__m256 DDotN = _mm256_mul_ps( Direction[0], Nx );
+					DDotN = _mm256_add_ps( _mm256_mul_ps( Direction[1], Ny ), DDotN );
+					DDotN = _mm256_add_ps( _mm256_mul_ps( Direction[2], Nz ), DDotN );
+
+					// mask off zero or near zero (ray parallel to surface)
+					__m256 did_hit = _mm256_or_ps( _mm256_cmp_ps( DDotN, EightEpsilons, _CMP_GT_OQ ),
+												   _mm256_cmp_ps( DDotN, EightNegativeEpsilons, _CMP_LT_OQ ) );
+
+					__m256 ODotN = _mm256_mul_ps( Origin[0], Nx );
+					ODotN = _mm256_add_ps( _mm256_mul_ps( Origin[1], Ny ), ODotN );
+					ODotN = _mm256_add_ps( _mm256_mul_ps( Origin[2], Nz ), ODotN );
+
+					__m256 numerator = _mm256_sub_ps( _mm256_broadcast_ss( &tri->m_flD ), ODotN );
+
+					__m256 isect_t = _mm256_div_ps( numerator, DDotN );
+					// now, we have the distance to the plane. lets update our mask
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( isect_t, EightZeros, _CMP_GT_OQ ) );
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( isect_t, HitDistance, _CMP_LT_OQ ) );
+
+					if ( !_mm256_movemask_ps( did_hit ) )
+						continue;
+
+					// now, check 3 edges
+					__m256 hitc1 = _mm256_add_ps( Origin[tri->m_nCoordSelect0],
+												  _mm256_mul_ps( isect_t, Direction[tri->m_nCoordSelect0] ) );
+					__m256 hitc2 = _mm256_add_ps( Origin[tri->m_nCoordSelect1],
+												  _mm256_mul_ps( isect_t, Direction[tri->m_nCoordSelect1] ) );
+
+					// do barycentric coordinate check
+					__m256 B0 = _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[0] ), hitc1 );
+					B0 = _mm256_add_ps( B0, _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[1] ), hitc2 ) );
+					B0 = _mm256_add_ps( B0, _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[2] ) );
+
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B0, EightZeros, _CMP_GE_OQ ) );
+
+					__m256 B1 = _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[3] ), hitc1 );
+					B1 = _mm256_add_ps( B1, _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[4] ), hitc2 ) );
+					B1 = _mm256_add_ps( B1, _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[5] ) );
+
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B1, EightZeros, _CMP_GE_OQ ) );
+
+					__m256 B2 = _mm256_add_ps( B1, B0 );
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B2, One, _CMP_LE_OQ ) );
+
+					if ( !_mm256_movemask_ps( did_hit ) )
+						continue;
+
+					// there's no callback, so transparent triangles block like everything else, same as
+					// Trace4Rays without one. now, set the hit_id and closest_hit fields for any enabled rays
+					__m256 replicated_n = _mm256_castsi256_ps( _mm256_set1_epi32( tnum ) );
+					HitIds = _mm256_blendv_ps( HitIds, replicated_n, did_hit );
+					HitDistance = _mm256_blendv_ps( HitDistance, isect_t, did_hit );
+					Normal[0] = _mm256_blendv_ps( Normal[0], Nx, did_hit );
+					Normal[1] = _mm256_blendv_ps( Normal[1], Ny, did_hit );
+					Normal[2] = _mm256_blendv_ps( Normal[2], Nz, did_hit );
+				} while ( --ntris );
+
+				// now, check if all rays have terminated
+				__m256 raydone = _mm256_cmp_ps( TMax, HitDistance, _CMP_LE_OQ );
+				if ( !_mm256_movemask_ps( raydone ) )
+					break;
+			}
+
+			if ( stack_ptr == &NodeQueue[MAX_NODE_STACK_LEN] )
+				break;
+
+			// pop stack!
+			CurNode = stack_ptr->node;
+			TMin = stack_ptr->TMin;
+			TMax = stack_ptr->TMax;
+			stack_ptr++;
+		}
+	}
+
+	_mm256_storeu_ps( (float *) rslt.m_HitIds, HitIds );
+	_mm256_storeu_ps( rslt.m_HitDistance, HitDistance );
+	for ( int c = 0; c < 3; c++ )
+		_mm256_storeu_ps( rslt.m_SurfaceNormal[c], Normal[c] );
+
+	// back to legacy SSE code without paying for the upper halves of the ymm registers
+	_mm256_zeroupper();
+}
+
+#endif // RAYTRACE_AVX
+
+bool RayTracingEnvironment::Is8WideTracerEnabled( void )
+{
+	if ( s_n8WideTracer == -1 )
+	{
+#ifdef RAYTRACE_AVX
+		s_n8WideTracer = CPUSupportsAVX() ? 1 : 0;
+#else
+		s_n8WideTracer = 0;
+#endif
+	}
+	return s_n8WideTracer == 1;
+}
+
+void RayTracingEnvironment::Set8WideTracerEnabled( bool bEnabled )
+{
+	// only turns it on if the cpu can actually do it
+	s_n8WideTracer = -1;
+	if ( !bEnabled || !Is8WideTracerEnabled() )
+		s_n8WideTracer = 0;
+}
+
+void RayTracingEnvironment::Trace8Rays( const FourRays *pRays, const fltx4 *pTMin, const fltx4 *pTMax,
+										RayTracingResult *pRsltOut, int32 skip_id )
+{
+#ifdef RAYTRACE_AVX
+	int msk = pRays[0].CalculateDirectionSignMask();
+	// the kernel only knows the kd tree
+	if ( msk != -1 && msk == pRays[1].CalculateDirectionSignMask() && Is8WideTracerEnabled() &&
+		 !( Flags & RTE_FLAGS_USE_BVH ) )
+	{
+		pRays[0].Check();
+		pRays[1].Check();
+
+		EightRays_t rays;
+		for ( int h = 0; h < 2; h++ )
+		{
+			FourVectors OneOverRayDir = pRays[h].direction;
+			OneOverRayDir.MakeReciprocalSaturate();
+
+			for ( int c = 0; c < 3; c++ )
+			{
+				StoreUnalignedSIMD( &rays.m_Origin[c][h * 4], pRays[h].origin[c] );
+				StoreUnalignedSIMD( &rays.m_Direction[c][h * 4], pRays[h].direction[c] );
+				StoreUnalignedSIMD( &rays.m_OneOverDirection[c][h * 4], OneOverRayDir[c] );
+			}
+			StoreUnalignedSIMD( &rays.m_TMin[h * 4], pTMin[h] );
+			StoreUnalignedSIMD( &rays.m_TMax[h * 4], pTMax[h] );
+		}
+
+		EightRaysResult_t rslt;
+		Trace8RaysAVX( *this, rays, msk, rslt, skip_id );
+
+		for ( int h = 0; h < 2; h++ )
+		{
+			memcpy( pRsltOut[h].HitIds, &rslt.m_HitIds[h * 4], sizeof( pRsltOut[h].HitIds ) );
+			pRsltOut[h].HitDistance = LoadUnalignedSIMD( &rslt.m_HitDistance[h * 4] );
+			pRsltOut[h].surface_normal.x = LoadUnalignedSIMD( &rslt.m_SurfaceNormal[0][h * 4] );
+			pRsltOut[h].surface_normal.y = LoadUnalignedSIMD( &rslt.m_SurfaceNormal[1][h * 4] );
+			pRsltOut[h].surface_normal.z = LoadUnalignedSIMD( &rslt.m_SurfaceNormal[2][h * 4] );
+		}
+		return;
+	}
+#endif
+
+	Trace4Rays( pRays[0], pTMin[0], pTMax[0], &pRsltOut[0], skip_id );
+	Trace4Rays( pRays[1], pTMin[1], pTMax[1], &pRsltOut[1], skip_id );
+}
@@ -19,7 +19,7 @@
 #include "threads.h"
 #include "pacifier.h"
 
-#define	MAX_THREADS	16
+#define	MAX_THREADS	MAX_TOOL_THREADS
 
 
 class CRunThreadsData
@@ -136,8 +136,10 @@ void ThreadSetDefault (void)
 	{
 		GetSystemInfo (&info);
 		numthreads = info.dwNumberOfProcessors;
-		if (numthreads < 1 || numthreads > 32)
+		if (numthreads < 1)
 			numthreads = 1;
+		if (numthreads > MAX_TOOL_THREADS)
+			numthreads = MAX_TOOL_THREADS;
 	}
 
 	Msg ("%i threads\n", numthreads);
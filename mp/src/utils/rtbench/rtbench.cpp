@@ -0,0 +1,206 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Builds the kd tree and the bvh for a ray trace environment dumped
+//			by vrad -dumptrace (trace.txt), times both, and traces the same
+//			packets of rays through each to compare speed and hits.
+//
+//=============================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include "raytrace.h"
+#include "mathlib/mathlib.h"
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+
+extern int n_intersection_calculations;
+
+void Usage( void )
+{
+	printf( "Usage: rtbench [-threads n] [-packets n] trace.txt\n" );
+	printf( "  -threads n : threads to build the bvh with, default is one per cpu\n" );
+	printf( "  -packets n : packets of 4 rays to trace, default 250000\n" );
+	exit( -1 );
+}
+
+static bool LoadRTEnv( const char *pFileName, RayTracingEnvironment &env )
+{
+	FILE *fp = fopen( pFileName, "r" );
+	if ( !fp )
+		return false;
+
+	// WriteWinding format: the number of points, then x y z r g b for each one
+	int nPoints;
+	while ( fscanf( fp, "%d", &nPoints ) == 1 )
+	{
+		if ( nPoints < 3 || nPoints > 64 )
+			break;
+
+		Vector points[64];
+		Vector color;
+		for ( int i = 0; i < nPoints; i++ )
+		{
+			if ( fscanf( fp, "%f %f %f %f %f %f", &points[i].x, &points[i].y, &points[i].z,
+				&color.x, &color.y, &color.z ) != 6 )
+			{
+				fclose( fp );
+				return false;
+			}
+		}
+
+		for ( int i = 2; i < nPoints; i++ )
+			env.AddTriangle( env.OptimizedTriangleList.Count(), points[0], points[i-1], points[i], color );
+	}
+
+	fclose( fp );
+	return true;
+}
+
+static float BuildEnvironment( RayTracingEnvironment &env )
+{
+	double flStart = Plat_FloatTime();
+	env.SetupAccelerationStructure();
+	return Plat_FloatTime() - flStart;
+}
+
+// Lcg so the packets are the same on every run and every platform
+static uint32 s_nSeed = 12345;
+static float RandomUnit( void )
+{
+	s_nSeed = s_nSeed * 1664525 + 1013904223;
+	return ( s_nSeed >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+// Packets of 4 rays from a point inside the world, spread a little around a random direction
+// like the rays from a sample to a light
+static void MakePackets( FourRays *pRays, int nPackets, Vector const &mins, Vector const &maxs )
+{
+	for ( int p = 0; p < nPackets; p++ )
+	{
+		Vector org;
+		for ( int c = 0; c < 3; c++ )
+			org[c] = mins[c] + ( maxs[c] - mins[c] ) * ( 0.1f + 0.8f * RandomUnit() );
+
+		Vector dir( RandomUnit() - 0.5f, RandomUnit() - 0.5f, RandomUnit() - 0.5f );
+		VectorNormalize( dir );
+
+		pRays[p].origin.DuplicateVector( org );
+		for ( int i = 0; i < 4; i++ )
+		{
+			Vector jitter = dir;
+			for ( int c = 0; c < 3; c++ )
+			{
+				// keep the signs the same so the packet goes down the tree together
+				jitter[c] += 0.02f * ( RandomUnit() - 0.5f );
+				if ( jitter[c] * dir[c] < 0 )
+					jitter[c] = 0;
+			}
+			VectorNormalize( jitter );
+			pRays[p].direction.X( i ) = jitter.x;
+			pRays[p].direction.Y( i ) = jitter.y;
+			pRays[p].direction.Z( i ) = jitter.z;
+		}
+	}
+}
+
+static float TracePackets( RayTracingEnvironment &env, FourRays const *pRays, int nPackets,
+						   RayTracingResult *pResults, int &nTriTests )
+{
+	fltx4 TMin = Four_Zeros;
+	fltx4 TMax = ReplicateX4( 1.0e20f );
+
+	n_intersection_calculations = 0;
+	double flStart = Plat_FloatTime();
+	for ( int p = 0; p < nPackets; p++ )
+		env.Trace4Rays( pRays[p], TMin, TMax, &pResults[p] );
+	float flElapsed = Plat_FloatTime() - flStart;
+	nTriTests = n_intersection_calculations;
+	return flElapsed;
+}
+
+int main( int argc, char **argv )
+{
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+	int nThreads = 0;
+	int nPackets = 250000;
+	const char *pFileName = NULL;
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-threads" ) && i + 1 < argc )
+			nThreads = atoi( argv[++i] );
+		else if ( !Q_stricmp( argv[i], "-packets" ) && i + 1 < argc )
+			nPackets = MAX( atoi( argv[++i] ), 1 );
+		else if ( argv[i][0] == '-' )
+			Usage();
+		else
+			pFileName = argv[i];
+	}
+	if ( !pFileName )
+		Usage();
+
+	RayTracingEnvironment *pKD = new RayTracingEnvironment;
+	RayTracingEnvironment *pBVH = new RayTracingEnvironment;
+	pBVH->Flags |= RTE_FLAGS_USE_BVH;
+	pBVH->m_nBuildThreads = nThreads;
+
+	if ( !LoadRTEnv( pFileName, *pKD ) || !LoadRTEnv( pFileName, *pBVH ) )
+	{
+		fprintf( stderr, "Couldn't read %s\n", pFileName );
+		return -1;
+	}
+	printf( "%d triangles\n", pKD->OptimizedTriangleList.Count() );
+	if ( !pKD->OptimizedTriangleList.Count() )
+		return -1;
+
+	float flKDBuild = BuildEnvironment( *pKD );
+	float flBVHBuild = BuildEnvironment( *pBVH );
+	printf( "kd tree: %7.2fs build, %8d nodes (%d kb)\n", flKDBuild, pKD->OptimizedKDTree.Count(),
+		(int)( pKD->OptimizedKDTree.Count() * sizeof( CacheOptimizedKDNode ) / 1024 ) );
+	printf( "bvh:     %7.2fs build, %8d nodes (%d kb)\n", flBVHBuild, pBVH->OptimizedBVH.Count(),
+		(int)( pBVH->OptimizedBVH.Count() * sizeof( CacheOptimizedBVHNode ) / 1024 ) );
+
+	FourRays *pRays = new FourRays[nPackets];
+	RayTracingResult *pKDResults = new RayTracingResult[nPackets];
+	RayTracingResult *pBVHResults = new RayTracingResult[nPackets];
+	MakePackets( pRays, nPackets, pKD->m_MinBound, pKD->m_MaxBound );
+
+	int nKDTests, nBVHTests;
+	float flKDTrace = TracePackets( *pKD, pRays, nPackets, pKDResults, nKDTests );
+	float flBVHTrace = TracePackets( *pBVH, pRays, nPackets, pBVHResults, nBVHTests );
+
+	int nRays = nPackets * 4;
+	printf( "kd tree: %7.2f Mrays/s, %5.1f triangle tests per ray\n",
+		nRays / MAX( flKDTrace, 1.0e-6f ) / 1.0e6f, (float)nKDTests / nRays );
+	printf( "bvh:     %7.2f Mrays/s, %5.1f triangle tests per ray\n",
+		nRays / MAX( flBVHTrace, 1.0e-6f ) / 1.0e6f, (float)nBVHTests / nRays );
+
+	// a ray can hit either of two triangles sharing an edge, so only count different distances
+	int nHits = 0;
+	int nMismatches = 0;
+	for ( int p = 0; p < nPackets; p++ )
+	{
+		for ( int i = 0; i < 4; i++ )
+		{
+			int nKDHit = pKDResults[p].HitIds[i];
+			int nBVHHit = pBVHResults[p].HitIds[i];
+			if ( nKDHit != -1 )
+				nHits++;
+
+			if ( nKDHit == nBVHHit )
+				continue;
+
+			float flKDDist = SubFloat( pKDResults[p].HitDistance, i );
+			float flBVHDist = SubFloat( pBVHResults[p].HitDistance, i );
+			if ( nKDHit == -1 || nBVHHit == -1 || fabs( flKDDist - flBVHDist ) > 1.0e-3f * MAX( flKDDist, 1.0f ) )
+				nMismatches++;
+		}
+	}
+	printf( "%d of %d rays hit, %d hits differ\n", nHits, nRays, nMismatches );
+
+	delete[] pRays;
+	delete[] pKDResults;
+	delete[] pBVHResults;
+	delete pKD;
+	delete pBVH;
+	return nMismatches ? 1 : 0;
+}
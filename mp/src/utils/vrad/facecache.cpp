@@ -0,0 +1,1006 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps each face's direct lighting and radiosity transfers between
+//			compiles (-cache).
+//
+//			Faces are matched up by a key made from their geometry, so it
+//			doesn't matter if vbsp renumbers them. Each face's direct lighting
+//			is saved with a key made from the lights that can see its samples
+//			and from the ray trace triangles inside the box around the samples
+//			and those lights, and each face's transfers with a key made from
+//			the patches its clusters can see and the triangles around them.
+//			A face is only relit if its key comes out different.
+//
+//			The triangles are hashed into a coarse grid and summed, so the
+//			keys for a box are cheap, and anything that moves inside a box
+//			changes its key. Sky lights can be blocked by anything, so faces
+//			that can see one depend on the whole map.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "facecache.h"
+#include "vmpi.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlmap.h"
+#include "tier0/threadtools.h"
+
+bool g_bFaceCache = false;
+
+#define FACECACHE_ID		( ( 'C' << 24 ) + ( 'F' << 16 ) + ( 'R' << 8 ) + 'V' )
+#define FACECACHE_VERSION	1
+
+#define OCCLUDER_GRID_SIZE	64
+
+extern int total_transfer;
+extern int max_transfer;
+
+int GetVisCache( int lastoffset, int cluster, byte *pvs );
+
+//-----------------------------------------------------------------------------
+// 64 bit FNV-1a. Keys are only ever compared with each other.
+//-----------------------------------------------------------------------------
+class CCacheKey
+{
+public:
+	CCacheKey() : m_nHash( 14695981039346656037ULL ) {}
+
+	void Add( void const *pData, int nBytes )
+	{
+		byte const *pBytes = (byte const *)pData;
+		for ( int i = 0; i < nBytes; i++ )
+		{
+			m_nHash ^= pBytes[i];
+			m_nHash *= 1099511628211ULL;
+		}
+	}
+
+	template< class T > void Add( T const &value )
+	{
+		Add( &value, sizeof( value ) );
+	}
+
+	uint64 Get() const
+	{
+		return m_nHash;
+	}
+
+private:
+	uint64 m_nHash;
+};
+
+struct CachedTransfer_t
+{
+	int		m_iFace;				// index into the cache's faces
+	int		m_iPatch;				// patch in that face, in g_FacePatches order
+	float	m_flTransfer;
+};
+
+struct CachedFace_t
+{
+	CachedFace_t() : m_bHasLight( false ), m_bHasTransfers( false ) {}
+
+	uint64	m_nGeometryKey;
+
+	bool	m_bHasLight;
+	uint64	m_nLightKey;
+	byte	m_Styles[MAXLIGHTMAPS];
+	int		m_nSamples;
+	int		m_nNormals;
+	CUtlVector<LightingValue_t> m_Light;		// [style][normal][sample]
+
+	bool	m_bHasTransfers;
+	uint64	m_nTransferKey;
+	CUtlVector<int> m_TransferStart;			// per patch, and one past the last
+	CUtlVector<CachedTransfer_t> m_Transfers;
+};
+
+static char s_szCacheFile[MAX_PATH];
+static uint64 s_nSettingsKey;
+static uint64 s_nDispKey;
+
+static CUtlVector<CachedFace_t> s_Faces;		// this compile, by face number
+static CUtlVector<bool> s_bCacheable;			// false for faces with the same key as another
+static CUtlVector<CachedFace_t> s_OldFaces;		// the last compile
+static CUtlVector<int> s_OldFaceForFace;		// -1 if the face is new
+static CUtlVector<int> s_FaceForOldFace;		// -1 if the face is gone
+static CUtlVector<bool> s_bReuseTransfers;
+
+static CUtlVector<int> s_FirstFacePatch;		// face -> s_FacePatches, numfaces+1 of them
+static CUtlVector<int> s_FacePatches;			// every face's patches, in g_FacePatches order
+static CUtlVector<int> s_PatchInFace;			// patch -> its place in its face's list
+
+static Vector s_GridMins, s_GridMaxs, s_GridScale;
+static CUtlVector<uint64> s_OccluderSums;		// summed volume table of the grid
+
+static CInterlockedInt s_nLightFaces;
+static CInterlockedInt s_nLightReused;
+static int s_nTransferFaces;
+static int s_nTransferReused;
+
+
+//-----------------------------------------------------------------------------
+// Occluder grid
+//-----------------------------------------------------------------------------
+static inline int OccluderSumIndex( int i, int j, int k )
+{
+	return ( i * ( OCCLUDER_GRID_SIZE + 1 ) + j ) * ( OCCLUDER_GRID_SIZE + 1 ) + k;
+}
+
+static inline int OccluderCell( float flCoord, int nAxis )
+{
+	int nCell = (int)floor( ( flCoord - s_GridMins[nAxis] ) * s_GridScale[nAxis] );
+	return clamp( nCell, 0, OCCLUDER_GRID_SIZE - 1 );
+}
+
+// Sum of the hashes of the triangles touching the cells the box touches
+static uint64 OccluderSum( Vector const &mins, Vector const &maxs )
+{
+	if ( !s_OccluderSums.Count() )
+		return 0;
+
+	int lo[3], hi[3];
+	for ( int c = 0; c < 3; c++ )
+	{
+		lo[c] = OccluderCell( mins[c], c );
+		hi[c] = OccluderCell( maxs[c], c ) + 1;
+	}
+
+	uint64 const *s = s_OccluderSums.Base();
+	return s[OccluderSumIndex( hi[0], hi[1], hi[2] )]
+		- s[OccluderSumIndex( lo[0], hi[1], hi[2] )]
+		- s[OccluderSumIndex( hi[0], lo[1], hi[2] )]
+		- s[OccluderSumIndex( hi[0], hi[1], lo[2] )]
+		+ s[OccluderSumIndex( lo[0], lo[1], hi[2] )]
+		+ s[OccluderSumIndex( lo[0], hi[1], lo[2] )]
+		+ s[OccluderSumIndex( hi[0], lo[1], lo[2] )]
+		- s[OccluderSumIndex( lo[0], lo[1], lo[2] )];
+}
+
+void FaceCache_HashOccluders()
+{
+	if ( !g_bFaceCache )
+		return;
+
+	if ( g_bUseMPI || g_pIncremental )
+	{
+		Warning( "-cache doesn't work with vmpi or incremental lighting, ignoring it.\n" );
+		g_bFaceCache = false;
+		return;
+	}
+
+	s_OccluderSums.Purge();
+
+	int nTris = g_RtEnv.OptimizedTriangleList.Count();
+	if ( !nTris )
+		return;
+
+	ClearBounds( s_GridMins, s_GridMaxs );
+	for ( int t = 0; t < nTris; t++ )
+	{
+		for ( int v = 0; v < 3; v++ )
+			AddPointToBounds( g_RtEnv.OptimizedTriangleList[t].Vertex( v ), s_GridMins, s_GridMaxs );
+	}
+	s_GridMins -= Vector( 1, 1, 1 );
+	s_GridMaxs += Vector( 1, 1, 1 );
+	for ( int c = 0; c < 3; c++ )
+		s_GridScale[c] = OCCLUDER_GRID_SIZE / ( s_GridMaxs[c] - s_GridMins[c] );
+
+	// add each triangle to every cell its bounds touch, one past the cell's index so the table
+	// can be summed in place
+	s_OccluderSums.SetCount( OccluderSumIndex( OCCLUDER_GRID_SIZE + 1, 0, 0 ) );
+	memset( s_OccluderSums.Base(), 0, s_OccluderSums.Count() * sizeof( uint64 ) );
+
+	for ( int t = 0; t < nTris; t++ )
+	{
+		TriGeometryData_t const &tri = g_RtEnv.OptimizedTriangleList[t].m_Data.m_GeometryData;
+
+		// the low bits of the id are numbering, only the type matters
+		CCacheKey key;
+		key.Add( tri.m_VertexCoordData, sizeof( tri.m_VertexCoordData ) );
+		key.Add( tri.m_nFlags );
+		key.Add( tri.m_nTriangleID & 0xff000000 );
+		uint64 nHash = key.Get();
+
+		Vector mins, maxs;
+		ClearBounds( mins, maxs );
+		for ( int v = 0; v < 3; v++ )
+			AddPointToBounds( g_RtEnv.OptimizedTriangleList[t].Vertex( v ), mins, maxs );
+
+		int lo[3], hi[3];
+		for ( int c = 0; c < 3; c++ )
+		{
+			lo[c] = OccluderCell( mins[c], c );
+			hi[c] = OccluderCell( maxs[c], c );
+		}
+
+		for ( int i = lo[0]; i <= hi[0]; i++ )
+		{
+			for ( int j = lo[1]; j <= hi[1]; j++ )
+			{
+				for ( int k = lo[2]; k <= hi[2]; k++ )
+					s_OccluderSums[OccluderSumIndex( i + 1, j + 1, k + 1 )] += nHash;
+			}
+		}
+	}
+
+	uint64 *s = s_OccluderSums.Base();
+	for ( int i = 1; i <= OCCLUDER_GRID_SIZE; i++ )
+	{
+		for ( int j = 1; j <= OCCLUDER_GRID_SIZE; j++ )
+		{
+			for ( int k = 1; k <= OCCLUDER_GRID_SIZE; k++ )
+			{
+				s[OccluderSumIndex( i, j, k )] +=
+					s[OccluderSumIndex( i - 1, j, k )] + s[OccluderSumIndex( i, j - 1, k )] + s[OccluderSumIndex( i, j, k - 1 )]
+					- s[OccluderSumIndex( i - 1, j - 1, k )] - s[OccluderSumIndex( i - 1, j, k - 1 )] - s[OccluderSumIndex( i, j - 1, k - 1 )]
+					+ s[OccluderSumIndex( i - 1, j - 1, k - 1 )];
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Keys
+//-----------------------------------------------------------------------------
+
+// Options that change the lighting everywhere. If any of them change the whole cache is thrown out.
+static uint64 SettingsKey()
+{
+	CCacheKey key;
+	key.Add( g_bHDR );
+	key.Add( do_fast );
+	key.Add( do_extra );
+	key.Add( extrapasses );
+	key.Add( do_centersamples );
+	key.Add( g_flSkySampleScale );
+	key.Add( g_SunAngularExtent );
+	key.Add( g_bFastAmbient );
+	key.Add( g_bTextureShadows );
+	key.Add( g_bLargeDispSampleRadius );
+	key.Add( g_flMaxDispSampleSize );
+	key.Add( g_bNoSkyRecurse );
+	key.Add( g_bStaticPropPolys );
+	key.Add( g_bDisablePropSelfShadowing );
+	key.Add( smoothing_threshold );
+	key.Add( num_sky_cameras );
+	for ( int i = 0; i < num_sky_cameras; i++ )
+	{
+		key.Add( sky_cameras[i].origin );
+		key.Add( sky_cameras[i].world_to_sky );
+	}
+	return key.Get();
+}
+
+// Displacements are sewn to their neighbors, so every displacement depends on all of them
+static uint64 DispKey()
+{
+	CCacheKey key;
+	for ( int i = 0; i < g_dispinfo.Count(); i++ )
+	{
+		ddispinfo_t const &disp = g_dispinfo[i];
+		key.Add( disp.startPosition );
+		key.Add( disp.power );
+		key.Add( disp.smoothingAngle );
+		key.Add( disp.contents );
+	}
+	if ( g_DispVerts.Count() )
+		key.Add( g_DispVerts.Base(), g_DispVerts.Count() * sizeof( CDispVert ) );
+	return key.Get();
+}
+
+static uint64 FaceGeometryKey( int facenum )
+{
+	dface_t const *f = &g_pFaces[facenum];
+	dplane_t const *plane = &dplanes[f->planenum];
+	texinfo_t const *tx = &texinfo[f->texinfo];
+
+	CCacheKey key;
+	key.Add( plane->normal );
+	key.Add( plane->dist );
+	key.Add( f->side );
+	for ( int i = 0; i < f->numedges; i++ )
+	{
+		int se = dsurfedges[f->firstedge + i];
+		int v = ( se < 0 ) ? dedges[-se].v[1] : dedges[se].v[0];
+		key.Add( dvertexes[v].point );
+	}
+	key.Add( tx->textureVecsTexelsPerWorldUnits );
+	key.Add( tx->lightmapVecsLuxelsPerWorldUnits );
+	key.Add( tx->flags );
+	key.Add( f->m_LightmapTextureMinsInLuxels );
+	key.Add( f->m_LightmapTextureSizeInLuxels );
+	key.Add( f->smoothingGroups );
+	key.Add( face_offset[facenum] );
+
+	// smoothed normals come from the neighbors
+	faceneighbor_t const *fn = &faceneighbor[facenum];
+	if ( fn->normal )
+		key.Add( fn->normal, f->numedges * sizeof( Vector ) );
+
+	if ( f->dispinfo != -1 )
+		key.Add( s_nDispKey );
+
+	return key.Get();
+}
+
+static uint64 FacePatchKey( int facenum )
+{
+	CCacheKey key;
+	key.Add( s_Faces[facenum].m_nGeometryKey );
+	for ( int i = s_FirstFacePatch[facenum]; i < s_FirstFacePatch[facenum+1]; i++ )
+	{
+		CPatch const &patch = g_Patches[s_FacePatches[i]];
+		key.Add( patch.origin );
+		key.Add( patch.normal );
+		key.Add( patch.area );
+		key.Add( patch.planeDist );
+
+		int nChildren[2] = { -1, -1 };
+		if ( patch.child1 != g_Patches.InvalidIndex() )
+		{
+			nChildren[0] = s_PatchInFace[patch.child1];
+			nChildren[1] = s_PatchInFace[patch.child2];
+		}
+		key.Add( nChildren );
+	}
+	return key.Get();
+}
+
+static void AddFacePatchBounds( int facenum, Vector &mins, Vector &maxs )
+{
+	for ( int i = s_FirstFacePatch[facenum]; i < s_FirstFacePatch[facenum+1]; i++ )
+	{
+		CPatch const &patch = g_Patches[s_FacePatches[i]];
+		AddPointToBounds( patch.mins, mins, maxs );
+		AddPointToBounds( patch.maxs, mins, maxs );
+	}
+}
+
+static uint64 LightKey( directlight_t const *dl )
+{
+	// not the cluster, texinfo or owner, they're just numbering
+	dworldlight_t const &light = dl->light;
+	CCacheKey key;
+	key.Add( light.type );
+	key.Add( light.style );
+	key.Add( light.origin );
+	key.Add( light.intensity );
+	key.Add( light.normal );
+	key.Add( light.stopdot );
+	key.Add( light.stopdot2 );
+	key.Add( light.exponent );
+	key.Add( light.radius );
+	key.Add( light.constant_attn );
+	key.Add( light.linear_attn );
+	key.Add( light.quadratic_attn );
+	key.Add( light.flags );
+	key.Add( dl->m_flStartFadeDistance );
+	key.Add( dl->m_flEndFadeDistance );
+	key.Add( dl->m_flCapDist );
+	bool bOnFace = ( dl->facenum != -1 );
+	key.Add( bOnFace );
+	return key.Get();
+}
+
+static void AddCluster( CUtlVector<int> &clusters, int iCluster )
+{
+	if ( clusters.Find( iCluster ) == -1 )
+		clusters.AddToTail( iCluster );
+}
+
+// Everything the face's direct lighting depends on
+static uint64 FaceLightKey( int facenum, int normalCount )
+{
+	facelight_t const *fl = &facelight[facenum];
+
+	// GatherSampleLight only uses the lights that can see the samples' clusters. Supersampling
+	// can go out to the luxels.
+	CUtlVector<int> clusters;
+	Vector mins, maxs;
+	ClearBounds( mins, maxs );
+	for ( int i = 0; i < fl->numsamples; i++ )
+	{
+		AddCluster( clusters, ClusterFromPoint( fl->sample[i].pos ) );
+		AddPointToBounds( fl->sample[i].pos, mins, maxs );
+	}
+	if ( do_extra )
+	{
+		for ( int i = 0; i < fl->numluxels; i++ )
+		{
+			AddCluster( clusters, ClusterFromPoint( fl->luxel[i] ) );
+			AddPointToBounds( fl->luxel[i], mins, maxs );
+		}
+	}
+
+	// samples are pushed off the face before tracing, and supersamples can be a luxel away
+	float flPad = 2.0f + sqrt( fl->worldAreaPerLuxel );
+	mins -= Vector( flPad, flPad, flPad );
+	maxs += Vector( flPad, flPad, flPad );
+
+	uint64 nLights = 0;
+	bool bSky = false;
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		int i;
+		for ( i = 0; i < clusters.Count(); i++ )
+		{
+			if ( PVSCheck( dl->pvs, clusters[i] ) )
+				break;
+		}
+		if ( i == clusters.Count() )
+			continue;
+
+		nLights += LightKey( dl );
+
+		if ( dl->light.type == emit_skylight || dl->light.type == emit_skyambient )
+			bSky = true;
+		else
+			AddPointToBounds( dl->light.origin, mins, maxs );
+	}
+
+	uint64 nOccluders = bSky ? OccluderSum( s_GridMins, s_GridMaxs ) : OccluderSum( mins, maxs );
+
+	CCacheKey key;
+	key.Add( s_Faces[facenum].m_nGeometryKey );
+	key.Add( s_nSettingsKey );
+	key.Add( fl->numsamples );
+	key.Add( normalCount );
+	key.Add( nLights );
+	key.Add( nOccluders );
+	return key.Get();
+}
+
+// What each face's transfers depend on: the patches in the pvs of its patches' clusters, and
+// anything between them and the face
+static void ComputeTransferKeys( CUtlVector<uint64> const &patchKeys )
+{
+	int nClusters = dvis->numclusters;
+
+	CUtlVector<uint64> clusterPatches;
+	CUtlVector<Vector> clusterMins, clusterMaxs;
+	clusterPatches.SetCount( nClusters );
+	clusterMins.SetCount( nClusters );
+	clusterMaxs.SetCount( nClusters );
+
+	CUtlVector<int> faceClusterStamp;
+	faceClusterStamp.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+		faceClusterStamp[i] = -1;
+
+	for ( int c = 0; c < nClusters; c++ )
+	{
+		clusterPatches[c] = 0;
+		ClearBounds( clusterMins[c], clusterMaxs[c] );
+
+		for ( int i = 0; i < g_ClusterLeaves[c].leafCount; i++ )
+		{
+			dleaf_t const *leaf = &dleafs[g_ClusterLeaves[c].leafs[i]];
+			for ( int k = 0; k < leaf->numleaffaces; k++ )
+			{
+				int facenum = dleaffaces[leaf->firstleafface + k];
+				if ( faceClusterStamp[facenum] == c )
+					continue;
+				faceClusterStamp[facenum] = c;
+
+				clusterPatches[c] += patchKeys[facenum];
+				AddFacePatchBounds( facenum, clusterMins[c], clusterMaxs[c] );
+			}
+		}
+	}
+
+	// displacements aren't in the leaves, they're in the clusters of their patches
+	CUtlVector<int> clusters;
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		if ( g_pFaces[facenum].dispinfo == -1 )
+			continue;
+
+		clusters.RemoveAll();
+		for ( int i = s_FirstFacePatch[facenum]; i < s_FirstFacePatch[facenum+1]; i++ )
+		{
+			int iCluster = g_Patches[s_FacePatches[i]].clusterNumber;
+			if ( iCluster >= 0 && iCluster < nClusters )
+				AddCluster( clusters, iCluster );
+		}
+		for ( int i = 0; i < clusters.Count(); i++ )
+		{
+			clusterPatches[clusters[i]] += patchKeys[facenum];
+			AddFacePatchBounds( facenum, clusterMins[clusters[i]], clusterMaxs[clusters[i]] );
+		}
+	}
+
+	CUtlVector<uint64> pvsPatches;
+	CUtlVector<Vector> pvsMins, pvsMaxs;
+	pvsPatches.SetCount( nClusters );
+	pvsMins.SetCount( nClusters );
+	pvsMaxs.SetCount( nClusters );
+
+	byte pvs[(MAX_MAP_CLUSTERS+7)/8];
+	for ( int c = 0; c < nClusters; c++ )
+	{
+		GetVisCache( -1, c, pvs );
+
+		pvsPatches[c] = 0;
+		ClearBounds( pvsMins[c], pvsMaxs[c] );
+		for ( int c2 = 0; c2 < nClusters; c2++ )
+		{
+			if ( !( pvs[c2 >> 3] & ( 1 << ( c2 & 7 ) ) ) )
+				continue;
+
+			pvsPatches[c] += clusterPatches[c2];
+			AddPointToBounds( clusterMins[c2], pvsMins[c], pvsMaxs[c] );
+			AddPointToBounds( clusterMaxs[c2], pvsMins[c], pvsMaxs[c] );
+		}
+	}
+
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		CachedFace_t &face = s_Faces[facenum];
+		if ( !s_bCacheable[facenum] || s_FirstFacePatch[facenum] == s_FirstFacePatch[facenum+1] )
+			continue;
+
+		Vector mins, maxs;
+		ClearBounds( mins, maxs );
+		AddFacePatchBounds( facenum, mins, maxs );
+
+		clusters.RemoveAll();
+		for ( int i = s_FirstFacePatch[facenum]; i < s_FirstFacePatch[facenum+1]; i++ )
+		{
+			int iCluster = g_Patches[s_FacePatches[i]].clusterNumber;
+			if ( iCluster >= 0 && iCluster < nClusters )
+				AddCluster( clusters, iCluster );
+		}
+
+		uint64 nTargets = 0;
+		for ( int i = 0; i < clusters.Count(); i++ )
+		{
+			nTargets += pvsPatches[clusters[i]];
+			AddPointToBounds( pvsMins[clusters[i]], mins, maxs );
+			AddPointToBounds( pvsMaxs[clusters[i]], mins, maxs );
+		}
+
+		// transfers are traced from a unit off each patch
+		mins -= Vector( 2, 2, 2 );
+		maxs += Vector( 2, 2, 2 );
+
+		CCacheKey key;
+		key.Add( patchKeys[facenum] );
+		key.Add( s_nSettingsKey );
+		key.Add( nTargets );
+		uint64 nOccluders = OccluderSum( mins, maxs );
+		key.Add( nOccluders );
+
+		face.m_nTransferKey = key.Get();
+		s_nTransferFaces++;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Loading and saving
+//-----------------------------------------------------------------------------
+
+// Guards against reading a huge count out of a damaged file
+static bool GetCount( CUtlBuffer &buf, int nElementSize, int &nCount )
+{
+	nCount = buf.GetInt();
+	return buf.IsValid() && nCount >= 0 && nCount <= buf.GetBytesRemaining() / nElementSize;
+}
+
+static bool LoadCache( char const *pFilename )
+{
+	s_OldFaces.Purge();
+
+	CUtlBuffer buf;
+	if ( !g_pFileSystem->ReadFile( pFilename, NULL, buf ) )
+		return false;
+
+	if ( buf.GetInt() != FACECACHE_ID || buf.GetInt() != FACECACHE_VERSION )
+	{
+		Warning( "%s is from a different version of vrad, relighting everything.\n", pFilename );
+		return false;
+	}
+
+	uint64 nSettingsKey;
+	buf.Get( &nSettingsKey, sizeof( nSettingsKey ) );
+	if ( nSettingsKey != s_nSettingsKey )
+	{
+		Msg( "Lighting options have changed since %s was saved, relighting everything.\n", pFilename );
+		return false;
+	}
+
+	int nFaces;
+	if ( !GetCount( buf, sizeof( uint64 ) + 2, nFaces ) )
+		return false;
+
+	bool bDamaged = false;
+	s_OldFaces.SetCount( nFaces );
+	for ( int i = 0; i < nFaces && !bDamaged; i++ )
+	{
+		CachedFace_t &face = s_OldFaces[i];
+		buf.Get( &face.m_nGeometryKey, sizeof( face.m_nGeometryKey ) );
+
+		face.m_bHasLight = ( buf.GetUnsignedChar() != 0 );
+		if ( face.m_bHasLight )
+		{
+			buf.Get( &face.m_nLightKey, sizeof( face.m_nLightKey ) );
+			buf.Get( face.m_Styles, sizeof( face.m_Styles ) );
+			face.m_nSamples = buf.GetInt();
+			face.m_nNormals = buf.GetInt();
+
+			int nLight;
+			if ( !GetCount( buf, sizeof( LightingValue_t ), nLight ) )
+			{
+				bDamaged = true;
+				break;
+			}
+			face.m_Light.SetCount( nLight );
+			buf.Get( face.m_Light.Base(), nLight * sizeof( LightingValue_t ) );
+		}
+
+		face.m_bHasTransfers = ( buf.GetUnsignedChar() != 0 );
+		if ( face.m_bHasTransfers )
+		{
+			buf.Get( &face.m_nTransferKey, sizeof( face.m_nTransferKey ) );
+
+			int nPatches;
+			if ( !GetCount( buf, sizeof( int ), nPatches ) )
+			{
+				bDamaged = true;
+				break;
+			}
+			face.m_TransferStart.SetCount( nPatches + 1 );
+			face.m_TransferStart[0] = 0;
+			for ( int p = 0; p < nPatches; p++ )
+				face.m_TransferStart[p+1] = face.m_TransferStart[p] + buf.GetInt();
+
+			int nTransfers;
+			if ( !GetCount( buf, sizeof( CachedTransfer_t ), nTransfers ) || nTransfers != face.m_TransferStart[nPatches] )
+			{
+				bDamaged = true;
+				break;
+			}
+			face.m_Transfers.SetCount( nTransfers );
+			buf.Get( face.m_Transfers.Base(), nTransfers * sizeof( CachedTransfer_t ) );
+		}
+
+		bDamaged = bDamaged || !buf.IsValid();
+	}
+
+	if ( bDamaged )
+	{
+		Warning( "%s is damaged, relighting everything.\n", pFilename );
+		s_OldFaces.Purge();
+		return false;
+	}
+
+	return true;
+}
+
+void FaceCache_Init( char const *pBSPFilename )
+{
+	if ( !g_bFaceCache )
+		return;
+
+	Q_StripExtension( pBSPFilename, s_szCacheFile, sizeof( s_szCacheFile ) );
+	Q_strncat( s_szCacheFile, g_bHDR ? ".hdr.lightcache" : ".lightcache", sizeof( s_szCacheFile ), COPY_ALL_CHARACTERS );
+
+	s_nSettingsKey = SettingsKey();
+	s_nDispKey = DispKey();
+	s_nLightFaces = 0;
+	s_nLightReused = 0;
+	s_nTransferFaces = 0;
+	s_nTransferReused = 0;
+
+	// list every face's patches so they can be referred to by their place in the face
+	s_FirstFacePatch.SetCount( numfaces + 1 );
+	s_FacePatches.RemoveAll();
+	s_PatchInFace.SetCount( g_Patches.Count() );
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		s_FirstFacePatch[facenum] = s_FacePatches.Count();
+		for ( int ndxPatch = g_FacePatches[facenum]; ndxPatch != g_FacePatches.InvalidIndex(); ndxPatch = g_Patches[ndxPatch].ndxNext )
+		{
+			s_PatchInFace[ndxPatch] = s_FacePatches.Count() - s_FirstFacePatch[facenum];
+			s_FacePatches.AddToTail( ndxPatch );
+		}
+	}
+	s_FirstFacePatch[numfaces] = s_FacePatches.Count();
+
+	// faces are matched to the last compile by their geometry, so ones that can't be told apart
+	// aren't cached
+	s_Faces.Purge();
+	s_Faces.SetCount( numfaces );
+	s_bCacheable.SetCount( numfaces );
+
+	CUtlMap<uint64, int> faceForKey( DefLessFunc( uint64 ) );
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		uint64 nKey = FaceGeometryKey( facenum );
+		s_Faces[facenum].m_nGeometryKey = nKey;
+		s_bCacheable[facenum] = true;
+
+		int iMap = faceForKey.Find( nKey );
+		if ( iMap == faceForKey.InvalidIndex() )
+		{
+			faceForKey.Insert( nKey, facenum );
+		}
+		else
+		{
+			s_bCacheable[facenum] = false;
+			if ( faceForKey[iMap] != -1 )
+				s_bCacheable[faceForKey[iMap]] = false;
+			faceForKey[iMap] = -1;
+		}
+	}
+
+	if ( numbounce > 0 )
+	{
+		CUtlVector<uint64> patchKeys;
+		patchKeys.SetCount( numfaces );
+		for ( int facenum = 0; facenum < numfaces; facenum++ )
+			patchKeys[facenum] = FacePatchKey( facenum );
+
+		ComputeTransferKeys( patchKeys );
+	}
+
+	s_OldFaceForFace.SetCount( numfaces );
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+		s_OldFaceForFace[facenum] = -1;
+
+	bool bLoaded = LoadCache( s_szCacheFile );
+
+	s_FaceForOldFace.SetCount( s_OldFaces.Count() );
+	for ( int i = 0; i < s_OldFaces.Count(); i++ )
+	{
+		int iMap = faceForKey.Find( s_OldFaces[i].m_nGeometryKey );
+		s_FaceForOldFace[i] = ( iMap != faceForKey.InvalidIndex() ) ? faceForKey[iMap] : -1;
+		if ( s_FaceForOldFace[i] != -1 )
+			s_OldFaceForFace[s_FaceForOldFace[i]] = i;
+	}
+
+	// transfers can be reused if their key matches and every patch they go to is still there
+	s_bReuseTransfers.SetCount( numfaces );
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		s_bReuseTransfers[facenum] = false;
+
+		int iOld = s_OldFaceForFace[facenum];
+		if ( iOld == -1 || numbounce == 0 )
+			continue;
+
+		CachedFace_t const &old = s_OldFaces[iOld];
+		int nPatches = s_FirstFacePatch[facenum+1] - s_FirstFacePatch[facenum];
+		if ( !old.m_bHasTransfers || old.m_nTransferKey != s_Faces[facenum].m_nTransferKey ||
+			 old.m_TransferStart.Count() != nPatches + 1 )
+			continue;
+
+		int i;
+		for ( i = 0; i < old.m_Transfers.Count(); i++ )
+		{
+			CachedTransfer_t const &transfer = old.m_Transfers[i];
+			if ( transfer.m_iFace < 0 || transfer.m_iFace >= s_FaceForOldFace.Count() )
+				break;
+
+			int iFace = s_FaceForOldFace[transfer.m_iFace];
+			if ( iFace == -1 || transfer.m_iPatch < 0 ||
+				 transfer.m_iPatch >= s_FirstFacePatch[iFace+1] - s_FirstFacePatch[iFace] )
+				break;
+		}
+
+		if ( i == old.m_Transfers.Count() )
+		{
+			s_bReuseTransfers[facenum] = true;
+			s_nTransferReused++;
+		}
+	}
+
+	if ( bLoaded )
+		Msg( "Loaded %d faces from %s\n", s_OldFaces.Count(), s_szCacheFile );
+}
+
+
+//-----------------------------------------------------------------------------
+// Lighting hooks
+//-----------------------------------------------------------------------------
+bool FaceCache_RestoreFaceLight( int facenum, int normalCount )
+{
+	if ( !g_bFaceCache || !s_bCacheable[facenum] )
+		return false;
+
+	facelight_t *fl = &facelight[facenum];
+	CachedFace_t &face = s_Faces[facenum];
+	face.m_nLightKey = FaceLightKey( facenum, normalCount );
+	++s_nLightFaces;
+
+	int iOld = s_OldFaceForFace[facenum];
+	if ( iOld == -1 )
+		return false;
+
+	CachedFace_t const &old = s_OldFaces[iOld];
+	if ( !old.m_bHasLight || old.m_nLightKey != face.m_nLightKey ||
+		 old.m_nSamples != fl->numsamples || old.m_nNormals != normalCount )
+		return false;
+
+	int nStyles = 0;
+	for ( int k = 0; k < MAXLIGHTMAPS && old.m_Styles[k] != 255; k++ )
+		nStyles++;
+	if ( old.m_Light.Count() != nStyles * normalCount * fl->numsamples )
+		return false;
+
+	dface_t *f = &g_pFaces[facenum];
+	LightingValue_t const *pLight = old.m_Light.Base();
+	for ( int k = 0; k < MAXLIGHTMAPS; k++ )
+	{
+		f->styles[k] = old.m_Styles[k];
+		if ( k >= nStyles )
+			continue;
+
+		for ( int n = 0; n < normalCount; n++ )
+		{
+			fl->light[k][n] = ( LightingValue_t* )calloc( fl->numsamples, sizeof( LightingValue_t ) );
+			memcpy( fl->light[k][n], pLight, fl->numsamples * sizeof( LightingValue_t ) );
+			pLight += fl->numsamples;
+		}
+	}
+
+	++s_nLightReused;
+	return true;
+}
+
+void FaceCache_StoreFaceLight( int facenum, int normalCount )
+{
+	if ( !g_bFaceCache || !s_bCacheable[facenum] )
+		return;
+
+	dface_t const *f = &g_pFaces[facenum];
+	facelight_t const *fl = &facelight[facenum];
+	CachedFace_t &face = s_Faces[facenum];
+
+	face.m_nSamples = fl->numsamples;
+	face.m_nNormals = normalCount;
+	face.m_Light.RemoveAll();
+	for ( int k = 0; k < MAXLIGHTMAPS; k++ )
+	{
+		face.m_Styles[k] = f->styles[k];
+		if ( f->styles[k] == 255 )
+		{
+			// styles are always packed at the front
+			for ( k++; k < MAXLIGHTMAPS; k++ )
+				face.m_Styles[k] = 255;
+			break;
+		}
+
+		for ( int n = 0; n < normalCount; n++ )
+			face.m_Light.AddMultipleToTail( fl->numsamples, fl->light[k][n] );
+	}
+	face.m_bHasLight = true;
+}
+
+bool FaceCache_RestoreTransfers( int patchnum )
+{
+	if ( !g_bFaceCache )
+		return false;
+
+	CPatch *patch = &g_Patches[patchnum];
+	if ( !s_bReuseTransfers[patch->faceNumber] )
+		return false;
+
+	CachedFace_t const &old = s_OldFaces[s_OldFaceForFace[patch->faceNumber]];
+	int iPatch = s_PatchInFace[patchnum];
+	int nFirst = old.m_TransferStart[iPatch];
+	int nTransfers = old.m_TransferStart[iPatch+1] - nFirst;
+
+	patch->numtransfers = nTransfers;
+	if ( nTransfers )
+	{
+		patch->transfers = ( transfer_t* )calloc( 1, nTransfers * sizeof( transfer_t ) );
+		if ( !patch->transfers )
+			Error( "Memory allocation failure" );
+
+		for ( int i = 0; i < nTransfers; i++ )
+		{
+			CachedTransfer_t const &cached = old.m_Transfers[nFirst + i];
+			int iFace = s_FaceForOldFace[cached.m_iFace];
+			patch->transfers[i].patch = s_FacePatches[s_FirstFacePatch[iFace] + cached.m_iPatch];
+			patch->transfers[i].transfer = cached.m_flTransfer;
+		}
+	}
+
+	ThreadLock();
+	total_transfer += nTransfers;
+	max_transfer = max( max_transfer, nTransfers );
+	ThreadUnlock();
+	return true;
+}
+
+void FaceCache_Save()
+{
+	if ( !g_bFaceCache )
+		return;
+
+	Msg( "Face cache: reused direct lighting on %d of %d faces", (int)s_nLightReused, (int)s_nLightFaces );
+	if ( numbounce > 0 )
+		Msg( ", transfers on %d of %d faces", s_nTransferReused, s_nTransferFaces );
+	Msg( "\n" );
+
+	CUtlVector<int> saveIndex;
+	saveIndex.SetCount( numfaces );
+	int nSaved = 0;
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+		saveIndex[facenum] = s_bCacheable[facenum] ? nSaved++ : -1;
+
+	CUtlBuffer buf;
+	buf.PutInt( FACECACHE_ID );
+	buf.PutInt( FACECACHE_VERSION );
+	buf.Put( &s_nSettingsKey, sizeof( s_nSettingsKey ) );
+	buf.PutInt( nSaved );
+
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		if ( saveIndex[facenum] == -1 )
+			continue;
+
+		CachedFace_t const &face = s_Faces[facenum];
+		buf.Put( &face.m_nGeometryKey, sizeof( face.m_nGeometryKey ) );
+
+		buf.PutUnsignedChar( face.m_bHasLight );
+		if ( face.m_bHasLight )
+		{
+			buf.Put( &face.m_nLightKey, sizeof( face.m_nLightKey ) );
+			buf.Put( face.m_Styles, sizeof( face.m_Styles ) );
+			buf.PutInt( face.m_nSamples );
+			buf.PutInt( face.m_nNormals );
+			buf.PutInt( face.m_Light.Count() );
+			buf.Put( face.m_Light.Base(), face.m_Light.Count() * sizeof( LightingValue_t ) );
+		}
+
+		// the transfers come straight from the patches, and can only be saved if every patch
+		// they go to is
+		int nFirstPatch = s_FirstFacePatch[facenum];
+		int nPatches = s_FirstFacePatch[facenum+1] - nFirstPatch;
+		bool bTransfers = ( numbounce > 0 && nPatches > 0 );
+		int nTransfers = 0;
+		for ( int i = 0; i < nPatches && bTransfers; i++ )
+		{
+			CPatch const &patch = g_Patches[s_FacePatches[nFirstPatch + i]];
+			for ( int t = 0; t < patch.numtransfers && bTransfers; t++ )
+				bTransfers = ( saveIndex[g_Patches[patch.transfers[t].patch].faceNumber] != -1 );
+			nTransfers += patch.numtransfers;
+		}
+
+		buf.PutUnsignedChar( bTransfers );
+		if ( bTransfers )
+		{
+			buf.Put( &face.m_nTransferKey, sizeof( face.m_nTransferKey ) );
+			buf.PutInt( nPatches );
+			for ( int i = 0; i < nPatches; i++ )
+				buf.PutInt( g_Patches[s_FacePatches[nFirstPatch + i]].numtransfers );
+
+			buf.PutInt( nTransfers );
+			for ( int i = 0; i < nPatches; i++ )
+			{
+				CPatch const &patch = g_Patches[s_FacePatches[nFirstPatch + i]];
+				for ( int t = 0; t < patch.numtransfers; t++ )
+				{
+					CachedTransfer_t cached;
+					cached.m_iFace = saveIndex[g_Patches[patch.transfers[t].patch].faceNumber];
+					cached.m_iPatch = s_PatchInFace[patch.transfers[t].patch];
+					cached.m_flTransfer = patch.transfers[t].transfer;
+					buf.Put( &cached, sizeof( cached ) );
+				}
+			}
+		}
+	}
+
+	if ( g_pFileSystem->WriteFile( s_szCacheFile, NULL, buf ) )
+		Msg( "Wrote %s (%.1f megs)\n", s_szCacheFile, buf.TellPut() / ( 1024.0f * 1024.0f ) );
+	else
+		Warning( "Couldn't write %s\n", s_szCacheFile );
+
+	s_Faces.Purge();
+	s_OldFaces.Purge();
+}
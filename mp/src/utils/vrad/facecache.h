@@ -0,0 +1,41 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps each face's direct lighting and radiosity transfers between
+//			compiles (-cache), so a recompile after a small edit only redoes the
+//			faces that the edit can reach.
+//
+//=============================================================================//
+
+#ifndef FACECACHE_H
+#define FACECACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+extern bool g_bFaceCache;
+
+// Hashes the ray trace triangles by where they are. Call before SetupAccelerationStructure,
+// the triangles can't be read once they're in intersection format.
+void FaceCache_HashOccluders();
+
+// Loads <map>.lightcache and works out which faces' transfers can be reused. Call after
+// RadWorld_Start, once the patches and direct lights exist.
+void FaceCache_Init( char const *pBSPFilename );
+
+// Called by BuildFacelights once the samples are placed. Returns true if it filled in the face's
+// styles and direct lighting from the cache.
+bool FaceCache_RestoreFaceLight( int facenum, int normalCount );
+
+// Called by BuildFacelights with the face's finished direct lighting, restored or not.
+void FaceCache_StoreFaceLight( int facenum, int normalCount );
+
+// Called by BuildVisLeafs for each patch. Returns true if it filled in the patch's transfers
+// from the cache.
+bool FaceCache_RestoreTransfers( int patchnum );
+
+// Saves the cache for the next compile, with the transfers from MakeAllScales if there were any.
+void FaceCache_Save();
+
+
+#endif // FACECACHE_H
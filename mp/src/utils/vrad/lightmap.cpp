@@ -9,6 +9,7 @@
 #include "vrad.h"
 #include "lightmap.h"
 #include "radial.h"
+#include "facecache.h"
 #include "mathlib/bumpvects.h"
 #include "tier1/utlvector.h"
 #include "vmpi.h"
@@ -1669,25 +1670,66 @@ void ExportDirectLightsToWorldLights()
 #define NSAMPLES_SUN_AREA_LIGHT 30							// number of samples to take for an
                                                             // non-point sun light
 
+// Traces the lines for the groups of samples that are still active. When there are two groups and
+// both are, they go out as one packet of 8.
+static void TestLineGroups( int nGroups, bool const *pActive, FourVectors const *pStart, FourVectors const *pStop,
+						    fltx4 *pFractionVisible, int static_prop_index_to_ignore )
+{
+	if ( nGroups == 2 && pActive[0] && pActive[1] )
+	{
+		TestLine8( pStart, pStop, pFractionVisible, static_prop_index_to_ignore );
+		return;
+	}
+
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( pActive[g] )
+			TestLine( pStart[g], pStop[g], &pFractionVisible[g], static_prop_index_to_ignore );
+	}
+}
+
+static void TestLineGroups_DoesHitSky( int nGroups, bool const *pActive, FourVectors const *pStart, FourVectors const *pStop,
+									   fltx4 *pFractionVisible, int static_prop_index_to_ignore )
+{
+	if ( nGroups == 2 && pActive[0] && pActive[1] )
+	{
+		TestLine_DoesHitSky8( pStart, pStop, pFractionVisible, true, static_prop_index_to_ignore );
+		return;
+	}
+
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( pActive[g] )
+			TestLine_DoesHitSky( pStart[g], pStop[g], &pFractionVisible[g], true, static_prop_index_to_ignore );
+	}
+}
+
 // Helper function - gathers light from sun (emit_skylight)
-void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-							 FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t *pOut, int nGroups, directlight_t *dl, int facenum, 
+							 FourVectors const *pPos, FourVectors * const *ppNormals, int normalCount, int iThread,
 							 int nLFlags, int static_prop_index_to_ignore,
 							 float flEpsilon )
 {
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
 	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
 
-	fltx4 dot;
+	fltx4 dot[2];
+	bool bActive[2] = { false, false };
+	bool bAnyActive = false;
 
-	if ( bIgnoreNormals )
-		dot = ReplicateX4( CONSTANT_DOT );
-	else
-		dot = NegSIMD( pNormals[0] * dl->light.normal );
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( bIgnoreNormals )
+			dot[g] = ReplicateX4( CONSTANT_DOT );
+		else
+			dot[g] = NegSIMD( ppNormals[g][0] * dl->light.normal );
 
-	dot = MaxSIMD( dot, Four_Zeros );
-	int zeroMask = TestSignSIMD ( CmpEqSIMD( dot, Four_Zeros ) );
-	if (zeroMask == 0xF)
+		dot[g] = MaxSIMD( dot[g], Four_Zeros );
+		int zeroMask = TestSignSIMD ( CmpEqSIMD( dot[g], Four_Zeros ) );
+		bActive[g] = ( zeroMask != 0xF );
+		bAnyActive = bAnyActive || bActive[g];
+	}
+	if ( !bAnyActive )
 		return;
 
 	int nsamples = 1;
@@ -1698,8 +1740,8 @@ void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, i
 			nsamples /= 4;
 	}
 
-	fltx4 totalFractionVisible = Four_Zeros;
-	fltx4 fractionVisible = Four_Zeros;
+	fltx4 totalFractionVisible[2] = { Four_Zeros, Four_Zeros };
+	fltx4 fractionVisible[2] = { Four_Zeros, Four_Zeros };
 
 	DirectionalSampler_t sampler;
 
@@ -1716,34 +1758,45 @@ void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, i
 			ofs *= MAX_TRACE_LENGTH * g_SunAngularExtent;
 			delta += ofs;
 		}
-		FourVectors delta4;
-		delta4.DuplicateVector ( delta );
-		delta4 += pos;
+		FourVectors delta4[2];
+		for ( int g = 0; g < nGroups; g++ )
+		{
+			delta4[g].DuplicateVector ( delta );
+			delta4[g] += pPos[g];
+		}
 
-		TestLine_DoesHitSky ( pos, delta4, &fractionVisible, true, static_prop_index_to_ignore );
+		TestLineGroups_DoesHitSky ( nGroups, bActive, pPos, delta4, fractionVisible, static_prop_index_to_ignore );
 
-		totalFractionVisible = AddSIMD ( totalFractionVisible, fractionVisible );
+		for ( int g = 0; g < nGroups; g++ )
+			totalFractionVisible[g] = AddSIMD ( totalFractionVisible[g], fractionVisible[g] );
 	}
 
-	fltx4 seeAmount = MulSIMD ( totalFractionVisible, ReplicateX4 ( 1.0f / nsamples ) );
-	out.m_flDot[0] = MulSIMD ( dot, seeAmount );
-	out.m_flFalloff = Four_Ones;
-	out.m_flSunAmount = MulSIMD ( seeAmount, ReplicateX4( 10000.0f ) );
-	for ( int i = 1; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		if ( bIgnoreNormals )
-			out.m_flDot[i] = ReplicateX4 ( CONSTANT_DOT );
-		else
+		if ( !bActive[g] )
+			continue;
+
+		SSE_sampleLightOutput_t &out = pOut[g];
+		fltx4 seeAmount = MulSIMD ( totalFractionVisible[g], ReplicateX4 ( 1.0f / nsamples ) );
+		out.m_flDot[0] = MulSIMD ( dot[g], seeAmount );
+		out.m_flFalloff = Four_Ones;
+		out.m_flSunAmount = MulSIMD ( seeAmount, ReplicateX4( 10000.0f ) );
+		for ( int i = 1; i < normalCount; i++ )
 		{
-			out.m_flDot[i] = NegSIMD( pNormals[i] * dl->light.normal );
-			out.m_flDot[i] = MulSIMD( out.m_flDot[i], seeAmount );
+			if ( bIgnoreNormals )
+				out.m_flDot[i] = ReplicateX4 ( CONSTANT_DOT );
+			else
+			{
+				out.m_flDot[i] = NegSIMD( ppNormals[g][i] * dl->light.normal );
+				out.m_flDot[i] = MulSIMD( out.m_flDot[i], seeAmount );
+			}
 		}
 	}
 }
 
 // Helper function - gathers light from ambient sky light
-void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-							   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t *pOut, int nGroups, directlight_t *dl, int facenum, 
+							   FourVectors const *pPos, FourVectors * const *ppNormals, int normalCount, int iThread,
 							   int nLFlags, int static_prop_index_to_ignore,
 							   float flEpsilon )
 {
@@ -1751,15 +1804,19 @@ void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl,
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
 	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
 
-	fltx4 sumdot = Four_Zeros;
-	fltx4 ambient_intensity[NUM_BUMP_VECTS+1];
-	fltx4 possibleHitCount[NUM_BUMP_VECTS+1];
-	fltx4 dots[NUM_BUMP_VECTS+1];
+	fltx4 sumdot[2];
+	fltx4 ambient_intensity[2][NUM_BUMP_VECTS+1];
+	fltx4 possibleHitCount[2][NUM_BUMP_VECTS+1];
+	fltx4 dots[2][NUM_BUMP_VECTS+1];
 
-	for ( int i = 0; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		ambient_intensity[i] = Four_Zeros;
-		possibleHitCount[i] = Four_Zeros;
+		sumdot[g] = Four_Zeros;
+		for ( int i = 0; i < normalCount; i++ )
+		{
+			ambient_intensity[g][i] = Four_Zeros;
+			possibleHitCount[g][i] = Four_Zeros;
+		}
 	}
 
 	DirectionalSampler_t sampler;
@@ -1774,73 +1831,91 @@ void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl,
 		FourVectors anorm;
 		anorm.DuplicateVector( sampler.NextValue() );
 
-		if ( bIgnoreNormals )
-			dots[0] = ReplicateX4( CONSTANT_DOT );
-		else
-			dots[0] = NegSIMD( pNormals[0] * anorm );
-
-		fltx4 validity = CmpGtSIMD( dots[0], ReplicateX4( EQUAL_EPSILON ) );
+		bool bActive[2] = { false, false };
+		FourVectors surfacePos[2];
+		FourVectors delta[2];
 
-		// No possibility of anybody getting lit
-		if ( !TestSignSIMD( validity ) )
-			continue;
-
-		dots[0] = AndSIMD( validity, dots[0] );
-		sumdot = AddSIMD( dots[0], sumdot );
-		possibleHitCount[0] = AddSIMD( AndSIMD( validity, Four_Ones ), possibleHitCount[0] );
-
-		for ( int i = 1; i < normalCount; i++ )
+		for ( int g = 0; g < nGroups; g++ )
 		{
 			if ( bIgnoreNormals )
-				dots[i] = ReplicateX4( CONSTANT_DOT );
+				dots[g][0] = ReplicateX4( CONSTANT_DOT );
 			else
-				dots[i] = NegSIMD( pNormals[i] * anorm );
-			fltx4 validity2 = CmpGtSIMD( dots[i], ReplicateX4 ( EQUAL_EPSILON ) );
-			dots[i] = AndSIMD( validity2, dots[i] );
-			possibleHitCount[i] = AddSIMD( AndSIMD( AndSIMD( validity, validity2 ), Four_Ones ), possibleHitCount[i] );
+				dots[g][0] = NegSIMD( ppNormals[g][0] * anorm );
+
+			fltx4 validity = CmpGtSIMD( dots[g][0], ReplicateX4( EQUAL_EPSILON ) );
+
+			// No possibility of anybody getting lit
+			if ( !TestSignSIMD( validity ) )
+				continue;
+
+			bActive[g] = true;
+
+			dots[g][0] = AndSIMD( validity, dots[g][0] );
+			sumdot[g] = AddSIMD( dots[g][0], sumdot[g] );
+			possibleHitCount[g][0] = AddSIMD( AndSIMD( validity, Four_Ones ), possibleHitCount[g][0] );
+
+			for ( int i = 1; i < normalCount; i++ )
+			{
+				if ( bIgnoreNormals )
+					dots[g][i] = ReplicateX4( CONSTANT_DOT );
+				else
+					dots[g][i] = NegSIMD( ppNormals[g][i] * anorm );
+				fltx4 validity2 = CmpGtSIMD( dots[g][i], ReplicateX4 ( EQUAL_EPSILON ) );
+				dots[g][i] = AndSIMD( validity2, dots[g][i] );
+				possibleHitCount[g][i] = AddSIMD( AndSIMD( AndSIMD( validity, validity2 ), Four_Ones ), possibleHitCount[g][i] );
+			}
+
+			// search back to see if we can hit a sky brush
+			delta[g] = anorm;
+			delta[g] *= -MAX_TRACE_LENGTH;
+			delta[g] += pPos[g];
+			surfacePos[g] = pPos[g];
+			FourVectors offset = anorm;
+			offset *= -flEpsilon;
+			surfacePos[g] -= offset;
 		}
 
-		// search back to see if we can hit a sky brush
-		FourVectors delta = anorm;
-		delta *= -MAX_TRACE_LENGTH;
-		delta += pos;
-		FourVectors surfacePos = pos;
-		FourVectors offset = anorm;
-		offset *= -flEpsilon;
-		surfacePos -= offset;
-
-		fltx4 fractionVisible = Four_Ones;
-		TestLine_DoesHitSky( surfacePos, delta, &fractionVisible, true, static_prop_index_to_ignore );
-		for ( int i = 0; i < normalCount; i++ )
+		fltx4 fractionVisible[2] = { Four_Ones, Four_Ones };
+		TestLineGroups_DoesHitSky( nGroups, bActive, surfacePos, delta, fractionVisible, static_prop_index_to_ignore );
+
+		for ( int g = 0; g < nGroups; g++ )
 		{
-			fltx4 addedAmount = MulSIMD( fractionVisible, dots[i] );
-			ambient_intensity[i] = AddSIMD( ambient_intensity[i], addedAmount );
-		}
+			if ( !bActive[g] )
+				continue;
 
+			for ( int i = 0; i < normalCount; i++ )
+			{
+				fltx4 addedAmount = MulSIMD( fractionVisible[g], dots[g][i] );
+				ambient_intensity[g][i] = AddSIMD( ambient_intensity[g][i], addedAmount );
+			}
+		}
 	}
 
-	out.m_flFalloff = Four_Ones;
-	for ( int i = 0; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		// now scale out the missing parts of the hemisphere of this bump basis vector
-		fltx4 factor = ReciprocalSIMD( possibleHitCount[0] );
-		factor = MulSIMD( factor, possibleHitCount[i] );
-		out.m_flDot[i] = MulSIMD( factor, sumdot );
-		out.m_flDot[i] = ReciprocalSIMD( out.m_flDot[i] );
-		out.m_flDot[i] = MulSIMD( ambient_intensity[i], out.m_flDot[i] );
+		SSE_sampleLightOutput_t &out = pOut[g];
+		out.m_flFalloff = Four_Ones;
+		for ( int i = 0; i < normalCount; i++ )
+		{
+			// now scale out the missing parts of the hemisphere of this bump basis vector
+			fltx4 factor = ReciprocalSIMD( possibleHitCount[g][0] );
+			factor = MulSIMD( factor, possibleHitCount[g][i] );
+			out.m_flDot[i] = MulSIMD( factor, sumdot[g] );
+			out.m_flDot[i] = ReciprocalSIMD( out.m_flDot[i] );
+			out.m_flDot[i] = MulSIMD( ambient_intensity[g][i], out.m_flDot[i] );
+		}
 	}
 
 }
 
-// Helper function - gathers light from area lights, spot lights, and point lights
-void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-								  FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
-								  int nLFlags, int static_prop_index_to_ignore,
-								  float flEpsilon )
+// Everything GatherSampleStandardLightSSE does before the visibility trace. Returns false if the
+// light can't reach any of the samples, src is where to trace to otherwise.
+static bool ComputeStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl,
+									 FourVectors const& pos, FourVectors *pNormals, int nLFlags,
+									 FourVectors &src, FourVectors &delta, fltx4 &dot )
 {
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
 
-	FourVectors src;
 	src.DuplicateVector( vec3_origin );
 
 	if (dl->facenum == -1)
@@ -1849,7 +1924,6 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 	}
 
 	// Find light vector
-	FourVectors delta;
 	delta = src;
 	delta -= pos;
 	fltx4 dist2 = delta.length2();
@@ -1858,7 +1932,7 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 	fltx4 dist = SqrtEstSIMD( dist2 );//delta.VectorNormalize();
 
 	// Compute dot
-	fltx4 dot = ReplicateX4( (float) CONSTANT_DOT );
+	dot = ReplicateX4( (float) CONSTANT_DOT );
 	if ( !bIgnoreNormals )
 		dot = delta * pNormals[0];
 	dot = MaxSIMD( Four_Zeros, dot );
@@ -1870,7 +1944,7 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 		fltx4 notPastFadeDist = CmpLeSIMD ( dist, ReplicateX4 ( dl->m_flEndFadeDistance ) );
 		dot = AndSIMD( dot, notPastFadeDist );  // dot = 0 if past fade distance
 		if ( !TestSignSIMD ( notPastFadeDist ) )
-			return;
+			return false;
 	}
 
 	dist = MaxSIMD( dist, Four_Ones );
@@ -1901,7 +1975,7 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 		// Light behind surface yields zero dot
 		dot2 = MaxSIMD( Four_Zeros, dot2 );
 		if ( TestSignSIMD( CmpEqSIMD( Four_Zeros, dot ) ) == 0xF )
-			return;
+			return false;
 
 		out.m_flFalloff = ReciprocalSIMD ( dist2 );
 		out.m_flFalloff = MulSIMD( out.m_flFalloff, dot2 );
@@ -1919,7 +1993,7 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 		// Affix dot2 to zero if outside light cone
 		inCone = CmpGtSIMD( dot2, ReplicateX4( dl->light.stopdot2 ) );
 		if ( !TestSignSIMD ( inCone ) )
-			return;
+			return false;
 		dot = AndSIMD( inCone, dot );
 
 		constant  = ReplicateX4( dl->light.constant_attn );
@@ -1976,57 +2050,82 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 		out.m_flFalloff = MulSIMD( mult, out.m_flFalloff );
 	}
 
+	return true;
+}
+
+// Helper function - gathers light from area lights, spot lights, and point lights
+void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t *pOut, int nGroups, directlight_t *dl, int facenum, 
+								  FourVectors const *pPos, FourVectors * const *ppNormals, int normalCount, int iThread,
+								  int nLFlags, int static_prop_index_to_ignore,
+								  float flEpsilon )
+{
+	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
+
+	FourVectors src[2];
+	FourVectors delta[2];
+	fltx4 dot[2];
+	bool bActive[2] = { false, false };
+
+	for ( int g = 0; g < nGroups; g++ )
+		bActive[g] = ComputeStandardLightSSE( pOut[g], dl, pPos[g], ppNormals[g], nLFlags, src[g], delta[g], dot[g] );
+
 	// Raytrace for visibility function
-	fltx4 fractionVisible = Four_Ones;
-	TestLine( pos, src, &fractionVisible, static_prop_index_to_ignore);
-	dot = MulSIMD( fractionVisible, dot );
-	out.m_flDot[0] = dot;
+	fltx4 fractionVisible[2] = { Four_Ones, Four_Ones };
+	TestLineGroups( nGroups, bActive, pPos, src, fractionVisible, static_prop_index_to_ignore );
 
-	for ( int i = 1; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		if ( bIgnoreNormals )
-			out.m_flDot[i] = ReplicateX4( (float) CONSTANT_DOT );
-		else
+		if ( !bActive[g] )
+			continue;
+
+		SSE_sampleLightOutput_t &out = pOut[g];
+		out.m_flDot[0] = MulSIMD( fractionVisible[g], dot[g] );
+
+		for ( int i = 1; i < normalCount; i++ )
 		{
-			out.m_flDot[i] = pNormals[i] * delta;
-			out.m_flDot[i] = MaxSIMD( Four_Zeros, out.m_flDot[i] );
+			if ( bIgnoreNormals )
+				out.m_flDot[i] = ReplicateX4( (float) CONSTANT_DOT );
+			else
+			{
+				out.m_flDot[i] = ppNormals[g][i] * delta[g];
+				out.m_flDot[i] = MaxSIMD( Four_Zeros, out.m_flDot[i] );
+			}
 		}
 	}
 }
 
-// returns dot product with normal and delta
-// dl - light
-// pos - position of sample
-// normal - surface normal of sample
-// out.m_flDot[] - returned dot products with light vector and each normal
-// out.m_flFalloff - amount of light falloff
-void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-					   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
-					   int nLFlags,
-					   int static_prop_index_to_ignore,
-					   float flEpsilon )
+// Same as GatherSampleLightSSE on one or two groups of 4 samples. The visibility traces for two
+// groups are done together.
+static void GatherSampleLightGroupsSSE( SSE_sampleLightOutput_t *pOut, int nGroups, directlight_t *dl, int facenum, 
+										FourVectors const *pPos, FourVectors * const *ppNormals, int normalCount, int iThread,
+										int nLFlags, int static_prop_index_to_ignore, float flEpsilon )
 {
-	for ( int b = 0; b < normalCount; b++ )
-		out.m_flDot[b] = Four_Zeros;
-	out.m_flFalloff = Four_Zeros;
-	out.m_flSunAmount = Four_Zeros;
+	Assert( nGroups >= 1 && nGroups <= 2 );
+
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		for ( int b = 0; b < normalCount; b++ )
+			pOut[g].m_flDot[b] = Four_Zeros;
+		pOut[g].m_flFalloff = Four_Zeros;
+		pOut[g].m_flSunAmount = Four_Zeros;
+	}
 	Assert( normalCount <= (NUM_BUMP_VECTS+1) );
 
 	// skylights work fundamentally differently than normal lights
 	switch( dl->light.type )
 	{
 	case emit_skylight:
-		GatherSampleSkyLightSSE( out, dl, facenum, pos, pNormals, normalCount,
+		GatherSampleSkyLightSSE( pOut, nGroups, dl, facenum, pPos, ppNormals, normalCount,
 		                         iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	case emit_skyambient:
-		GatherSampleAmbientSkySSE( out, dl, facenum, pos, pNormals, normalCount,
+		GatherSampleAmbientSkySSE( pOut, nGroups, dl, facenum, pPos, ppNormals, normalCount,
 		                           iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	case emit_point:
 	case emit_surface:
 	case emit_spotlight:
-		GatherSampleStandardLightSSE( out, dl, facenum, pos, pNormals, normalCount,
+		GatherSampleStandardLightSSE( pOut, nGroups, dl, facenum, pPos, ppNormals, normalCount,
 		                              iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	default:
@@ -2038,14 +2137,33 @@ void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int
 	// (tested by checking the dot product of the face normal and the light position)
 	// we don't want it to contribute to *any* of the bumped lightmaps. It glows
 	// in disturbing ways if we don't do this.
-	out.m_flDot[0] = MaxSIMD ( out.m_flDot[0], Four_Zeros );
-	fltx4 notZero = CmpGtSIMD( out.m_flDot[0], Four_Zeros );
-	for ( int n = 1; n < normalCount; n++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		out.m_flDot[n] = MaxSIMD( out.m_flDot[n], Four_Zeros );
-		out.m_flDot[n] = AndSIMD( out.m_flDot[n], notZero );
+		SSE_sampleLightOutput_t &out = pOut[g];
+		out.m_flDot[0] = MaxSIMD ( out.m_flDot[0], Four_Zeros );
+		fltx4 notZero = CmpGtSIMD( out.m_flDot[0], Four_Zeros );
+		for ( int n = 1; n < normalCount; n++ )
+		{
+			out.m_flDot[n] = MaxSIMD( out.m_flDot[n], Four_Zeros );
+			out.m_flDot[n] = AndSIMD( out.m_flDot[n], notZero );
+		}
 	}
+}
 
+// returns dot product with normal and delta
+// dl - light
+// pos - position of sample
+// normal - surface normal of sample
+// out.m_flDot[] - returned dot products with light vector and each normal
+// out.m_flFalloff - amount of light falloff
+void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
+					   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+					   int nLFlags,
+					   int static_prop_index_to_ignore,
+					   float flEpsilon )
+{
+	GatherSampleLightGroupsSSE( &out, 1, dl, facenum, &pos, &pNormals, normalCount, iThread,
+		nLFlags, static_prop_index_to_ignore, flEpsilon );
 }
 
 /*
@@ -2485,83 +2603,155 @@ static void ComputeIlluminationPointAndNormalsSSE( lightinfo_t const& l, FourVec
 		pInfo->m_Clusters[i] = ClusterFromPoint( pos.Vec( i ) );
 }
 
+// A light's contribution to the second group of samples, held until the first group is done
+struct DeferredSampleLight_t
+{
+	directlight_t	*m_pLight;
+	float			m_flDot[NUM_BUMP_VECTS+1][4];
+	float			m_flSunAmount[4];
+};
+
 //-----------------------------------------------------------------------------
-// Iterates over all lights and computes lighting at up to 4 sample points
+// Adds a light's contribution to up to 4 sample points
 //-----------------------------------------------------------------------------
-static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, int numSamples )
+static void AddLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, int numSamples, directlight_t *dl,
+							   fltx4 const *fxdot, fltx4 const &sunAmount )
 {
-	SSE_sampleLightOutput_t out;
+	// Figure out the lightstyle for this particular sample
+	int lightStyleIndex = FindOrAllocateLightstyleSamples( info.m_pFace, info.m_pFaceLight, 
+		dl->light.style, info.m_NormalCount );
+	if (lightStyleIndex < 0)
+	{
+		if (info.m_WarnFace != info.m_FaceNum)
+		{
+			Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
+				info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
+			info.m_WarnFace = info.m_FaceNum;
+		}
+		return;
+	}
+
+	// pLightmaps is an array of the lightmaps for each normal direction,
+	// here's where the result of the sample gathering goes
+	LightingValue_t** pLightmaps = info.m_pFaceLight->light[lightStyleIndex];
+
+	// Incremental lighting only cares about lightstyle zero
+	if( g_pIncremental && (dl->light.style == 0) )
+	{
+		for ( int i = 0; i < numSamples; i++ )
+		{
+			g_pIncremental->AddLightToFace( dl->m_IncrementalID, info.m_FaceNum, sampleIdx + i, 
+				info.m_LightmapSize, SubFloat( fxdot[0], i ), info.m_iThread );
+		}
+	}
+
+	for( int n = 0; n < info.m_NormalCount; ++n )
+	{
+		for ( int i = 0; i < numSamples; i++ )
+		{
+			pLightmaps[n][sampleIdx + i].AddLight( SubFloat( fxdot[n], i ), dl->light.intensity, SubFloat( sunAmount, i ) );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Iterates over all lights and computes lighting at up to 8 sample points, in
+// two groups of 4. The visibility traces for both groups go out together, but
+// the second group's light is only added after the first group's, so the face's
+// lightstyles are allocated in the same order as doing a group at a time.
+//-----------------------------------------------------------------------------
+static void GatherSampleLightAt8Points( SSE_SampleInfo_t *pInfo, int nGroups, int sampleIdx, int const *pNumSamples,
+									   CUtlVector<DeferredSampleLight_t> &deferred )
+{
+	SSE_sampleLightOutput_t out[2];
+	FourVectors points[2];
+	FourVectors *pNormals[2];
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		points[g] = pInfo[g].m_Points;
+		pNormals[g] = pInfo[g].m_PointNormals;
+	}
+
+	int normalCount = pInfo[0].m_NormalCount;
+	deferred.RemoveAll();
 
 	// Iterate over all direct lights and add them to the particular sample
 	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
 	{	    
 		// is this lights cluster visible?
-		fltx4 dotMask = Four_Zeros;
-		bool skipLight = true;
-		for( int s = 0; s < numSamples; s++ )
+		fltx4 dotMask[2];
+		bool bVisible[2] = { false, false };
+		for ( int g = 0; g < nGroups; g++ )
 		{
-			if( PVSCheck( dl->pvs, info.m_Clusters[s] ) )
+			dotMask[g] = Four_Zeros;
+			for( int s = 0; s < pNumSamples[g]; s++ )
 			{
-				dotMask = SetComponentSIMD( dotMask, s, 1.0f );
-				skipLight = false;
+				if( PVSCheck( dl->pvs, pInfo[g].m_Clusters[s] ) )
+				{
+					dotMask[g] = SetComponentSIMD( dotMask[g], s, 1.0f );
+					bVisible[g] = true;
+				}
 			}
 		}
-		if ( skipLight )
+
+		// only the groups that can see it need the traces
+		int iFirst = bVisible[0] ? 0 : 1;
+		int nVisible = (int)bVisible[0] + (int)bVisible[1];
+		if ( !nVisible )
 			continue;
 
-		GatherSampleLightSSE( out, dl, info.m_FaceNum, info.m_Points, info.m_PointNormals, info.m_NormalCount, info.m_iThread );
+		GatherSampleLightGroupsSSE( &out[iFirst], nVisible, dl, pInfo[0].m_FaceNum, &points[iFirst], &pNormals[iFirst],
+			normalCount, pInfo[0].m_iThread, 0, -1, 0.0f );
 		
-		// Apply the PVS check filter and compute falloff x dot
-		fltx4 fxdot[NUM_BUMP_VECTS + 1];
-		skipLight = true;
-		for ( int b = 0; b < info.m_NormalCount; b++ )
+		for ( int g = iFirst; g < iFirst + nVisible; g++ )
 		{
-			fxdot[b] = MulSIMD( out.m_flDot[b], dotMask );
-			fxdot[b] = MulSIMD( fxdot[b], out.m_flFalloff );
-			if ( !IsAllZeros( fxdot[b] ) )
+			// Apply the PVS check filter and compute falloff x dot
+			fltx4 fxdot[NUM_BUMP_VECTS + 1];
+			bool skipLight = true;
+			for ( int b = 0; b < normalCount; b++ )
 			{
-				skipLight = false;
+				fxdot[b] = MulSIMD( out[g].m_flDot[b], dotMask[g] );
+				fxdot[b] = MulSIMD( fxdot[b], out[g].m_flFalloff );
+				if ( !IsAllZeros( fxdot[b] ) )
+				{
+					skipLight = false;
+				}
 			}
-		}
-		if ( skipLight )
-			continue;
+			if ( skipLight )
+				continue;
 
-		// Figure out the lightstyle for this particular sample
-		int lightStyleIndex = FindOrAllocateLightstyleSamples( info.m_pFace, info.m_pFaceLight, 
-			dl->light.style, info.m_NormalCount );
-		if (lightStyleIndex < 0)
-		{
-			if (info.m_WarnFace != info.m_FaceNum)
+			if ( g == 0 )
 			{
-				Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
-					info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
-				info.m_WarnFace = info.m_FaceNum;
+				AddLightAt4Points( pInfo[0], sampleIdx, pNumSamples[0], dl, fxdot, out[0].m_flSunAmount );
+				continue;
 			}
-			continue;
+
+			DeferredSampleLight_t &light = deferred[deferred.AddToTail()];
+			light.m_pLight = dl;
+			for ( int b = 0; b < normalCount; b++ )
+				StoreUnalignedSIMD( light.m_flDot[b], fxdot[b] );
+			StoreUnalignedSIMD( light.m_flSunAmount, out[g].m_flSunAmount );
 		}
+	}
 
-		// pLightmaps is an array of the lightmaps for each normal direction,
-		// here's where the result of the sample gathering goes
-		LightingValue_t** pLightmaps = info.m_pFaceLight->light[lightStyleIndex];
+	if ( nGroups < 2 )
+		return;
 
-		// Incremental lighting only cares about lightstyle zero
-		if( g_pIncremental && (dl->light.style == 0) )
-		{
-			for ( int i = 0; i < numSamples; i++ )
-			{
-				g_pIncremental->AddLightToFace( dl->m_IncrementalID, info.m_FaceNum, sampleIdx + i, 
-					info.m_LightmapSize, SubFloat( fxdot[0], i ), info.m_iThread );
-			}
-		}
+	pInfo[1].m_WarnFace = pInfo[0].m_WarnFace;
 
-		for( int n = 0; n < info.m_NormalCount; ++n )
-		{
-			for ( int i = 0; i < numSamples; i++ )
-			{
-				pLightmaps[n][sampleIdx + i].AddLight( SubFloat( fxdot[n], i ), dl->light.intensity, SubFloat( out.m_flSunAmount, i ) );
-			}
-		}
+	for ( int i = 0; i < deferred.Count(); i++ )
+	{
+		DeferredSampleLight_t &light = deferred[i];
+
+		fltx4 fxdot[NUM_BUMP_VECTS + 1];
+		for ( int b = 0; b < normalCount; b++ )
+			fxdot[b] = LoadUnalignedSIMD( light.m_flDot[b] );
+		fltx4 sunAmount = LoadUnalignedSIMD( light.m_flSunAmount );
+
+		AddLightAt4Points( pInfo[1], sampleIdx + 4, pNumSamples[1], light.m_pLight, fxdot, sunAmount );
 	}
+
+	pInfo[0].m_WarnFace = pInfo[1].m_WarnFace;
 }
 
 
@@ -3106,44 +3296,63 @@ void BuildFacelights (int iThread, int facenum)
 	CalcPoints( &l, fl, facenum );
 	InitSampleInfo( l, iThread, sampleInfo );
 
+	// the last compile's lighting can be used if nothing that reaches this face has changed
+	bool bCached = g_bFaceCache && FaceCache_RestoreFaceLight( facenum, sampleInfo.m_NormalCount );
+
 	// Allocate sample positions/normals to SSE
 	int numGroups = ( fl->numsamples & 0x3) ? ( fl->numsamples / 4 ) + 1 : ( fl->numsamples / 4 );
 
 	// always allocate style 0 lightmap
-	f->styles[0] = 0;
-	AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
-
-	// sample the lights at each sample location
-	for ( int grp = 0; grp < numGroups; ++grp )
+	if ( !bCached )
 	{
-		int nSample = 4 * grp;
+		f->styles[0] = 0;
+		AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
+	}
 
-		sample_t *sample = sampleInfo.m_pFaceLight->sample + nSample;
-		int numSamples = min ( 4, sampleInfo.m_pFaceLight->numsamples - nSample );
+	// sample the lights at each sample location, two groups of spots at a time so each light's
+	// visibility traces go out 8 at a time
+	SSE_SampleInfo_t groupInfo[2] = { sampleInfo, sampleInfo };
+	CUtlVector<DeferredSampleLight_t> deferredLights;
 
-		FourVectors positions;
-		FourVectors normals;
+	for ( int grp = 0; grp < numGroups; grp += 2 )
+	{
+		int nGroups = min( 2, numGroups - grp );
+		int numSamples[2];
 
-		for ( int i = 0; i < 4; i++ )
+		for ( int g = 0; g < nGroups; g++ )
 		{
-			v[i] = ( i < numSamples ) ? sample[i].pos : sample[numSamples - 1].pos;
-			n[i] = ( i < numSamples ) ? sample[i].normal : sample[numSamples - 1].normal;
-		}
-		positions.LoadAndSwizzle( v[0], v[1], v[2], v[3] );
-		normals.LoadAndSwizzle( n[0], n[1], n[2], n[3] );
+			int nSample = 4 * ( grp + g );
 
-		ComputeIlluminationPointAndNormalsSSE( l, positions, normals, &sampleInfo, numSamples );
+			sample_t *sample = sampleInfo.m_pFaceLight->sample + nSample;
+			numSamples[g] = min ( 4, sampleInfo.m_pFaceLight->numsamples - nSample );
 
-		// Fixup sample normals in case of smooth faces
-		if ( !l.isflat )
-		{
-			for ( int i = 0; i < numSamples; i++ )
-				sample[i].normal = sampleInfo.m_PointNormals[0].Vec( i );
+			FourVectors positions;
+			FourVectors normals;
+
+			for ( int i = 0; i < 4; i++ )
+			{
+				v[i] = ( i < numSamples[g] ) ? sample[i].pos : sample[numSamples[g] - 1].pos;
+				n[i] = ( i < numSamples[g] ) ? sample[i].normal : sample[numSamples[g] - 1].normal;
+			}
+			positions.LoadAndSwizzle( v[0], v[1], v[2], v[3] );
+			normals.LoadAndSwizzle( n[0], n[1], n[2], n[3] );
+
+			ComputeIlluminationPointAndNormalsSSE( l, positions, normals, &groupInfo[g], numSamples[g] );
+
+			// Fixup sample normals in case of smooth faces
+			if ( !l.isflat )
+			{
+				for ( int i = 0; i < numSamples[g]; i++ )
+					sample[i].normal = groupInfo[g].m_PointNormals[0].Vec( i );
+			}
 		}
 
-		// Iterate over all the lights and add their contribution to this group of spots
-		GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		// Iterate over all the lights and add their contribution to these groups of spots
+		if ( !bCached )
+			GatherSampleLightAt8Points( groupInfo, nGroups, 4 * grp, numSamples, deferredLights );
 	}
+
+	sampleInfo.m_WarnFace = groupInfo[0].m_WarnFace;
 	
 	// Tell the incremental light manager that we're done with this face.
 	if( g_pIncremental )
@@ -3161,7 +3370,7 @@ void BuildFacelights (int iThread, int facenum)
 	}
 
 	// get rid of the -extra functionality on displacement surfaces
-	if (do_extra && !sampleInfo.m_IsDispFace)
+	if (do_extra && !sampleInfo.m_IsDispFace && !bCached)
 	{
 		// For each lightstyle, perform a supersampling pass
 		for ( i = 0; i < MAXLIGHTMAPS; ++i )
@@ -3174,6 +3383,11 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
+	if ( g_bFaceCache )
+	{
+		FaceCache_StoreFaceLight( facenum, sampleInfo.m_NormalCount );
+	}
+
 	if (!g_bUseMPI) 
 	{
 		//
@@ -148,6 +148,22 @@ public:
 	}
 };
 
+// Assume we can see the targets unless we get hits
+static fltx4 FractionVisible( RayTracingResult const &rt_result, fltx4 len )
+{
+	float visibility[4];
+	for ( int i = 0; i < 4; i++ )
+	{
+		visibility[i] = 1.0f;
+		if ( ( rt_result.HitIds[i] != -1 ) &&
+		     ( rt_result.HitDistance.m128_f32[i] < len.m128_f32[i] ) )
+		{
+			visibility[i] = 0.0f;
+		}
+	}
+	return LoadUnalignedSIMD( visibility );
+}
+
 void TestLine( const FourVectors& start, const FourVectors& stop,
                fltx4 *pFractionVisible, int static_prop_index_to_ignore )
 {
@@ -163,22 +179,41 @@ void TestLine( const FourVectors& start, const FourVectors& stop,
 
 	g_RtEnv.Trace4Rays(myrays, Four_Zeros, len, &rt_result, TRACE_ID_STATICPROP | static_prop_index_to_ignore, g_bTextureShadows ? &coverageCallback : 0 );
 
-	// Assume we can see the targets unless we get hits
-	float visibility[4];
-	for ( int i = 0; i < 4; i++ )
-	{
-		visibility[i] = 1.0f;
-		if ( ( rt_result.HitIds[i] != -1 ) &&
-		     ( rt_result.HitDistance.m128_f32[i] < len.m128_f32[i] ) )
-		{
-			visibility[i] = 0.0f;
-		}
-	}
-	*pFractionVisible = LoadUnalignedSIMD( visibility );
+	*pFractionVisible = FractionVisible( rt_result, len );
 	if ( g_bTextureShadows )
 		*pFractionVisible = MinSIMD( *pFractionVisible, coverageCallback.GetFractionVisible() );
 }
 
+void TestLine8( FourVectors const *pStart, FourVectors const *pStop,
+				fltx4 *pFractionVisible, int static_prop_index_to_ignore )
+{
+	// The coverage callback needs the 4 wide tracer
+	if ( g_bTextureShadows )
+	{
+		TestLine( pStart[0], pStop[0], &pFractionVisible[0], static_prop_index_to_ignore );
+		TestLine( pStart[1], pStop[1], &pFractionVisible[1], static_prop_index_to_ignore );
+		return;
+	}
+
+	FourRays myrays[2];
+	fltx4 len[2];
+	fltx4 TMin[2] = { Four_Zeros, Four_Zeros };
+	for ( int h = 0; h < 2; h++ )
+	{
+		myrays[h].origin = pStart[h];
+		myrays[h].direction = pStop[h];
+		myrays[h].direction -= myrays[h].origin;
+		len[h] = myrays[h].direction.length();
+		myrays[h].direction *= ReciprocalSIMD( len[h] );
+	}
+
+	RayTracingResult rt_result[2];
+	g_RtEnv.Trace8Rays( myrays, TMin, len, rt_result, TRACE_ID_STATICPROP | static_prop_index_to_ignore );
+
+	pFractionVisible[0] = FractionVisible( rt_result[0], len[0] );
+	pFractionVisible[1] = FractionVisible( rt_result[1], len[1] );
+}
+
 
 
 /*
@@ -349,25 +384,12 @@ void DM_ClipBoxToBrush( CToolTrace *trace, const Vector& mins, const Vector& max
 	}
 }
 
-void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
+// Works out how much of the sky each ray of a TestLine_DoesHitSky trace sees. pCoverage is what the
+// texture shadows covered, or NULL without them.
+static void SkyFractionVisible( FourVectors const& start, FourVectors const& stop, fltx4 len,
+	RayTracingResult const &rt_result, fltx4 const *pCoverage,
 	fltx4 *pFractionVisible, bool canRecurse, int static_prop_to_skip, bool bDoDebug )
 {
-	FourRays myrays;
-	myrays.origin = start;
-	myrays.direction = stop;
-	myrays.direction -= myrays.origin;
-	fltx4 len = myrays.direction.length();
-	myrays.direction *= ReciprocalSIMD( len );
-	RayTracingResult rt_result;
-	CCoverageCountTexture coverageCallback;
-
-	g_RtEnv.Trace4Rays(myrays, Four_Zeros, len, &rt_result, TRACE_ID_STATICPROP | static_prop_to_skip, g_bTextureShadows? &coverageCallback : 0);
-
-	if ( bDoDebug )
-	{
-		WriteTrace( "trace.txt", myrays, rt_result );
-	}
-
 	float aOcclusion[4];
 	for ( int i = 0; i < 4; i++ )
 	{
@@ -381,8 +403,8 @@ void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
 		}
 	}
 	fltx4 occlusion = LoadUnalignedSIMD( aOcclusion );
-	if (g_bTextureShadows)
-		occlusion = MaxSIMD ( occlusion, coverageCallback.GetCoverage() );
+	if ( pCoverage )
+		occlusion = MaxSIMD ( occlusion, *pCoverage );
 
 	bool fullyOccluded = ( TestSignSIMD( CmpGeSIMD( occlusion, Four_Ones ) ) == 0xF );
 
@@ -428,6 +450,68 @@ void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
 	*pFractionVisible = SubSIMD( Four_Ones, occlusion );
 }
 
+void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
+	fltx4 *pFractionVisible, bool canRecurse, int static_prop_to_skip, bool bDoDebug )
+{
+	FourRays myrays;
+	myrays.origin = start;
+	myrays.direction = stop;
+	myrays.direction -= myrays.origin;
+	fltx4 len = myrays.direction.length();
+	myrays.direction *= ReciprocalSIMD( len );
+	RayTracingResult rt_result;
+	CCoverageCountTexture coverageCallback;
+
+	g_RtEnv.Trace4Rays(myrays, Four_Zeros, len, &rt_result, TRACE_ID_STATICPROP | static_prop_to_skip, g_bTextureShadows? &coverageCallback : 0);
+
+	if ( bDoDebug )
+	{
+		WriteTrace( "trace.txt", myrays, rt_result );
+	}
+
+	fltx4 coverage = coverageCallback.GetCoverage();
+	SkyFractionVisible( start, stop, len, rt_result, g_bTextureShadows ? &coverage : NULL,
+		pFractionVisible, canRecurse, static_prop_to_skip, bDoDebug );
+}
+
+void TestLine_DoesHitSky8( FourVectors const *pStart, FourVectors const *pStop,
+	fltx4 *pFractionVisible, bool canRecurse, int static_prop_to_skip, bool bDoDebug )
+{
+	// The coverage callback needs the 4 wide tracer
+	if ( g_bTextureShadows )
+	{
+		TestLine_DoesHitSky( pStart[0], pStop[0], &pFractionVisible[0], canRecurse, static_prop_to_skip, bDoDebug );
+		TestLine_DoesHitSky( pStart[1], pStop[1], &pFractionVisible[1], canRecurse, static_prop_to_skip, bDoDebug );
+		return;
+	}
+
+	FourRays myrays[2];
+	fltx4 len[2];
+	fltx4 TMin[2] = { Four_Zeros, Four_Zeros };
+	for ( int h = 0; h < 2; h++ )
+	{
+		myrays[h].origin = pStart[h];
+		myrays[h].direction = pStop[h];
+		myrays[h].direction -= myrays[h].origin;
+		len[h] = myrays[h].direction.length();
+		myrays[h].direction *= ReciprocalSIMD( len[h] );
+	}
+
+	RayTracingResult rt_result[2];
+	g_RtEnv.Trace8Rays( myrays, TMin, len, rt_result, TRACE_ID_STATICPROP | static_prop_to_skip );
+
+	for ( int h = 0; h < 2; h++ )
+	{
+		if ( bDoDebug )
+		{
+			WriteTrace( "trace.txt", myrays[h], rt_result[h] );
+		}
+
+		SkyFractionVisible( pStart[h], pStop[h], len[h], rt_result[h], NULL,
+			&pFractionVisible[h], canRecurse, static_prop_to_skip, bDoDebug );
+	}
+}
+
 
 
 //-----------------------------------------------------------------------------
@@ -7,6 +7,7 @@
 //=============================================================================//
 
 #include "vrad.h"
+#include "facecache.h"
 #include "vmpi.h"
 #ifdef MPI
 #include "messbuf.h"
@@ -417,12 +418,16 @@ void BuildVisLeafs_Cluster(
 			
 			patchnum = patch - g_Patches.Base();
 
-			// build to all other world clusters
-			BuildVisRow (patchnum, pvs, head, transfers, transferMaker, threadnum );
-			transferMaker.Finish();
-			
-			// do the transfers
-			MakeScales( patchnum, transfers );
+			// the last compile's transfers can be used if nothing this patch can see has changed
+			if ( !FaceCache_RestoreTransfers( patchnum ) )
+			{
+				// build to all other world clusters
+				BuildVisRow (patchnum, pvs, head, transfers, transferMaker, threadnum );
+				transferMaker.Finish();
+				
+				// do the transfers
+				MakeScales( patchnum, transfers );
+			}
 
 			// Let MPI aggregate the data if it's being used.
 			if ( PatchCB )
@@ -11,6 +11,7 @@
 #include "vrad.h"
 #include "physdll.h"
 #include "lightmap.h"
+#include "facecache.h"
 #include "tier1/strtools.h"
 #include "vmpi.h"
 #include "macro_texture.h"
@@ -2019,6 +2020,9 @@ bool RadWorld_Go()
 	}
 
 	// build initial facelights
+	qprintf( "Direct lighting visibility: %s\n",
+		( RayTracingEnvironment::Is8WideTracerEnabled() && !g_bTextureShadows && !( g_RtEnv.Flags & RTE_FLAGS_USE_BVH ) ) ? "8 rays at a time (AVX)" : "4 rays at a time" );
+
 	if (g_bUseMPI) 
 	{
 		// RunThreadsOnIndividual (numfaces, true, BuildFacelights);
@@ -2070,6 +2074,9 @@ bool RadWorld_Go()
 			BounceLight ();
 		}
 
+		// save this compile's lighting for the next one
+		FaceCache_Save();
+
 		//
 		// displacement surface luxel accumulation (make threaded!!!)
 		//
@@ -2257,6 +2264,8 @@ void VRAD_LoadBSP( char const *pFilename )
 	// Build acceleration structure
 	printf ( "Setting up ray-trace acceleration structure... ");
 	float start = Plat_FloatTime();
+	g_RtEnv.m_nBuildThreads = numthreads;				// only used by the bvh
+	FaceCache_HashOccluders();							// before the triangles are converted
 	g_RtEnv.SetupAccelerationStructure();
 	float end = Plat_FloatTime();
 	printf ( "Done (%.2f seconds)\n", end-start );
@@ -2267,6 +2276,9 @@ void VRAD_LoadBSP( char const *pFilename )
 
 	RadWorld_Start();
 
+	// Load the last compile's lighting, needs the patches and lights
+	FaceCache_Init( source );
+
 	// Setup incremental lighting.
 	if( g_pIncremental )
 	{
@@ -2475,6 +2487,18 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bNoSkyRecurse = true;
 		}
+		else if (!Q_stricmp(argv[i],"-noavx"))
+		{
+			RayTracingEnvironment::Set8WideTracerEnabled( false );
+		}
+		else if (!Q_stricmp(argv[i],"-bvh"))
+		{
+			g_RtEnv.Flags |= RTE_FLAGS_USE_BVH;
+		}
+		else if (!Q_stricmp(argv[i],"-cache"))
+		{
+			g_bFaceCache = true;
+		}
 		else if (!Q_stricmp(argv[i],"-final"))
 		{
 			g_flSkySampleScale = 16.0;
@@ -2829,6 +2853,13 @@ void PrintUsage( int argc, char **argv )
 		"  -StaticPropNormals : when lighting static props, just show their normal vector\n"
 		"  -textureshadows : Allows texture alpha channels to block light - rays intersecting alpha surfaces will sample the texture\n"
 		"  -noskyboxrecurse : Turn off recursion into 3d skybox (skybox shadows on world)\n"
+		"  -noavx          : Trace direct lighting 4 rays at a time even if the cpu has AVX\n"
+		"  -bvh            : Trace against a bvh instead of a kd tree. Builds faster on\n"
+		"                    big maps, but can't trace 8 rays at a time. With\n"
+		"                    -textureshadows, alpha shadows can differ slightly from\n"
+		"                    the kd tree's.\n"
+		"  -cache          : Keep each face's lighting in <map>.lightcache and only\n"
+		"                    relight the faces that changed since the last compile.\n"
 		"  -nossprops      : Globally disable self-shadowing on static props\n"
 		"\n"
 #if 1 // Disabled for the initial SDK release with VMPI so we can get feedback from selected users.
@@ -386,6 +386,12 @@ void TestLine( FourVectors const& start, FourVectors const& stop, fltx4 *pFracti
 void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
                           fltx4 *pFractionVisible, bool canRecurse = true, int static_prop_to_skip=-1, bool bDoDebug = false );
 
+// same as TestLine and TestLine_DoesHitSky on two groups of 4 lines at once, traced as one packet of 8
+// when the cpu can
+void TestLine8( FourVectors const *pStart, FourVectors const *pStop, fltx4 *pFractionVisible, int static_prop_index_to_ignore=-1);
+void TestLine_DoesHitSky8( FourVectors const *pStart, FourVectors const *pStop,
+                           fltx4 *pFractionVisible, bool canRecurse = true, int static_prop_to_skip=-1, bool bDoDebug = false );
+
 // converts any marked brush entities to triangles for shadow casting
 void ExtractBrushEntityShadowCasters ( void );
 void AddBrushesForRayTrace ( void );
@@ -0,0 +1,194 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Work stealing scheduler for PortalFlow.
+//
+// Every thread gets a deque of portals, dealt out in sorted order to whichever
+// thread has the least estimated work so far, so each deque is still cheapest
+// first and later portals can reuse what the earlier ones found. A thread that
+// runs out takes the most expensive portal left on the busiest other deque, so
+// the big portals at the end don't leave the rest of the threads idle.
+//
+//=============================================================================//
+
+#include <windows.h>
+#include "vis.h"
+#define NO_THREAD_NAMES
+#include "threads.h"
+#include "pacifier.h"
+#include "tier0/threadtools.h"
+
+struct PortalDeque_t
+{
+	CThreadFastMutex	m_Mutex;
+	CUtlVector<int>		m_Work;			// Indices into sorted_portals, cheapest first.
+	int					m_iHead;		// The owner takes from here...
+	int					m_iTail;		// ...and thieves from one before here.
+	int					m_nCostLeft;	// Estimated cost of m_iHead to m_iTail.
+
+	int					m_nRun;
+	int					m_nStolen;
+	double				m_flBusy;
+};
+
+static PortalDeque_t	g_PortalDeques[MAX_TOOL_THREADS];
+static int				g_nPortalDeques;
+static ThreadWorkerFn	g_PortalFlowFn;
+static int				g_nPortalsDone;
+static int				g_nPortalsTotal;
+
+// The work in PortalFlow goes up with how many portals it might see.
+static int PortalCost( int iPortal )
+{
+	return sorted_portals[iPortal]->nummightsee + 1;
+}
+
+static bool TakeOwnPortal( PortalDeque_t &deque, int &iPortal )
+{
+	AUTO_LOCK_FM( deque.m_Mutex );
+
+	if ( deque.m_iHead == deque.m_iTail )
+		return false;
+
+	iPortal = deque.m_Work[deque.m_iHead++];
+	deque.m_nCostLeft -= PortalCost( iPortal );
+	return true;
+}
+
+static bool StealPortal( int iThread, int &iPortal )
+{
+	while ( 1 )
+	{
+		// Pick the deque with the most work left. It's read without the locks, so it can be stale, but
+		// it's only a guess at where to steal from.
+		int iVictim = -1;
+		int nMostCost = 0;
+		for ( int i = 0; i < g_nPortalDeques; i++ )
+		{
+			if ( i != iThread && g_PortalDeques[i].m_nCostLeft > nMostCost )
+			{
+				iVictim = i;
+				nMostCost = g_PortalDeques[i].m_nCostLeft;
+			}
+		}
+
+		// Nothing is ever added, once every deque is empty the work is done.
+		if ( iVictim < 0 )
+			return false;
+
+		PortalDeque_t &victim = g_PortalDeques[iVictim];
+
+		AUTO_LOCK_FM( victim.m_Mutex );
+
+		if ( victim.m_iHead == victim.m_iTail )
+			continue;
+
+		iPortal = victim.m_Work[--victim.m_iTail];
+		victim.m_nCostLeft -= PortalCost( iPortal );
+		return true;
+	}
+}
+
+static void PortalFlowThread( int iThread, void *pUserData )
+{
+	PortalDeque_t &deque = g_PortalDeques[iThread];
+
+	while ( 1 )
+	{
+		int iPortal;
+		if ( TakeOwnPortal( deque, iPortal ) )
+		{
+			deque.m_nRun++;
+		}
+		else if ( StealPortal( iThread, iPortal ) )
+		{
+			deque.m_nRun++;
+			deque.m_nStolen++;
+		}
+		else
+		{
+			break;
+		}
+
+		double flStart = Plat_FloatTime();
+		g_PortalFlowFn( iThread, iPortal );
+		deque.m_flBusy += Plat_FloatTime() - flStart;
+
+		int nDone = InterlockedIncrement( (volatile long *)&g_nPortalsDone );
+
+		ThreadLock();
+		UpdatePacifier( (float)nDone / g_nPortalsTotal );
+		ThreadUnlock();
+	}
+}
+
+/*
+==================
+RunPortalFlowScheduled
+
+Runs fn on sorted_portals[0] to sorted_portals[nPortals-1], like RunThreadsOnIndividual.
+==================
+*/
+void RunPortalFlowScheduled( int nPortals, qboolean showpacifier, ThreadWorkerFn fn )
+{
+	if ( numthreads == -1 )
+		ThreadSetDefault();
+
+	g_nPortalDeques = clamp( numthreads, 1, MAX_TOOL_THREADS );
+	g_PortalFlowFn = fn;
+	g_nPortalsDone = 0;
+	g_nPortalsTotal = nPortals;
+
+	for ( int i = 0; i < g_nPortalDeques; i++ )
+	{
+		PortalDeque_t &deque = g_PortalDeques[i];
+		deque.m_Work.RemoveAll();
+		deque.m_Work.EnsureCapacity( nPortals / g_nPortalDeques + 1 );
+		deque.m_nCostLeft = 0;
+		deque.m_nRun = 0;
+		deque.m_nStolen = 0;
+		deque.m_flBusy = 0;
+	}
+
+	// Deal the portals out in order to the least loaded deque.
+	for ( int iPortal = 0; iPortal < nPortals; iPortal++ )
+	{
+		int iLeast = 0;
+		for ( int i = 1; i < g_nPortalDeques; i++ )
+		{
+			if ( g_PortalDeques[i].m_nCostLeft < g_PortalDeques[iLeast].m_nCostLeft )
+				iLeast = i;
+		}
+
+		g_PortalDeques[iLeast].m_Work.AddToTail( iPortal );
+		g_PortalDeques[iLeast].m_nCostLeft += PortalCost( iPortal );
+	}
+
+	for ( int i = 0; i < g_nPortalDeques; i++ )
+	{
+		g_PortalDeques[i].m_iHead = 0;
+		g_PortalDeques[i].m_iTail = g_PortalDeques[i].m_Work.Count();
+	}
+
+	if ( showpacifier )
+		printf( "%-20s ", "PortalFlow:" );
+
+	double flStart = Plat_FloatTime();
+
+	numthreads = g_nPortalDeques;
+	RunThreadsOn( nPortals, showpacifier, PortalFlowThread );
+
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	// How well the work was spread out.
+	double flBusy = 0;
+	for ( int i = 0; i < g_nPortalDeques; i++ )
+	{
+		PortalDeque_t &deque = g_PortalDeques[i];
+		flBusy += deque.m_flBusy;
+
+		qprintf( "thread %2i: %5i portals (%i stolen), %5.1f%% busy\n", i, deque.m_nRun, deque.m_nStolen,
+			flElapsed > 0 ? deque.m_flBusy * 100.0 / flElapsed : 0.0 );
+	}
+
+	Msg( "%.1f%% thread utilization during PortalFlow\n", flElapsed > 0 ? flBusy * 100.0 / ( flElapsed * g_nPortalDeques ) : 0.0 );
+}
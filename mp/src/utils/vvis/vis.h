@@ -113,6 +113,7 @@ void LeafFlow (int leafnum);
 void BasePortalVis (int iThread, int portalnum);
 void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
+void RunPortalFlowScheduled( int nPortals, qboolean showpacifier, void (*fn)( int iThread, int portalnum ) );
 void WritePortalTrace( const char *source );
 
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
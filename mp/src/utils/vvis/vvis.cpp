@@ -46,6 +46,7 @@ int			portalbytes, portallongs;
 
 bool		fastvis;
 bool		nosort;
+bool		nosteal;
 
 int			totalvis;
 
@@ -306,10 +307,14 @@ void CalcPortalVis (void)
 	{
  		RunMPIPortalFlow();
 	}
-	else 
+	else if (nosteal)
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
 	}
+	else
+	{
+		RunPortalFlowScheduled (g_numportals*2, true, PortalFlow);
+	}
 }
 
 
@@ -947,6 +952,11 @@ int ParseCommandLine( int argc, char **argv )
 			Msg ("nosort = true\n");
 			nosort = true;
 		}
+		else if (!Q_stricmp (argv[i],"-nosteal"))
+		{
+			Msg ("nosteal = true\n");
+			nosteal = true;
+		}
 		else if (!Q_stricmp (argv[i],"-tmpin"))
 			strcpy (inbase, "/tmp");
 		else if( !Q_stricmp( argv[i], "-low" ) )
@@ -1030,6 +1040,8 @@ void PrintUsage( int argc, char **argv )
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -nosteal        : Hand out portals one at a time from a shared queue instead of\n"
+		"                    per-thread queues that steal from each other.\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"